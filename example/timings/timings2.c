@@ -93,11 +93,14 @@ enum
   TIMINGS_BALANCE_A_COUNT_OUT,
   TIMINGS_BALANCE_COMM_SENT,
   TIMINGS_BALANCE_COMM_NZPEERS,
+  TIMINGS_BALANCE_COMM_BYTES,
+  TIMINGS_BALANCE_COMM_BYTES_RAW,
   TIMINGS_BALANCE_B_COUNT_IN,
   TIMINGS_BALANCE_B_COUNT_OUT,
   TIMINGS_BALANCE_RANGES,
   TIMINGS_BALANCE_NOTIFY,
   TIMINGS_BALANCE_NOTIFY_ALLGATHER,
+  TIMINGS_BALANCE_OVERLAP,
   TIMINGS_BALANCE_A_ZERO_SENDS,
   TIMINGS_BALANCE_A_ZERO_RECEIVES,
   TIMINGS_BALANCE_B_ZERO_SENDS,
@@ -112,6 +115,7 @@ enum
   TIMINGS_REBALANCE_COMM_NZPEERS,
   TIMINGS_REBALANCE_B_COUNT_IN,
   TIMINGS_REBALANCE_B_COUNT_OUT,
+  TIMINGS_REBALANCE_OVERLAP,
   TIMINGS_PARTITION,
   TIMINGS_GHOSTS,
   TIMINGS_NODES,
@@ -249,6 +253,7 @@ main (int argc, char **argv)
   const timings_regression_t *r, *regression;
   timings_config_t    config;
   sc_statinfo_t       stats[TIMINGS_NUM_STATS];
+  sc_statinfo_t       memstats[2 * P4EST_MEMORY_NUM_PHASES];
   sc_flopinfo_t       fi, snapshot;
   mpi_context_t       mpi_context, *mpi = &mpi_context;
   sc_options_t       *opt;
@@ -257,6 +262,7 @@ main (int argc, char **argv)
   int                 borders;
   int                 max_ranges;
   int                 use_ranges, use_ranges_notify, use_balance_verify;
+  int                 use_overlap_bsearch;
   int                 oldschool, generate;
   int                 first_argc;
   int                 test_multiple_orders;
@@ -298,6 +304,8 @@ main (int argc, char **argv)
                          "use both ranges and notify");
   sc_options_add_switch (opt, 'y', "balance-verify", &use_balance_verify,
                          "use verifications in balance");
+  sc_options_add_switch (opt, 0, "overlap-bsearch", &use_overlap_bsearch,
+                         "use binary searches for the balance overlap");
   sc_options_add_int (opt, 'l', "level", &refine_level, 0,
                       "initial refine level");
 #ifndef P4_TO_P8
@@ -505,6 +513,7 @@ main (int argc, char **argv)
   p4est->inspect->use_balance_ranges_notify = use_ranges_notify;
   p4est->inspect->use_balance_verify = use_balance_verify;
   p4est->inspect->balance_max_ranges = max_ranges;
+  p4est->inspect->use_balance_overlap_bsearch = use_overlap_bsearch;
   P4EST_GLOBAL_STATISTICSF
     ("Balance: new overlap %d new subtree %d borders %d\n", overlap,
      (overlap && subtree), (overlap && borders));
@@ -543,6 +552,12 @@ main (int argc, char **argv)
   sc_stats_set1 (&stats[TIMINGS_BALANCE_COMM_NZPEERS],
                  (double) p4est->inspect->balance_comm_nzpeers,
                  "Balance nonzero peers second round");
+  sc_stats_set1 (&stats[TIMINGS_BALANCE_COMM_BYTES],
+                 (double) p4est->inspect->balance_comm_bytes,
+                 "Balance bytes sent");
+  sc_stats_set1 (&stats[TIMINGS_BALANCE_COMM_BYTES_RAW],
+                 (double) p4est->inspect->balance_comm_bytes_raw,
+                 "Balance bytes sent unencoded");
   sc_stats_set1 (&stats[TIMINGS_BALANCE_B_COUNT_IN],
                  (double) p4est->inspect->balance_B_count_in,
                  "Balance B count inlist");
@@ -556,6 +571,8 @@ main (int argc, char **argv)
   sc_stats_set1 (&stats[TIMINGS_BALANCE_NOTIFY_ALLGATHER],
                  p4est->inspect->balance_notify_allgather,
                  "Balance time for notify_allgather");
+  sc_stats_set1 (&stats[TIMINGS_BALANCE_OVERLAP],
+                 p4est->inspect->balance_overlap, "Balance overlap time");
   sc_stats_set1 (&stats[TIMINGS_BALANCE_A_ZERO_RECEIVES],
                  p4est->inspect->balance_zero_receives[0],
                  "Balance A zero receives");
@@ -603,6 +620,8 @@ main (int argc, char **argv)
   sc_stats_set1 (&stats[TIMINGS_REBALANCE_B_COUNT_OUT],
                  (double) p4est->inspect->balance_B_count_out,
                  "Rebalance B count outlist");
+  sc_stats_set1 (&stats[TIMINGS_REBALANCE_OVERLAP],
+                 p4est->inspect->balance_overlap, "Rebalance overlap time");
   P4EST_ASSERT (count_balanced == p4est->global_num_quadrants);
   P4EST_ASSERT (crc == p4est_checksum (p4est));
 
@@ -737,6 +756,11 @@ main (int argc, char **argv)
   sc_stats_print (p4est_package_id, SC_LP_ESSENTIAL,
                   TIMINGS_NUM_STATS, stats, 1, 1);
 
+  /* print current and peak memory in bytes without a second summary */
+  p4est_memory_stats (p4est, memstats);
+  sc_stats_print (p4est_package_id, SC_LP_ESSENTIAL,
+                  2 * P4EST_MEMORY_NUM_PHASES, memstats, 1, 0);
+
   /* destroy the p4est and its connectivity structure */
   P4EST_FREE (quadrant_counts);
   P4EST_FREE (p4est->inspect);
@@ -27,6 +27,7 @@
 #include <p8est_bits.h>
 #include <p8est_communication.h>
 #include <p8est_extended.h>
+#include <p8est_fields.h>
 #include <p8est_ghost.h>
 #include <p8est_io.h>
 #include <p8est_search.h>
@@ -35,6 +36,7 @@
 #include <p4est_bits.h>
 #include <p4est_communication.h>
 #include <p4est_extended.h>
+#include <p4est_fields.h>
 #include <p4est_ghost.h>
 #include <p4est_io.h>
 #include <p4est_search.h>
@@ -46,6 +48,9 @@
 #ifdef P4EST_HAVE_ZLIB
 #include <zlib.h>
 #endif
+#ifdef P4EST_ENABLE_OPENMP
+#include <omp.h>
+#endif
 
 #ifdef P4EST_ENABLE_MPIIO
 #define P4EST_MPIIO_WRITE
@@ -62,11 +67,37 @@ typedef struct
   int                 recv_first_count, recv_second_count;
   int                 send_first_count, send_second_count;
   sc_array_t          send_first, send_second, recv_first, recv_second;
+  /** the messages to and from a remote peer as encoded quadrants */
+  sc_array_t          send_first_bytes, send_second_bytes;
+  sc_array_t          recv_first_bytes, recv_second_bytes;
 }
 p4est_balance_peer_t;
 
+/** Work unit of the threaded refinement: a range of one local tree. */
+typedef struct p4est_refine_unit
+{
+  p4est_topidx_t      which_tree;       /**< tree containing the range */
+  size_t              first, last;      /**< range of input quadrants */
+  int                 changed;          /**< boolean: out is populated */
+  int                 shared;           /**< boolean: input is shared */
+  int                 maxlevel;         /**< highest level of output */
+  sc_array_t          out;              /**< output quadrants if changed */
+  sc_array_t         *jumps;            /**< refined quadrants or NULL */
+  p4est_locidx_t      quadrants_per_level[P4EST_MAXLEVEL + 1];
+}
+p4est_refine_unit_t;
+
 #define p4est_num_ranges (25)
 
+/** Number of refinement work units per thread to even out the load. */
+#define P4EST_REFINE_UNITS_PER_THREAD 4
+
+/** Lower limit for the number of input quadrants in a work unit. */
+#define P4EST_REFINE_MIN_UNIT 256
+
+/** Number of quadrants filled and initialized at once by p4est_new_uniform. */
+#define P4EST_NEW_UNIFORM_CHUNK 1024
+
 #ifndef P4_TO_P8
 
 static int          p4est_uninitialized_key;
@@ -74,7 +105,6 @@ void               *P4EST_DATA_UNINITIALIZED = &p4est_uninitialized_key;
 
 #endif /* P4_TO_P8 */
 
-static const size_t number_toread_quadrants = 32;
 static const int8_t fully_owned_flag = 0x01;
 static const int8_t any_face_flag = 0x02;
 
@@ -177,9 +207,198 @@ p4est_memory_used (p4est_t * p4est)
   P4EST_ASSERT (p4est->quadrant_pool != NULL);
   size += sc_mempool_memory_used (p4est->quadrant_pool);
 
+  if (p4est->compact != NULL) {
+    size += sizeof (p4est_compact_t) +
+      sc_array_memory_used (&p4est->compact->keys, 0) +
+      sc_array_memory_used (&p4est->compact->levels, 0) +
+      sc_array_memory_used (&p4est->compact->user_data, 0);
+  }
+
   return size;
 }
 
+void
+p4est_memory_record (p4est_t * p4est, p4est_memory_phase_t phase,
+                     size_t bytes)
+{
+  p4est_inspect_t    *inspect = p4est->inspect;
+
+  P4EST_ASSERT (0 <= (int) phase && (int) phase < P4EST_MEMORY_NUM_PHASES);
+
+  if (inspect == NULL) {
+    return;
+  }
+  inspect->memory_current[phase] = bytes;
+  inspect->memory_peak[phase] = SC_MAX (inspect->memory_peak[phase], bytes);
+}
+
+void
+p4est_memory_stats (p4est_t * p4est, sc_statinfo_t * stats)
+{
+  /* the statistics keep pointers to the names */
+  static const char  *current_names[P4EST_MEMORY_NUM_PHASES] = {
+    "Memory forest", "Memory connectivity", "Memory balance",
+    "Memory ghost", "Memory lnodes"
+  };
+  static const char  *peak_names[P4EST_MEMORY_NUM_PHASES] = {
+    "Memory peak forest", "Memory peak connectivity", "Memory peak balance",
+    "Memory peak ghost", "Memory peak lnodes"
+  };
+  int                 i;
+  p4est_inspect_t    *inspect = p4est->inspect;
+
+  P4EST_ASSERT (inspect != NULL);
+
+  p4est_memory_record (p4est, P4EST_MEMORY_FOREST,
+                       p4est_memory_used (p4est));
+  p4est_memory_record (p4est, P4EST_MEMORY_CONNECTIVITY,
+                       p4est_connectivity_memory_used (p4est->connectivity));
+
+  for (i = 0; i < P4EST_MEMORY_NUM_PHASES; ++i) {
+    sc_stats_set1 (&stats[i], (double) inspect->memory_current[i],
+                   current_names[i]);
+    sc_stats_set1 (&stats[P4EST_MEMORY_NUM_PHASES + i],
+                   (double) inspect->memory_peak[i], peak_names[i]);
+  }
+  sc_stats_compute (p4est->mpicomm, 2 * P4EST_MEMORY_NUM_PHASES, stats);
+}
+
+/** Bump the revision counter after a modification of the forest that is
+ * recorded in the changed flags of the local trees.  If the forest was
+ * known to be balanced up to the changed trees, this remains true.
+ */
+static void
+p4est_revision_bump_tracked (p4est_t * p4est)
+{
+  if (p4est->balance_revision == p4est->revision) {
+    ++p4est->balance_revision;
+  }
+  ++p4est->revision;
+}
+
+/** Determine whether a modification of the forest needs to record the
+ * refined and coarsened quadrants for p4est_jump_check.  This is the case
+ * if the forest is known to be balanced before the modification.
+ */
+static int
+p4est_jump_tracking (p4est_t * p4est)
+{
+  return p4est->balance_type != 0 &&
+    p4est->balance_revision == p4est->revision;
+}
+
+/** Record a refined quadrant or the parent of a coarsened family.
+ * \param [in,out] jumps    Array of quadrants, or NULL to do nothing.
+ * \param [in] coarsened    Boolean: \a q is the parent of a family.
+ */
+static void
+p4est_jump_record (sc_array_t * jumps, const p4est_quadrant_t * q,
+                   int coarsened)
+{
+  p4est_quadrant_t   *r;
+
+  if (jumps != NULL) {
+    r = p4est_quadrant_array_push (jumps);
+    *r = *q;
+    r->p.user_data = NULL;
+    r->pad8 = (int8_t) coarsened;
+  }
+}
+
+/** Find the leaf of a local tree that contains or equals a quadrant.
+ * \return              -1 if the quadrant is not covered by the local part
+ *                      of the tree, P4EST_QMAXLEVEL + 1 if it is subdivided
+ *                      into several leaves, and the level of the leaf else.
+ */
+static int
+p4est_jump_leaf_level (p4est_tree_t * tree, const p4est_quadrant_t * s)
+{
+  ssize_t             idx;
+  p4est_quadrant_t    desc, *r;
+
+  if (!p4est_quadrant_is_inside_root (s)) {
+    return -1;
+  }
+  p4est_quadrant_first_descendant (s, &desc, P4EST_QMAXLEVEL);
+  if (p4est_quadrant_compare (&desc, &tree->first_desc) < 0) {
+    return -1;
+  }
+  p4est_quadrant_last_descendant (s, &desc, P4EST_QMAXLEVEL);
+  if (p4est_quadrant_compare (&desc, &tree->last_desc) > 0) {
+    return -1;
+  }
+
+  /* the last leaf not after s is s or its ancestor unless s is subdivided */
+  idx = p4est_find_higher_bound (&tree->quadrants, s,
+                                 tree->quadrants.elem_count / 2);
+  if (idx >= 0) {
+    r = p4est_quadrant_array_index (&tree->quadrants, (size_t) idx);
+    if (p4est_quadrant_is_equal (r, s) || p4est_quadrant_is_ancestor (r, s)) {
+      return (int) r->level;
+    }
+  }
+  return P4EST_QMAXLEVEL + 1;
+}
+
+/** Check whether a modification of a balanced tree may have created a level
+ * jump of more than one.  Such a jump can only occur between a child of a
+ * refined quadrant and a leaf coarser than that quadrant, or between the
+ * parent of a coarsened family and a leaf finer than its children.  We look
+ * up the quadrants of the critical size that touch a recorded quadrant
+ * within the balance type of the forest.  The result is conservative for
+ * neighbors in other trees or on other processes.
+ * \param [in] jumps    Quadrants recorded by p4est_jump_record.
+ * \return              True if the tree may be unbalanced.
+ */
+static int
+p4est_jump_check (p4est_t * p4est, p4est_tree_t * tree, sc_array_t * jumps)
+{
+  int                 i, k, n, nk, coarsened;
+  int                 balance, outside, level;
+  int                 off[P4EST_DIM];
+  size_t              zz;
+  p4est_qcoord_t      h;
+  p4est_quadrant_t   *q, s;
+
+  balance =
+    p4est_connect_type_int ((p4est_connect_type_t) p4est->balance_type);
+  P4EST_QUADRANT_INIT (&s);
+  for (zz = 0; zz < jumps->elem_count; ++zz) {
+    q = p4est_quadrant_array_index (jumps, zz);
+    coarsened = (int) q->pad8;
+    s.level = (int8_t) (q->level + coarsened);
+    h = P4EST_QUADRANT_LEN (s.level);
+
+    /* the neighbors of size h are offset by -1 to 1 + coarsened */
+    n = 3 + coarsened;
+    nk = n * n;
+#ifdef P4_TO_P8
+    nk *= n;
+#endif
+    for (k = 0; k < nk; ++k) {
+      outside = 0;
+      for (i = 0; i < P4EST_DIM; ++i) {
+        off[i] = (i == 0 ? k : i == 1 ? k / n : k / (n * n)) % n - 1;
+        outside += (off[i] < 0 || off[i] > coarsened);
+      }
+      if (outside == 0 || outside > balance) {
+        continue;
+      }
+      s.x = q->x + off[0] * h;
+      s.y = q->y + off[1] * h;
+#ifdef P4_TO_P8
+      s.z = q->z + off[2] * h;
+#endif
+      level = p4est_jump_leaf_level (tree, &s);
+      if (level < 0 || (!coarsened && level < (int) s.level) ||
+          (coarsened && level > (int) s.level)) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
 long
 p4est_revision (p4est_t * p4est)
 {
@@ -198,15 +417,95 @@ p4est_new (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
                         data_size, init_fn, user_pointer);
 }
 
-p4est_t            *
-p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
+/** Fill a range of a tree with the uniform quadrants of a given level.
+ * The tree's quadrant array is resized to hold the range.  The user data is
+ * allocated in Morton order and initialized chunk by chunk afterwards.
+ * \param [in] first_morton  Morton index of the first quadrant in the tree.
+ * \param [in] num_threads   Fill and initialize concurrently if above 1.
+ */
+static void
+p4est_new_fill_uniform (p4est_t * p4est, p4est_topidx_t which_tree,
+                        int level, uint64_t first_morton, size_t count,
+                        int num_threads, p4est_init_t init_fn,
+                        p4est_init_batch_t init_batch_fn)
+{
+  long                lc, num_chunks;
+  size_t              zz, zfirst, zlast;
+  uint64_t            ids[P4EST_NEW_UNIFORM_CHUNK];
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quadrants;
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_OLD_QMAXLEVEL);
+  P4EST_ASSERT (count > 0);
+  P4EST_ASSERT (init_fn == NULL || init_batch_fn == NULL);
+
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  sc_array_resize (&tree->quadrants, count);
+  quadrants = p4est_quadrant_array_index (&tree->quadrants, 0);
+  num_chunks = (long) ((count + P4EST_NEW_UNIFORM_CHUNK - 1) /
+                       P4EST_NEW_UNIFORM_CHUNK);
+  num_threads = SC_MAX (num_threads, 1);
+
+  /* the coordinates are independent of each other */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) schedule (static) \
+  if (num_threads > 1 && num_chunks > 1) private (zz, zfirst, zlast, ids)
+#endif
+  for (lc = 0; lc < num_chunks; ++lc) {
+    zfirst = (size_t) lc * P4EST_NEW_UNIFORM_CHUNK;
+    zlast = SC_MIN (zfirst + P4EST_NEW_UNIFORM_CHUNK, count);
+    for (zz = zfirst; zz < zlast; ++zz) {
+      ids[zz - zfirst] = first_morton + zz;
+    }
+    memset (quadrants + zfirst, -1,
+            (zlast - zfirst) * sizeof (p4est_quadrant_t));
+    p4est_quadrant_set_morton_batch (quadrants + zfirst, zlast - zfirst,
+                                     level, ids);
+  }
+
+  /* the memory pool is not thread safe */
+  for (zz = 0; zz < count; ++zz) {
+    quadrants[zz].p.user_data = p4est->data_size > 0 ?
+      sc_mempool_alloc (p4est->user_data_pool) : NULL;
+  }
+  if (init_fn == NULL && init_batch_fn == NULL) {
+    return;
+  }
+
+  /* the callbacks see contiguous ranges that cover the tree once */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_threads) schedule (dynamic) \
+  if (num_threads > 1 && num_chunks > 1) private (zz, zfirst, zlast)
+#endif
+  for (lc = 0; lc < num_chunks; ++lc) {
+    zfirst = (size_t) lc * P4EST_NEW_UNIFORM_CHUNK;
+    zlast = SC_MIN (zfirst + P4EST_NEW_UNIFORM_CHUNK, count);
+    if (init_batch_fn != NULL) {
+      init_batch_fn (p4est, which_tree,
+                     tree->quadrants_offset + (p4est_locidx_t) zfirst,
+                     zlast - zfirst, quadrants + zfirst);
+    }
+    else {
+      for (zz = zfirst; zz < zlast; ++zz) {
+        init_fn (p4est, which_tree, quadrants + zz);
+      }
+    }
+  }
+}
+
+/** Create a new forest.
+ * This function implements both p4est_new_ext and p4est_new_uniform.
+ */
+static p4est_t     *
+p4est_new_int (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
                p4est_locidx_t min_quadrants, int min_level, int fill_uniform,
-               size_t data_size, p4est_init_t init_fn, void *user_pointer)
+               int num_threads, size_t data_size, p4est_init_t init_fn,
+               p4est_init_batch_t init_batch_fn, void *user_pointer)
 {
   int                 num_procs, rank;
   int                 i, must_remove_last_quadrant;
   int                 level;
-  uint64_t            first_morton, last_morton, miu, count;
+  uint64_t            first_morton, last_morton, count;
   p4est_topidx_t      jt, num_trees;
   p4est_gloidx_t      tree_num_quadrants, global_num_quadrants;
   p4est_gloidx_t      first_tree, first_quadrant, first_tree_quadrant;
@@ -234,6 +533,7 @@ p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   p4est->user_pointer = user_pointer;
   p4est->connectivity = connectivity;
   num_trees = connectivity->num_trees;
+  p4est_connectivity_cache_transforms (connectivity);
 
   /* set parallel environment */
   p4est_comm_parallel_env_assign (p4est, mpicomm);
@@ -331,6 +631,8 @@ p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
       tree->quadrants_per_level[i] = -1;
     }
     tree->maxlevel = 0;
+    tree->changed = 0;
+    tree->unbalanced = 0;
   }
   p4est->local_num_quadrants = 0;
   p4est->global_num_quadrants = 0;
@@ -415,15 +717,10 @@ p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
       P4EST_ASSERT (count > 0);
 
       /* populate quadrant array in Morton order */
-      sc_array_resize (tquadrants, (size_t) count);
-      quad = p4est_quadrant_array_index (tquadrants, 0);
-      p4est_quadrant_set_morton (quad, level, first_morton);
-      p4est_quadrant_init_data (p4est, jt, quad, init_fn);
-      for (miu = 1; miu < count; ++miu) {
-        quad = p4est_quadrant_array_index (tquadrants, (size_t) miu);
-        p4est_quadrant_successor (quad - 1, quad);
-        p4est_quadrant_init_data (p4est, jt, quad, init_fn);
-      }
+      tree->quadrants_offset = p4est->local_num_quadrants;
+      p4est_new_fill_uniform (p4est, jt, level, first_morton, (size_t) count,
+                              num_threads, init_fn, init_batch_fn);
+      quad = p4est_quadrant_array_index (tquadrants, (size_t) count - 1);
 
       /* remember first tree position */
       p4est_quadrant_first_descendant (p4est_quadrant_array_index
@@ -499,20 +796,73 @@ p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   return p4est;
 }
 
+p4est_t            *
+p4est_new_ext (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
+               p4est_locidx_t min_quadrants, int min_level, int fill_uniform,
+               size_t data_size, p4est_init_t init_fn, void *user_pointer)
+{
+  return p4est_new_int (mpicomm, connectivity, min_quadrants, min_level,
+                        fill_uniform, 0, data_size, init_fn, NULL,
+                        user_pointer);
+}
+
+p4est_t            *
+p4est_new_uniform (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
+                   int level, int num_threads, size_t data_size,
+                   p4est_init_t init_fn, p4est_init_batch_t init_batch_fn,
+                   void *user_pointer)
+{
+  P4EST_ASSERT (0 <= level && level <= P4EST_OLD_QMAXLEVEL);
+  P4EST_ASSERT (init_fn == NULL || init_batch_fn == NULL);
+
+  return p4est_new_int (mpicomm, connectivity, 0, level, 1, num_threads,
+                        data_size, init_fn, init_batch_fn, user_pointer);
+}
+
+/** Free the compact storage without restoring the trees. */
+static void
+p4est_compact_destroy (p4est_t * p4est)
+{
+  p4est_compact_t    *compact = p4est->compact;
+
+  P4EST_ASSERT (compact != NULL);
+
+  sc_array_reset (&compact->keys);
+  sc_array_reset (&compact->levels);
+  sc_array_reset (&compact->user_data);
+  P4EST_FREE (compact);
+  p4est->compact = NULL;
+}
+
 void
 p4est_destroy (p4est_t * p4est)
 {
 #ifdef P4EST_ENABLE_DEBUG
   size_t              qz;
 #endif
+  int                 own_pool;
   p4est_topidx_t      jt;
   p4est_tree_t       *tree;
 
+  P4EST_ASSERT (p4est->fields == NULL);
+
+  if (p4est->compact != NULL) {
+    if (p4est->data_size > 0) {
+      /* the user data is returned to its pool through the trees */
+      p4est_expand (p4est);
+    }
+    else {
+      p4est_compact_destroy (p4est);
+    }
+  }
+
+  /* the user data pool may stay with copy-on-write copies */
+  own_pool = p4est_cow_release (p4est);
   for (jt = 0; jt < p4est->connectivity->num_trees; ++jt) {
     tree = p4est_tree_array_index (p4est->trees, jt);
 
 #ifdef P4EST_ENABLE_DEBUG
-    for (qz = 0; qz < tree->quadrants.elem_count; ++qz) {
+    for (qz = 0; own_pool && qz < tree->quadrants.elem_count; ++qz) {
       p4est_quadrant_t   *quad =
         p4est_quadrant_array_index (&tree->quadrants, qz);
       p4est_quadrant_free_data (p4est, quad);
@@ -523,14 +873,13 @@ p4est_destroy (p4est_t * p4est)
   }
   sc_array_destroy (p4est->trees);
 
-  if (p4est->user_data_pool != NULL) {
+  if (p4est->user_data_pool != NULL && own_pool) {
     sc_mempool_destroy (p4est->user_data_pool);
   }
   sc_mempool_destroy (p4est->quadrant_pool);
 
   p4est_comm_parallel_env_release (p4est);
-  P4EST_FREE (p4est->global_first_quadrant);
-  P4EST_FREE (p4est->global_first_position);
+  p4est_comm_partition_release (p4est);
   P4EST_FREE (p4est);
 }
 
@@ -540,8 +889,13 @@ p4est_copy (p4est_t * input, int copy_data)
   return p4est_copy_ext (input, copy_data, 0 /* don't duplicate MPI comm */ );
 }
 
-p4est_t            *
-p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
+/** Copy a forest with either private or shared tree storage.
+ * \param [in] share   If true, the local trees of the copy share storage
+ *                      and user data with the input, see p4est_copy_cow.
+ */
+static p4est_t     *
+p4est_copy_int (p4est_t * input, int copy_data, int duplicate_mpicomm,
+                int share)
 {
   const p4est_topidx_t num_trees = input->connectivity->num_trees;
   const p4est_topidx_t first_tree = input->first_local_tree;
@@ -554,11 +908,18 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
   p4est_quadrant_t   *iq, *pq;
   sc_array_t         *iquadrants, *pquadrants;
 
+  SC_CHECK_ABORT (input->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+
   /* create a shallow copy and zero out dependent fields */
   p4est = P4EST_ALLOC (p4est_t, 1);
   memcpy (p4est, input, sizeof (p4est_t));
   p4est->global_first_quadrant = NULL;
   p4est->global_first_position = NULL;
+  p4est->partition_shared = NULL;
+  p4est->cow = NULL;
+  p4est->fields = NULL;
+  p4est->compact = NULL;
   p4est->trees = NULL;
   p4est->user_data_pool = NULL;
   p4est->quadrant_pool = NULL;
@@ -570,7 +931,11 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
   }
 
   /* allocate a user data pool if necessary and a quadrant pool */
-  if (copy_data && p4est->data_size > 0) {
+  if (share) {
+    P4EST_ASSERT (copy_data);
+    p4est->user_data_pool = input->user_data_pool;
+  }
+  else if (copy_data && p4est->data_size > 0) {
     p4est->user_data_pool = sc_mempool_new (p4est->data_size);
   }
   else {
@@ -587,7 +952,10 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
     memcpy (ptree, itree, sizeof (p4est_tree_t));
     sc_array_init (&ptree->quadrants, sizeof (p4est_quadrant_t));
   }
-  for (jt = first_tree; jt <= last_tree; ++jt) {
+  if (share) {
+    p4est_cow_share (input, p4est);
+  }
+  for (jt = first_tree; !share && jt <= last_tree; ++jt) {
     itree = p4est_tree_array_index (input->trees, jt);
     iquadrants = &itree->quadrants;
     icount = iquadrants->elem_count;
@@ -618,9 +986,20 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
                                               p4est->mpisize + 1);
   memcpy (p4est->global_first_position, input->global_first_position,
           (p4est->mpisize + 1) * sizeof (p4est_quadrant_t));
+  if (input->partition_shared != NULL) {
+    /* the copy shares its partition arrays like the input */
+    p4est_comm_partition_share (p4est);
+  }
 
   /* the copy starts with a revision count of zero */
   p4est->revision = 0;
+  if (input->balance_revision == input->revision) {
+    /* the copied trees carry over their changed flags */
+    p4est->balance_revision = 0;
+  }
+  else {
+    p4est->balance_type = 0;
+  }
 
   /* check for valid p4est and return */
   P4EST_ASSERT (p4est_is_valid (p4est));
@@ -628,6 +1007,162 @@ p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
   return p4est;
 }
 
+p4est_t            *
+p4est_copy_ext (p4est_t * input, int copy_data, int duplicate_mpicomm)
+{
+  return p4est_copy_int (input, copy_data, duplicate_mpicomm, 0);
+}
+
+p4est_t            *
+p4est_copy_cow (p4est_t * input, int duplicate_mpicomm)
+{
+  return p4est_copy_int (input, 1, duplicate_mpicomm, 1);
+}
+
+void
+p4est_unshare (p4est_t * p4est)
+{
+  p4est_cow_unshare (p4est);
+}
+
+/** Return the number of local quadrants in a local tree. */
+static              size_t
+p4est_compact_tree_count (p4est_t * p4est, p4est_topidx_t which_tree)
+{
+  p4est_tree_t       *tree, *next;
+
+  P4EST_ASSERT (p4est->first_local_tree <= which_tree &&
+                which_tree <= p4est->last_local_tree);
+
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  if (which_tree == p4est->last_local_tree) {
+    return (size_t) (p4est->local_num_quadrants - tree->quadrants_offset);
+  }
+  next = p4est_tree_array_index (p4est->trees, which_tree + 1);
+  return (size_t) (next->quadrants_offset - tree->quadrants_offset);
+}
+
+int
+p4est_compact (p4est_t * p4est)
+{
+  const int           with_data = (p4est->data_size > 0);
+  const size_t        lnq = (size_t) p4est->local_num_quadrants;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_compact_t    *compact;
+
+  P4EST_ASSERT (p4est->compact == NULL);
+  P4EST_ASSERT (p4est->fields == NULL);
+
+  /* the keys hold the quadrant coordinates up to a fixed level */
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    if ((int) tree->maxlevel > P4EST_OLD_QMAXLEVEL) {
+      return 0;
+    }
+  }
+
+  /* the user data pointers must not be shared with other forests */
+  p4est_cow_unshare (p4est);
+
+  compact = P4EST_ALLOC (p4est_compact_t, 1);
+  sc_array_init_size (&compact->keys, sizeof (uint64_t), lnq);
+  sc_array_init_size (&compact->levels, sizeof (int8_t), lnq);
+  sc_array_init_size (&compact->user_data, sizeof (void *),
+                      with_data ? lnq : 0);
+
+  /* release the tree storage one tree at a time */
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    P4EST_ASSERT (tree->quadrants.elem_count ==
+                  p4est_compact_tree_count (p4est, jt));
+    p4est_compact_encode (compact, tree->quadrants_offset,
+                          &tree->quadrants, with_data);
+    sc_array_reset (&tree->quadrants);
+  }
+  p4est->compact = compact;
+
+  return 1;
+}
+
+void
+p4est_expand (p4est_t * p4est)
+{
+  const int           with_data = (p4est->data_size > 0);
+  size_t              count;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+
+  P4EST_ASSERT (p4est->compact != NULL);
+
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    P4EST_ASSERT (tree->quadrants.elem_count == 0);
+    count = p4est_compact_tree_count (p4est, jt);
+    sc_array_resize (&tree->quadrants, count);
+    p4est_compact_decode (p4est->compact, tree->quadrants_offset, count,
+                          (p4est_quadrant_t *) tree->quadrants.array,
+                          with_data);
+  }
+  p4est_compact_destroy (p4est);
+}
+
+/** Expand a compact forest for an algorithm that runs on the tree arrays.
+ * \param [in,out] p4est  The forest, compact or not.
+ * \return                True if the forest has been expanded.
+ */
+static int
+p4est_compact_suspend (p4est_t * p4est)
+{
+  if (p4est->compact == NULL) {
+    return 0;
+  }
+  p4est_expand (p4est);
+  return 1;
+}
+
+/** Compact a forest again that has been expanded by p4est_compact_suspend.
+ * If a tree has become too fine for the keys, the forest stays expanded.
+ * \param [in,out] p4est      The forest.
+ * \param [in] recompact      The return value of p4est_compact_suspend.
+ */
+static void
+p4est_compact_resume (p4est_t * p4est, int recompact)
+{
+  if (recompact) {
+    (void) p4est_compact (p4est);
+  }
+}
+
+p4est_topidx_t
+p4est_compact_quadrant (p4est_t * p4est, p4est_locidx_t local_num,
+                        p4est_quadrant_t * quadrant)
+{
+  p4est_topidx_t      low, high, guess;
+  p4est_tree_t       *tree;
+
+  P4EST_ASSERT (p4est->compact != NULL);
+  P4EST_ASSERT (0 <= local_num && local_num < p4est->local_num_quadrants);
+
+  /* the local trees are nonempty and their offsets increase strictly */
+  low = p4est->first_local_tree;
+  high = p4est->last_local_tree;
+  while (low < high) {
+    guess = low + (high - low + 1) / 2;
+    tree = p4est_tree_array_index (p4est->trees, guess);
+    if (tree->quadrants_offset <= local_num) {
+      low = guess;
+    }
+    else {
+      high = guess - 1;
+    }
+  }
+
+  p4est_compact_decode (p4est->compact, local_num, 1, quadrant,
+                        p4est->data_size > 0);
+  return low;
+}
+
 void
 p4est_reset_data (p4est_t * p4est, size_t data_size,
                   p4est_init_t init_fn, void *user_pointer)
@@ -641,6 +1176,13 @@ p4est_reset_data (p4est_t * p4est, size_t data_size,
 
   doresize = (p4est->data_size != data_size);
 
+  /* the data of shared trees is not changed in place */
+  p4est_cow_unshare (p4est);
+  if (doresize && !p4est_cow_release (p4est)) {
+    /* the old pool stays with the other forests */
+    p4est->user_data_pool = NULL;
+  }
+
   p4est->data_size = data_size;
   p4est->user_pointer = user_pointer;
 
@@ -676,230 +1218,426 @@ p4est_reset_data (p4est_t * p4est, size_t data_size,
   }
 }
 
-void
-p4est_refine (p4est_t * p4est, int refine_recursive,
-              p4est_refine_t refine_fn, p4est_init_t init_fn)
+/** Give a quadrant copied from shared storage its own user data. */
+static void
+p4est_refine_copy_data (p4est_t * p4est, p4est_quadrant_t * quad)
 {
-  p4est_refine_ext (p4est, refine_recursive, -1, refine_fn, init_fn, NULL);
+  void               *data;
+
+  if (p4est->data_size > 0) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_user_data_pool)
+#endif
+    data = sc_mempool_alloc (p4est->user_data_pool);
+    memcpy (data, quad->p.user_data, p4est->data_size);
+    quad->p.user_data = data;
+  }
 }
 
-void
-p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
-                  p4est_refine_t refine_fn, p4est_init_t init_fn,
-                  p4est_replace_t replace_fn)
+/** Replace a quadrant by its children and run the data callbacks.
+ * \param [in] q        The quadrant to refine.  It may alias a child.
+ * \param [out] family  Pointers to the children in Morton order.
+ * \param [in] shared   If true, the user data of q is not freed.
+ */
+static void
+p4est_refine_family (p4est_t * p4est, p4est_topidx_t which_tree,
+                     const p4est_quadrant_t * q, p4est_quadrant_t * family[],
+                     p4est_init_t init_fn, p4est_replace_t replace_fn,
+                     int shared)
 {
-#ifdef P4EST_ENABLE_DEBUG
-  size_t              quadrant_pool_size, data_pool_size;
-#endif
-  int                 firsttime;
-  int                 i, maxlevel;
-  p4est_topidx_t      nt;
-  p4est_gloidx_t      old_gnq;
-  size_t              incount, current, restpos, movecount;
-  sc_list_t          *list;
-  p4est_tree_t       *tree;
-  p4est_quadrant_t   *q, *qalloc, *qpop;
-  p4est_quadrant_t   *c0, *c1, *c2, *c3;
-#ifdef P4_TO_P8
-  p4est_quadrant_t   *c4, *c5, *c6, *c7;
-#endif
-  sc_array_t         *tquadrants;
-  p4est_quadrant_t   *family[8];
+  int                 i;
   p4est_quadrant_t    parent, *pp = &parent;
 
-  if (allowed_level < 0) {
-    allowed_level = P4EST_QMAXLEVEL;
+  parent = *q;
+  if (replace_fn == NULL && !shared) {
+    p4est_quadrant_free_data (p4est, &parent);
   }
-  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
-                            "_refine with %lld total quadrants,"
-                            " allowed level %d\n",
-                            (long long) p4est->global_num_quadrants,
-                            allowed_level);
-  p4est_log_indent_push ();
-  P4EST_ASSERT (p4est_is_valid (p4est));
-  P4EST_ASSERT (0 <= allowed_level && allowed_level <= P4EST_QMAXLEVEL);
-  P4EST_ASSERT (refine_fn != NULL);
-
-  /* remember input quadrant count; it will not decrease */
-  old_gnq = p4est->global_num_quadrants;
-
-  /*
-     q points to a quadrant that is an array member
-     qalloc is a quadrant that has been allocated through quadrant_pool
-     qpop is a quadrant that has been allocated through quadrant_pool
-     never mix these two types of quadrant pointers
-
-     The quadrant->pad8 field of list quadrants is interpreted as boolean
-     and set to true for quadrants that have already been refined.
-   */
-  list = sc_list_new (NULL);
-  p4est->local_num_quadrants = 0;
+  p4est_quadrant_childrenpv (&parent, family);
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    p4est_quadrant_init_data (p4est, which_tree, family[i], init_fn);
+  }
+  if (replace_fn != NULL) {
+    /* in family mode we always call the replace callback right away */
+    replace_fn (p4est, which_tree, 1, &pp, P4EST_CHILDREN, family);
+    if (!shared) {
+      p4est_quadrant_free_data (p4est, &parent);
+    }
+  }
+}
 
-  /* loop over all local trees */
-  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
-    tree = p4est_tree_array_index (p4est->trees, nt);
-    tree->quadrants_offset = p4est->local_num_quadrants;
-    tquadrants = &tree->quadrants;
-#ifdef P4EST_ENABLE_DEBUG
-    quadrant_pool_size = p4est->quadrant_pool->elem_count;
-    data_pool_size = 0;
-    if (p4est->user_data_pool != NULL) {
-      data_pool_size = p4est->user_data_pool->elem_count;
+/** Refine the quadrants of one work unit with the semantics of refine_ext.
+ * Without recursion the output is counted first and written in one pass.
+ * Otherwise the recursion runs on a stack of bounded size.  In both cases
+ * the unit's output array is only created when a quadrant is refined.
+ * Output copied from a shared input tree gets its own user data.
+ * \param [in] refine_batch_fn  If not NULL, used instead of refine_fn.
+ *                              Requires refine_recursive to be false.
+ * \param [in] flags    Scratch array of int8_t private to the thread.
+ */
+static void
+p4est_refine_unit (p4est_t * p4est, p4est_refine_unit_t * unit,
+                   int refine_recursive, int allowed_level,
+                   p4est_refine_t refine_fn,
+                   p4est_refine_batch_t refine_batch_fn,
+                   p4est_init_t init_fn, p4est_replace_t replace_fn,
+                   sc_array_t * flags)
+{
+  int                 i, shared;
+  int8_t             *flag;
+  const p4est_topidx_t nt = unit->which_tree;
+  size_t              zz, incount, numref, top;
+  p4est_tree_t       *tree;
+  sc_array_t         *tquadrants, view;
+  p4est_quadrant_t   *q, *r;
+  p4est_quadrant_t   *c[P4EST_CHILDREN];
+  p4est_quadrant_t    stack[(P4EST_CHILDREN - 1) * P4EST_QMAXLEVEL + 1];
+
+  tree = p4est_tree_array_index (p4est->trees, nt);
+  tquadrants = &tree->quadrants;
+  incount = unit->last - unit->first;
+  P4EST_ASSERT (refine_batch_fn == NULL || !refine_recursive);
+  unit->changed = 0;
+  unit->maxlevel = 0;
+  memset (unit->quadrants_per_level, 0, sizeof (unit->quadrants_per_level));
+
+  if (!refine_recursive) {
+    /* query the callback for every quadrant and count the refinements */
+    sc_array_resize (flags, incount);
+    if (refine_batch_fn != NULL) {
+      refine_batch_fn (p4est, nt,
+                       tree->quadrants_offset + (p4est_locidx_t) unit->first,
+                       incount, p4est_quadrant_array_index (tquadrants,
+                                                            unit->first),
+                       (int8_t *) flags->array);
     }
-#endif
-
-    /* initial log message for this tree */
-    P4EST_VERBOSEF ("Into refine tree %lld with %llu\n", (long long) nt,
-                    (unsigned long long) tquadrants->elem_count);
-
-    /* reset the quadrant counters */
-    maxlevel = 0;
-    for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
-      tree->quadrants_per_level[i] = 0;
+    numref = 0;
+    for (zz = 0; zz < incount; ++zz) {
+      q = p4est_quadrant_array_index (tquadrants, unit->first + zz);
+      flag = (int8_t *) sc_array_index (flags, zz);
+      if (refine_batch_fn == NULL) {
+        *flag = (int8_t) (refine_fn (p4est, nt, q) != 0);
+      }
+      *flag = (int8_t) (*flag && (int) q->level < allowed_level);
+      if (*flag) {
+        ++numref;
+        unit->maxlevel = SC_MAX (unit->maxlevel, (int) q->level + 1);
+        unit->quadrants_per_level[q->level + 1] += P4EST_CHILDREN;
+      }
+      else {
+        unit->maxlevel = SC_MAX (unit->maxlevel, (int) q->level);
+        ++unit->quadrants_per_level[q->level];
+      }
+    }
+    if (numref == 0) {
+      return;
     }
 
-    /* run through the array to find first quadrant to be refined */
-    q = NULL;
-    incount = tquadrants->elem_count;
-    for (current = 0; current < incount; ++current) {
-      q = p4est_quadrant_array_index (tquadrants, current);
-      if (refine_fn (p4est, nt, q) && (int) q->level < allowed_level) {
-        break;
+    /* write the output of known size sequentially */
+    sc_array_init_size (&unit->out, sizeof (p4est_quadrant_t),
+                        incount + numref * (P4EST_CHILDREN - 1));
+    r = p4est_quadrant_array_index (&unit->out, 0);
+    for (zz = 0; zz < incount; ++zz) {
+      q = p4est_quadrant_array_index (tquadrants, unit->first + zz);
+      flag = (int8_t *) sc_array_index (flags, zz);
+      if (!*flag) {
+        *r = *q;
+        if (unit->shared) {
+          p4est_refine_copy_data (p4est, r);
+        }
+        ++r;
+        continue;
+      }
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        c[i] = r++;
       }
-      maxlevel = SC_MAX (maxlevel, (int) q->level);
-      ++tree->quadrants_per_level[q->level];
+      p4est_jump_record (unit->jumps, q, 0);
+      p4est_refine_family (p4est, nt, q, c, init_fn, replace_fn,
+                           unit->shared);
     }
-    if (current == incount) {
-      /* no refinement occurs in this tree */
-      p4est->local_num_quadrants += incount;
+    P4EST_ASSERT (r == p4est_quadrant_array_index (&unit->out, 0) +
+                  unit->out.elem_count);
+    unit->changed = 1;
+    return;
+  }
+
+  for (zz = unit->first; zz < unit->last; ++zz) {
+    q = p4est_quadrant_array_index (tquadrants, zz);
+    if (!refine_fn (p4est, nt, q) || (int) q->level >= allowed_level) {
+      /* this input quadrant stays as is */
+      if (unit->changed) {
+        r = p4est_quadrant_array_push (&unit->out);
+        *r = *q;
+        if (unit->shared) {
+          p4est_refine_copy_data (p4est, r);
+        }
+      }
+      unit->maxlevel = SC_MAX (unit->maxlevel, (int) q->level);
+      ++unit->quadrants_per_level[q->level];
       continue;
     }
-    P4EST_ASSERT (q != NULL);
+    if (!unit->changed) {
+      /* copy the unchanged quadrants in front of this one */
+      sc_array_init (&unit->out, sizeof (p4est_quadrant_t));
+      sc_array_init_view (&view, tquadrants, unit->first, zz - unit->first);
+      sc_array_copy (&unit->out, &view);
+      for (top = 0; unit->shared && top < unit->out.elem_count; ++top) {
+        p4est_refine_copy_data
+          (p4est, p4est_quadrant_array_index (&unit->out, top));
+      }
+      unit->changed = 1;
+    }
 
-    /* now we have a quadrant to refine, prepend it to the list */
-    qalloc = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-    *qalloc = *q;               /* never prepend array members directly */
-    qalloc->pad8 = 0;           /* this quadrant has not been refined yet */
-    (void) sc_list_prepend (list, qalloc);      /* only new quadrants */
+    /* refine depth first; the children are stacked in reverse order */
+    top = 0;
+    shared = unit->shared;
+    while (q != NULL) {
+      P4EST_ASSERT (top + P4EST_CHILDREN <=
+                    sizeof (stack) / sizeof (p4est_quadrant_t));
+      for (i = 0; i < P4EST_CHILDREN; ++i) {
+        c[i] = &stack[top + P4EST_CHILDREN - 1 - i];
+      }
+      p4est_jump_record (unit->jumps, q, 0);
+      p4est_refine_family (p4est, nt, q, c, init_fn, replace_fn, shared);
+      shared = 0;
+      top += P4EST_CHILDREN;
+
+      /* pop quadrants until one is to be refined or the stack is empty */
+      q = NULL;
+      while (top > 0) {
+        q = &stack[--top];
+        if (refine_fn (p4est, nt, q) && (int) q->level < allowed_level) {
+          break;
+        }
+        r = p4est_quadrant_array_push (&unit->out);
+        *r = *q;
+        unit->maxlevel = SC_MAX (unit->maxlevel, (int) q->level);
+        ++unit->quadrants_per_level[q->level];
+        q = NULL;
+      }
+    }
+  }
+}
 
-    P4EST_QUADRANT_INIT (&parent);
+void
+p4est_refine (p4est_t * p4est, int refine_recursive,
+              p4est_refine_t refine_fn, p4est_init_t init_fn)
+{
+  p4est_refine_ext (p4est, refine_recursive, -1, refine_fn, init_fn, NULL);
+}
 
-    /*
-       current points to the next array member to write
-       restpos points to the next array member to read
-     */
-    restpos = current + 1;
-
-    /* run through the list and refine recursively */
-    firsttime = 1;
-    while (list->elem_count > 0) {
-      qpop = p4est_quadrant_list_pop (list);
-      if (firsttime ||
-          ((refine_recursive || !qpop->pad8) &&
-           refine_fn (p4est, nt, qpop) &&
-           (int) qpop->level < allowed_level)) {
-        firsttime = 0;
-        sc_array_resize (tquadrants,
-                         tquadrants->elem_count + P4EST_CHILDREN - 1);
+/** Refine the forest with either a single or a batch refinement callback.
+ * This function implements both p4est_refine_ext and p4est_refine_batch.
+ */
+static void
+p4est_refine_int (p4est_t * p4est, int refine_recursive, int allowed_level,
+                  p4est_refine_t refine_fn,
+                  p4est_refine_batch_t refine_batch_fn,
+                  p4est_init_t init_fn, p4est_replace_t replace_fn)
+{
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              data_pool_size, old_lnq;
+#endif
+  int                 num_threads, num_scratch, tracking;
+  int                 i, ithread, maxlevel, changed;
+  int                 recompact;
+  long                lu;
+  size_t              zz, zu, zv, num_units, first_unit;
+  size_t              unit_size, tcount, tsplit, outcount, offset;
+  p4est_topidx_t      nt;
+  p4est_gloidx_t      old_gnq;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_refine_unit_t *unit;
+  sc_array_t         *tquadrants, fresh;
+  sc_array_t          units;
+  sc_array_t         *flags;
 
-        if (replace_fn != NULL) {
-          /* do not free qpop's data yet: we will do this when the parent
-           * is replaced */
-          parent = *qpop;
-        }
-        else {
-          p4est_quadrant_free_data (p4est, qpop);
-        }
-        c0 = qpop;
-        c1 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c2 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c3 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
+  recompact = p4est_compact_suspend (p4est);
 
-#ifdef P4_TO_P8
-        c4 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c5 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c6 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-        c7 = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
+  if (allowed_level < 0) {
+    allowed_level = P4EST_QMAXLEVEL;
+  }
+  num_threads = 0;
+  if (p4est->inspect != NULL) {
+    num_threads = SC_MAX (p4est->inspect->refine_threads, 0);
+  }
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_refine with %lld total quadrants,"
+                            " allowed level %d\n",
+                            (long long) p4est->global_num_quadrants,
+                            allowed_level);
+  p4est_log_indent_push ();
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (0 <= allowed_level && allowed_level <= P4EST_QMAXLEVEL);
+  P4EST_ASSERT ((refine_fn != NULL) != (refine_batch_fn != NULL));
 
-        p8est_quadrant_children (qpop, c0, c1, c2, c3, c4, c5, c6, c7);
-#else
-        p4est_quadrant_children (qpop, c0, c1, c2, c3);
+  /* remember input quadrant count; it will not decrease */
+  old_gnq = p4est->global_num_quadrants;
+  p4est_cow_reclaim (p4est);
+  p4est_fields_save (p4est);
+#ifdef P4EST_ENABLE_DEBUG
+  old_lnq = (size_t) p4est->local_num_quadrants;
+  data_pool_size = 0;
+  if (p4est->user_data_pool != NULL) {
+    data_pool_size = p4est->user_data_pool->elem_count;
+  }
 #endif
-        p4est_quadrant_init_data (p4est, nt, c0, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c1, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c2, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c3, init_fn);
-        c0->pad8 = c1->pad8 = c2->pad8 = c3->pad8 = 1;
 
-#ifdef P4_TO_P8
-        p4est_quadrant_init_data (p4est, nt, c4, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c5, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c6, init_fn);
-        p4est_quadrant_init_data (p4est, nt, c7, init_fn);
-        c4->pad8 = c5->pad8 = c6->pad8 = c7->pad8 = 1;
-
-        (void) sc_list_prepend (list, c7);
-        (void) sc_list_prepend (list, c6);
-        (void) sc_list_prepend (list, c5);
-        (void) sc_list_prepend (list, c4);
-#endif
-        (void) sc_list_prepend (list, c3);
-        (void) sc_list_prepend (list, c2);
-        (void) sc_list_prepend (list, c1);
-        (void) sc_list_prepend (list, c0);
+  /* one work unit per tree, or units of contiguous quadrants for threads */
+  tracking = p4est_jump_tracking (p4est);
+  unit_size = 0;
+  if (num_threads > 0) {
+    unit_size = (size_t) p4est->local_num_quadrants /
+      (size_t) (P4EST_REFINE_UNITS_PER_THREAD * num_threads);
+    unit_size = SC_MAX (unit_size, P4EST_REFINE_MIN_UNIT);
+  }
+  sc_array_init (&units, sizeof (p4est_refine_unit_t));
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    tcount = tree->quadrants.elem_count;
+    tsplit = unit_size > 0 ? (tcount + unit_size - 1) / unit_size : 1;
+    for (zz = 0; zz < tsplit; ++zz) {
+      unit = (p4est_refine_unit_t *) sc_array_push (&units);
+      unit->which_tree = nt;
+      unit->shared = p4est_cow_is_shared (p4est, nt);
+      unit->first = (tcount * zz) / tsplit;
+      unit->last = (tcount * (zz + 1)) / tsplit;
+      unit->jumps = tracking ?
+        sc_array_new (sizeof (p4est_quadrant_t)) : NULL;
+    }
+  }
+  num_units = units.elem_count;
+  if (num_threads > 0) {
+    P4EST_VERBOSEF ("Refine with %d threads on %llu work units\n",
+                    num_threads, (unsigned long long) num_units);
+  }
 
-        if (replace_fn != NULL) {
-          /* in family mode we always call the replace callback right
-           * away */
-          family[0] = c0;
-          family[1] = c1;
-          family[2] = c2;
-          family[3] = c3;
-#ifdef P4_TO_P8
-          family[4] = c4;
-          family[5] = c5;
-          family[6] = c6;
-          family[7] = c7;
+  /* every thread owns a scratch array for the refinement flags */
+  num_scratch = SC_MAX (num_threads, 1);
+  flags = P4EST_ALLOC (sc_array_t, num_scratch);
+  for (i = 0; i < num_scratch; ++i) {
+    sc_array_init (&flags[i], sizeof (int8_t));
+  }
+
+  /* refine the units independently of each other */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_scratch) schedule (dynamic) \
+  private (ithread, unit)
 #endif
-          replace_fn (p4est, nt, 1, &pp, P4EST_CHILDREN, family);
-          p4est_quadrant_free_data (p4est, &parent);
+  for (lu = 0; lu < (long) num_units; ++lu) {
+#ifdef P4EST_ENABLE_OPENMP
+    ithread = omp_get_thread_num ();
+#else
+    ithread = 0;
+#endif
+    unit = (p4est_refine_unit_t *) sc_array_index (&units, (size_t) lu);
+    p4est_refine_unit (p4est, unit, refine_recursive, allowed_level,
+                       refine_fn, refine_batch_fn, init_fn, replace_fn,
+                       &flags[ithread]);
+  }
+
+  for (i = 0; i < num_scratch; ++i) {
+    sc_array_reset (&flags[i]);
+  }
+  P4EST_FREE (flags);
+
+  /* merge the output of the units into the trees in order */
+  p4est->local_num_quadrants = 0;
+  zu = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    tree->quadrants_offset = p4est->local_num_quadrants;
+    tquadrants = &tree->quadrants;
+
+    /* accumulate the counters of the units in this tree */
+    maxlevel = 0;
+    changed = 0;
+    outcount = 0;
+    for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+      tree->quadrants_per_level[i] = 0;
+    }
+    for (first_unit = zu; zu < num_units; ++zu) {
+      unit = (p4est_refine_unit_t *) sc_array_index (&units, zu);
+      if (unit->which_tree != nt) {
+        break;
+      }
+      changed = changed || unit->changed;
+      outcount += unit->changed ? unit->out.elem_count :
+        unit->last - unit->first;
+      maxlevel = SC_MAX (maxlevel, unit->maxlevel);
+      for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+        tree->quadrants_per_level[i] += unit->quadrants_per_level[i];
+      }
+    }
+    P4EST_ASSERT (zu > first_unit);
+
+    if (changed && p4est_cow_is_shared (p4est, nt)) {
+      /* the shared input is left alone and the tree gets a new array */
+      sc_array_init_size (&fresh, sizeof (p4est_quadrant_t), outcount);
+      offset = 0;
+      for (zz = first_unit; zz < zu; ++zz) {
+        unit = (p4est_refine_unit_t *) sc_array_index (&units, zz);
+        if (unit->changed) {
+          memcpy (sc_array_index (&fresh, offset), unit->out.array,
+                  unit->out.elem_count * sizeof (p4est_quadrant_t));
+          offset += unit->out.elem_count;
+          sc_array_reset (&unit->out);
+          continue;
+        }
+        for (zv = unit->first; zv < unit->last; ++zv) {
+          q = p4est_quadrant_array_index (&fresh, offset++);
+          *q = *p4est_quadrant_array_index (tquadrants, zv);
+          p4est_refine_copy_data (p4est, q);
         }
       }
-      else {
-        /* need to make room in the array to store this new quadrant */
-        if (restpos < incount && current == restpos) {
-          movecount = SC_MIN (incount - restpos, number_toread_quadrants);
-          while (movecount > 0) {
-            q = p4est_quadrant_array_index (tquadrants, restpos);
-            qalloc = p4est_quadrant_mempool_alloc (p4est->quadrant_pool);
-            *qalloc = *q;       /* never append array members directly */
-            qalloc->pad8 = 0;   /* has not been refined yet */
-            (void) sc_list_append (list, qalloc);       /* only new quadrants */
-            --movecount;
-            ++restpos;
+      P4EST_ASSERT (offset == outcount);
+      p4est_cow_release_tree (p4est, nt);
+      *tquadrants = fresh;
+    }
+    else if (changed && zu == first_unit + 1) {
+      /* the tree takes over the output array of its only unit */
+      unit = (p4est_refine_unit_t *) sc_array_index (&units, first_unit);
+      sc_array_reset (tquadrants);
+      *tquadrants = unit->out;
+    }
+    else if (changed) {
+      /* the output never precedes its input, so move back to front */
+      sc_array_resize (tquadrants, outcount);
+      offset = outcount;
+      for (zz = zu; zz > first_unit; --zz) {
+        unit = (p4est_refine_unit_t *) sc_array_index (&units, zz - 1);
+        if (unit->changed) {
+          offset -= unit->out.elem_count;
+          memcpy (sc_array_index (tquadrants, offset), unit->out.array,
+                  unit->out.elem_count * sizeof (p4est_quadrant_t));
+          sc_array_reset (&unit->out);
+        }
+        else {
+          offset -= unit->last - unit->first;
+          P4EST_ASSERT (offset >= unit->first);
+          if (offset > unit->first) {
+            memmove (sc_array_index (tquadrants, offset),
+                     sc_array_index (tquadrants, unit->first),
+                     (unit->last - unit->first) * sizeof (p4est_quadrant_t));
           }
         }
-
-        /* store new quadrant and update counters */
-        q = p4est_quadrant_array_index (tquadrants, current);
-        *q = *qpop;
-        maxlevel = SC_MAX (maxlevel, (int) qpop->level);
-        ++tree->quadrants_per_level[qpop->level];
-        ++current;
-        sc_mempool_free (p4est->quadrant_pool, qpop);
       }
+      P4EST_ASSERT (offset == 0);
+    }
+    if (changed) {
+      tree->changed = 1;
     }
     tree->maxlevel = (int8_t) maxlevel;
     p4est->local_num_quadrants += tquadrants->elem_count;
-
-    P4EST_ASSERT (restpos == incount);
-    P4EST_ASSERT (current == tquadrants->elem_count);
-    P4EST_ASSERT (list->first == NULL && list->last == NULL);
-    P4EST_ASSERT (quadrant_pool_size == p4est->quadrant_pool->elem_count);
-    if (p4est->user_data_pool != NULL) {
-      P4EST_ASSERT (data_pool_size + tquadrants->elem_count ==
-                    p4est->user_data_pool->elem_count + incount);
+    for (zz = first_unit; tracking && zz < zu; ++zz) {
+      unit = (p4est_refine_unit_t *) sc_array_index (&units, zz);
+      if (!tree->unbalanced && p4est_jump_check (p4est, tree, unit->jumps)) {
+        tree->unbalanced = 1;
+      }
+      sc_array_destroy (unit->jumps);
     }
+
+    P4EST_ASSERT (tquadrants->elem_count == outcount);
     P4EST_ASSERT (p4est_tree_is_sorted (tree));
     P4EST_ASSERT (p4est_tree_is_complete (tree));
 
@@ -907,29 +1645,57 @@ p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
     P4EST_VERBOSEF ("Done refine tree %lld now %llu\n", (long long) nt,
                     (unsigned long long) tquadrants->elem_count);
   }
+  P4EST_ASSERT (zu == num_units);
   if (p4est->last_local_tree >= 0) {
     for (; nt < p4est->connectivity->num_trees; ++nt) {
       tree = p4est_tree_array_index (p4est->trees, nt);
       tree->quadrants_offset = p4est->local_num_quadrants;
     }
   }
-
-  sc_list_destroy (list);
+  sc_array_reset (&units);
+#ifdef P4EST_ENABLE_DEBUG
+  if (p4est->user_data_pool != NULL && p4est->cow == NULL) {
+    P4EST_ASSERT (data_pool_size + (size_t) p4est->local_num_quadrants ==
+                  p4est->user_data_pool->elem_count + old_lnq);
+  }
+#endif
 
   /* compute global number of quadrants */
   p4est_comm_count_quadrants (p4est);
   P4EST_ASSERT (p4est->global_num_quadrants >= old_gnq);
   if (old_gnq != p4est->global_num_quadrants) {
-    ++p4est->revision;
+    p4est_revision_bump_tracked (p4est);
   }
 
   P4EST_ASSERT (p4est_is_valid (p4est));
+  p4est_fields_remap (p4est);
+  p4est_compact_resume (p4est, recompact);
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
                             "_refine with %lld total quadrants\n",
                             (long long) p4est->global_num_quadrants);
 }
 
+void
+p4est_refine_ext (p4est_t * p4est, int refine_recursive, int allowed_level,
+                  p4est_refine_t refine_fn, p4est_init_t init_fn,
+                  p4est_replace_t replace_fn)
+{
+  P4EST_ASSERT (refine_fn != NULL);
+  p4est_refine_int (p4est, refine_recursive, allowed_level,
+                    refine_fn, NULL, init_fn, replace_fn);
+}
+
+void
+p4est_refine_batch (p4est_t * p4est, int allowed_level,
+                    p4est_refine_batch_t refine_fn,
+                    p4est_init_t init_fn, p4est_replace_t replace_fn)
+{
+  P4EST_ASSERT (refine_fn != NULL);
+  p4est_refine_int (p4est, 0, allowed_level,
+                    NULL, refine_fn, init_fn, replace_fn);
+}
+
 void
 p4est_coarsen (p4est_t * p4est, int coarsen_recursive,
                p4est_coarsen_t coarsen_fn, p4est_init_t init_fn)
@@ -946,7 +1712,7 @@ p4est_coarsen_ext (p4est_t * p4est,
 #ifdef P4EST_ENABLE_DEBUG
   size_t              data_pool_size;
 #endif
-  int                 i, maxlevel;
+  int                 i, maxlevel, recompact;
   int                 isfamily;
   size_t              zz;
   size_t              incount, removed;
@@ -957,9 +1723,11 @@ p4est_coarsen_ext (p4est_t * p4est,
   p4est_tree_t       *tree;
   p4est_quadrant_t   *c[P4EST_CHILDREN];
   p4est_quadrant_t   *cfirst, *clast;
-  sc_array_t         *tquadrants;
+  sc_array_t         *tquadrants, *jumps;
   p4est_quadrant_t    qtemp;
 
+  recompact = p4est_compact_suspend (p4est);
+
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
                             "_coarsen with %lld total quadrants\n",
                             (long long) p4est->global_num_quadrants);
@@ -969,8 +1737,12 @@ p4est_coarsen_ext (p4est_t * p4est,
 
   /* remember input quadrant count; it will not increase */
   old_gnq = p4est->global_num_quadrants;
+  p4est_cow_reclaim (p4est);
+  p4est_fields_save (p4est);
 
   P4EST_QUADRANT_INIT (&qtemp);
+  jumps = p4est_jump_tracking (p4est) ?
+    sc_array_new (sizeof (p4est_quadrant_t)) : NULL;
 
   /* loop over all local trees */
   prev_offset = 0;
@@ -1021,6 +1793,20 @@ p4est_coarsen_ext (p4est_t * p4est,
        */
       P4EST_ASSERT (!isfamily || p4est_quadrant_is_familypv (c));
       if (isfamily && coarsen_fn (p4est, jt, c)) {
+        if (p4est_cow_is_shared (p4est, jt)) {
+          /* the tree is about to change and gets its own storage */
+          P4EST_ASSERT (removed == 0);
+          p4est_cow_unshare_tree (p4est, jt);
+          for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
+            c[zz] = p4est_quadrant_array_index (tquadrants, window + zz);
+          }
+#ifdef P4EST_ENABLE_DEBUG
+          if (p4est->user_data_pool != NULL) {
+            data_pool_size = p4est->user_data_pool->elem_count;
+          }
+#endif
+        }
+
         /* coarsen this family of quadrants */
         if (replace_fn == NULL) {
           for (zz = 0; zz < P4EST_CHILDREN; ++zz) {
@@ -1035,6 +1821,7 @@ p4est_coarsen_ext (p4est_t * p4est,
         }
         p4est_quadrant_parent (c[0], cfirst);
         p4est_quadrant_init_data (p4est, jt, cfirst, init_fn);
+        p4est_jump_record (jumps, cfirst, 1);
         tree->quadrants_per_level[cfirst->level] += 1;
         p4est->local_num_quadrants -= P4EST_CHILDREN - 1;
         removed += P4EST_CHILDREN - 1;
@@ -1099,6 +1886,15 @@ p4est_coarsen_ext (p4est_t * p4est,
     tree->maxlevel = (int8_t) maxlevel;
     tree->quadrants_offset = prev_offset;
     prev_offset += num_quadrants;
+    if (removed > 0) {
+      tree->changed = 1;
+    }
+    if (jumps != NULL) {
+      if (p4est_jump_check (p4est, tree, jumps)) {
+        tree->unbalanced = 1;
+      }
+      sc_array_truncate (jumps);
+    }
 
     /* do some sanity checks */
     P4EST_ASSERT (num_quadrants == (p4est_locidx_t) tquadrants->elem_count);
@@ -1121,20 +1917,451 @@ p4est_coarsen_ext (p4est_t * p4est,
     }
   }
 
+  if (jumps != NULL) {
+    sc_array_destroy (jumps);
+  }
+
   /* compute global number of quadrants */
   p4est_comm_count_quadrants (p4est);
   P4EST_ASSERT (p4est->global_num_quadrants <= old_gnq);
   if (old_gnq != p4est->global_num_quadrants) {
-    ++p4est->revision;
+    p4est_revision_bump_tracked (p4est);
   }
 
   P4EST_ASSERT (p4est_is_valid (p4est));
+  p4est_fields_remap (p4est);
+  p4est_compact_resume (p4est, recompact);
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
                             "_coarsen with %lld total quadrants\n",
                             (long long) p4est->global_num_quadrants);
 }
 
+void
+p4est_coarsen_batch (p4est_t * p4est, p4est_coarsen_batch_t coarsen_fn,
+                     p4est_init_t init_fn, p4est_replace_t replace_fn)
+{
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              data_pool_size;
+#endif
+  int                 i, maxlevel, recompact;
+  int8_t             *flags;
+  size_t              rz, wz, incount;
+  p4est_locidx_t      prev_offset;
+  p4est_topidx_t      jt;
+  p4est_gloidx_t      old_gnq;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *c[P4EST_CHILDREN];
+  p4est_quadrant_t   *q, *pp;
+  sc_array_t         *tquadrants, *jumps;
+  sc_array_t          flag_array;
+  p4est_quadrant_t    parent;
+
+  recompact = p4est_compact_suspend (p4est);
+
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_coarsen_batch with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+  p4est_log_indent_push ();
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (coarsen_fn != NULL);
+
+  /* remember input quadrant count; it will not increase */
+  old_gnq = p4est->global_num_quadrants;
+  p4est_cow_reclaim (p4est);
+  p4est_fields_save (p4est);
+
+  P4EST_QUADRANT_INIT (&parent);
+  pp = &parent;
+  sc_array_init (&flag_array, sizeof (int8_t));
+  jumps = p4est_jump_tracking (p4est) ?
+    sc_array_new (sizeof (p4est_quadrant_t)) : NULL;
+
+  /* loop over all local trees */
+  prev_offset = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tquadrants = &tree->quadrants;
+    incount = tquadrants->elem_count;
+#ifdef P4EST_ENABLE_DEBUG
+    data_pool_size = 0;
+    if (p4est->user_data_pool != NULL) {
+      data_pool_size = p4est->user_data_pool->elem_count;
+    }
+#endif
+
+    /* initial log message for this tree */
+    P4EST_VERBOSEF ("Into coarsen tree %lld with %llu\n", (long long) jt,
+                    (unsigned long long) incount);
+
+    /* flag all quadrants of this tree at once */
+    sc_array_resize (&flag_array, incount);
+    flags = (int8_t *) flag_array.array;
+    coarsen_fn (p4est, jt, tree->quadrants_offset, incount,
+                p4est_quadrant_array_index (tquadrants, 0), flags);
+
+    /* compact the array in one pass, replacing flagged families */
+    wz = 0;
+    for (rz = 0; rz < incount;) {
+      i = 0;
+      if (rz + P4EST_CHILDREN <= incount) {
+        for (; i < P4EST_CHILDREN; ++i) {
+          c[i] = p4est_quadrant_array_index (tquadrants, rz + i);
+          if (!flags[rz + i] || i != p4est_quadrant_child_id (c[i])) {
+            break;
+          }
+        }
+      }
+      if (i < P4EST_CHILDREN) {
+        /* keep this quadrant */
+        if (wz < rz) {
+          *p4est_quadrant_array_index (tquadrants, wz) =
+            *p4est_quadrant_array_index (tquadrants, rz);
+        }
+        ++wz;
+        ++rz;
+        continue;
+      }
+
+      if (p4est_cow_is_shared (p4est, jt)) {
+        /* the tree is about to change and gets its own storage */
+        P4EST_ASSERT (wz == rz);
+        p4est_cow_unshare_tree (p4est, jt);
+        for (i = 0; i < P4EST_CHILDREN; ++i) {
+          c[i] = p4est_quadrant_array_index (tquadrants, rz + i);
+        }
+#ifdef P4EST_ENABLE_DEBUG
+        if (p4est->user_data_pool != NULL) {
+          data_pool_size = p4est->user_data_pool->elem_count;
+        }
+#endif
+      }
+
+      /* in a complete tree, consecutive child ids make up a family */
+      P4EST_ASSERT (p4est_quadrant_is_familypv (c));
+      if (replace_fn == NULL) {
+        for (i = 0; i < P4EST_CHILDREN; ++i) {
+          p4est_quadrant_free_data (p4est, c[i]);
+        }
+      }
+      p4est_quadrant_parent (c[0], &parent);
+      p4est_quadrant_init_data (p4est, jt, &parent, init_fn);
+      p4est_jump_record (jumps, &parent, 1);
+      if (replace_fn != NULL) {
+        replace_fn (p4est, jt, P4EST_CHILDREN, c, 1, &pp);
+        for (i = 0; i < P4EST_CHILDREN; ++i) {
+          p4est_quadrant_free_data (p4est, c[i]);
+        }
+      }
+      tree->quadrants_per_level[parent.level + 1] -= P4EST_CHILDREN;
+      tree->quadrants_per_level[parent.level] += 1;
+
+      /* the family has been read completely before it is overwritten */
+      q = p4est_quadrant_array_index (tquadrants, wz);
+      *q = parent;
+      ++wz;
+      rz += P4EST_CHILDREN;
+    }
+    sc_array_resize (tquadrants, wz);
+    p4est->local_num_quadrants -= (p4est_locidx_t) (incount - wz);
+
+    /* compute maximum level */
+    maxlevel = 0;
+    for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+      P4EST_ASSERT (tree->quadrants_per_level[i] >= 0);
+      if (tree->quadrants_per_level[i] > 0) {
+        maxlevel = i;
+      }
+    }
+    tree->maxlevel = (int8_t) maxlevel;
+    tree->quadrants_offset = prev_offset;
+    prev_offset += (p4est_locidx_t) wz;
+    if (wz < incount) {
+      tree->changed = 1;
+    }
+    if (jumps != NULL) {
+      if (p4est_jump_check (p4est, tree, jumps)) {
+        tree->unbalanced = 1;
+      }
+      sc_array_truncate (jumps);
+    }
+
+    /* do some sanity checks */
+    if (p4est->user_data_pool != NULL) {
+      P4EST_ASSERT (data_pool_size - (incount - wz) ==
+                    p4est->user_data_pool->elem_count);
+    }
+    P4EST_ASSERT (p4est_tree_is_sorted (tree));
+    P4EST_ASSERT (p4est_tree_is_complete (tree));
+
+    /* final log message for this tree */
+    P4EST_VERBOSEF ("Done coarsen tree %lld now %llu\n", (long long) jt,
+                    (unsigned long long) tquadrants->elem_count);
+  }
+  if (p4est->last_local_tree >= 0) {
+    for (; jt < p4est->connectivity->num_trees; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      tree->quadrants_offset = p4est->local_num_quadrants;
+    }
+  }
+  sc_array_reset (&flag_array);
+  if (jumps != NULL) {
+    sc_array_destroy (jumps);
+  }
+
+  /* compute global number of quadrants */
+  p4est_comm_count_quadrants (p4est);
+  P4EST_ASSERT (p4est->global_num_quadrants <= old_gnq);
+  if (old_gnq != p4est->global_num_quadrants) {
+    p4est_revision_bump_tracked (p4est);
+  }
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  p4est_fields_remap (p4est);
+  p4est_compact_resume (p4est, recompact);
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_coarsen_batch with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+}
+
+/** Determine the action of p4est_adapt at a position in a tree.
+ * \return              1 to refine the quadrant, -1 to coarsen the family
+ *                      starting at this position, 0 to keep the quadrant.
+ */
+static int
+p4est_adapt_action (sc_array_t * tquadrants, const int8_t * flags,
+                    size_t pos, int maxlevel)
+{
+  int                 i;
+  p4est_quadrant_t   *q;
+
+  q = p4est_quadrant_array_index (tquadrants, pos);
+  if (flags[pos] > 0) {
+    return (int) q->level < maxlevel;
+  }
+  if (flags[pos] < 0 && pos + P4EST_CHILDREN <= tquadrants->elem_count &&
+      p4est_quadrant_child_id (q) == 0) {
+    for (i = 1; i < P4EST_CHILDREN; ++i) {
+      if (flags[pos + i] >= 0 || i != p4est_quadrant_child_id
+          (p4est_quadrant_array_index (tquadrants, pos + i))) {
+        return 0;
+      }
+    }
+    return -1;
+  }
+  return 0;
+}
+
+int
+p4est_adapt (p4est_t * p4est, const int8_t * flags, int maxlevel,
+             int balance, p4est_connect_type_t btype,
+             p4est_init_t init_fn, p4est_replace_t replace_fn)
+{
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              data_pool_size;
+#endif
+  int                 mpiret;
+  int                 i, level, action;
+  int                 changed, local_changed, tree_changed;
+  int                 recompact;
+  size_t              rz, incount, outcount;
+  const int8_t       *tflags;
+  p4est_locidx_t      in_offset;
+  p4est_topidx_t      jt;
+  p4est_gloidx_t      old_gnq;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *r;
+  p4est_quadrant_t   *c[P4EST_CHILDREN];
+  sc_array_t         *tquadrants, *jumps, out;
+
+  recompact = p4est_compact_suspend (p4est);
+
+  if (maxlevel < 0) {
+    maxlevel = P4EST_QMAXLEVEL;
+  }
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_adapt with %lld total quadrants,"
+                            " allowed level %d\n",
+                            (long long) p4est->global_num_quadrants,
+                            maxlevel);
+  p4est_log_indent_push ();
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (0 <= maxlevel && maxlevel <= P4EST_QMAXLEVEL);
+  P4EST_ASSERT (flags != NULL || p4est->local_num_quadrants == 0);
+
+  old_gnq = p4est->global_num_quadrants;
+  local_changed = 0;
+  p4est_cow_reclaim (p4est);
+  p4est_fields_save (p4est);
+  jumps = p4est_jump_tracking (p4est) ?
+    sc_array_new (sizeof (p4est_quadrant_t)) : NULL;
+
+  /* loop over all local trees */
+  in_offset = 0;
+  p4est->local_num_quadrants = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    tree->quadrants_offset = p4est->local_num_quadrants;
+    tquadrants = &tree->quadrants;
+    incount = tquadrants->elem_count;
+    tflags = flags + in_offset;
+    in_offset += (p4est_locidx_t) incount;
+#ifdef P4EST_ENABLE_DEBUG
+    data_pool_size = 0;
+    if (p4est->user_data_pool != NULL) {
+      data_pool_size = p4est->user_data_pool->elem_count;
+    }
+#endif
+
+    /* count the output of this tree from the flags */
+    outcount = 0;
+    tree_changed = 0;
+    for (rz = 0; rz < incount;) {
+      action = p4est_adapt_action (tquadrants, tflags, rz, maxlevel);
+      outcount += action > 0 ? P4EST_CHILDREN : 1;
+      rz += action < 0 ? P4EST_CHILDREN : 1;
+      tree_changed = tree_changed || action != 0;
+    }
+    local_changed = local_changed || tree_changed;
+    if (!tree_changed) {
+      p4est->local_num_quadrants += (p4est_locidx_t) incount;
+      continue;
+    }
+    if (p4est_cow_is_shared (p4est, jt)) {
+      /* the user data of the input is freed below */
+      p4est_cow_unshare_tree (p4est, jt);
+#ifdef P4EST_ENABLE_DEBUG
+      if (p4est->user_data_pool != NULL) {
+        data_pool_size = p4est->user_data_pool->elem_count;
+      }
+#endif
+    }
+
+    /* write the new quadrants in one pass */
+    sc_array_init_size (&out, sizeof (p4est_quadrant_t), outcount);
+    r = p4est_quadrant_array_index (&out, 0);
+    for (rz = 0; rz < incount;) {
+      q = p4est_quadrant_array_index (tquadrants, rz);
+      action = p4est_adapt_action (tquadrants, tflags, rz, maxlevel);
+      if (action > 0) {
+        /* replace the quadrant by its children */
+        for (i = 0; i < P4EST_CHILDREN; ++i) {
+          c[i] = r++;
+        }
+        p4est_jump_record (jumps, q, 0);
+        if (replace_fn == NULL) {
+          p4est_quadrant_free_data (p4est, q);
+        }
+        p4est_quadrant_childrenpv (q, c);
+        for (i = 0; i < P4EST_CHILDREN; ++i) {
+          p4est_quadrant_init_data (p4est, jt, c[i], init_fn);
+        }
+        if (replace_fn != NULL) {
+          replace_fn (p4est, jt, 1, &q, P4EST_CHILDREN, c);
+          p4est_quadrant_free_data (p4est, q);
+        }
+        level = (int) q->level;
+        --tree->quadrants_per_level[level];
+        tree->quadrants_per_level[level + 1] += P4EST_CHILDREN;
+        ++rz;
+      }
+      else if (action < 0) {
+        /* replace the family by its parent */
+        for (i = 0; i < P4EST_CHILDREN; ++i) {
+          c[i] = p4est_quadrant_array_index (tquadrants, rz + i);
+          if (replace_fn == NULL) {
+            p4est_quadrant_free_data (p4est, c[i]);
+          }
+        }
+        P4EST_ASSERT (p4est_quadrant_is_familypv (c));
+        p4est_quadrant_parent (q, r);
+        p4est_quadrant_init_data (p4est, jt, r, init_fn);
+        p4est_jump_record (jumps, r, 1);
+        if (replace_fn != NULL) {
+          replace_fn (p4est, jt, P4EST_CHILDREN, c, 1, &r);
+          for (i = 0; i < P4EST_CHILDREN; ++i) {
+            p4est_quadrant_free_data (p4est, c[i]);
+          }
+        }
+        level = (int) r->level;
+        tree->quadrants_per_level[level + 1] -= P4EST_CHILDREN;
+        ++tree->quadrants_per_level[level];
+        ++r;
+        rz += P4EST_CHILDREN;
+      }
+      else {
+        *r++ = *q;
+        ++rz;
+      }
+    }
+    P4EST_ASSERT (r == p4est_quadrant_array_index (&out, 0) + outcount);
+
+    /* the tree takes over the new array */
+    sc_array_reset (tquadrants);
+    *tquadrants = out;
+    p4est->local_num_quadrants += (p4est_locidx_t) outcount;
+    tree->changed = 1;
+    if (jumps != NULL) {
+      if (p4est_jump_check (p4est, tree, jumps)) {
+        tree->unbalanced = 1;
+      }
+      sc_array_truncate (jumps);
+    }
+
+    /* compute maximum level */
+    tree->maxlevel = 0;
+    for (i = 0; i <= P4EST_QMAXLEVEL; ++i) {
+      P4EST_ASSERT (tree->quadrants_per_level[i] >= 0);
+      if (tree->quadrants_per_level[i] > 0) {
+        tree->maxlevel = (int8_t) i;
+      }
+    }
+
+    /* do some sanity checks */
+    if (p4est->user_data_pool != NULL) {
+      P4EST_ASSERT (data_pool_size + outcount ==
+                    p4est->user_data_pool->elem_count + incount);
+    }
+    P4EST_ASSERT (p4est_tree_is_sorted (tree));
+    P4EST_ASSERT (p4est_tree_is_complete (tree));
+  }
+  if (p4est->last_local_tree >= 0) {
+    for (; jt < p4est->connectivity->num_trees; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      tree->quadrants_offset = p4est->local_num_quadrants;
+    }
+  }
+
+  if (jumps != NULL) {
+    sc_array_destroy (jumps);
+  }
+
+  /* a mesh may change without changing its number of quadrants */
+  mpiret = sc_MPI_Allreduce (&local_changed, &changed, 1, sc_MPI_INT,
+                             sc_MPI_LOR, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  p4est_comm_count_quadrants (p4est);
+  if (changed) {
+    p4est_revision_bump_tracked (p4est);
+  }
+  P4EST_ASSERT (changed || old_gnq == p4est->global_num_quadrants);
+  P4EST_ASSERT (p4est_is_valid (p4est));
+
+  /* only a changed mesh may need to be balanced */
+  if (changed && balance) {
+    p4est_balance_ext (p4est, btype, init_fn, replace_fn);
+  }
+
+  p4est_fields_remap (p4est);
+  p4est_compact_resume (p4est, recompact);
+  p4est_log_indent_pop ();
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_adapt with %lld total quadrants\n",
+                            (long long) p4est->global_num_quadrants);
+  return changed;
+}
+
 /** Check if the insulation layer of a quadrant overlaps anybody.
  * If yes, the quadrant itself is scheduled for sending.
  * Both quadrants are in the receiving tree's coordinates.
@@ -1150,6 +2377,7 @@ p4est_balance_schedule (p4est_t * p4est, p4est_balance_peer_t * peers,
                         p4est_topidx_t qtree, int inter_tree,
                         const p4est_quadrant_t * q,
                         const p4est_quadrant_t * insul,
+                        const int8_t * peer_changed,
                         int *first_peer, int *last_peer)
 {
   const int           rank = p4est->mpirank;
@@ -1178,6 +2406,10 @@ p4est_balance_schedule (p4est_t * p4est, p4est_balance_peer_t * peers,
       /* do not send to empty processors */
       continue;
     }
+    if (peer_changed != NULL && !peer_changed[owner]) {
+      /* the owner has not changed since the last balance */
+      continue;
+    }
     peer = peers + owner;
     /* avoid duplicates in the send array */
     found = 0;
@@ -1218,12 +2450,25 @@ p4est_balance_response (p4est_t * p4est, p4est_balance_peer_t * peer,
   sc_array_t         *first_seeds = sc_array_new (sizeof (p4est_quadrant_t));
 
 /* compute and uniqify overlap quadrants */
-  p4est_tree_compute_overlap (p4est, &peer->recv_first,
-                              &peer->send_second, balance, borders,
-                              first_seeds);
+  if (p4est->inspect != NULL) {
+    p4est->inspect->balance_overlap -= sc_MPI_Wtime ();
+  }
+  if (p4est->inspect != NULL && p4est->inspect->use_balance_overlap_bsearch) {
+    p4est_tree_compute_overlap (p4est, &peer->recv_first,
+                                &peer->send_second, balance, borders,
+                                first_seeds);
+  }
+  else {
+    p4est_tree_compute_overlap_sweep (p4est, &peer->recv_first,
+                                      &peer->send_second, balance, borders,
+                                      first_seeds);
+  }
   /* replace peer->recv_first with first_seeds */
   p4est_tree_uniqify_overlap (&peer->send_second);
   p4est_tree_uniqify_overlap (first_seeds);
+  if (p4est->inspect != NULL) {
+    p4est->inspect->balance_overlap += sc_MPI_Wtime ();
+  }
   /* replace peer->recv_first with first_seeds */
   sc_array_resize (&peer->recv_first, first_seeds->elem_count);
   memcpy (peer->recv_first.array, first_seeds->array,
@@ -1238,6 +2483,59 @@ p4est_balance_response (p4est_t * p4est, p4est_balance_peer_t * peer,
   }
 }
 
+/** Return the bytes of the forest and the working storage of balance. */
+static size_t
+p4est_balance_memory (p4est_t * p4est, p4est_balance_peer_t * peers,
+                      sc_array_t * borders)
+{
+  int                 j;
+  size_t              zz, size;
+  p4est_balance_peer_t *peer;
+
+  size = p4est_memory_used (p4est) +
+    p4est->connectivity->num_trees * sizeof (int8_t) +
+    p4est->mpisize * (sizeof (p4est_balance_peer_t) + sizeof (int8_t) +
+                      6 * sizeof (sc_MPI_Request) +
+                      sizeof (sc_MPI_Status) + sizeof (int));
+  for (j = 0; j < p4est->mpisize; ++j) {
+    peer = peers + j;
+    size += sc_array_memory_used (&peer->send_first, 0) +
+      sc_array_memory_used (&peer->send_second, 0) +
+      sc_array_memory_used (&peer->recv_first, 0) +
+      sc_array_memory_used (&peer->recv_second, 0) +
+      sc_array_memory_used (&peer->send_first_bytes, 0) +
+      sc_array_memory_used (&peer->send_second_bytes, 0) +
+      sc_array_memory_used (&peer->recv_first_bytes, 0) +
+      sc_array_memory_used (&peer->recv_second_bytes, 0);
+  }
+  size += sc_array_memory_used (borders, 1);
+  for (zz = 0; zz < borders->elem_count; ++zz) {
+    size += sc_array_memory_used ((sc_array_t *)
+                                  sc_array_index (borders, zz), 0);
+  }
+  return size;
+}
+
+/** Reset the balance statistics for a balance that has been skipped. */
+static void
+p4est_balance_inspect_skip (p4est_inspect_t * inspect)
+{
+  int                 k;
+
+  inspect->balance_skipped = 1;
+  inspect->balance_A_count_in = inspect->balance_A_count_out = 0;
+  inspect->balance_B_count_in = inspect->balance_B_count_out = 0;
+  inspect->balance_comm_sent = inspect->balance_comm_nzpeers = 0;
+  inspect->balance_comm_bytes = inspect->balance_comm_bytes_raw = 0;
+  for (k = 0; k < 2; ++k) {
+    inspect->balance_zero_sends[k] = inspect->balance_zero_receives[k] = 0;
+  }
+  inspect->balance_A = inspect->balance_comm = inspect->balance_B = 0.;
+  inspect->balance_ranges = inspect->balance_notify = 0.;
+  inspect->balance_notify_allgather = inspect->balance_overlap = 0.;
+  inspect->use_B = 0;
+}
+
 void
 p4est_balance (p4est_t * p4est, p4est_connect_type_t btype,
                p4est_init_t init_fn)
@@ -1257,7 +2555,11 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   int                 quad_contact[P4EST_FACES];
   int                 any_face, tree_contact[P4EST_FACES];
   int                 tree_fully_owned, full_tree[2];
+  int                 incremental, tree_changed;
+  int                 num_threads, recompact;
+  int                 mpiret, local_unbalanced, unbalanced;
   int8_t             *tree_flags;
+  int8_t              local_changed, *peer_changed, *schedule_changed;
   size_t              zz, treecount, ctree;
   size_t              localcount;
   size_t              qcount, qbytes;
@@ -1276,6 +2578,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   p4est_connectivity_t *conn = p4est->connectivity;
   sc_array_t         *qarray, *tquadrants;
   sc_array_t         *borders;
+  sc_array_t         *thread_trees;
 #ifdef P4EST_ENABLE_DEBUG
   size_t              data_pool_size;
 #endif
@@ -1301,7 +2604,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   p4est_gloidx_t      ltotal[2], gtotal[2];
 #endif /* P4EST_ENABLE_DEBUG */
   int                 i;
-  int                 mpiret, rcount;
+  int                 rcount;
   int                 first_bound;
   int                 request_first_count, request_second_count, outcount;
   int                 request_send_count, total_send_count, total_recv_count;
@@ -1326,6 +2629,8 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   MPI_Status         *recv_statuses, *jstatus;
 #endif /* P4EST_ENABLE_MPI */
 
+  recompact = p4est_compact_suspend (p4est);
+
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
                             "_balance %s with %lld total quadrants\n",
                             p4est_connect_type_string (btype),
@@ -1339,8 +2644,66 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
                 btype == P8EST_CONNECT_CORNER);
 #endif
 
+  /* refine and coarsen record whether they may have created a level jump */
+  if (p4est->balance_type != 0 && (int) btype <= p4est->balance_type &&
+      p4est->balance_revision == p4est->revision) {
+    local_unbalanced = 0;
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      local_unbalanced = local_unbalanced || tree->unbalanced;
+    }
+    mpiret = sc_MPI_Allreduce (&local_unbalanced, &unbalanced, 1,
+                               sc_MPI_INT, sc_MPI_LOR, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+    if (!unbalanced) {
+      /* the forest is still balanced with respect to its balance type */
+      P4EST_ASSERT (p4est_is_balanced (p4est, btype));
+      for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree;
+           ++nt) {
+        tree = p4est_tree_array_index (p4est->trees, nt);
+        tree->changed = 0;
+      }
+      p4est->balance_revision = p4est->revision;
+      if (p4est->inspect != NULL) {
+        p4est_balance_inspect_skip (p4est->inspect);
+      }
+      p4est_compact_resume (p4est, recompact);
+      p4est_log_indent_pop ();
+      P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                                "_balance skipped with %lld total"
+                                " quadrants\n",
+                                (long long) p4est->global_num_quadrants);
+      return;
+    }
+  }
+
   /* remember input quadrant count; it will not decrease */
   old_gnq = p4est->global_num_quadrants;
+  p4est_cow_reclaim (p4est);
+  p4est_fields_save (p4est);
+
+  /* skip unchanged trees if the forest has been balanced before */
+  incremental = p4est->inspect != NULL &&
+    p4est->inspect->use_balance_incremental && p4est->balance_type != 0 &&
+    (int) btype <= p4est->balance_type &&
+    p4est->balance_revision == p4est->revision;
+  peer_changed = NULL;
+  if (incremental) {
+    local_changed = 0;
+    for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      local_changed = local_changed || tree->changed;
+    }
+    peer_changed = P4EST_ALLOC (int8_t, num_procs);
+#ifdef P4EST_ENABLE_MPI
+    mpiret = MPI_Allgather (&local_changed, 1, MPI_BYTE,
+                           peer_changed, 1, MPI_BYTE, p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+#else
+    peer_changed[0] = local_changed;
+#endif
+    P4EST_GLOBAL_INFO ("Balance incrementally\n");
+  }
 
 #ifdef P4EST_ENABLE_DEBUG
   data_pool_size = 0;
@@ -1398,6 +2761,10 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
     sc_array_init (&peer->send_second, sizeof (p4est_quadrant_t));
     sc_array_init (&peer->recv_first, sizeof (p4est_quadrant_t));
     sc_array_init (&peer->recv_second, sizeof (p4est_quadrant_t));
+    sc_array_init (&peer->send_first_bytes, 1);
+    sc_array_init (&peer->send_second_bytes, 1);
+    sc_array_init (&peer->recv_first_bytes, 1);
+    sc_array_init (&peer->recv_second_bytes, 1);
     peer->send_first_count = peer->send_second_count = 0;
     peer->recv_first_count = peer->recv_second_count = 0;
     peer->have_first_count = peer->have_first_load = 0;
@@ -1428,6 +2795,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
 
   /* start balance_A timing */
   if (p4est->inspect != NULL) {
+    p4est->inspect->balance_skipped = 0;
     p4est->inspect->balance_A = -sc_MPI_Wtime ();
     p4est->inspect->balance_A_count_in = 0;
     p4est->inspect->balance_A_count_out = 0;
@@ -1437,9 +2805,24 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   /* loop over all local trees to assemble first send list */
   first_tree = p4est->first_local_tree;
   last_tree = p4est->last_local_tree;
+  num_threads = p4est->inspect != NULL ? p4est->inspect->balance_threads : 0;
+  all_incount = 0;
+  thread_trees = sc_array_new (sizeof (p4est_topidx_t));
+  if (num_threads > 0) {
+    /* local balance first pass of all changed trees at once */
+    for (nt = first_tree; nt <= last_tree; ++nt) {
+      tree = p4est_tree_array_index (p4est->trees, nt);
+      all_incount += tree->quadrants.elem_count;
+      if (!incremental || tree->changed) {
+        *(p4est_topidx_t *) sc_array_push (thread_trees) = nt;
+      }
+    }
+    p4est_balance_subtrees (p4est, btype, thread_trees, init_fn, replace_fn,
+                            num_threads);
+  }
+
   first_peer = num_procs;
   last_peer = -1;
-  all_incount = 0;
   skipped = 0;
   for (nt = first_tree; nt <= last_tree; ++nt) {
     p4est_comm_tree_info (p4est, nt, full_tree, tree_contact, NULL, NULL);
@@ -1453,14 +2836,26 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
     }
     tree = p4est_tree_array_index (p4est->trees, nt);
     tquadrants = &tree->quadrants;
-    all_incount += tquadrants->elem_count;
+    if (num_threads <= 0) {
+      all_incount += tquadrants->elem_count;
+    }
 
     /* initial log message for this tree */
     P4EST_VERBOSEF ("Into balance tree %lld with %llu\n", (long long) nt,
                     (unsigned long long) tquadrants->elem_count);
 
     /* local balance first pass */
-    p4est_balance_subtree_ext (p4est, btype, nt, init_fn, replace_fn);
+    tree_changed = !incremental || tree->changed;
+    if (tree_changed) {
+      if (num_threads <= 0) {
+        p4est_balance_subtree_ext (p4est, btype, nt, init_fn, replace_fn);
+      }
+      schedule_changed = NULL;
+    }
+    else {
+      /* this tree is balanced; its border only matters to changed peers */
+      schedule_changed = peer_changed;
+    }
     treecount = tquadrants->elem_count;
     P4EST_VERBOSEF ("Balance tree %lld A %llu\n",
                     (long long) nt, (unsigned long long) treecount);
@@ -1583,7 +2978,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
                 tosend.pad16 = face;
                 p4est_quadrant_transform_face (&insulq, &tempq, ftransform);
                 p4est_balance_schedule (p4est, peers, qtree, 1,
-                                        &tosend, &tempq,
+                                        &tosend, &tempq, schedule_changed,
                                         &first_peer, &last_peer);
               }
               else {
@@ -1604,7 +2999,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
                 tosend.pad16 = edge;
                 p8est_quadrant_transform_edge (&insulq, &tempq, &ei, et, 1);
                 p4est_balance_schedule (p4est, peers, et->ntree, 1,
-                                        &tosend, &tempq,
+                                        &tosend, &tempq, schedule_changed,
                                         &first_peer, &last_peer);
               }
             }
@@ -1632,8 +3027,8 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
                 p4est_quadrant_transform_corner (&tempq, (int) ct->ncorner,
                                                  1);
                 p4est_balance_schedule (p4est, peers, ct->ntree, 1,
-                                        &tosend, &tempq, &first_peer,
-                                        &last_peer);
+                                        &tosend, &tempq, schedule_changed,
+                                        &first_peer, &last_peer);
               }
             }
           }
@@ -1643,8 +3038,8 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
             tosend.p.piggy2.from_tree = nt;
             tosend.pad16 = -1;
             p4est_balance_schedule (p4est, peers, nt, 0,
-                                    &tosend, &insulq, &first_peer,
-                                    &last_peer);
+                                    &tosend, &insulq, schedule_changed,
+                                    &first_peer, &last_peer);
           }
         }
       }
@@ -1666,10 +3061,14 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   is_balance_verify = 0;
 #endif
   if (p4est->inspect != NULL) {
+    p4est_memory_record (p4est, P4EST_MEMORY_BALANCE,
+                         p4est_balance_memory (p4est, peers, borders));
     p4est->inspect->balance_A += sc_MPI_Wtime ();
     p4est->inspect->balance_comm = -sc_MPI_Wtime ();
     p4est->inspect->balance_comm_sent = 0;
     p4est->inspect->balance_comm_nzpeers = 0;
+    p4est->inspect->balance_comm_bytes = 0;
+    p4est->inspect->balance_comm_bytes_raw = 0;
     for (k = 0; k < 2; ++k) {
       p4est->inspect->balance_zero_sends[k] = 0;
       p4est->inspect->balance_zero_receives[k] = 0;
@@ -1677,6 +3076,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
     p4est->inspect->balance_ranges = 0.;
     p4est->inspect->balance_notify = 0.;
     p4est->inspect->balance_notify_allgather = 0.;
+    p4est->inspect->balance_overlap = 0.;
 #ifdef P4EST_ENABLE_MPI
     is_ranges_primary = p4est->inspect->use_balance_ranges;
     is_ranges_active = is_ranges_primary;
@@ -1967,7 +3367,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
 
     /* sort and send the actual quadrants and post receive for reply */
     if (qcount > 0) {
-      sc_array_sort (&peer->send_first, p4est_quadrant_compare_piggy);
+      p4est_quadrant_array_sort_piggy (&peer->send_first);
 
 #ifdef P4EST_ENABLE_DEBUG
       checksum = p4est_quadrant_checksum (&peer->send_first, &checkarray, 0);
@@ -1975,9 +3375,15 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
 #endif /* P4EST_ENABLE_DEBUG */
 
       total_send_count += qcount;
-      qbytes = qcount * sizeof (p4est_quadrant_t);
-      mpiret = MPI_Isend (peer->send_first.array, (int) qbytes, MPI_BYTE,
-                          j, P4EST_COMM_BALANCE_FIRST_LOAD,
+      p4est_balance_encode (&peer->send_first, 1, &peer->send_first_bytes);
+      qbytes = peer->send_first_bytes.elem_count;
+      if (p4est->inspect != NULL) {
+        p4est->inspect->balance_comm_bytes += qbytes;
+        p4est->inspect->balance_comm_bytes_raw +=
+          qcount * sizeof (p4est_quadrant_t);
+      }
+      mpiret = MPI_Isend (peer->send_first_bytes.array, (int) qbytes,
+                          MPI_BYTE, j, P4EST_COMM_BALANCE_FIRST_LOAD,
                           p4est->mpicomm, &send_requests_first_load[j]);
       SC_CHECK_MPI (mpiret);
       ++request_send_count;
@@ -2040,12 +3446,12 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
           P4EST_LDEBUGF ("Balance A recv %llu quadrants from %d\n",
                          (unsigned long long) qcount, j);
           P4EST_ASSERT (peer->recv_first.elem_count == 0);
-          sc_array_resize (&peer->recv_first, qcount);
           total_recv_count += qcount;
-          qbytes = qcount * sizeof (p4est_quadrant_t);
+          qbytes = qcount * P4EST_BALANCE_RECORD_BYTES;
+          sc_array_resize (&peer->recv_first_bytes, qbytes);
           P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
-          mpiret = MPI_Irecv (peer->recv_first.array, (int) qbytes, MPI_BYTE,
-                              j, P4EST_COMM_BALANCE_FIRST_LOAD,
+          mpiret = MPI_Irecv (peer->recv_first_bytes.array, (int) qbytes,
+                              MPI_BYTE, j, P4EST_COMM_BALANCE_FIRST_LOAD,
                               p4est->mpicomm, &requests_first[j]);
           SC_CHECK_MPI (mpiret);
           ++recv_load[0];
@@ -2064,17 +3470,20 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
         P4EST_ASSERT (peer->recv_first_count > 0);
         mpiret = MPI_Get_count (jstatus, MPI_BYTE, &rcount);
         SC_CHECK_MPI (mpiret);
-        SC_CHECK_ABORTF (rcount ==
-                         peer->recv_first_count *
-                         (int) sizeof (p4est_quadrant_t),
-                         "Receive load mismatch A %d %dx%llu", rcount,
-                         peer->recv_first_count,
-                         (unsigned long long) sizeof (p4est_quadrant_t));
+        SC_CHECK_ABORTF (rcount <= peer->recv_first_count *
+                         P4EST_BALANCE_RECORD_BYTES,
+                         "Receive load mismatch A %d %dx%d", rcount,
+                         peer->recv_first_count, P4EST_BALANCE_RECORD_BYTES);
 
         /* received load, close this request */
         peer->have_first_load = 1;
         P4EST_ASSERT (requests_first[j] == MPI_REQUEST_NULL);
         --request_first_count;
+        sc_array_resize (&peer->recv_first_bytes, (size_t) rcount);
+        p4est_balance_decode (&peer->recv_first_bytes,
+                              (size_t) peer->recv_first_count, 1,
+                              &peer->recv_first);
+        sc_array_reset (&peer->recv_first_bytes);
 
 #ifdef P4EST_ENABLE_DEBUG
         checksum =
@@ -2110,9 +3519,16 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
 #endif /* P4EST_ENABLE_DEBUG */
 
           total_send_count += qcount;
-          qbytes = qcount * sizeof (p4est_quadrant_t);
-          mpiret = MPI_Isend (peer->send_second.array, (int) qbytes, MPI_BYTE,
-                              j, P4EST_COMM_BALANCE_SECOND_LOAD,
+          p4est_balance_encode (&peer->send_second, 0,
+                                &peer->send_second_bytes);
+          qbytes = peer->send_second_bytes.elem_count;
+          if (p4est->inspect != NULL) {
+            p4est->inspect->balance_comm_bytes += qbytes;
+            p4est->inspect->balance_comm_bytes_raw +=
+              qcount * sizeof (p4est_quadrant_t);
+          }
+          mpiret = MPI_Isend (peer->send_second_bytes.array, (int) qbytes,
+                              MPI_BYTE, j, P4EST_COMM_BALANCE_SECOND_LOAD,
                               p4est->mpicomm, &send_requests_second_load[j]);
           SC_CHECK_MPI (mpiret);
           ++request_send_count;
@@ -2127,7 +3543,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
 
   /* simulate send and receive with myself across tree boundaries */
   peer = peers + rank;
-  sc_array_sort (&peer->send_first, p4est_quadrant_compare_piggy);
+  p4est_quadrant_array_sort_piggy (&peer->send_first);
   qcount = peer->send_first.elem_count;
   peer->recv_first_count = peer->send_first_count = (int) qcount;
   qbytes = qcount * sizeof (p4est_quadrant_t);
@@ -2177,11 +3593,11 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
           P4EST_LDEBUGF ("Balance B recv %llu quadrants from %d\n",
                          (unsigned long long) qcount, j);
           P4EST_ASSERT (peer->recv_second.elem_count == 0);
-          sc_array_resize (&peer->recv_second, qcount);
           total_recv_count += qcount;
-          qbytes = qcount * sizeof (p4est_quadrant_t);
+          qbytes = qcount * P4EST_BALANCE_RECORD_BYTES;
+          sc_array_resize (&peer->recv_second_bytes, qbytes);
           P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
-          mpiret = MPI_Irecv (peer->recv_second.array, (int) qbytes,
+          mpiret = MPI_Irecv (peer->recv_second_bytes.array, (int) qbytes,
                               MPI_BYTE, j, P4EST_COMM_BALANCE_SECOND_LOAD,
                               p4est->mpicomm, &requests_second[j]);
           SC_CHECK_MPI (mpiret);
@@ -2201,17 +3617,20 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
         P4EST_ASSERT (peer->recv_second_count > 0);
         mpiret = MPI_Get_count (jstatus, MPI_BYTE, &rcount);
         SC_CHECK_MPI (mpiret);
-        SC_CHECK_ABORTF (rcount ==
-                         peer->recv_second_count *
-                         (int) sizeof (p4est_quadrant_t),
-                         "Receive load mismatch B %d %dx%llu", rcount,
-                         peer->recv_second_count,
-                         (unsigned long long) sizeof (p4est_quadrant_t));
+        SC_CHECK_ABORTF (rcount <= peer->recv_second_count *
+                         P4EST_BALANCE_RECORD_BYTES,
+                         "Receive load mismatch B %d %dx%d", rcount,
+                         peer->recv_second_count, P4EST_BALANCE_RECORD_BYTES);
 
         /* received load, close this request */
         peer->have_second_load = 1;
         P4EST_ASSERT (requests_second[j] == MPI_REQUEST_NULL);
         --request_second_count;
+        sc_array_resize (&peer->recv_second_bytes, (size_t) rcount);
+        p4est_balance_decode (&peer->recv_second_bytes,
+                              (size_t) peer->recv_second_count, 0,
+                              &peer->recv_second);
+        sc_array_reset (&peer->recv_second_bytes);
 
 #ifdef P4EST_ENABLE_DEBUG
         checksum =
@@ -2290,6 +3709,7 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
         continue;
       }
       if (borders == NULL) {
+        p4est_cow_unshare_tree (p4est, qtree);
         tree = p4est_tree_array_index (p4est->trees, qtree);
         q = p4est_quadrant_array_push (&tree->quadrants);
         *q = *s;
@@ -2308,6 +3728,19 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   }
 
   /* rebalance and clamp result back to original tree boundaries */
+  if (num_threads > 0) {
+    /* the border regions of all trees are balanced at once */
+    sc_array_truncate (thread_trees);
+    for (nt = first_tree; nt <= last_tree; ++nt) {
+      if (!(tree_flags[nt] & fully_owned_flag) ||
+          (tree_flags[nt] & any_face_flag)) {
+        *(p4est_topidx_t *) sc_array_push (thread_trees) = nt;
+      }
+    }
+    p4est_balance_borders (p4est, btype, thread_trees, init_fn, replace_fn,
+                           borders, num_threads);
+  }
+  sc_array_destroy (thread_trees);
   p4est->local_num_quadrants = 0;
   for (nt = first_tree; nt <= last_tree; ++nt) {
     /* check if we are the only processor in an isolated tree */
@@ -2319,7 +3752,10 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
         (tree_flags[nt] & any_face_flag)) {
       /* we have most probably received quadrants, run sort and balance */
       /* balance the border, add it back into the tree, and linearize */
-      p4est_balance_border (p4est, btype, nt, init_fn, replace_fn, borders);
+      if (num_threads <= 0) {
+        p4est_balance_border (p4est, btype, nt, init_fn, replace_fn,
+                              borders);
+      }
       P4EST_VERBOSEF ("Balance tree %lld B %llu to %llu\n",
                       (long long) nt,
                       (unsigned long long) treecount,
@@ -2374,6 +3810,10 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   }
 
   /* cleanup temporary storage */
+  if (p4est->inspect != NULL) {
+    p4est_memory_record (p4est, P4EST_MEMORY_BALANCE,
+                         p4est_balance_memory (p4est, peers, borders));
+  }
   P4EST_FREE (tree_flags);
   for (j = 0; j < num_procs; ++j) {
     peer = peers + j;
@@ -2381,6 +3821,10 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
     sc_array_reset (&peer->send_second);
     sc_array_reset (&peer->recv_first);
     sc_array_reset (&peer->recv_second);
+    sc_array_reset (&peer->send_first_bytes);
+    sc_array_reset (&peer->send_second_bytes);
+    sc_array_reset (&peer->recv_first_bytes);
+    sc_array_reset (&peer->recv_second_bytes);
   }
   P4EST_FREE (peers);
 
@@ -2416,19 +3860,175 @@ p4est_balance_ext (p4est_t * p4est, p4est_connect_type_t btype,
   /* some sanity checks */
   P4EST_ASSERT ((p4est_locidx_t) all_outcount == p4est->local_num_quadrants);
   P4EST_ASSERT (all_outcount >= all_incount);
-  if (p4est->user_data_pool != NULL) {
+  if (p4est->user_data_pool != NULL && p4est->cow == NULL) {
     P4EST_ASSERT (data_pool_size + all_outcount - all_incount ==
                   p4est->user_data_pool->elem_count);
   }
   P4EST_ASSERT (p4est_is_valid (p4est));
   P4EST_ASSERT (p4est_is_balanced (p4est, btype));
   P4EST_VERBOSEF ("Balance skipped %lld\n", (long long) skipped);
+
+  /* the forest is balanced and all trees are unchanged from here on */
+  P4EST_FREE (peer_changed);
+  for (nt = first_tree; nt <= last_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    tree->changed = 0;
+    tree->unbalanced = 0;
+  }
+  p4est->balance_type = (int) btype;
+  p4est->balance_revision = p4est->revision;
+  p4est_fields_remap (p4est);
+  if (p4est->inspect != NULL) {
+    /* the result of balance is the forest itself */
+    p4est_memory_record (p4est, P4EST_MEMORY_BALANCE,
+                         p4est_memory_used (p4est));
+  }
+  p4est_compact_resume (p4est, recompact);
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
                             "_balance with %lld total quadrants\n",
                             (long long) p4est->global_num_quadrants);
 }
 
+#ifdef P4EST_ENABLE_MPI
+
+/** Find the groups of consecutive processes that share a compute node.
+ * \param [in] p4est       The forest whose communicator is examined.
+ * \param [out] node_first Allocated array of the first process of each
+ *                         group and one beyond, to be freed by the caller.
+ * \return                 The number of groups.
+ */
+static int
+p4est_partition_node_groups (p4est_t * p4est, int **node_first)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 i, num_nodes;
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  int                 mpiret, leader;
+  int                *leaders;
+  MPI_Comm            nodecomm;
+#endif
+
+  *node_first = P4EST_ALLOC (int, num_procs + 1);
+#ifdef P4EST_ENABLE_MPICOMMSHARED
+  /* identify each node by its lowest rank */
+  mpiret = MPI_Comm_split_type (p4est->mpicomm, MPI_COMM_TYPE_SHARED,
+                                p4est->mpirank, MPI_INFO_NULL, &nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Allreduce (&p4est->mpirank, &leader, 1, MPI_INT, MPI_MIN,
+                          nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_free (&nodecomm);
+  SC_CHECK_MPI (mpiret);
+  leaders = P4EST_ALLOC (int, num_procs);
+  mpiret = MPI_Allgather (&leader, 1, MPI_INT, leaders, 1, MPI_INT,
+                          p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  /* a group ends wherever the node changes along the ranks */
+  num_nodes = 0;
+  for (i = 0; i < num_procs; ++i) {
+    if (i == 0 || leaders[i] != leaders[i - 1]) {
+      (*node_first)[num_nodes++] = i;
+    }
+  }
+  P4EST_FREE (leaders);
+#else
+  /* without shared communicators every process is its own node */
+  for (i = 0; i < num_procs; ++i) {
+    (*node_first)[i] = i;
+  }
+  num_nodes = num_procs;
+#endif
+  (*node_first)[num_nodes] = num_procs;
+
+  return num_nodes;
+}
+
+/** Compute the cumulative load at the cuts of a partition with hysteresis.
+ * The current group boundaries are kept if no group exceeds its share of
+ * the load by more than the tolerance, and the load of each group is split
+ * evenly between its processes.  Otherwise the result is the flat split.
+ * \param [in] num_procs  The number of processes.
+ * \param [in] num_nodes  The number of node groups.
+ * \param [in] node_first First process of each group and one beyond.
+ * \param [in] load_sums  Current cumulative load, \a num_procs + 1 entries.
+ * \param [in] tolerance  Relative excess load allowed for any group.
+ * \param [out] cuts      Designated cumulative load, \a num_procs + 1.
+ * \return                True if the group boundaries have been kept.
+ */
+static int
+p4est_partition_node_cuts (int num_procs, int num_nodes,
+                           const int *node_first, const int64_t * load_sums,
+                           double tolerance, int64_t * cuts)
+{
+  int                 i, k, n;
+  int                 keep;
+  int64_t             low, high;
+  const int64_t       total = load_sums[num_procs];
+
+  keep = 1;
+  for (k = 0; k < num_nodes; ++k) {
+    n = node_first[k + 1] - node_first[k];
+    if ((double) (load_sums[node_first[k + 1]] - load_sums[node_first[k]]) >
+        (1. + tolerance) * (double) total * n / num_procs) {
+      keep = 0;
+      break;
+    }
+  }
+
+  for (k = 0; k < num_nodes; ++k) {
+    n = node_first[k + 1] - node_first[k];
+    if (keep) {
+      low = load_sums[node_first[k]];
+      high = load_sums[node_first[k + 1]];
+    }
+    else {
+      low = (int64_t) p4est_partition_cut_uint64 (total, node_first[k],
+                                                  num_procs);
+      high = (int64_t) p4est_partition_cut_uint64 (total, node_first[k + 1],
+                                                   num_procs);
+    }
+    for (i = 0; i < n; ++i) {
+      cuts[node_first[k] + i] =
+        low + (int64_t) p4est_partition_cut_uint64 (high - low, i, n);
+    }
+  }
+  cuts[num_procs] = total;
+
+  return keep;
+}
+
+/** Return the ratio of maximum to average load over groups of processes.
+ * \param [in] num_procs   The number of processes.
+ * \param [in] num_groups  The number of groups.
+ * \param [in] group_first First process of each group and one beyond,
+ *                         or NULL if every process forms its own group.
+ * \param [in] cuts        Cumulative load, \a num_procs + 1 entries.
+ */
+static double
+p4est_partition_imbalance (int num_procs, int num_groups,
+                           const int *group_first, const int64_t * cuts)
+{
+  int                 k, first, last;
+  double              share, ratio;
+
+  ratio = 1.;
+  if (cuts[num_procs] == 0) {
+    return ratio;
+  }
+  for (k = 0; k < num_groups; ++k) {
+    first = group_first == NULL ? k : group_first[k];
+    last = group_first == NULL ? k + 1 : group_first[k + 1];
+    share = (double) cuts[num_procs] * (last - first) / num_procs;
+    ratio = SC_MAX (ratio, (double) (cuts[last] - cuts[first]) / share);
+  }
+
+  return ratio;
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
 void
 p4est_partition (p4est_t * p4est, int allow_for_coarsening,
                  p4est_weight_t weight_fn)
@@ -2440,9 +4040,48 @@ p4est_gloidx_t
 p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
                      p4est_weight_t weight_fn)
 {
-  p4est_gloidx_t      global_shipped = 0;
-  const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
+  int                 recompact;
+  p4est_gloidx_t      global_shipped;
+
+  recompact = p4est_compact_suspend (p4est);
+  global_shipped = p4est_partition_end
+    (p4est_partition_begin (p4est, partition_for_coarsening, weight_fn));
+  p4est_compact_resume (p4est, recompact);
+
+  return global_shipped;
+}
+
+p4est_partition_context_t *
+p4est_partition_begin (p4est_t * p4est, int partition_for_coarsening,
+                       p4est_weight_t weight_fn)
+{
+  return p4est_partition_payload_begin (p4est, partition_for_coarsening,
+                                        weight_fn, NULL, NULL, NULL, NULL);
+}
+
+p4est_gloidx_t
+p4est_partition_payload (p4est_t * p4est, int partition_for_coarsening,
+                         p4est_weight_t weight_fn, const int *src_sizes,
+                         const void *const *src_payloads,
+                         sc_array_t * dest_sizes, sc_array_t * dest_data)
+{
+  return p4est_partition_end
+    (p4est_partition_payload_begin (p4est, partition_for_coarsening,
+                                    weight_fn, src_sizes, src_payloads,
+                                    dest_sizes, dest_data));
+}
+
+p4est_partition_context_t *
+p4est_partition_payload_begin (p4est_t * p4est, int partition_for_coarsening,
+                               p4est_weight_t weight_fn,
+                               const int *src_sizes,
+                               const void *const *src_payloads,
+                               sc_array_t * dest_sizes,
+                               sc_array_t * dest_data)
+{
+  p4est_partition_context_t *pc;
 #ifdef P4EST_ENABLE_MPI
+  const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
   int                 mpiret;
   int                 low_source, high_source;
   const int           num_procs = p4est->mpisize;
@@ -2463,6 +4102,8 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
   p4est_gloidx_t     *send_array;
   int64_t             weight, weight_sum;
   int64_t             cut, my_lowcut, my_highcut;
+  int64_t            *cuts;             /* designated cumulative load */
+  int                 use_nodes, keep_nodes, num_nodes, *node_first;
   int64_t            *local_weights;    /* cumulative weights by quadrant */
   int64_t            *global_weight_sums;
   p4est_quadrant_t   *q;
@@ -2472,6 +4113,9 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
   p4est_gloidx_t      num_corrected;
 #endif /* P4EST_ENABLE_MPI */
 
+  SC_CHECK_ABORT (p4est->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+
   P4EST_ASSERT (p4est_is_valid (p4est));
   P4EST_GLOBAL_PRODUCTIONF
     ("Into " P4EST_STRING
@@ -2480,11 +4124,16 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
 
   /* this function does nothing in a serial setup */
   if (p4est->mpisize == 1) {
+    if (p4est->inspect != NULL) {
+      p4est->inspect->partition_node_imbalance = 1.;
+      p4est->inspect->partition_rank_imbalance = 1.;
+    }
     P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_partition no shipping\n");
 
     /* in particular, there is no need to bumb the revision counter */
-    P4EST_ASSERT (global_shipped == 0);
-    return global_shipped;
+    return p4est_partition_given_payload_begin (p4est, NULL, src_sizes,
+                                                src_payloads, dest_sizes,
+                                                dest_data);
   }
 
   p4est_log_indent_push ();
@@ -2492,13 +4141,41 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
 #ifdef P4EST_ENABLE_MPI
   /* allocate new quadrant distribution counts */
   num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
+  cuts = P4EST_ALLOC (int64_t, num_procs + 1);
+
+  /* find the compute nodes for the partition hysteresis */
+  use_nodes = p4est->inspect != NULL &&
+    p4est->inspect->use_partition_node_hysteresis;
+  keep_nodes = 0;
+  num_nodes = num_procs;
+  node_first = NULL;
+  if (use_nodes) {
+    num_nodes = p4est_partition_node_groups (p4est, &node_first);
+  }
 
   if (weight_fn == NULL) {
-    /* Divide up the quadrants equally */
+    if (use_nodes) {
+      /* split the quadrants between nodes and then within each */
+      global_weight_sums = P4EST_ALLOC (int64_t, num_procs + 1);
+      for (p = 0; p <= num_procs; ++p) {
+        global_weight_sums[p] = (int64_t) p4est->global_first_quadrant[p];
+      }
+      keep_nodes = p4est_partition_node_cuts (num_procs, num_nodes,
+                                              node_first, global_weight_sums,
+                                              p4est->inspect->
+                                              partition_node_hysteresis, cuts);
+      P4EST_FREE (global_weight_sums);
+    }
+    else {
+      /* Divide up the quadrants equally */
+      for (p = 0; p <= num_procs; ++p) {
+        cuts[p] = (int64_t)
+          p4est_partition_cut_gloidx (global_num_quadrants, p, num_procs);
+      }
+    }
     for (p = 0, next_quadrant = 0; p < num_procs; ++p) {
       prev_quadrant = next_quadrant;
-      next_quadrant =
-        p4est_partition_cut_gloidx (global_num_quadrants, p + 1, num_procs);
+      next_quadrant = (p4est_gloidx_t) cuts[p + 1];
       qcount = next_quadrant - prev_quadrant;
       P4EST_ASSERT (0 <= qcount
                     && qcount <= (p4est_gloidx_t) P4EST_LOCIDX_MAX);
@@ -2562,20 +4239,37 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
       P4EST_FREE (local_weights);
       P4EST_FREE (global_weight_sums);
       P4EST_FREE (num_quadrants_in_proc);
+      P4EST_FREE (cuts);
+      P4EST_FREE (node_first);
       p4est_log_indent_pop ();
       P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
                                "_partition no shipping\n");
 
       /* in particular, there is no need to bumb the revision counter */
-      P4EST_ASSERT (global_shipped == 0);
-      return global_shipped;
+      return p4est_partition_given_payload_begin (p4est, NULL, src_sizes,
+                                                  src_payloads, dest_sizes,
+                                                  dest_data);
+    }
+
+    /* determine the weight at the cut of every processor */
+    if (use_nodes) {
+      keep_nodes = p4est_partition_node_cuts (num_procs, num_nodes,
+                                              node_first, global_weight_sums,
+                                              p4est->inspect->
+                                              partition_node_hysteresis, cuts);
+    }
+    else {
+      for (i = 0; i <= num_procs; ++i) {
+        cuts[i] = (int64_t)
+          p4est_partition_cut_uint64 (weight_sum, i, num_procs);
+      }
     }
 
     /* determine processor ids to send to */
     send_lowest = num_procs;
     send_highest = 0;
     for (i = 1; i <= num_procs; ++i) {
-      cut = p4est_partition_cut_uint64 (weight_sum, i, num_procs);
+      cut = cuts[i];
       if (global_weight_sums[rank] < cut &&
           cut <= global_weight_sums[rank + 1]) {
         send_lowest = SC_MIN (send_lowest, i);
@@ -2602,9 +4296,7 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
         base_index = 2 * (i - send_lowest);
         if (i < num_procs) {
           /* do binary search in the weight array */
-          lowers = sc_search_lower_bound64 (p4est_partition_cut_uint64
-                                            (weight_sum, i, num_procs),
-                                            local_weights,
+          lowers = sc_search_lower_bound64 (cuts[i], local_weights,
                                             (size_t) local_num_quadrants + 1,
                                             (size_t) lowers);
           P4EST_ASSERT (lowers > 0
@@ -2643,7 +4335,7 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
 
     /* determine processor ids to receive from and post irecv */
     i = 0;
-    my_lowcut = p4est_partition_cut_uint64 (weight_sum, rank, num_procs);
+    my_lowcut = cuts[rank];
     if (my_lowcut == 0) {
       recv_low = 0;
       recv_requests[0] = MPI_REQUEST_NULL;
@@ -2664,7 +4356,7 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
       P4EST_ASSERT (i < num_procs);
       low_source = i;
     }
-    my_highcut = p4est_partition_cut_uint64 (weight_sum, rank + 1, num_procs);
+    my_highcut = cuts[rank + 1];
     if (my_highcut == 0) {
       recv_high = 0;
       recv_requests[1] = MPI_REQUEST_NULL;
@@ -2759,6 +4451,377 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
 #endif
   }
 
+  /* report the balance of load between nodes and processes */
+  if (p4est->inspect != NULL) {
+    p4est->inspect->partition_node_imbalance =
+      p4est_partition_imbalance (num_procs, num_nodes, node_first, cuts);
+    p4est->inspect->partition_rank_imbalance =
+      p4est_partition_imbalance (num_procs, num_procs, NULL, cuts);
+  }
+  if (use_nodes) {
+    P4EST_GLOBAL_INFOF ("Partition across %d nodes %s their boundaries\n",
+                        num_nodes, keep_nodes ? "keeping" : "moving");
+  }
+  P4EST_FREE (cuts);
+  P4EST_FREE (node_first);
+
+  /* correct partition */
+  if (partition_for_coarsening) {
+    num_corrected =
+      p4est_partition_for_coarsening (p4est, num_quadrants_in_proc);
+    P4EST_GLOBAL_INFOF
+      ("Designated partition for coarsening %lld quadrants moved\n",
+       (long long) num_corrected);
+  }
+
+  /* post the messages of the partition algorithm with proper counts */
+  pc = p4est_partition_given_payload_begin (p4est, num_quadrants_in_proc,
+                                            src_sizes, src_payloads,
+                                            dest_sizes, dest_data);
+  P4EST_FREE (num_quadrants_in_proc);
+#else
+  pc = p4est_partition_given_payload_begin (p4est, NULL, src_sizes,
+                                            src_payloads, dest_sizes,
+                                            dest_data);
+#endif /* P4EST_ENABLE_MPI */
+
+  p4est_log_indent_pop ();
+  return pc;
+}
+
+p4est_gloidx_t
+p4est_partition_end (p4est_partition_context_t * pc)
+{
+  const int           pending = pc->pending;
+  p4est_t            *p4est = pc->p4est;
+  p4est_gloidx_t      global_shipped;
+
+  global_shipped = p4est_partition_given_end (pc);
+  if (!pending) {
+    /* the begin call has decided to keep the partition */
+    P4EST_ASSERT (global_shipped == 0);
+    return global_shipped;
+  }
+  if (global_shipped) {
+    /* the partition of the forest has changed somewhere */
+    ++p4est->revision;
+  }
+
+  /* check validity of the p4est */
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Done " P4EST_STRING "_partition shipped %lld quadrants %.3g%%\n",
+     (long long) global_shipped,
+     global_shipped * 100. / p4est->global_num_quadrants);
+
+  return global_shipped;
+}
+
+#ifdef P4EST_ENABLE_MPI
+
+/** Sum the weights of all constraints, each normalized by its even share.
+ * Constraints with zero share are ignored.
+ */
+static double
+p4est_partition_multi_normalized (const int64_t * sums, const double *share,
+                                  int num_constraints)
+{
+  int                 c;
+  double              normalized = 0.;
+
+  for (c = 0; c < num_constraints; ++c) {
+    if (share[c] > 0.) {
+      normalized += (double) sums[c] / share[c];
+    }
+  }
+  return normalized;
+}
+
+/** Compute how far the cumulative weights at a cut lead the even shares.
+ * \param [in] sums       Cumulative weight of every constraint at the cut.
+ * \param [in] share      Even share of every constraint.
+ * \param [in] num_constraints  The number of constraints.
+ * \param [in] cut        The number of the cut between 1 and mpisize - 1.
+ * \param [out] behind    Largest lag of any constraint in units of its share.
+ * \return                Largest lead of any constraint in units of its share.
+ */
+static double
+p4est_partition_multi_ahead (const int64_t * sums, const double *share,
+                             int num_constraints, int cut, double *behind)
+{
+  int                 c;
+  double              dev, ahead;
+
+  ahead = *behind = 0.;
+  for (c = 0; c < num_constraints; ++c) {
+    if (share[c] > 0.) {
+      dev = (double) sums[c] / share[c] - cut;
+      ahead = SC_MAX (ahead, dev);
+      *behind = SC_MAX (*behind, -dev);
+    }
+  }
+  return ahead;
+}
+
+/** Find the local cut that balances all constraints best.
+ * The cut of the summed normalized weights is taken if no constraint
+ * deviates from its share by more than the tolerance.  Otherwise the cut
+ * minimizes the largest deviation; since the lead of the constraints grows
+ * and their lag shrinks along the curve, a bisection finds it.
+ * \param [in] local_sums Cumulative weights by local quadrant and constraint.
+ * \param [in] num_quadrants  The number of local quadrants.
+ * \param [in] share      Even share of every constraint.
+ * \param [in] num_constraints  The number of constraints.
+ * \param [in] cut        The number of the cut between 1 and mpisize - 1.
+ * \param [in] target     Summed normalized weight at the cut.
+ * \param [in] tolerance  Deviation accepted without searching further.
+ * \return                The local quadrant index of the cut.
+ */
+static p4est_locidx_t
+p4est_partition_multi_cut (const int64_t * local_sums,
+                           p4est_locidx_t num_quadrants, const double *share,
+                           int num_constraints, int cut, double target,
+                           double tolerance)
+{
+  p4est_locidx_t      low, high, mid;
+  double              ahead, behind, ahead2, behind2;
+
+  /* find the cut of the summed normalized weights */
+  low = 0;
+  high = num_quadrants;
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    if (p4est_partition_multi_normalized
+        (local_sums + (size_t) mid * num_constraints, share,
+         num_constraints) < target) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
+    }
+  }
+  ahead = p4est_partition_multi_ahead
+    (local_sums + (size_t) low * num_constraints, share, num_constraints,
+     cut, &behind);
+  if (ahead <= tolerance && behind <= tolerance) {
+    return low;
+  }
+
+  /* find the first cut where the lead is no smaller than the lag */
+  low = 0;
+  high = num_quadrants;
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    ahead = p4est_partition_multi_ahead
+      (local_sums + (size_t) mid * num_constraints, share, num_constraints,
+       cut, &behind);
+    if (ahead < behind) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
+    }
+  }
+
+  /* the best cut is there or just before */
+  if (low > 0) {
+    ahead = p4est_partition_multi_ahead
+      (local_sums + (size_t) low * num_constraints, share, num_constraints,
+       cut, &behind);
+    ahead2 = p4est_partition_multi_ahead
+      (local_sums + (size_t) (low - 1) * num_constraints, share,
+       num_constraints, cut, &behind2);
+    if (SC_MAX (ahead2, behind2) < SC_MAX (ahead, behind)) {
+      --low;
+    }
+  }
+  return low;
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
+p4est_gloidx_t
+p4est_partition_multi (p4est_t * p4est, int partition_for_coarsening,
+                       int num_constraints, p4est_weights_t weights_fn,
+                       double tolerance, double *imbalance)
+{
+  p4est_gloidx_t      global_shipped = 0;
+  const p4est_gloidx_t global_num_quadrants = p4est->global_num_quadrants;
+  int                 c;
+#ifdef P4EST_ENABLE_MPI
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const int           nc = num_constraints;
+  const p4est_locidx_t local_num_quadrants = p4est->local_num_quadrants;
+  int                 mpiret;
+  int                 i, p;
+  int                *weights;
+  size_t              lz, stride;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      kl;
+  p4est_locidx_t     *num_quadrants_in_proc;
+  p4est_gloidx_t      qcount;
+  p4est_gloidx_t      num_corrected;
+  int64_t            *local_sums;       /* cumulative weights by quadrant */
+  int64_t            *global_sums;      /* cumulative weights by process */
+  int64_t            *cut_sums;         /* quadrant index and weights by cut */
+  double             *share;            /* even share of every constraint */
+  double              low_sum, high_sum, total_sum;
+  double              target, ratio;
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+#endif /* P4EST_ENABLE_MPI */
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (num_constraints > 0);
+  P4EST_ASSERT (weights_fn != NULL);
+  P4EST_ASSERT (tolerance >= 0.);
+  P4EST_GLOBAL_PRODUCTIONF
+    ("Into " P4EST_STRING
+     "_partition_multi with %d constraints %lld total quadrants\n",
+     num_constraints, (long long) global_num_quadrants);
+
+  if (imbalance != NULL) {
+    for (c = 0; c < num_constraints; ++c) {
+      imbalance[c] = 1.;
+    }
+  }
+
+  /* this function does nothing in a serial setup */
+  if (p4est->mpisize == 1) {
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_multi no shipping\n");
+
+    /* in particular, there is no need to bumb the revision counter */
+    return global_shipped;
+  }
+
+  p4est_log_indent_push ();
+
+#ifdef P4EST_ENABLE_MPI
+  /* sum the weights of every constraint along the local quadrants */
+  weights = P4EST_ALLOC (int, nc);
+  local_sums = P4EST_ALLOC (int64_t, (size_t) nc * (local_num_quadrants + 1));
+  for (c = 0; c < nc; ++c) {
+    local_sums[c] = 0;
+  }
+  kl = 0;
+  for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+    tree = p4est_tree_array_index (p4est->trees, nt);
+    for (lz = 0; lz < tree->quadrants.elem_count; ++lz, ++kl) {
+      q = p4est_quadrant_array_index (&tree->quadrants, lz);
+      weights_fn (p4est, nt, q, weights);
+      for (c = 0; c < nc; ++c) {
+        P4EST_ASSERT (weights[c] >= 0);
+        local_sums[(size_t) (kl + 1) * nc + c] =
+          local_sums[(size_t) kl * nc + c] + (int64_t) weights[c];
+      }
+    }
+  }
+  P4EST_ASSERT (kl == local_num_quadrants);
+  P4EST_FREE (weights);
+
+  /* distribute the local sums and accumulate them over processes */
+  global_sums = P4EST_ALLOC (int64_t, (size_t) nc * (num_procs + 1));
+  mpiret = MPI_Allgather (local_sums + (size_t) nc * local_num_quadrants,
+                          nc, MPI_LONG_LONG_INT, global_sums + nc, nc,
+                          MPI_LONG_LONG_INT, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  for (c = 0; c < nc; ++c) {
+    global_sums[c] = 0;
+  }
+  for (p = 0; p < num_procs; ++p) {
+    for (c = 0; c < nc; ++c) {
+      global_sums[(size_t) (p + 1) * nc + c] += global_sums[(size_t) p * nc + c];
+    }
+  }
+  for (kl = 0; kl <= local_num_quadrants; ++kl) {
+    for (c = 0; c < nc; ++c) {
+      local_sums[(size_t) kl * nc + c] += global_sums[(size_t) rank * nc + c];
+    }
+  }
+
+  /* every constraint is measured in units of its even share */
+  share = P4EST_ALLOC (double, nc);
+  for (c = 0; c < nc; ++c) {
+    share[c] = (double) global_sums[(size_t) num_procs * nc + c] / num_procs;
+    P4EST_GLOBAL_VERBOSEF ("Constraint %d global weight sum %lld\n", c,
+                           (long long) global_sums[(size_t) num_procs * nc +
+                                                   c]);
+  }
+  total_sum = p4est_partition_multi_normalized
+    (global_sums + (size_t) num_procs * nc, share, nc);
+
+  /* if all quadrants have zero weight we do nothing */
+  if (total_sum == 0.) {
+    P4EST_FREE (local_sums);
+    P4EST_FREE (global_sums);
+    P4EST_FREE (share);
+    p4est_log_indent_pop ();
+    P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING
+                             "_partition_multi no shipping\n");
+
+    /* in particular, there is no need to bumb the revision counter */
+    P4EST_ASSERT (global_shipped == 0);
+    return global_shipped;
+  }
+
+  /* place the cuts whose summed normalized weight falls on this process */
+  stride = (size_t) nc + 1;
+  cut_sums = P4EST_ALLOC_ZERO (int64_t, stride * (num_procs + 1));
+  low_sum = p4est_partition_multi_normalized
+    (global_sums + (size_t) rank * nc, share, nc);
+  high_sum = p4est_partition_multi_normalized
+    (global_sums + (size_t) (rank + 1) * nc, share, nc);
+  for (i = 1; i < num_procs; ++i) {
+    target = total_sum * i / num_procs;
+    if (low_sum < target && target <= high_sum) {
+      kl = p4est_partition_multi_cut (local_sums, local_num_quadrants,
+                                      share, nc, i, target, tolerance);
+      cut_sums[i * stride] = p4est->global_first_quadrant[rank] + kl;
+      for (c = 0; c < nc; ++c) {
+        cut_sums[i * stride + 1 + c] = local_sums[(size_t) kl * nc + c];
+      }
+    }
+  }
+  P4EST_FREE (local_sums);
+
+  /* every cut has been placed by exactly one process */
+  mpiret = MPI_Allreduce (MPI_IN_PLACE, cut_sums,
+                          (int) (stride * (num_procs + 1)),
+                          MPI_LONG_LONG_INT, MPI_SUM, p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  cut_sums[num_procs * stride] = global_num_quadrants;
+  for (c = 0; c < nc; ++c) {
+    cut_sums[num_procs * stride + 1 + c] =
+      global_sums[(size_t) num_procs * nc + c];
+  }
+  P4EST_FREE (global_sums);
+
+  /* derive the quadrant counts and the balance of every constraint */
+  num_quadrants_in_proc = P4EST_ALLOC (p4est_locidx_t, num_procs);
+  for (p = 0; p < num_procs; ++p) {
+    qcount = cut_sums[(p + 1) * stride] - cut_sums[p * stride];
+    P4EST_ASSERT (0 <= qcount
+                  && qcount <= (p4est_gloidx_t) P4EST_LOCIDX_MAX);
+    num_quadrants_in_proc[p] = (p4est_locidx_t) qcount;
+  }
+  for (c = 0; c < nc; ++c) {
+    ratio = 1.;
+    if (share[c] > 0.) {
+      for (p = 0; p < num_procs; ++p) {
+        ratio = SC_MAX (ratio, (cut_sums[(p + 1) * stride + 1 + c] -
+                                cut_sums[p * stride + 1 + c]) / share[c]);
+      }
+    }
+    P4EST_GLOBAL_INFOF ("Constraint %d imbalance %g\n", c, ratio);
+    if (imbalance != NULL) {
+      imbalance[c] = ratio;
+    }
+  }
+  P4EST_FREE (cut_sums);
+  P4EST_FREE (share);
+
   /* correct partition */
   if (partition_for_coarsening) {
     num_corrected =
@@ -2782,7 +4845,7 @@ p4est_partition_ext (p4est_t * p4est, int partition_for_coarsening,
 
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTIONF
-    ("Done " P4EST_STRING "_partition shipped %lld quadrants %.3g%%\n",
+    ("Done " P4EST_STRING "_partition_multi shipped %lld quadrants %.3g%%\n",
      (long long) global_shipped,
      global_shipped * 100. / global_num_quadrants);
 
@@ -3490,6 +5553,9 @@ p4est_save_ext (const char *filename, p4est_t * p4est,
   p4est_qcoord_t     *qpos;
   sc_array_t         *tquadrants;
 
+  SC_CHECK_ABORT (p4est->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_save %s\n", filename);
   p4est_log_indent_push ();
 
@@ -122,6 +122,14 @@ typedef struct p4est_tree
   p4est_locidx_t      quadrants_per_level[P4EST_MAXLEVEL + 1];
                                              /**< locals only */
   int8_t              maxlevel;              /**< highest local quadrant level */
+  int8_t              changed;               /**< nonzero if modified since the
+                                                  last balance, see
+                                                  p4est_t::balance_type */
+  int8_t              unbalanced;            /**< nonzero if refinement or
+                                                  coarsening since the last
+                                                  balance may have created a
+                                                  level jump of more than one
+                                                  in or next to this tree */
 }
 p4est_tree_t;
 
@@ -131,6 +139,26 @@ p4est_tree_t;
  */
 typedef struct p4est_inspect p4est_inspect_t;
 
+/** Storage of the partition arrays shared by the processes of a node.
+ * Declared in p4est_communication.h, see \ref p4est_comm_partition_share.
+ */
+typedef struct p4est_partition_shared p4est_partition_shared_t;
+
+/** Storage shared between copies made by p4est_copy_cow.
+ * Declared in p4est_algorithms.h.
+ */
+typedef struct p4est_cow p4est_cow_t;
+
+/** Per-quadrant data stored in contiguous arrays, one for each field.
+ * Declared in p4est_fields.h.
+ */
+typedef struct p4est_fields p4est_fields_t;
+
+/** Compact storage of the local quadrants made by p4est_compact.
+ * Declared in p4est_algorithms.h.
+ */
+typedef struct p4est_compact p4est_compact_t;
+
 /** The p4est forest datatype */
 typedef struct p4est
 {
@@ -169,6 +197,28 @@ typedef struct p4est
   sc_mempool_t       *quadrant_pool;  /**< memory allocator for temporary
                                            quadrants */
   p4est_inspect_t    *inspect;        /**< algorithmic switches */
+  int                 balance_type;     /**< connect type of the last
+                                             balance, 0 if unknown */
+  long                balance_revision; /**< revision at which the changed
+                                             flags of the trees are
+                                             complete; the forest is known
+                                             to be balanced up to the
+                                             changed trees if it equals
+                                             the revision */
+  p4est_partition_shared_t *partition_shared; /**< if not NULL,
+                                             global_first_quadrant and
+                                             global_first_position are
+                                             stored once per node */
+  p4est_cow_t       *cow;             /**< if not NULL, trees may share
+                                             storage with copies, see
+                                             p4est_copy_cow */
+  p4est_fields_t    *fields;          /**< if not NULL, field data that
+                                             follows the quadrants, see
+                                             p4est_fields_new */
+  p4est_compact_t   *compact;         /**< if not NULL, the local
+                                             quadrants are stored here
+                                             instead of in the trees, see
+                                             p4est_compact */
 }
 p4est_t;
 
@@ -287,7 +337,7 @@ void                p4est_destroy (p4est_t * p4est);
  * The connectivity is not duplicated.
  * Copying of quadrant user data is optional.
  * If old and new data sizes are 0, the user_data field is copied regardless.
- * The inspect member of the copy is set to NULL.
+ * The inspect and fields members of the copy are set to NULL.
  * The revision counter of the copy is set to zero.
  *
  * \param [in]  copy_data  If true, data are copied.
@@ -322,7 +372,8 @@ void                p4est_reset_data (p4est_t * p4est, size_t data_size,
  *                       shall be refined.  If refine_recursive is true,
  *                       refine_fn is called for every existing and newly
  *                       created quadrant.  Otherwise, it is called for every
- *                       existing quadrant.  It is possible that a refinement
+ *                       existing quadrant before any quadrant is created.
+ *                       It is possible that a refinement
  *                       request made by the callback is ignored.  To catch
  *                       this case, you can examine whether init_fn gets
  *                       called, or use p4est_refine_ext in p4est_extended.h
@@ -26,12 +26,14 @@
 #include <p8est_algorithms.h>
 #include <p8est_bits.h>
 #include <p8est_communication.h>
+#include <p8est_fields.h>
 #include <p8est_search.h>
 #include <p8est_balance.h>
 #else
 #include <p4est_algorithms.h>
 #include <p4est_bits.h>
 #include <p4est_communication.h>
+#include <p4est_fields.h>
 #include <p4est_search.h>
 #include <p4est_balance.h>
 #endif /* !P4_TO_P8 */
@@ -43,6 +45,9 @@
 #ifdef P4EST_HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
+#ifdef P4EST_ENABLE_OPENMP
+#include <omp.h>
+#endif
 
 #ifndef P4_TO_P8
 
@@ -82,7 +87,11 @@ p4est_quadrant_init_data (p4est_t * p4est, p4est_topidx_t which_tree,
 {
   P4EST_ASSERT (p4est_quadrant_is_extended (quad));
 
+  /* the threaded refinement and balance share the data pool */
   if (p4est->data_size > 0) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_user_data_pool)
+#endif
     quad->p.user_data = sc_mempool_alloc (p4est->user_data_pool);
   }
   else {
@@ -99,6 +108,9 @@ p4est_quadrant_free_data (p4est_t * p4est, p4est_quadrant_t * quad)
   P4EST_ASSERT (p4est_quadrant_is_extended (quad));
 
   if (p4est->data_size > 0) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_user_data_pool)
+#endif
     sc_mempool_free (p4est->user_data_pool, quad->p.user_data);
   }
   quad->p.user_data = NULL;
@@ -521,6 +533,13 @@ p4est_is_valid (p4est_t * p4est)
     goto failtest;
   }
 
+  /* the tree storage is only accessible after p4est_expand */
+  if (p4est->compact != NULL) {
+    P4EST_NOTICE ("p4est is in compact storage\n");
+    failed = 1;
+    goto failtest;
+  }
+
   /* check last item of global partition */
   if (!(p4est->global_first_position[num_procs].p.which_tree ==
         p4est->connectivity->num_trees &&
@@ -798,10 +817,188 @@ p4est_output_array_push_data (sc_array_t * out, const p4est_quadrant_t * src,
   /* *INDENT-ON* */
 }
 
-void
-p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
-                            sc_array_t * out, p4est_connect_type_t balance,
-                            sc_array_t * borders, sc_array_t * inseeds)
+/** Advance in a sorted quadrant array by exponential search.
+ * \param [in] start      Search starts here, earlier positions are
+ *                        known to be skipped.
+ * \param [in] inclusive  Boolean: skip quadrants equal to \a q as well.
+ * \return                The first position >= \a start whose quadrant
+ *                        is greater than (or equal to, if not inclusive)
+ *                        \a q, the array count if there is none.
+ */
+static size_t
+p4est_overlap_gallop (sc_array_t * quadrants, size_t start,
+                      const p4est_quadrant_t * q, int inclusive)
+{
+  const size_t        count = quadrants->elem_count;
+  size_t              lo, hi, step, guess;
+
+  /* p4est_quadrant_compare (a, q) < inclusive means a is to be skipped */
+  if (start >= count ||
+      p4est_quadrant_compare (p4est_quadrant_array_index (quadrants, start),
+                              q) >= inclusive) {
+    return start;
+  }
+
+  /* double the step until we overshoot, position lo is always skipped */
+  lo = start;
+  for (step = 1;; step *= 2) {
+    hi = lo + step;
+    if (hi >= count) {
+      hi = count;
+      break;
+    }
+    if (p4est_quadrant_compare (p4est_quadrant_array_index (quadrants, hi),
+                                q) >= inclusive) {
+      break;
+    }
+    lo = hi;
+  }
+
+  /* bisect the range (lo, hi] for the first position not to skip */
+  while (lo + 1 < hi) {
+    guess = lo + (hi - lo) / 2;
+    if (p4est_quadrant_compare (p4est_quadrant_array_index (quadrants, guess),
+                                q) < inclusive) {
+      lo = guess;
+    }
+    else {
+      hi = guess;
+    }
+  }
+  return hi;
+}
+
+/** Find the tree quadrants that overlap each insulation quadrant.
+ * The insulation quadrants of all incoming quadrants of a tree and their
+ * last descendants are sorted and each swept against the tree in one pass.
+ * This yields the same result as p4est_find_lower_bound and
+ * p4est_find_higher_bound.  The sweep gallops through the tree, such that
+ * few incoming quadrants cost O(in log (tree / in)) instead of O(tree).
+ * \param [out] bounds     Two entries for every insulation quadrant
+ *                         P4EST_INSUL * iz + which of the input: the
+ *                         lowest tree quadrant >= the insulation quadrant
+ *                         and the highest one <= its last descendant,
+ *                         -1 if there is none.  Insulation quadrants
+ *                         outside of the tree range are not assigned.
+ */
+static void
+p4est_tree_overlap_bounds (p4est_t * p4est, sc_array_t * in,
+                           sc_array_t * borders, ssize_t * bounds)
+{
+  int                 k, l, m, which;
+  int                 offset[P4EST_INSUL][3];
+  size_t              iz, izstart, jz, pz;
+  size_t              incount, treecount, probe;
+  p4est_topidx_t      qtree;
+  p4est_qcoord_t      qh;
+  p4est_quadrant_t    ins, fd, ld;
+  p4est_quadrant_t   *inq, *s;
+  p4est_tree_t       *tree;
+  sc_array_t         *tquadrants;
+  sc_array_t         *lows, *highs;
+
+  P4EST_QUADRANT_INIT (&ins);
+  P4EST_QUADRANT_INIT (&fd);
+  P4EST_QUADRANT_INIT (&ld);
+
+  /* precompute the position of the insulation quadrants */
+  for (m = 0; m < (P4EST_DIM == 3 ? 3 : 1); ++m) {
+    for (k = 0; k < 3; ++k) {
+      for (l = 0; l < 3; ++l) {
+        which = m * 9 + k * 3 + l;
+        offset[which][0] = l - 1;
+        offset[which][1] = k - 1;
+        offset[which][2] = m - 1;
+      }
+    }
+  }
+
+  incount = in->elem_count;
+  lows = sc_array_new (sizeof (p4est_quadrant_t));
+  highs = sc_array_new (sizeof (p4est_quadrant_t));
+  for (izstart = 0; izstart < incount; izstart = iz) {
+    inq = p4est_quadrant_array_index (in, izstart);
+    qtree = inq->p.piggy2.which_tree;
+    tree = p4est_tree_array_index (p4est->trees, qtree);
+    if (borders == NULL) {
+      tquadrants = &tree->quadrants;
+    }
+    else {
+      tquadrants = (sc_array_t *) sc_array_index_int
+        (borders, (int) (qtree - p4est->first_local_tree));
+    }
+    treecount = tquadrants->elem_count;
+
+    /* collect the insulation quadrants that overlap this tree */
+    sc_array_truncate (lows);
+    sc_array_truncate (highs);
+    for (iz = izstart; iz < incount; ++iz) {
+      inq = p4est_quadrant_array_index (in, iz);
+      if (inq->p.piggy2.which_tree != qtree) {
+        break;
+      }
+      qh = P4EST_QUADRANT_LEN (inq->level);
+      for (which = 0; which < P4EST_INSUL; ++which) {
+        if (which == P4EST_INSUL / 2) {
+          continue;
+        }
+        ins = *inq;
+        ins.x += offset[which][0] * qh;
+        ins.y += offset[which][1] * qh;
+#ifdef P4_TO_P8
+        ins.z += offset[which][2] * qh;
+#endif
+        if ((ins.x < 0 || ins.x >= P4EST_ROOT_LEN) ||
+            (ins.y < 0 || ins.y >= P4EST_ROOT_LEN) ||
+#ifdef P4_TO_P8
+            (ins.z < 0 || ins.z >= P4EST_ROOT_LEN) ||
+#endif
+            0) {
+          continue;
+        }
+        p4est_quadrant_first_descendant (&ins, &fd, P4EST_QMAXLEVEL);
+        p4est_quadrant_last_descendant (&ins, &ld, P4EST_QMAXLEVEL);
+        if (p4est_quadrant_compare (&ld, &tree->first_desc) < 0 ||
+            p4est_quadrant_compare (&tree->last_desc, &fd) < 0) {
+          continue;
+        }
+        s = p4est_quadrant_array_push (lows);
+        *s = ins;
+        s->p.user_long = (long) (P4EST_INSUL * iz + which);
+        s = p4est_quadrant_array_push (highs);
+        *s = ld;
+        s->p.user_long = (long) (P4EST_INSUL * iz + which);
+      }
+    }
+
+    /* sweep the sorted insulation quadrants through the tree */
+    p4est_quadrant_array_sort (lows);
+    jz = 0;
+    for (pz = 0; pz < lows->elem_count; ++pz) {
+      s = p4est_quadrant_array_index (lows, pz);
+      jz = p4est_overlap_gallop (tquadrants, jz, s, 0);
+      probe = (size_t) s->p.user_long;
+      bounds[2 * probe] = jz < treecount ? (ssize_t) jz : -1;
+    }
+    p4est_quadrant_array_sort (highs);
+    jz = 0;
+    for (pz = 0; pz < highs->elem_count; ++pz) {
+      s = p4est_quadrant_array_index (highs, pz);
+      jz = p4est_overlap_gallop (tquadrants, jz, s, 1);
+      probe = (size_t) s->p.user_long;
+      bounds[2 * probe + 1] = (ssize_t) jz - 1;
+    }
+  }
+  sc_array_destroy (lows);
+  sc_array_destroy (highs);
+}
+
+static void
+p4est_tree_compute_overlap_internal (p4est_t * p4est, sc_array_t * in,
+                                     sc_array_t * out,
+                                     p4est_connect_type_t balance,
+                                     sc_array_t * borders,
+                                     sc_array_t * inseeds, int sweep)
 {
   int                 k, l, m, which;
   int                 face, corner, level;
@@ -838,6 +1035,7 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
   sc_array_t         *seeds = NULL;
   p4est_quadrant_t   *neigharray[P4EST_CHILDREN];
   size_t              nneigh = -1;
+  ssize_t            *bounds = NULL;
 
   P4EST_QUADRANT_INIT (&fd);
   P4EST_QUADRANT_INIT (&ld);
@@ -869,6 +1067,12 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
   seeds = sc_array_new (sizeof (p4est_quadrant_t));
   first_tree = p4est->first_local_tree;
 
+  /* find the overlapping tree quadrants in advance */
+  if (sweep && incount > 0) {
+    bounds = P4EST_ALLOC (ssize_t, 2 * P4EST_INSUL * incount);
+    p4est_tree_overlap_bounds (p4est, in, borders, bounds);
+  }
+
   /* loop over input list of quadrants */
   for (iz = 0; iz < incount; ++iz) {
     inq = p4est_quadrant_array_index (in, iz);
@@ -1028,8 +1232,14 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
           last_index = (ssize_t) treecount - 1;
         }
         else {
-          /* do a binary search for the highest tree quadrant <= ld */
-          last_index = p4est_find_higher_bound (tquadrants, &ld, guess);
+          if (bounds != NULL) {
+            /* the sweep has found the highest tree quadrant <= ld */
+            last_index = bounds[2 * (P4EST_INSUL * iz + which) + 1];
+          }
+          else {
+            /* do a binary search for the highest tree quadrant <= ld */
+            last_index = p4est_find_higher_bound (tquadrants, &ld, guess);
+          }
           if (last_index < 0) {
             SC_ABORT_NOT_REACHED ();
           }
@@ -1040,6 +1250,10 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
           /* the first tree quadrant overlaps an insulation quadrant */
           first_index = 0;
         }
+        else if (bounds != NULL) {
+          /* the sweep has found the lowest tree quadrant >= s */
+          first_index = bounds[2 * (P4EST_INSUL * iz + which)];
+        }
         else {
           /* Do a binary search for the lowest tree quadrant >= s.
              Does not accept a strict ancestor of s, which is on purpose. */
@@ -1186,6 +1400,26 @@ p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
   sc_array_reset (cta);
 
   sc_array_destroy (seeds);
+  P4EST_FREE (bounds);
+}
+
+void
+p4est_tree_compute_overlap (p4est_t * p4est, sc_array_t * in,
+                            sc_array_t * out, p4est_connect_type_t balance,
+                            sc_array_t * borders, sc_array_t * inseeds)
+{
+  p4est_tree_compute_overlap_internal (p4est, in, out, balance, borders,
+                                       inseeds, 0);
+}
+
+void
+p4est_tree_compute_overlap_sweep (p4est_t * p4est, sc_array_t * in,
+                                  sc_array_t * out,
+                                  p4est_connect_type_t balance,
+                                  sc_array_t * borders, sc_array_t * inseeds)
+{
+  p4est_tree_compute_overlap_internal (p4est, in, out, balance, borders,
+                                       inseeds, 1);
 }
 
 void
@@ -1201,7 +1435,7 @@ p4est_tree_uniqify_overlap (sc_array_t * out)
   }
 
   /* sort array and remove duplicates */
-  sc_array_sort (out, p4est_quadrant_compare_piggy);
+  p4est_quadrant_array_sort_piggy (out);
   dupcount = olcount = 0;
   iz = 0;                       /* read counter */
   jz = 0;                       /* write counter */
@@ -1938,7 +2172,7 @@ p4est_complete_or_balance_kernel (sc_array_t * inlist,
 
     /* sort inlist */
     if (inlist->elem_count > incount) {
-      sc_array_sort (inlist, p4est_quadrant_compare);
+      p4est_quadrant_array_sort (inlist);
     }
   }
 
@@ -2160,16 +2394,19 @@ p4est_balance_replace_recursive (p4est_t * p4est, p4est_topidx_t nt,
   }
 }
 
+/** Complete or balance one tree.
+ * \param [in] qpool   The forest's quadrant pool, or the pool of a thread
+ *                     when several trees are balanced concurrently.
+ */
 static void
 p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
                            p4est_init_t init_fn, p4est_replace_t replace_fn,
-                           int btype)
+                           int btype, sc_mempool_t * qpool)
 {
   p4est_tree_t       *tree;
   sc_array_t         *tquadrants;
   int                 bound;
   int8_t              maxlevel;
-  sc_mempool_t       *qpool;
 #ifdef P4EST_ENABLE_DEBUG
   size_t              data_pool_size;
 #endif
@@ -2184,6 +2421,7 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
 
   P4EST_ASSERT (which_tree >= p4est->first_local_tree);
   P4EST_ASSERT (which_tree <= p4est->last_local_tree);
+  p4est_cow_unshare_tree (p4est, which_tree);
   tree = p4est_tree_array_index (p4est->trees, which_tree);
   tquadrants = &(tree->quadrants);
 
@@ -2212,8 +2450,6 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
     SC_ABORT_NOT_REACHED ();
   }
 
-  qpool = p4est->quadrant_pool;
-
 #ifdef P4EST_ENABLE_DEBUG
   data_pool_size = 0;
   if (p4est->user_data_pool != NULL) {
@@ -2348,9 +2584,13 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
   sc_array_resize (tquadrants, ocount);
   memcpy (tquadrants->array, outlist->array, outlist->elem_size * ocount);
   tree->maxlevel = maxlevel;
+  if (ocount != tcount) {
+    tree->changed = 1;
+    tree->unbalanced = 1;
+  }
 
-  /* sanity check */
-  if (p4est->user_data_pool != NULL) {
+  /* sanity check; other threads may use the data pool concurrently */
+  if (p4est->user_data_pool != NULL && qpool == p4est->quadrant_pool) {
     P4EST_ASSERT (data_pool_size + (ocount - tcount) ==
                   p4est->user_data_pool->elem_count);
   }
@@ -2367,6 +2607,9 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
   sc_mempool_destroy (list_alloc);
 
   if (p4est->inspect) {
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp critical (p4est_balance_inspect)
+#endif
     if (!p4est->inspect->use_B) {
       p4est->inspect->balance_A_count_in += count_already_inlist;
       p4est->inspect->balance_A_count_in += count_ancestor_inlist;
@@ -2380,80 +2623,55 @@ p4est_complete_or_balance (p4est_t * p4est, p4est_topidx_t which_tree,
   }
 }
 
-void
-p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
-                      p4est_topidx_t which_tree, p4est_init_t init_fn,
-                      p4est_replace_t replace_fn, sc_array_t * borders)
+/** A leaf of a tree that is balanced against its descendants in the border.
+ * The regions of a border do not overlap and are balanced independently.
+ */
+typedef struct p4est_balance_region
+{
+  p4est_topidx_t      which_tree;
+  size_t              tindex;   /**< index of the leaf in the tree */
+  size_t              first;    /**< index of the leaf in the border */
+  size_t              last;     /**< end of its descendants in the border */
+  size_t              count_in, count_out, count_an;
+  sc_array_t          out;      /**< the quadrants replacing the leaf */
+}
+p4est_balance_region_t;
+
+/** Temporary storage of one thread balancing border regions. */
+typedef struct p4est_balance_scratch
+{
+  sc_mempool_t       *qpool;
+  sc_mempool_t       *list_alloc;
+  sc_array_t          inlist;
+}
+p4est_balance_scratch_t;
+
+/** Sort the border of a tree and find its regions.
+ * \param [in,out] qarray   The border; it is sorted and made unique.
+ * \param [in,out] regions  The regions of this tree are appended in order.
+ */
+static void
+p4est_balance_border_regions (p4est_t * p4est, p4est_topidx_t which_tree,
+                              sc_array_t * qarray, sc_array_t * regions)
 {
   size_t              iz, jz, kz;
-  size_t              incount;
-  size_t              count_already_inlist, count_already_outlist;
-  size_t              count_ancestor_inlist;
+  size_t              qcount = qarray->elem_count;
+  size_t              tqoffset, tqorig;
+  ssize_t             tqindex;
   p4est_tree_t       *tree;
-  p4est_quadrant_t   *q, *p, *r;
-  p4est_quadrant_t    tempq, tempp;
-  sc_array_t          qview;
-  sc_array_t         *inlist, *flist, *tquadrants;
+  p4est_quadrant_t   *q, *p;
+  sc_array_t         *tquadrants;
   sc_array_t          tqview;
-  size_t              tqoffset, fcount;
-  p4est_topidx_t      first_tree = p4est->first_local_tree;
-  size_t              num_added, num_this_added;
-  int                 bound;
-  ssize_t             tqindex;
-  size_t              tqorig;
-  sc_mempool_t       *list_alloc, *qpool;
-  /* get this tree's border */
-  sc_array_t         *qarray = (sc_array_t *) sc_array_index (borders,
-                                                              which_tree -
-                                                              first_tree);
-  size_t              qcount = qarray->elem_count;
-
-  if (!qcount) {
-    /* nothing to be done */
-    return;
-  }
-
-  P4EST_QUADRANT_INIT (&tempq);
-  P4EST_QUADRANT_INIT (&tempp);
-
-  /* set up balance machinery */
-
-  if (btype == P4EST_CONNECT_FULL) {
-    bound = (1 << P4EST_DIM);
-  }
-#ifdef P4_TO_P8
-  else if (btype == P8EST_CONNECT_EDGE) {
-    bound = (1 << P4EST_DIM) - 1;
-  }
-#endif
-  else {
-    bound = P4EST_DIM + 1;
-  }
-
-  P4EST_ASSERT (which_tree >= p4est->first_local_tree);
-  P4EST_ASSERT (which_tree <= p4est->last_local_tree);
+  p4est_balance_region_t *region;
 
+  P4EST_ASSERT (qcount > 0);
   tree = p4est_tree_array_index (p4est->trees, which_tree);
   tquadrants = &(tree->quadrants);
   tqorig = tquadrants->elem_count;
   tqoffset = 0;
-  sc_array_init_view (&tqview, tquadrants, tqoffset,
-                      tquadrants->elem_count - tqoffset);
-
-  qpool = p4est->quadrant_pool;
-
-  count_already_inlist = count_already_outlist = 0;
-  count_ancestor_inlist = 0;
-  num_added = 0;
-
-  /* initialize temporary storage */
-  list_alloc = sc_mempool_new (sizeof (sc_link_t));
-
-  inlist = sc_array_new (sizeof (p4est_quadrant_t));
-  flist = sc_array_new (sizeof (p4est_quadrant_t));
 
   /* sort the border and remove duplicates */
-  sc_array_sort (qarray, p4est_quadrant_compare);
+  p4est_quadrant_array_sort (qarray);
   jz = 1;                       /* number included */
   kz = 0;                       /* number skipped */
   p = p4est_quadrant_array_index (qarray, 0);
@@ -2490,7 +2708,7 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
 
     P4EST_ASSERT (p4est_quadrant_is_valid (p));
 
-    /* get a view of all of the quads that are descended from this quad */
+    /* find all of the quads that are descended from this quad */
     jz = iz + 1;
     kz = jz;
 
@@ -2508,91 +2726,162 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
       }
     }
 
-    incount = kz - jz;
-    if (!incount) {
+    if (kz == jz) {
       continue;
     }
 
-    /* find p in tquadrants */
+    /* find p in the tree quadrants past the previous region */
+    sc_array_init_view (&tqview, tquadrants, tqoffset, tqorig - tqoffset);
     tqindex = sc_array_bsearch (&tqview, p, p4est_quadrant_compare);
-
     P4EST_ASSERT (tqindex >= 0);
+    tqindex += tqoffset;
+    tqoffset = tqindex + 1;
 
-    /* copy everything before p into flist */
-    if (tqindex) {
-      fcount = flist->elem_count;
-      sc_array_resize (flist, fcount + tqindex);
-      memcpy (sc_array_index (flist, fcount),
-              tqview.array, tqindex * sizeof (p4est_quadrant_t));
-    }
+    region = (p4est_balance_region_t *) sc_array_push (regions);
+    region->which_tree = which_tree;
+    region->tindex = (size_t) tqindex;
+    region->first = iz;
+    region->last = kz;
+    region->count_in = region->count_out = region->count_an = 0;
+    sc_array_init (&region->out, sizeof (p4est_quadrant_t));
 
-    /* update the view of tquadrants to be everything past p */
-    tqindex += tqoffset;        /* tqindex is the index of p in tquadrants */
-    tqoffset = tqindex + 1;
-    sc_array_init_view (&tqview, tquadrants, tqoffset, tqorig - tqoffset);
+    /* skip over the quadrants of this region */
+    iz = kz - 1;
+  }
+}
 
-    /* first, remove p */
-    q = p4est_quadrant_array_index (tquadrants, tqindex);
-    P4EST_ASSERT (p4est_quadrant_is_equal (q, p));
-    /* reset the data, decrement level count */
-    if (replace_fn == NULL) {
-      p4est_quadrant_free_data (p4est, q);
-    }
-    else {
-      tempp = *q;
-    }
-    --tree->quadrants_per_level[q->level];
+/** Balance the leaf of a region against its descendants in the border.
+ * This only touches the leaf, the region and the scratch storage.
+ */
+static void
+p4est_balance_border_region (p4est_t * p4est, int bound,
+                             sc_array_t * qarray,
+                             p4est_balance_region_t * region,
+                             p4est_balance_scratch_t * scratch,
+                             p4est_init_t init_fn,
+                             p4est_replace_t replace_fn)
+{
+  size_t              jz;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *p, *r;
+  p4est_quadrant_t    tempq, tempp;
+  sc_array_t         *inlist = &scratch->inlist;
+  sc_array_t         *out = &region->out;
+
+  P4EST_QUADRANT_INIT (&tempq);
+  P4EST_QUADRANT_INIT (&tempp);
+
+  tree = p4est_tree_array_index (p4est->trees, region->which_tree);
+  p = p4est_quadrant_array_index (qarray, region->first);
 
-    /* get all of the quadrants that descend from p into inlist */
-    sc_array_init_view (&qview, qarray, jz, incount);
-    sc_array_resize (inlist, 1);
-    q = p4est_quadrant_array_index (inlist, 0);
-    r = p4est_quadrant_array_index (&qview, 0);
+  /* first, remove p from the tree */
+  q = p4est_quadrant_array_index (&tree->quadrants, region->tindex);
+  P4EST_ASSERT (p4est_quadrant_is_equal (q, p));
+  if (replace_fn == NULL) {
+    p4est_quadrant_free_data (p4est, q);
+  }
+  else {
+    tempp = *q;
+  }
+
+  /* get all of the quadrants that descend from p into inlist */
+  sc_array_resize (inlist, 1);
+  q = p4est_quadrant_array_index (inlist, 0);
+  r = p4est_quadrant_array_index (qarray, region->first + 1);
+  P4EST_ASSERT (p4est_quadrant_child_id (r) == 0);
+  *q = *r;
+  for (jz = region->first + 2; jz < region->last; jz++) {
+    r = p4est_quadrant_array_index (qarray, jz);
     P4EST_ASSERT (p4est_quadrant_child_id (r) == 0);
-    *q = *r;
-    for (jz = 1; jz < incount; jz++) {
-      r = p4est_quadrant_array_index (&qview, jz);
-      P4EST_ASSERT (p4est_quadrant_child_id (r) == 0);
-      p4est_nearest_common_ancestor (r, q, &tempq);
-      if (tempq.level >= SC_MIN (r->level, q->level) - 1) {
-        if (r->level > q->level) {
-          *q = *r;
-        }
-        continue;
+    p4est_nearest_common_ancestor (r, q, &tempq);
+    if (tempq.level >= SC_MIN (r->level, q->level) - 1) {
+      if (r->level > q->level) {
+        *q = *r;
       }
-      q = (p4est_quadrant_t *) sc_array_push (inlist);
-      *q = *r;
+      continue;
     }
+    q = (p4est_quadrant_t *) sc_array_push (inlist);
+    *q = *r;
+  }
 
-    fcount = flist->elem_count;
+  /* balance them within the containing quad */
+  p4est_complete_or_balance_kernel (inlist, p, bound, scratch->qpool,
+                                    scratch->list_alloc, out, NULL, NULL,
+                                    &region->count_in, &region->count_out,
+                                    &region->count_an);
+
+  /* initialize */
+  for (jz = 0; jz < out->elem_count; jz++) {
+    q = p4est_quadrant_array_index (out, jz);
+    P4EST_ASSERT (p4est_quadrant_is_ancestor (p, q));
+    p4est_quadrant_init_data (p4est, region->which_tree, q, init_fn);
+  }
+  if (replace_fn != NULL) {
+    p4est_balance_replace_recursive (p4est, region->which_tree,
+                                     out, 0, out->elem_count,
+                                     &tempp, init_fn, replace_fn);
+  }
+}
+
+/** Replace the leaves of the regions of one tree by their outputs.
+ * \param [in,out] regions  The regions of this tree; their output is freed.
+ */
+static void
+p4est_balance_border_merge (p4est_t * p4est, p4est_topidx_t which_tree,
+                            p4est_balance_region_t * regions,
+                            size_t num_regions)
+{
+  size_t              iz, jz, fcount;
+  size_t              tqoffset, tqorig;
+  size_t              count_in, count_out, count_an;
+  size_t              num_added;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  sc_array_t         *tquadrants, *flist;
+  p4est_balance_region_t *region;
+
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  tquadrants = &(tree->quadrants);
+  tqorig = tquadrants->elem_count;
+  tqoffset = 0;
+  count_in = count_out = count_an = 0;
+  num_added = 0;
+
+  flist = sc_array_new (sizeof (p4est_quadrant_t));
+  for (iz = 0; iz < num_regions; ++iz) {
+    region = regions + iz;
+    P4EST_ASSERT (region->which_tree == which_tree);
+    P4EST_ASSERT (tqoffset <= region->tindex);
+
+    /* copy everything before the leaf into flist */
+    if (tqoffset < region->tindex) {
+      fcount = flist->elem_count;
+      sc_array_resize (flist, fcount + region->tindex - tqoffset);
+      memcpy (sc_array_index (flist, fcount),
+              sc_array_index (tquadrants, tqoffset),
+              (region->tindex - tqoffset) * sizeof (p4est_quadrant_t));
+    }
+    q = p4est_quadrant_array_index (tquadrants, region->tindex);
+    --tree->quadrants_per_level[q->level];
+    tqoffset = region->tindex + 1;
 
-    /* balance them within the containing quad */
-    p4est_complete_or_balance_kernel (inlist, p, bound, qpool, list_alloc,
-                                      flist, NULL, NULL,
-                                      &count_already_inlist,
-                                      &count_already_outlist,
-                                      &count_ancestor_inlist);
-
-    /* count the amount we've added (-1 because we subtract p) */
-    num_this_added = flist->elem_count - 1 - fcount;
-    num_added += num_this_added;
-
-    /* initialize */
-    for (jz = fcount; jz < flist->elem_count; jz++) {
-      q = p4est_quadrant_array_index (flist, jz);
-      P4EST_ASSERT (p4est_quadrant_is_ancestor (p, q));
+    /* append the balanced replacement of the leaf */
+    for (jz = 0; jz < region->out.elem_count; jz++) {
+      q = p4est_quadrant_array_index (&region->out, jz);
       ++tree->quadrants_per_level[q->level];
       tree->maxlevel = (int8_t) SC_MAX (tree->maxlevel, q->level);
-      p4est_quadrant_init_data (p4est, which_tree, q, init_fn);
-    }
-    if (replace_fn != NULL) {
-      p4est_balance_replace_recursive (p4est, which_tree,
-                                       flist, fcount, flist->elem_count,
-                                       &tempp, init_fn, replace_fn);
     }
-
-    /* skip over the quadrants that we just operated on */
-    iz = kz - 1;
+    fcount = flist->elem_count;
+    sc_array_resize (flist, fcount + region->out.elem_count);
+    memcpy (sc_array_index (flist, fcount), region->out.array,
+            region->out.elem_count * sizeof (p4est_quadrant_t));
+
+    /* count the amount we've added (-1 because we subtract the leaf) */
+    num_added += region->out.elem_count - 1;
+    count_in += region->count_in;
+    count_out += region->count_out;
+    count_an += region->count_an;
+    sc_array_reset (&region->out);
   }
 
   /* copy the remaining tquadrants to flist */
@@ -2600,66 +2889,230 @@ p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
     fcount = flist->elem_count;
     sc_array_resize (flist, fcount + tqorig - tqoffset);
     memcpy (sc_array_index (flist, fcount),
-            tqview.array, (tqorig - tqoffset) * sizeof (p4est_quadrant_t));
+            sc_array_index (tquadrants, tqoffset),
+            (tqorig - tqoffset) * sizeof (p4est_quadrant_t));
   }
 
   /* copy flist into tquadrants */
   sc_array_resize (tquadrants, flist->elem_count);
   memcpy (tquadrants->array, flist->array,
           flist->elem_count * flist->elem_size);
-
-  sc_mempool_destroy (list_alloc);
+  sc_array_destroy (flist);
   P4EST_ASSERT (tqorig + num_added == tquadrants->elem_count);
 
   /* print more statistics */
   P4EST_VERBOSEF
     ("Tree border %lld inlist %llu outlist %llu ancestor %llu insert %llu\n",
-     (long long) which_tree, (unsigned long long) count_already_inlist,
-     (unsigned long long) count_already_outlist,
-     (unsigned long long) count_ancestor_inlist,
+     (long long) which_tree, (unsigned long long) count_in,
+     (unsigned long long) count_out, (unsigned long long) count_an,
      (unsigned long long) num_added);
 
-  sc_array_destroy (inlist);
-  sc_array_destroy (flist);
-
   P4EST_ASSERT (p4est_tree_is_complete (tree));
 
   if (p4est->inspect) {
-    p4est->inspect->balance_B_count_in += count_already_inlist;
-    p4est->inspect->balance_B_count_in += count_ancestor_inlist;
-    p4est->inspect->balance_B_count_out += count_already_outlist;
+    p4est->inspect->balance_B_count_in += count_in;
+    p4est->inspect->balance_B_count_in += count_an;
+    p4est->inspect->balance_B_count_out += count_out;
   }
 }
 
 void
-p4est_complete_subtree (p4est_t * p4est,
-                        p4est_topidx_t which_tree, p4est_init_t init_fn)
+p4est_balance_borders (p4est_t * p4est, p4est_connect_type_t btype,
+                       sc_array_t * trees, p4est_init_t init_fn,
+                       p4est_replace_t replace_fn, sc_array_t * borders,
+                       int num_threads)
 {
-  p4est_complete_or_balance (p4est, which_tree, init_fn, NULL, 0);
-}
+  int                 bound;
+  int                 i, ithread, num_scratch;
+  long                lr;
+  size_t              zt, zr, zfirst, num_regions;
+  p4est_topidx_t      which_tree;
+  sc_array_t         *qarray;
+  sc_array_t          regions;
+  p4est_balance_region_t *region;
+  p4est_balance_scratch_t *scratch;
 
-void
-p4est_balance_subtree (p4est_t * p4est, p4est_connect_type_t btype,
-                       p4est_topidx_t which_tree, p4est_init_t init_fn)
-{
-  p4est_complete_or_balance (p4est, which_tree, init_fn, NULL,
-                             p4est_connect_type_int (btype));
-}
+  P4EST_ASSERT (trees->elem_size == sizeof (p4est_topidx_t));
 
-void
-p4est_balance_subtree_ext (p4est_t * p4est, p4est_connect_type_t btype,
-                           p4est_topidx_t which_tree, p4est_init_t init_fn,
-                           p4est_replace_t replace_fn)
-{
-  p4est_complete_or_balance (p4est, which_tree, init_fn, replace_fn,
-                             p4est_connect_type_int (btype));
-}
+  /* set up balance machinery */
 
-size_t
-p4est_linearize_tree (p4est_t * p4est, p4est_tree_t * tree)
-{
-#ifdef P4EST_ENABLE_DEBUG
-  size_t              data_pool_size;
+  if (btype == P4EST_CONNECT_FULL) {
+    bound = (1 << P4EST_DIM);
+  }
+#ifdef P4_TO_P8
+  else if (btype == P8EST_CONNECT_EDGE) {
+    bound = (1 << P4EST_DIM) - 1;
+  }
+#endif
+  else {
+    bound = P4EST_DIM + 1;
+  }
+
+  /* the regions of all trees are found in order */
+  sc_array_init (&regions, sizeof (p4est_balance_region_t));
+  for (zt = 0; zt < trees->elem_count; ++zt) {
+    which_tree = *(p4est_topidx_t *) sc_array_index (trees, zt);
+    P4EST_ASSERT (which_tree >= p4est->first_local_tree);
+    P4EST_ASSERT (which_tree <= p4est->last_local_tree);
+    qarray = (sc_array_t *) sc_array_index (borders, (size_t)
+                                            (which_tree -
+                                             p4est->first_local_tree));
+    if (qarray->elem_count == 0) {
+      /* nothing to be done */
+      continue;
+    }
+    p4est_cow_unshare_tree (p4est, which_tree);
+    p4est_balance_border_regions (p4est, which_tree, qarray, &regions);
+  }
+  num_regions = regions.elem_count;
+
+  /* every thread owns a quadrant pool and temporary storage */
+  num_scratch = SC_MAX (num_threads, 1);
+  scratch = P4EST_ALLOC (p4est_balance_scratch_t, num_scratch);
+  for (i = 0; i < num_scratch; ++i) {
+    scratch[i].qpool = num_threads > 0 ?
+      sc_mempool_new (sizeof (p4est_quadrant_t)) : p4est->quadrant_pool;
+    scratch[i].list_alloc = sc_mempool_new (sizeof (sc_link_t));
+    sc_array_init (&scratch[i].inlist, sizeof (p4est_quadrant_t));
+  }
+
+  /* balance the regions independently of each other */
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_scratch) schedule (dynamic) \
+  private (ithread, region, qarray)
+#endif
+  for (lr = 0; lr < (long) num_regions; ++lr) {
+#ifdef P4EST_ENABLE_OPENMP
+    ithread = omp_get_thread_num ();
+#else
+    ithread = 0;
+#endif
+    region = (p4est_balance_region_t *) sc_array_index (&regions,
+                                                        (size_t) lr);
+    qarray = (sc_array_t *) sc_array_index (borders, (size_t)
+                                            (region->which_tree -
+                                             p4est->first_local_tree));
+    p4est_balance_border_region (p4est, bound, qarray, region,
+                                 &scratch[ithread], init_fn, replace_fn);
+  }
+
+  for (i = 0; i < num_scratch; ++i) {
+    if (num_threads > 0) {
+      sc_mempool_destroy (scratch[i].qpool);
+    }
+    sc_mempool_destroy (scratch[i].list_alloc);
+    sc_array_reset (&scratch[i].inlist);
+  }
+  P4EST_FREE (scratch);
+
+  /* merge the regions into their trees in order */
+  for (zr = 0; zr < num_regions; zr = zfirst) {
+    region = (p4est_balance_region_t *) sc_array_index (&regions, zr);
+    which_tree = region->which_tree;
+    for (zfirst = zr + 1; zfirst < num_regions; ++zfirst) {
+      if (((p4est_balance_region_t *)
+           sc_array_index (&regions, zfirst))->which_tree != which_tree) {
+        break;
+      }
+    }
+    p4est_balance_border_merge (p4est, which_tree, region, zfirst - zr);
+  }
+  sc_array_reset (&regions);
+}
+
+void
+p4est_balance_border (p4est_t * p4est, p4est_connect_type_t btype,
+                      p4est_topidx_t which_tree, p4est_init_t init_fn,
+                      p4est_replace_t replace_fn, sc_array_t * borders)
+{
+  sc_array_t          trees;
+
+  sc_array_init_data (&trees, &which_tree, sizeof (p4est_topidx_t), 1);
+  p4est_balance_borders (p4est, btype, &trees, init_fn, replace_fn,
+                         borders, 0);
+}
+
+void
+p4est_balance_subtrees (p4est_t * p4est, p4est_connect_type_t btype,
+                        sc_array_t * trees, p4est_init_t init_fn,
+                        p4est_replace_t replace_fn, int num_threads)
+{
+  const int           bt = p4est_connect_type_int (btype);
+  int                 i, ithread, num_scratch;
+  long                lt;
+  size_t              zt;
+  p4est_topidx_t      which_tree;
+  sc_mempool_t      **qpools;
+
+  P4EST_ASSERT (trees->elem_size == sizeof (p4est_topidx_t));
+
+  /* the copy-on-write storage is not thread safe */
+  for (zt = 0; zt < trees->elem_count; ++zt) {
+    which_tree = *(p4est_topidx_t *) sc_array_index (trees, zt);
+    p4est_cow_unshare_tree (p4est, which_tree);
+  }
+
+  /* every thread owns a quadrant pool */
+  num_scratch = SC_MAX (num_threads, 1);
+  qpools = P4EST_ALLOC (sc_mempool_t *, num_scratch);
+  for (i = 0; i < num_scratch; ++i) {
+    qpools[i] = num_threads > 0 ?
+      sc_mempool_new (sizeof (p4est_quadrant_t)) : p4est->quadrant_pool;
+  }
+
+#ifdef P4EST_ENABLE_OPENMP
+#pragma omp parallel for num_threads (num_scratch) schedule (dynamic) \
+  private (ithread, which_tree)
+#endif
+  for (lt = 0; lt < (long) trees->elem_count; ++lt) {
+#ifdef P4EST_ENABLE_OPENMP
+    ithread = omp_get_thread_num ();
+#else
+    ithread = 0;
+#endif
+    which_tree = *(p4est_topidx_t *) sc_array_index (trees, (size_t) lt);
+    p4est_complete_or_balance (p4est, which_tree, init_fn, replace_fn, bt,
+                               qpools[ithread]);
+  }
+
+  for (i = 0; i < num_scratch && num_threads > 0; ++i) {
+    sc_mempool_destroy (qpools[i]);
+  }
+  P4EST_FREE (qpools);
+}
+
+void
+p4est_complete_subtree (p4est_t * p4est,
+                        p4est_topidx_t which_tree, p4est_init_t init_fn)
+{
+  p4est_complete_or_balance (p4est, which_tree, init_fn, NULL, 0,
+                             p4est->quadrant_pool);
+}
+
+void
+p4est_balance_subtree (p4est_t * p4est, p4est_connect_type_t btype,
+                       p4est_topidx_t which_tree, p4est_init_t init_fn)
+{
+  p4est_complete_or_balance (p4est, which_tree, init_fn, NULL,
+                             p4est_connect_type_int (btype),
+                             p4est->quadrant_pool);
+}
+
+void
+p4est_balance_subtree_ext (p4est_t * p4est, p4est_connect_type_t btype,
+                           p4est_topidx_t which_tree, p4est_init_t init_fn,
+                           p4est_replace_t replace_fn)
+{
+  p4est_complete_or_balance (p4est, which_tree, init_fn, replace_fn,
+                             p4est_connect_type_int (btype),
+                             p4est->quadrant_pool);
+}
+
+size_t
+p4est_linearize_tree (p4est_t * p4est, p4est_tree_t * tree)
+{
+#ifdef P4EST_ENABLE_DEBUG
+  size_t              data_pool_size;
 #endif
   size_t              incount, removed;
   size_t              current, rest;
@@ -2803,9 +3256,48 @@ p4est_next_nonempty_process (int rank, int num_procs,
   return rank;
 }
 
-p4est_gloidx_t
-p4est_partition_given (p4est_t * p4est,
-                       const p4est_locidx_t * new_num_quadrants_in_proc)
+/** Append the payloads of \a count consecutive local quadrants. */
+static void
+p4est_partition_payload_append (sc_array_t * dest_sizes,
+                                sc_array_t * dest_data,
+                                const int *src_sizes,
+                                const void *const *src_payloads,
+                                p4est_locidx_t count)
+{
+  p4est_locidx_t      il;
+  size_t              bytes;
+
+  if (count == 0) {
+    return;
+  }
+  memcpy (sc_array_push_count (dest_sizes, (size_t) count), src_sizes,
+          count * sizeof (int));
+  for (il = 0; il < count; ++il) {
+    P4EST_ASSERT (src_sizes[il] >= 0);
+    if ((bytes = (size_t) src_sizes[il]) > 0) {
+      memcpy (sc_array_push_count (dest_data, bytes), src_payloads[il],
+              bytes);
+    }
+  }
+}
+
+p4est_partition_context_t *
+p4est_partition_given_begin (p4est_t * p4est,
+                             const p4est_locidx_t * new_num_quadrants_in_proc)
+{
+  return p4est_partition_given_payload_begin (p4est,
+                                              new_num_quadrants_in_proc,
+                                              NULL, NULL, NULL, NULL);
+}
+
+p4est_partition_context_t *
+p4est_partition_given_payload_begin (p4est_t * p4est,
+                                     const p4est_locidx_t *
+                                     new_num_quadrants_in_proc,
+                                     const int *src_sizes,
+                                     const void *const *src_payloads,
+                                     sc_array_t * dest_sizes,
+                                     sc_array_t * dest_data)
 {
   const int           num_procs = p4est->mpisize;
   const int           rank = p4est->mpirank;
@@ -2826,25 +3318,15 @@ p4est_partition_given (p4est_t * p4est,
   int                 from_proc, to_proc;
   int                 num_proc_recv_from, num_proc_send_to;
   char               *user_data_send_buf;
-  char               *user_data_recv_buf;
   char              **recv_buf, **send_buf;
-  size_t              recv_size, send_size, zz, zoffset;
-  p4est_topidx_t      it;
+  size_t              recv_size, send_size;
   p4est_topidx_t      which_tree;
-  p4est_topidx_t      first_tree, last_tree;
   p4est_topidx_t      num_recv_trees;
-  p4est_topidx_t      new_first_local_tree, new_last_local_tree;
-  p4est_topidx_t      first_from_tree, last_from_tree, from_tree;
   p4est_locidx_t      il;
   p4est_locidx_t      num_copy;
-  p4est_locidx_t      num_quadrants;
-  p4est_locidx_t      new_local_num_quadrants;
   p4est_locidx_t     *num_recv_from, *num_send_to;
-  p4est_locidx_t     *new_local_tree_elem_count;
-  p4est_locidx_t     *new_local_tree_elem_count_before;
   p4est_locidx_t     *num_per_tree_local;
   p4est_locidx_t     *num_per_tree_send_buf;
-  p4est_locidx_t     *num_per_tree_recv_buf;
   p4est_gloidx_t     *begin_send_to;
   p4est_gloidx_t      tree_from_begin, tree_from_end, num_copy_global;
   p4est_gloidx_t      from_begin, from_end, lower_bound,
@@ -2856,22 +3338,55 @@ p4est_partition_given (p4est_t * p4est,
   p4est_gloidx_t     *new_global_last_quad_index;
   p4est_gloidx_t     *local_tree_last_quad_index;
   p4est_gloidx_t      diff64, total_quadrants_shipped;
-  sc_array_t         *quadrants;
   p4est_quadrant_t   *quad_send_buf;
-  p4est_quadrant_t   *quad_recv_buf;
-  p4est_quadrant_t   *quad;
   p4est_tree_t       *tree;
+  p4est_partition_context_t *pc;
+  const int           with_payload = (dest_sizes != NULL);
+  char               *payload_send_buf;
+  size_t              payload_size;
+  p4est_locidx_t      lfirst;
 #ifdef P4EST_ENABLE_MPI
   int                 sk;
   int                 mpiret;
   MPI_Comm            comm = p4est->mpicomm;
   MPI_Request        *recv_request, *send_request;
+  MPI_Request        *bytes_request;
+  int                *recv_bytes, *send_bytes;
 #endif
 #ifdef P4EST_ENABLE_DEBUG
   unsigned            crc;
   p4est_gloidx_t      total_requested_quadrants = 0;
 #endif
 
+  SC_CHECK_ABORT (p4est->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+  P4EST_ASSERT (!with_payload || dest_data != NULL);
+  P4EST_ASSERT (!with_payload || dest_sizes->elem_size == sizeof (int));
+  P4EST_ASSERT (!with_payload || dest_data->elem_size == 1);
+  P4EST_ASSERT (!with_payload || p4est->local_num_quadrants == 0 ||
+                (src_sizes != NULL && src_payloads != NULL));
+
+  pc = P4EST_ALLOC_ZERO (p4est_partition_context_t, 1);
+  pc->p4est = p4est;
+  pc->revision = p4est->revision;
+  pc->src_sizes = src_sizes;
+  pc->src_payloads = src_payloads;
+  pc->dest_sizes = dest_sizes;
+  pc->dest_data = dest_data;
+  if (with_payload) {
+    sc_array_resize (dest_sizes, 0);
+    sc_array_resize (dest_data, 0);
+  }
+  if (new_num_quadrants_in_proc == NULL) {
+    /* the current partition is kept and nothing is sent */
+    if (with_payload) {
+      p4est_partition_payload_append (dest_sizes, dest_data, src_sizes,
+                                      src_payloads,
+                                      p4est->local_num_quadrants);
+    }
+    return pc;
+  }
+
   P4EST_GLOBAL_INFOF
     ("Into " P4EST_STRING "_partition_given with %lld total quadrants\n",
      (long long) p4est->global_num_quadrants);
@@ -3044,6 +3559,25 @@ p4est_partition_given (p4est_t * p4est,
   recv_buf = P4EST_ALLOC (char *, num_procs);
 #ifdef P4EST_ENABLE_MPI
   recv_request = P4EST_ALLOC (MPI_Request, num_proc_recv_from);
+  recv_bytes = send_bytes = NULL;
+  bytes_request = NULL;
+  if (with_payload) {
+    /* the size of a message with payload is known only to its sender */
+    recv_bytes = P4EST_ALLOC (int, num_procs);
+    for (from_proc = from_begin_global_quad, sk = 0;
+         from_proc <= from_end_global_quad; ++from_proc) {
+      if (from_proc != rank && num_recv_from[from_proc]) {
+        mpiret = MPI_Irecv (recv_bytes + from_proc, 1, MPI_INT, from_proc,
+                            P4EST_COMM_PARTITION_GIVEN_BYTES, comm,
+                            recv_request + sk);
+        SC_CHECK_MPI (mpiret);
+        ++sk;
+      }
+    }
+    for (; sk < num_proc_recv_from; ++sk) {
+      recv_request[sk] = MPI_REQUEST_NULL;
+    }
+  }
 #endif
 
   /* Allocate space for receiving quadrants and user data */
@@ -3052,7 +3586,8 @@ p4est_partition_given (p4est_t * p4est,
        , sk = 0
 #endif
        ; from_proc <= from_end_global_quad; ++from_proc) {
-    if (from_proc != rank && num_recv_from[from_proc]) {
+    /* with payload the receives are posted once the sizes are known */
+    if (from_proc != rank && num_recv_from[from_proc] && !with_payload) {
       num_recv_trees =          /* same type */
         p4est->global_first_position[from_proc + 1].p.which_tree
         - p4est->global_first_position[from_proc].p.which_tree + 1;
@@ -3074,7 +3609,7 @@ p4est_partition_given (p4est_t * p4est,
     }
   }
 #ifdef P4EST_ENABLE_MPI
-  for (; sk < num_proc_recv_from; ++sk) {
+  for (; !with_payload && sk < num_proc_recv_from; ++sk) {
     /* for empty processors in receiving range */
     recv_request[sk] = MPI_REQUEST_NULL;
   }
@@ -3184,6 +3719,36 @@ p4est_partition_given (p4est_t * p4est,
   send_request = P4EST_ALLOC (MPI_Request, num_proc_send_to);
 #endif
 
+#ifdef P4EST_ENABLE_MPI
+  if (with_payload) {
+    /* tell the receivers the size of our messages before packing them */
+    send_bytes = P4EST_ALLOC (int, num_procs);
+    bytes_request = P4EST_ALLOC (MPI_Request, num_proc_send_to);
+    for (to_proc = to_begin_global_quad, sk = 0;
+         to_proc <= to_end_global_quad; ++to_proc) {
+      if (to_proc != rank && num_send_to[to_proc]) {
+        lfirst = (p4est_locidx_t)
+          (begin_send_to[to_proc] - p4est->global_first_quadrant[rank]);
+        send_size = num_send_trees * sizeof (p4est_locidx_t)
+          + (quad_plus_data_size + sizeof (int)) * num_send_to[to_proc];
+        for (il = 0; il < num_send_to[to_proc]; ++il) {
+          P4EST_ASSERT (src_sizes[lfirst + il] >= 0);
+          send_size += (size_t) src_sizes[lfirst + il];
+        }
+        send_bytes[to_proc] = (int) send_size;
+        mpiret = MPI_Isend (send_bytes + to_proc, 1, MPI_INT, to_proc,
+                            P4EST_COMM_PARTITION_GIVEN_BYTES, comm,
+                            bytes_request + sk);
+        SC_CHECK_MPI (mpiret);
+        ++sk;
+      }
+    }
+    for (; sk < num_proc_send_to; ++sk) {
+      bytes_request[sk] = MPI_REQUEST_NULL;
+    }
+  }
+#endif
+
   /* Set the num_per_tree_local */
   num_per_tree_local = P4EST_ALLOC_ZERO (p4est_locidx_t, num_send_trees);
   to_proc = rank;
@@ -3219,6 +3784,17 @@ p4est_partition_given (p4est_t * p4est,
     if (to_proc != rank && num_send_to[to_proc]) {
       send_size = num_send_trees * sizeof (p4est_locidx_t)
         + quad_plus_data_size * num_send_to[to_proc];
+      payload_size = 0;
+      lfirst = (p4est_locidx_t)
+        (begin_send_to[to_proc] - p4est->global_first_quadrant[rank]);
+      if (with_payload) {
+        /* the payload follows the quadrants and their data */
+        for (il = 0; il < num_send_to[to_proc]; ++il) {
+          P4EST_ASSERT (src_sizes[lfirst + il] >= 0);
+          payload_size += (size_t) src_sizes[lfirst + il];
+        }
+        send_size += num_send_to[to_proc] * sizeof (int) + payload_size;
+      }
 
       send_buf[to_proc] = P4EST_ALLOC (char, send_size);
 
@@ -3280,11 +3856,30 @@ p4est_partition_given (p4est_t * p4est,
           user_data_send_buf += num_copy * data_size;
         }
       }
+      if (with_payload) {
+        /* copy the sizes and payloads right into the message */
+        P4EST_ASSERT (user_data_send_buf == send_buf[to_proc] +
+                      num_send_trees * sizeof (p4est_locidx_t) +
+                      quad_plus_data_size * num_send_to[to_proc]);
+        memcpy (user_data_send_buf, src_sizes + lfirst,
+                num_send_to[to_proc] * sizeof (int));
+        payload_send_buf =
+          user_data_send_buf + num_send_to[to_proc] * sizeof (int);
+        for (il = 0; il < num_send_to[to_proc]; ++il) {
+          if (src_sizes[lfirst + il] > 0) {
+            memcpy (payload_send_buf, src_payloads[lfirst + il],
+                    (size_t) src_sizes[lfirst + il]);
+            payload_send_buf += src_sizes[lfirst + il];
+          }
+        }
+        P4EST_ASSERT (payload_send_buf == send_buf[to_proc] + send_size);
+      }
 
       /* Post send operation for the quadrants and their data */
 #ifdef P4EST_ENABLE_MPI
       P4EST_LDEBUGF ("partition send %lld quadrants to %d\n",
                      (long long) num_send_to[to_proc], to_proc);
+      P4EST_ASSERT (!with_payload || send_bytes[to_proc] == (int) send_size);
       mpiret = MPI_Isend (send_buf[to_proc], (int) send_size, MPI_BYTE,
                           to_proc, P4EST_COMM_PARTITION_GIVEN,
                           comm, send_request + sk);
@@ -3297,13 +3892,184 @@ p4est_partition_given (p4est_t * p4est,
   for (; sk < num_proc_send_to; ++sk) {
     send_request[sk] = MPI_REQUEST_NULL;
   }
+  if (with_payload) {
+    /* the sizes have been sent early and the receives are posted now */
+    mpiret = MPI_Waitall (num_proc_recv_from, recv_request,
+                          MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    for (from_proc = from_begin_global_quad, sk = 0;
+         from_proc <= from_end_global_quad; ++from_proc) {
+      if (from_proc != rank && num_recv_from[from_proc]) {
+        recv_buf[from_proc] = P4EST_ALLOC (char, recv_bytes[from_proc]);
+        P4EST_LDEBUGF ("partition recv %lld quadrants from %d\n",
+                       (long long) num_recv_from[from_proc], from_proc);
+        mpiret = MPI_Irecv (recv_buf[from_proc], recv_bytes[from_proc],
+                            MPI_BYTE, from_proc, P4EST_COMM_PARTITION_GIVEN,
+                            comm, recv_request + sk);
+        SC_CHECK_MPI (mpiret);
+        ++sk;
+      }
+    }
+    for (; sk < num_proc_recv_from; ++sk) {
+      recv_request[sk] = MPI_REQUEST_NULL;
+    }
+  }
+  pc->recv_request = recv_request;
+  pc->send_request = send_request;
+  pc->bytes_request = bytes_request;
+  pc->recv_bytes = recv_bytes;
+  pc->send_bytes = send_bytes;
+#endif
+
+  /* remember what is needed to complete the partition */
+  pc->pending = 1;
+  pc->shipped = total_quadrants_shipped;
+  pc->from_begin = from_begin_global_quad;
+  pc->from_end = from_end_global_quad;
+  pc->to_begin = to_begin_global_quad;
+  pc->to_end = to_end_global_quad;
+  pc->num_proc_recv_from = num_proc_recv_from;
+  pc->num_proc_send_to = num_proc_send_to;
+  pc->num_recv_from = num_recv_from;
+  pc->num_send_to = num_send_to;
+  pc->num_per_tree_local = num_per_tree_local;
+  pc->begin_send_to = begin_send_to;
+  pc->global_last_quad_index = global_last_quad_index;
+  pc->new_global_last_quad_index = new_global_last_quad_index;
+  pc->local_tree_last_quad_index = local_tree_last_quad_index;
+  pc->recv_buf = recv_buf;
+  pc->send_buf = send_buf;
+#ifdef P4EST_ENABLE_DEBUG
+  pc->crc = crc;
+#endif
+
+  return pc;
+}
+
+p4est_gloidx_t
+p4est_partition_given_end (p4est_partition_context_t * pc)
+{
+  p4est_t            *p4est = pc->p4est;
+  const int           num_procs = p4est->mpisize;
+  const int           rank = p4est->mpirank;
+  const p4est_topidx_t first_local_tree = p4est->first_local_tree;
+  const p4est_topidx_t last_local_tree = p4est->last_local_tree;
+  const size_t        data_size = p4est->data_size;
+  const p4est_gloidx_t from_begin_global_quad = pc->from_begin;
+  const p4est_gloidx_t from_end_global_quad = pc->from_end;
+  const p4est_gloidx_t to_begin_global_quad = pc->to_begin;
+  const p4est_gloidx_t to_end_global_quad = pc->to_end;
+  const p4est_gloidx_t total_quadrants_shipped = pc->shipped;
+  p4est_locidx_t     *num_recv_from = pc->num_recv_from;
+  p4est_locidx_t     *num_send_to = pc->num_send_to;
+  p4est_locidx_t     *num_per_tree_local = pc->num_per_tree_local;
+  p4est_gloidx_t     *begin_send_to = pc->begin_send_to;
+  p4est_gloidx_t     *global_last_quad_index = pc->global_last_quad_index;
+  p4est_gloidx_t     *new_global_last_quad_index =
+    pc->new_global_last_quad_index;
+  p4est_gloidx_t     *local_tree_last_quad_index =
+    pc->local_tree_last_quad_index;
+  char              **recv_buf = pc->recv_buf;
+  char              **send_buf = pc->send_buf;
+  sc_array_t         *trees = p4est->trees;
+
+  int                 i;
+  int                 from_proc;
+  char               *user_data_recv_buf;
+  size_t              zz, zoffset;
+  p4est_topidx_t      it;
+  p4est_topidx_t      which_tree;
+  p4est_topidx_t      first_tree, last_tree;
+  p4est_topidx_t      num_recv_trees;
+  p4est_topidx_t      new_first_local_tree, new_last_local_tree;
+  p4est_topidx_t      first_from_tree, last_from_tree, from_tree;
+  p4est_locidx_t      num_copy;
+  p4est_locidx_t      num_quadrants;
+  p4est_locidx_t      new_local_num_quadrants;
+  p4est_locidx_t     *new_local_tree_elem_count;
+  p4est_locidx_t     *new_local_tree_elem_count_before;
+  p4est_locidx_t     *num_per_tree_recv_buf;
+  p4est_gloidx_t      tree_from_begin, tree_from_end;
+  p4est_gloidx_t      from_begin, from_end;
+  p4est_gloidx_t      my_base, my_begin, my_end;
+  p4est_gloidx_t     *src_gfq;
+  sc_array_t         *quadrants;
+  p4est_quadrant_t   *quad_recv_buf;
+  p4est_quadrant_t   *quad;
+  p4est_tree_t       *tree;
+  const size_t        quad_plus_data_size = sizeof (p4est_quadrant_t)
+    + data_size;
+  const char         *sizes_recv_buf;
+  p4est_locidx_t      lfirst;
+  size_t              payload_size;
+  int                *dest_sizes;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  const int           num_proc_recv_from = pc->num_proc_recv_from;
+  const int           num_proc_send_to = pc->num_proc_send_to;
+  MPI_Request        *recv_request = pc->recv_request;
+  MPI_Request        *send_request = pc->send_request;
+#endif
+#ifdef P4EST_ENABLE_DEBUG
+  const unsigned      crc = pc->crc;
+#endif
+
+  /* the forest must not have been modified since the begin call */
+  P4EST_ASSERT (pc->revision == p4est->revision);
+  if (!pc->pending) {
+    P4EST_FREE (pc);
+    return 0;
+  }
 
+  /* the trees are rewritten in place */
+  p4est_cow_unshare (p4est);
+
+#ifdef P4EST_ENABLE_MPI
   /* Fill in forest */
   mpiret =
     MPI_Waitall (num_proc_recv_from, recv_request, MPI_STATUSES_IGNORE);
   SC_CHECK_MPI (mpiret);
+
 #endif
 
+  if (pc->dest_sizes != NULL) {
+    /* concatenate the payloads in the order of the new local quadrants */
+    for (from_proc = from_begin_global_quad;
+         from_proc <= from_end_global_quad; ++from_proc) {
+      num_copy = num_recv_from[from_proc];
+      if (num_copy == 0) {
+        /* no quadrants from this process */
+      }
+      else if (from_proc == rank) {
+        lfirst = (p4est_locidx_t)
+          (begin_send_to[rank] - p4est->global_first_quadrant[rank]);
+        p4est_partition_payload_append (pc->dest_sizes, pc->dest_data,
+                                        pc->src_sizes + lfirst,
+                                        pc->src_payloads + lfirst, num_copy);
+      }
+      else {
+        num_recv_trees =        /* same type */
+          p4est->global_first_position[from_proc + 1].p.which_tree
+          - p4est->global_first_position[from_proc].p.which_tree + 1;
+        sizes_recv_buf = recv_buf[from_proc] +
+          num_recv_trees * sizeof (p4est_locidx_t) +
+          quad_plus_data_size * num_copy;
+        dest_sizes = (int *) sc_array_push_count (pc->dest_sizes,
+                                                  (size_t) num_copy);
+        memcpy (dest_sizes, sizes_recv_buf, num_copy * sizeof (int));
+        payload_size = 0;
+        for (zz = 0; zz < (size_t) num_copy; ++zz) {
+          P4EST_ASSERT (dest_sizes[zz] >= 0);
+          payload_size += (size_t) dest_sizes[zz];
+        }
+        if (payload_size > 0) {
+          memcpy (sc_array_push_count (pc->dest_data, payload_size),
+                  sizes_recv_buf + num_copy * sizeof (int), payload_size);
+        }
+      }
+    }
+  }
+
   /* Loop through and fill in */
 
   /* Calculate the local index of the end of each tree in the repartition */
@@ -3554,14 +4320,26 @@ p4est_partition_given (p4est_t * p4est,
   /* Set the global index and count of quadrants instead
    * of calling p4est_comm_count_quadrants
    */
+  src_gfq = NULL;
+  if (p4est->fields != NULL) {
+    /* the fields are sent after the quadrants */
+    src_gfq = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+    src_gfq[0] = 0;
+    for (i = 0; i < num_procs; ++i) {
+      src_gfq[i + 1] = global_last_quad_index[i] + 1;
+    }
+  }
   P4EST_FREE (global_last_quad_index);
   global_last_quad_index = new_global_last_quad_index;
   P4EST_ASSERT (p4est->global_num_quadrants ==
                 new_global_last_quad_index[num_procs - 1] + 1);
   P4EST_ASSERT (p4est->global_first_quadrant[0] == 0);
-  for (i = 0; i < num_procs; ++i) {
-    p4est->global_first_quadrant[i + 1] = global_last_quad_index[i] + 1;
+  if (p4est_comm_partition_write_begin (p4est)) {
+    for (i = 0; i < num_procs; ++i) {
+      p4est->global_first_quadrant[i + 1] = global_last_quad_index[i] + 1;
+    }
   }
+  p4est_comm_partition_write_end (p4est);
   P4EST_FREE (new_global_last_quad_index);
   global_last_quad_index = new_global_last_quad_index = NULL;
 
@@ -3607,12 +4385,24 @@ p4est_partition_given (p4est_t * p4est,
     P4EST_QUADRANT_INIT (&tree->last_desc);
   }
   p4est->local_num_quadrants = new_local_num_quadrants;
+  if (src_gfq != NULL) {
+    p4est_fields_transfer (p4est, src_gfq);
+    P4EST_FREE (src_gfq);
+  }
 
   /* Clean up */
 
 #ifdef P4EST_ENABLE_MPI
   mpiret = MPI_Waitall (num_proc_send_to, send_request, MPI_STATUSES_IGNORE);
   SC_CHECK_MPI (mpiret);
+  if (pc->bytes_request != NULL) {
+    mpiret = MPI_Waitall (num_proc_send_to, pc->bytes_request,
+                          MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (pc->bytes_request);
+  }
+  P4EST_FREE (pc->recv_bytes);
+  P4EST_FREE (pc->send_bytes);
 
 #ifdef P4EST_ENABLE_DEBUG
   for (i = 0; i < num_proc_recv_from; ++i) {
@@ -3656,5 +4446,456 @@ p4est_partition_given (p4est_t * p4est,
      (long long) total_quadrants_shipped,
      total_quadrants_shipped * 100. / p4est->global_num_quadrants);
 
+  P4EST_FREE (pc);
   return total_quadrants_shipped;
 }
+
+p4est_gloidx_t
+p4est_partition_given (p4est_t * p4est,
+                       const p4est_locidx_t * new_num_quadrants_in_proc)
+{
+  P4EST_ASSERT (new_num_quadrants_in_proc != NULL);
+
+  return p4est_partition_given_end
+    (p4est_partition_given_begin (p4est, new_num_quadrants_in_proc));
+}
+
+void
+p4est_cow_share (p4est_t * input, p4est_t * copy)
+{
+  const p4est_topidx_t num_trees = input->connectivity->num_trees;
+  size_t              qcount;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *itree, *ctree;
+  p4est_cow_tree_t   *ct;
+
+  P4EST_ASSERT (copy->cow == NULL);
+  P4EST_ASSERT (copy->user_data_pool == input->user_data_pool);
+
+  /* the forests of one family use the same user data pool */
+  if (input->cow == NULL) {
+    input->cow = P4EST_ALLOC (p4est_cow_t, 1);
+    input->cow->pool_refcount = P4EST_ALLOC (int, 1);
+    *input->cow->pool_refcount = 1;
+    input->cow->trees = P4EST_ALLOC_ZERO (p4est_cow_tree_t *, num_trees);
+  }
+  copy->cow = P4EST_ALLOC (p4est_cow_t, 1);
+  copy->cow->pool_refcount = input->cow->pool_refcount;
+  ++*copy->cow->pool_refcount;
+  copy->cow->trees = P4EST_ALLOC_ZERO (p4est_cow_tree_t *, num_trees);
+
+  for (jt = input->first_local_tree; jt <= input->last_local_tree; ++jt) {
+    itree = p4est_tree_array_index (input->trees, jt);
+    ctree = p4est_tree_array_index (copy->trees, jt);
+    P4EST_ASSERT (ctree->quadrants.elem_count == 0);
+    qcount = itree->quadrants.elem_count;
+
+    /* move a private tree of the input into shared storage */
+    if ((ct = input->cow->trees[jt]) == NULL) {
+      ct = input->cow->trees[jt] = P4EST_ALLOC (p4est_cow_tree_t, 1);
+      ct->refcount = 1;
+      ct->quadrants = itree->quadrants;
+      sc_array_init_view (&itree->quadrants, &ct->quadrants, 0, qcount);
+    }
+    ++ct->refcount;
+    copy->cow->trees[jt] = ct;
+    sc_array_reset (&ctree->quadrants);
+    sc_array_init_view (&ctree->quadrants, &ct->quadrants, 0, qcount);
+  }
+}
+
+int
+p4est_cow_is_shared (p4est_t * p4est, p4est_topidx_t which_tree)
+{
+  P4EST_ASSERT (0 <= which_tree &&
+                which_tree < p4est->connectivity->num_trees);
+
+  return p4est->cow != NULL && p4est->cow->trees[which_tree] != NULL;
+}
+
+void
+p4est_cow_reclaim (p4est_t * p4est)
+{
+  p4est_topidx_t      jt;
+  p4est_cow_tree_t   *ct;
+
+  if (p4est->cow == NULL) {
+    return;
+  }
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    ct = p4est->cow->trees[jt];
+    if (ct != NULL && ct->refcount == 1) {
+      /* nobody else uses the storage; this does not copy anything */
+      p4est_cow_unshare_tree (p4est, jt);
+    }
+  }
+}
+
+void
+p4est_cow_unshare_tree (p4est_t * p4est, p4est_topidx_t which_tree)
+{
+  size_t              zz;
+  void               *data;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  p4est_cow_tree_t   *ct;
+
+  if (!p4est_cow_is_shared (p4est, which_tree)) {
+    return;
+  }
+  ct = p4est->cow->trees[which_tree];
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  P4EST_ASSERT (ct->refcount >= 1);
+  P4EST_ASSERT (!SC_ARRAY_IS_OWNER (&tree->quadrants));
+  P4EST_ASSERT (tree->quadrants.elem_count == ct->quadrants.elem_count);
+
+  if (ct->refcount == 1) {
+    /* the last user takes over the storage and the user data */
+    tree->quadrants = ct->quadrants;
+    P4EST_FREE (ct);
+  }
+  else {
+    sc_array_init (&tree->quadrants, sizeof (p4est_quadrant_t));
+    sc_array_copy (&tree->quadrants, &ct->quadrants);
+    if (p4est->data_size > 0) {
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+        q = p4est_quadrant_array_index (&tree->quadrants, zz);
+        data = sc_mempool_alloc (p4est->user_data_pool);
+        memcpy (data, q->p.user_data, p4est->data_size);
+        q->p.user_data = data;
+      }
+    }
+    --ct->refcount;
+  }
+  p4est->cow->trees[which_tree] = NULL;
+}
+
+void
+p4est_cow_unshare (p4est_t * p4est)
+{
+  p4est_topidx_t      jt;
+
+  if (p4est->cow == NULL) {
+    return;
+  }
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    p4est_cow_unshare_tree (p4est, jt);
+  }
+}
+
+/** Drop one reference to shared tree storage.
+ * \param [in] free_data    If true, the user data is returned to the pool
+ *                          together with the last reference.
+ */
+static void
+p4est_cow_tree_unref (p4est_t * p4est, p4est_cow_tree_t * ct, int free_data)
+{
+  size_t              zz;
+
+  P4EST_ASSERT (ct->refcount >= 1);
+  if (--ct->refcount > 0) {
+    return;
+  }
+  if (free_data) {
+    for (zz = 0; zz < ct->quadrants.elem_count; ++zz) {
+      p4est_quadrant_free_data
+        (p4est, p4est_quadrant_array_index (&ct->quadrants, zz));
+    }
+  }
+  sc_array_reset (&ct->quadrants);
+  P4EST_FREE (ct);
+}
+
+void
+p4est_cow_release_tree (p4est_t * p4est, p4est_topidx_t which_tree)
+{
+  p4est_tree_t       *tree;
+
+  P4EST_ASSERT (p4est_cow_is_shared (p4est, which_tree));
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  sc_array_reset (&tree->quadrants);
+  p4est_cow_tree_unref (p4est, p4est->cow->trees[which_tree], 1);
+  p4est->cow->trees[which_tree] = NULL;
+}
+
+int
+p4est_cow_release (p4est_t * p4est)
+{
+  int                 exclusive;
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_cow_t        *cow = p4est->cow;
+
+  if (cow == NULL) {
+    return 1;
+  }
+
+  /* with the last forest the whole pool goes away */
+  exclusive = (--*cow->pool_refcount == 0);
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    if (cow->trees[jt] != NULL) {
+      sc_array_reset (&tree->quadrants);
+      p4est_cow_tree_unref (p4est, cow->trees[jt], !exclusive);
+    }
+    else if (!exclusive) {
+      for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+        p4est_quadrant_free_data
+          (p4est, p4est_quadrant_array_index (&tree->quadrants, zz));
+      }
+    }
+  }
+  if (exclusive) {
+    P4EST_FREE (cow->pool_refcount);
+  }
+  P4EST_FREE (cow->trees);
+  P4EST_FREE (cow);
+  p4est->cow = NULL;
+
+  return exclusive;
+}
+
+void
+p4est_compact_encode (p4est_compact_t * compact, p4est_locidx_t first,
+                      sc_array_t * quadrants, int with_data)
+{
+  const size_t        count = quadrants->elem_count;
+  size_t              zz;
+  uint64_t           *keys;
+  int8_t             *levels;
+  void              **user_data;
+  p4est_quadrant_t   *q;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+  P4EST_ASSERT (first >= 0);
+  P4EST_ASSERT ((size_t) first + count <= compact->keys.elem_count);
+  if (count == 0) {
+    return;
+  }
+
+  keys = (uint64_t *) sc_array_index (&compact->keys, (size_t) first);
+  levels = (int8_t *) sc_array_index (&compact->levels, (size_t) first);
+  user_data = NULL;
+  if (with_data) {
+    user_data =
+      (void **) sc_array_index (&compact->user_data, (size_t) first);
+  }
+  p4est_quadrant_linear_id_batch ((p4est_quadrant_t *) quadrants->array,
+                                  count, P4EST_OLD_QMAXLEVEL, keys);
+  for (zz = 0; zz < count; ++zz) {
+    q = p4est_quadrant_array_index (quadrants, zz);
+    P4EST_ASSERT (p4est_quadrant_is_inside_root (q));
+    P4EST_ASSERT (q->level <= P4EST_OLD_QMAXLEVEL);
+    levels[zz] = q->level;
+    if (with_data) {
+      user_data[zz] = q->p.user_data;
+    }
+  }
+}
+
+void
+p4est_compact_decode (p4est_compact_t * compact, p4est_locidx_t first,
+                      size_t count, p4est_quadrant_t * quadrants,
+                      int with_data)
+{
+  size_t              zz;
+  const uint64_t     *keys;
+  const int8_t       *levels;
+  void              **user_data;
+  p4est_quadrant_t   *q;
+
+  P4EST_ASSERT (first >= 0);
+  P4EST_ASSERT ((size_t) first + count <= compact->keys.elem_count);
+  if (count == 0) {
+    return;
+  }
+
+  keys = (uint64_t *) sc_array_index (&compact->keys, (size_t) first);
+  levels = (int8_t *) sc_array_index (&compact->levels, (size_t) first);
+  user_data = NULL;
+  if (with_data) {
+    user_data =
+      (void **) sc_array_index (&compact->user_data, (size_t) first);
+  }
+  /* the key encodes the coordinates of the lower left corner */
+  memset (quadrants, -1, count * sizeof (p4est_quadrant_t));
+  p4est_quadrant_set_morton_batch (quadrants, count, P4EST_OLD_QMAXLEVEL,
+                                   keys);
+  for (zz = 0; zz < count; ++zz) {
+    q = quadrants + zz;
+    q->level = levels[zz];
+    q->p.user_data = with_data ? user_data[zz] : NULL;
+  }
+}
+
+/** Write an unsigned integer in groups of 7 bits, lowest group first.
+ * \return             The position after the last byte written.
+ */
+static uint8_t     *
+p4est_balance_put (uint8_t * pos, uint64_t value)
+{
+  while (value >= 0x80) {
+    *pos++ = (uint8_t) (value | 0x80);
+    value >>= 7;
+  }
+  *pos++ = (uint8_t) value;
+  return pos;
+}
+
+/** Read an integer written by p4est_balance_put.
+ * \return             The position after the last byte read.
+ */
+static const uint8_t *
+p4est_balance_get (const uint8_t * pos, const uint8_t * end,
+                   uint64_t * value)
+{
+  int                 shift;
+
+  *value = 0;
+  for (shift = 0;; shift += 7) {
+    SC_CHECK_ABORT (pos < end && shift < 64, "Balance decode overrun");
+    *value |= (uint64_t) (*pos & 0x7f) << shift;
+    if (!(*pos++ & 0x80)) {
+      return pos;
+    }
+  }
+}
+
+/** Map a signed difference to an integer that is small if the difference
+ * is small in absolute value. */
+static uint64_t
+p4est_balance_zigzag (int64_t diff)
+{
+  return diff < 0 ? (((uint64_t) - (diff + 1)) << 1) | 1 :
+    ((uint64_t) diff) << 1;
+}
+
+/** Invert p4est_balance_zigzag. */
+static int64_t
+p4est_balance_unzigzag (uint64_t value)
+{
+  return (value & 1) ? -(int64_t) (value >> 1) - 1 : (int64_t) (value >> 1);
+}
+
+/** Express a coordinate of an extended quadrant in units of a level. */
+static uint64_t
+p4est_balance_coord (p4est_qcoord_t coord, int level)
+{
+  return ((uint64_t) ((int64_t) coord + P4EST_ROOT_LEN)) >>
+    (P4EST_MAXLEVEL - level);
+}
+
+void
+p4est_balance_encode (sc_array_t * quadrants, int first_round,
+                      sc_array_t * bytes)
+{
+  int                 i, level;
+  size_t              zz;
+  uint8_t            *pos;
+  p4est_topidx_t      prev_tree;
+  p4est_qcoord_t      coord[P4EST_DIM], prev[P4EST_DIM];
+  p4est_quadrant_t   *q;
+
+  P4EST_ASSERT (bytes->elem_size == 1);
+  sc_array_resize (bytes,
+                   quadrants->elem_count * P4EST_BALANCE_RECORD_BYTES);
+  pos = (uint8_t *) bytes->array;
+  prev_tree = 0;
+  for (i = 0; i < P4EST_DIM; ++i) {
+    prev[i] = 0;
+  }
+  for (zz = 0; zz < quadrants->elem_count; ++zz) {
+    q = p4est_quadrant_array_index (quadrants, zz);
+    P4EST_ASSERT (p4est_quadrant_is_extended (q));
+    P4EST_ASSERT (q->p.piggy2.which_tree >= prev_tree);
+    level = (int) q->level;
+    *pos++ = (uint8_t) level;
+    pos = p4est_balance_put (pos, (uint64_t)
+                             (q->p.piggy2.which_tree - prev_tree));
+    coord[0] = q->x;
+    coord[1] = q->y;
+#ifdef P4_TO_P8
+    coord[2] = q->z;
+#endif
+    for (i = 0; i < P4EST_DIM; ++i) {
+      pos = p4est_balance_put
+        (pos, p4est_balance_zigzag ((int64_t)
+                                    (p4est_balance_coord (coord[i], level) -
+                                     p4est_balance_coord (prev[i], level))));
+      prev[i] = coord[i];
+    }
+    if (first_round) {
+      P4EST_ASSERT (q->pad16 >= -1 && q->pad16 < 0xff);
+      pos = p4est_balance_put
+        (pos, p4est_balance_zigzag ((int64_t) q->p.piggy2.from_tree -
+                                    q->p.piggy2.which_tree));
+      *pos++ = (uint8_t) (q->pad16 + 1);
+    }
+    else {
+      P4EST_ASSERT (q->p.piggy2.from_tree == -1 && q->pad16 == -1);
+    }
+    prev_tree = q->p.piggy2.which_tree;
+  }
+  P4EST_ASSERT (pos <= (uint8_t *) bytes->array + bytes->elem_count);
+  sc_array_resize (bytes, (size_t) (pos - (uint8_t *) bytes->array));
+}
+
+void
+p4est_balance_decode (sc_array_t * bytes, size_t count, int first_round,
+                      sc_array_t * quadrants)
+{
+  int                 i, level;
+  size_t              zz;
+  uint64_t            value;
+  const uint8_t      *pos, *end;
+  p4est_topidx_t      prev_tree;
+  p4est_qcoord_t      coord[P4EST_DIM], prev[P4EST_DIM];
+  p4est_quadrant_t   *q;
+
+  P4EST_ASSERT (bytes->elem_size == 1);
+  sc_array_resize (quadrants, count);
+  pos = (const uint8_t *) bytes->array;
+  end = pos + bytes->elem_count;
+  prev_tree = 0;
+  for (i = 0; i < P4EST_DIM; ++i) {
+    prev[i] = 0;
+  }
+  for (zz = 0; zz < count; ++zz) {
+    q = p4est_quadrant_array_index (quadrants, zz);
+    SC_CHECK_ABORT (pos < end, "Balance decode overrun");
+    level = (int) *pos++;
+    SC_CHECK_ABORT (level <= P4EST_QMAXLEVEL, "Balance decode level");
+    pos = p4est_balance_get (pos, end, &value);
+    q->p.piggy2.which_tree = prev_tree + (p4est_topidx_t) value;
+    for (i = 0; i < P4EST_DIM; ++i) {
+      pos = p4est_balance_get (pos, end, &value);
+      value = p4est_balance_coord (prev[i], level) +
+        (uint64_t) p4est_balance_unzigzag (value);
+      coord[i] = (p4est_qcoord_t)
+        ((int64_t) (value << (P4EST_MAXLEVEL - level)) - P4EST_ROOT_LEN);
+      prev[i] = coord[i];
+    }
+    q->x = coord[0];
+    q->y = coord[1];
+#ifdef P4_TO_P8
+    q->z = coord[2];
+#endif
+    q->level = (int8_t) level;
+    if (first_round) {
+      pos = p4est_balance_get (pos, end, &value);
+      q->p.piggy2.from_tree = q->p.piggy2.which_tree +
+        (p4est_topidx_t) p4est_balance_unzigzag (value);
+      SC_CHECK_ABORT (pos < end, "Balance decode overrun");
+      q->pad8 = 0;
+      q->pad16 = (int16_t) (*pos++ - 1);
+    }
+    else {
+      p4est_quadrant_pad (q);
+      q->p.piggy2.from_tree = -1;
+    }
+    P4EST_ASSERT (p4est_quadrant_is_extended (q));
+    prev_tree = q->p.piggy2.which_tree;
+  }
+  SC_CHECK_ABORT (pos == end, "Balance decode length");
+}
@@ -173,6 +173,21 @@ void                p4est_tree_compute_overlap (p4est_t * p4est,
                                                 sc_array_t * borders,
                                                 sc_array_t * inseeds);
 
+/** Compute the overlap of a number of insulation layers with a tree.
+ * The result is the same as for p4est_tree_compute_overlap.  Instead of
+ * binary searches for every insulation quadrant, the insulation layers of
+ * all quadrants of a tree are sorted and swept through the tree in one pass,
+ * which takes time linear in the size of \a in and the tree.
+ * The parameters are the same as for p4est_tree_compute_overlap.
+ */
+void                p4est_tree_compute_overlap_sweep (p4est_t * p4est,
+                                                      sc_array_t * in,
+                                                      sc_array_t * out,
+                                                      p4est_connect_type_t
+                                                      balance,
+                                                      sc_array_t * borders,
+                                                      sc_array_t * inseeds);
+
 /** Gets the reduced representation of the overlap that results from using
  * p4est_tree_compute_overlap_new
  * \param [in,out] out  A piggy-sorted subset of tree->quadrants.
@@ -249,6 +264,37 @@ void                p4est_balance_border (p4est_t * p4est,
                                           p4est_replace_t replace_fn,
                                           sc_array_t * borders);
 
+/** Balance several local trees, each as in p4est_balance_subtree_ext.
+ * \param [in,out] p4est      The p4est to work on.
+ * \param [in]     btype      The balance type (face, edge or corner).
+ * \param [in]     trees      The local trees to balance, type p4est_topidx_t.
+ * \param [in]     init_fn    Callback function to initialize the user_data.
+ * \param [in]     replace_fn Callback function invoked for replaced quadrants.
+ * \param [in]     num_threads  If positive, balance the trees concurrently
+ *                              on this many threads.
+ */
+void                p4est_balance_subtrees (p4est_t * p4est,
+                                            p4est_connect_type_t btype,
+                                            sc_array_t * trees,
+                                            p4est_init_t init_fn,
+                                            p4est_replace_t replace_fn,
+                                            int num_threads);
+
+/** Balance the borders of several trees as in p4est_balance_border.
+ * The border of each tree is cut into leaves together with their
+ * descendants.  These regions are balanced independently and merged in order.
+ * \param [in]     trees      The local trees to process, type p4est_topidx_t.
+ * \param [in]     num_threads  If positive, balance the regions concurrently
+ *                              on this many threads.
+ */
+void                p4est_balance_borders (p4est_t * p4est,
+                                           p4est_connect_type_t btype,
+                                           sc_array_t * trees,
+                                           p4est_init_t init_fn,
+                                           p4est_replace_t replace_fn,
+                                           sc_array_t * borders,
+                                           int num_threads);
+
 /** Remove overlaps from a sorted list of quadrants.
  *
  * This is algorithm 8 from H. Sundar, R.S. Sampath and G. Biros
@@ -319,6 +365,37 @@ int                 p4est_next_nonempty_process (int rank,
                                                  p4est_locidx_t *
                                                  num_quadrants_in_proc);
 
+/** Context data of a partition whose messages are in transit.
+ * The members are internal to \ref p4est_partition_given_begin and
+ * \ref p4est_partition_given_end and must not be changed.
+ */
+struct p4est_partition_context
+{
+  p4est_t            *p4est;    /**< The forest being partitioned. */
+  long                revision; /**< The forest may not change meanwhile. */
+  int                 pending;  /**< Boolean: messages have been posted. */
+  p4est_gloidx_t      shipped;  /**< Global count of shipped quadrants. */
+  p4est_gloidx_t      from_begin, from_end; /**< Range of senders to us. */
+  p4est_gloidx_t      to_begin, to_end;     /**< Range of receivers. */
+  int                 num_proc_recv_from, num_proc_send_to;
+  p4est_locidx_t     *num_recv_from, *num_send_to;
+  p4est_locidx_t     *num_per_tree_local;
+  p4est_gloidx_t     *begin_send_to;
+  p4est_gloidx_t     *global_last_quad_index;
+  p4est_gloidx_t     *new_global_last_quad_index;
+  p4est_gloidx_t     *local_tree_last_quad_index;
+  char              **recv_buf, **send_buf;
+  sc_MPI_Request     *recv_request, *send_request;
+  unsigned            crc;      /**< Checksum of the forest in debug mode. */
+  const int          *src_sizes;        /**< Payload sizes or NULL. */
+  const void *const  *src_payloads;     /**< Payload pointers or NULL. */
+  sc_array_t         *dest_sizes;       /**< Received payload sizes. */
+  sc_array_t         *dest_data;        /**< Received payloads. */
+  int                *recv_bytes;       /**< Payload message sizes. */
+  int                *send_bytes;       /**< Payload message sizes. */
+  sc_MPI_Request     *bytes_request;    /**< Sends of the message sizes. */
+};
+
 /** Partition \a p4est given the number of quadrants per proc.
  *
  * Given the desired number of quadrants per proc \a num_quadrants_in_proc
@@ -333,6 +410,202 @@ p4est_gloidx_t      p4est_partition_given (p4est_t * p4est,
                                            const p4est_locidx_t *
                                            num_quadrants_in_proc);
 
+/** Begin to partition \a p4est given the number of quadrants per proc.
+ * The messages with the quadrants and their data are posted and the
+ * function returns without waiting for them.  The forest is not changed.
+ * It must not be modified before \ref p4est_partition_given_end is called.
+ *
+ * \param [in] p4est the forest that will be partitioned.
+ * \param [in] num_quadrants_in_proc  an integer array of the number of
+ *                                    quadrants desired per processor.
+ *                                    If NULL, the partition is kept.
+ * \return  The context to be passed to \ref p4est_partition_given_end.
+ */
+p4est_partition_context_t *p4est_partition_given_begin (p4est_t * p4est,
+                                                        const p4est_locidx_t *
+                                                        num_quadrants_in_proc);
+
+/** Begin to partition \a p4est with a variable-size payload per quadrant.
+ * This function works like \ref p4est_partition_given_begin.  In addition,
+ * the payload of every quadrant is sent in the same message as the
+ * quadrant itself.  It is copied directly from the given pointers into the
+ * message buffer.  The source arrays must stay alive until the partition
+ * is completed by \ref p4est_partition_given_end.  This function then
+ * stores the payloads in the order of the new local quadrants.
+ * The message sizes are exchanged first, such that all receives are
+ * posted before this function returns and the end call only waits.
+ *
+ * \param [in] p4est the forest that will be partitioned.
+ * \param [in] num_quadrants_in_proc  The quadrants desired per processor.
+ *                                    If NULL, the partition is kept.
+ * \param [in] src_sizes     The payload byte count of each local quadrant.
+ * \param [in] src_payloads  For each local quadrant the address of its
+ *                           payload, may be NULL where the size is 0.
+ * \param [out] dest_sizes   Array of int, resized to the new count of
+ *                           local quadrants and filled with payload sizes.
+ * \param [out] dest_data    Array of elem_size 1, resized to hold the
+ *                           concatenated payloads of the new local quadrants.
+ * \return  The context to be passed to \ref p4est_partition_given_end.
+ */
+p4est_partition_context_t *p4est_partition_given_payload_begin
+  (p4est_t * p4est, const p4est_locidx_t * num_quadrants_in_proc,
+   const int *src_sizes, const void *const *src_payloads,
+   sc_array_t * dest_sizes, sc_array_t * dest_data);
+
+/** Complete the partition started by \ref p4est_partition_given_begin.
+ * \param [in] pc       The context is freed.
+ * \return  Returns the global count of shipped quadrants.
+ */
+p4est_gloidx_t      p4est_partition_given_end (p4est_partition_context_t * pc);
+
+/** Quadrant storage of one tree shared by copy-on-write forests.
+ * The forests sharing it hold views of \a quadrants in their trees.
+ */
+typedef struct p4est_cow_tree
+{
+  int                 refcount; /**< Number of forests using the storage. */
+  sc_array_t          quadrants;        /**< The shared quadrants. */
+}
+p4est_cow_tree_t;
+
+/** Copy-on-write state of a forest, see \ref p4est_copy_cow.
+ * All forests created from each other by \ref p4est_copy_cow use the same
+ * user data pool, which is destroyed with the last of them.  The user data
+ * of the quadrants in a shared tree is shared as well.
+ */
+struct p4est_cow
+{
+  int                *pool_refcount;    /**< Forests using the data pool. */
+  p4est_cow_tree_t  **trees;    /**< Shared storage per tree or NULL. */
+};
+
+/** Share the local trees of a forest with a shallow copy of it.
+ * \param [in,out] input  Its trees are converted to shared storage.
+ * \param [in,out] copy   Must have the same trees as \a input without any
+ *                        quadrants and use the same user data pool.
+ */
+void                p4est_cow_share (p4est_t * input, p4est_t * copy);
+
+/** Query whether a tree uses storage shared with other forests.
+ * \param [in] p4est        Valid forest.
+ * \param [in] which_tree   Index of a local tree.
+ * \return                  True if the tree must not be modified in place.
+ */
+int                 p4est_cow_is_shared (p4est_t * p4est,
+                                         p4est_topidx_t which_tree);
+
+/** Take over the shared storage that no other forest uses anymore.
+ * This is cheap and should be called before modifying the forest.
+ * \param [in,out] p4est    Valid forest.
+ */
+void                p4est_cow_reclaim (p4est_t * p4est);
+
+/** Give a tree private storage that can be modified in place.
+ * The user data of the quadrants is duplicated unless no other forest
+ * uses the storage anymore.
+ * \param [in,out] p4est    Valid forest.
+ * \param [in] which_tree   Index of a local tree, may be private already.
+ */
+void                p4est_cow_unshare_tree (p4est_t * p4est,
+                                            p4est_topidx_t which_tree);
+
+/** Give all local trees private storage.
+ * \param [in,out] p4est    Valid forest.
+ */
+void                p4est_cow_unshare (p4est_t * p4est);
+
+/** Stop using the shared storage of a tree whose quadrants are replaced.
+ * The tree's view is reset; the shared user data is not accessed.
+ * \param [in,out] p4est    Valid forest.
+ * \param [in] which_tree   Index of a shared local tree.
+ */
+void                p4est_cow_release_tree (p4est_t * p4est,
+                                            p4est_topidx_t which_tree);
+
+/** Detach the forest from all forests it shares storage with.
+ * Shared trees are released and left empty.  If the user data pool stays
+ * with other forests, the user data of the private trees is returned to it.
+ * \param [in,out] p4est    Valid forest; its trees must be reset or their
+ *                          user data be reassigned by the caller.
+ * \return                  True if the caller owns the user data pool
+ *                          exclusively and must destroy it.
+ */
+int                 p4est_cow_release (p4est_t * p4est);
+
+/** Compact storage of the local quadrants of a forest.
+ * The arrays are indexed by the process-local quadrant number.
+ */
+struct p4est_compact
+{
+  sc_array_t          keys;     /**< uint64_t Morton index of the first
+                                     descendant at P4EST_OLD_QMAXLEVEL. */
+  sc_array_t          levels;   /**< int8_t level of the quadrant. */
+  sc_array_t          user_data;        /**< void * user data if the
+                                             forest has data_size > 0. */
+};
+
+/** Store contiguous quadrants in compact storage.
+ * \param [in,out] compact  Its arrays must be sized to hold the quadrants.
+ * \param [in] first        Index of the first quadrant in \a compact.
+ * \param [in] quadrants    Quadrants no finer than P4EST_OLD_QMAXLEVEL.
+ * \param [in] with_data    If true, the user_data pointers are stored.
+ */
+void                p4est_compact_encode (p4est_compact_t * compact,
+                                          p4est_locidx_t first,
+                                          sc_array_t * quadrants,
+                                          int with_data);
+
+/** Restore contiguous quadrants from compact storage.
+ * \param [in] compact      Compact storage.
+ * \param [in] first        Index of the first quadrant in \a compact.
+ * \param [in] count        Number of quadrants.
+ * \param [out] quadrants   Array of at least \a count quadrants.
+ * \param [in] with_data    If true, the user_data pointers are restored,
+ *                          otherwise they are set to NULL.
+ */
+void                p4est_compact_decode (p4est_compact_t * compact,
+                                          p4est_locidx_t first, size_t count,
+                                          p4est_quadrant_t * quadrants,
+                                          int with_data);
+
+/** Upper bound for the bytes of a quadrant encoded by p4est_balance_encode:
+ * level, tree increment, coordinates, source tree and contact index. */
+#define P4EST_BALANCE_RECORD_BYTES (12 + 5 * P4EST_DIM)
+
+/** Encode quadrants sorted by tree and Morton index for the balance exchange.
+ * Each quadrant is written as its level, the increment of its tree number
+ * and the differences of its coordinates to those of the previous quadrant
+ * in units of its own level.  Neighboring quadrants take a few bytes each.
+ * \param [in] first_round  If true, also write the tree the quadrant comes
+ *                          from and its contact index stored in pad16.  In
+ *                          the second round these are -1 by construction.
+ * \param [out] bytes       Array of element size one, resized to the code.
+ */
+void                p4est_balance_encode (sc_array_t * quadrants,
+                                          int first_round,
+                                          sc_array_t * bytes);
+
+/** Decode the quadrants written by p4est_balance_encode.
+ * \param [in] bytes        The complete code as received.
+ * \param [in] count        The number of quadrants in the code.
+ * \param [in] first_round  Must match the value passed to the encoder.
+ * \param [out] quadrants   Resized to \a count and overwritten.
+ */
+void                p4est_balance_decode (sc_array_t * bytes,
+                                          size_t count, int first_round,
+                                          sc_array_t * quadrants);
+
+/** Record the bytes in use by an algorithm phase.
+ * This function does nothing if the forest has no inspect structure.
+ * \param [in,out] p4est  The memory accounting of its inspect structure
+ *                        is updated.
+ * \param [in] phase      The subsystem or algorithm phase.
+ * \param [in] bytes      Bytes currently in use by the phase.
+ */
+void                p4est_memory_record (p4est_t * p4est,
+                                         p4est_memory_phase_t phase,
+                                         size_t bytes);
+
 SC_EXTERN_C_END;
 
 #endif /* !P4EST_ALGORITHMS_H */
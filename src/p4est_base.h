@@ -154,10 +154,27 @@ typedef enum p4est_comm_tag
   P4EST_COMM_LNODES_PASS,
   P4EST_COMM_LNODES_OWNED,
   P4EST_COMM_LNODES_ALL,
+  P4EST_COMM_COST_TRANSFER,
+  P4EST_COMM_FIELDS_TRANSFER,
+  P4EST_COMM_PARTITION_GIVEN_BYTES,
+  P4EST_COMM_GHOST_EXCHANGE_PLAN,
   P4EST_COMM_TAG_LAST
 }
 p4est_comm_tag_t;
 
+/** Subsystems and algorithm phases of the memory accounting that is
+ * recorded in the inspect structure of a forest. */
+typedef enum p4est_memory_phase
+{
+  P4EST_MEMORY_FOREST,          /**< the forest, see p4est_memory_used */
+  P4EST_MEMORY_CONNECTIVITY,    /**< the connectivity of the forest */
+  P4EST_MEMORY_BALANCE,         /**< p4est_balance_ext */
+  P4EST_MEMORY_GHOST,           /**< p4est_ghost_new and its variants */
+  P4EST_MEMORY_LNODES,          /**< p4est_lnodes_new */
+  P4EST_MEMORY_NUM_PHASES
+}
+p4est_memory_phase_t;
+
 /* some error checking possibly specific to p4est */
 #ifdef P4EST_ENABLE_DEBUG
 #define P4EST_ASSERT(c) SC_CHECK_ABORT ((c), "Assertion '" #c "'")
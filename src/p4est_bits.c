@@ -30,6 +30,18 @@
 #include <p4est_extended.h>
 #endif /* !P4_TO_P8 */
 
+/* pdep and pext interleave bits in one instruction on x86-64 with BMI2 */
+#if defined (__GNUC__) && defined (__x86_64__)
+#define P4EST_BITS_BMI2
+#include <immintrin.h>
+#endif
+
+#ifndef P4_TO_P8
+#define P4EST_MORTON_MASK 0x5555555555555555ULL
+#else
+#define P4EST_MORTON_MASK 0x1249249249249249ULL
+#endif
+
 /* Function declarations for 128 bit unsigned integers
  * are in p{4,8}est_extended.h. */
 int
@@ -412,6 +424,56 @@ p4est_quadrant_compare (const void *v1, const void *v2)
   return (diff == 0) ? 0 : ((diff < 0) ? -1 : 1);
 }
 
+void
+p4est_quadrant_compare_batch (const p4est_quadrant_t * quadrants,
+                              size_t count, const p4est_quadrant_t * pivot,
+                              int *results)
+{
+  /* adding 2^(P4EST_MAXLEVEL + 2) to negative coordinates is a cast */
+  const uint32_t      px = (uint32_t) pivot->x;
+  const uint32_t      py = (uint32_t) pivot->y;
+#ifdef P4_TO_P8
+  const uint32_t      pz = (uint32_t) pivot->z;
+  uint32_t            qz, exclorz;
+#endif
+  uint32_t            qx, qy, exclorx, exclory, exclorxy, exclor;
+  uint32_t            a, b;
+  size_t              zz;
+  const p4est_quadrant_t *q;
+
+  P4EST_ASSERT (p4est_quadrant_is_node (pivot, 1) ||
+                p4est_quadrant_is_extended (pivot));
+
+  /* the most significant differing bit selects the coordinate to compare */
+  for (zz = 0; zz < count; ++zz) {
+    q = quadrants + zz;
+    P4EST_ASSERT (p4est_quadrant_is_node (q, 1) ||
+                  p4est_quadrant_is_extended (q));
+    qx = (uint32_t) q->x;
+    qy = (uint32_t) q->y;
+    exclorx = qx ^ px;
+    exclory = qy ^ py;
+    exclor = exclorxy = exclorx | exclory;
+    a = qx;
+    b = px;
+    if (exclory > (exclorxy ^ exclory)) {
+      a = qy;
+      b = py;
+    }
+#ifdef P4_TO_P8
+    qz = (uint32_t) q->z;
+    exclorz = qz ^ pz;
+    exclor = exclorxy | exclorz;
+    if (exclorz > (exclor ^ exclorz)) {
+      a = qz;
+      b = pz;
+    }
+#endif
+    results[zz] = exclor ? (a > b) - (a < b) :
+      (q->level > pivot->level) - (q->level < pivot->level);
+  }
+}
+
 int
 p4est_quadrant_disjoint (const void *a, const void *b)
 {
@@ -2113,36 +2175,162 @@ p4est_quadrant_shift_corner (const p4est_quadrant_t * q,
   P4EST_ASSERT (p4est_quadrant_touches_corner (r, corner, 1));
 }
 
-uint64_t
-p4est_quadrant_linear_id (const p4est_quadrant_t * quadrant, int level)
+/** Spread the low bits of a coordinate to every P4EST_DIM-th bit.
+ * This handles 32 bits in 2D and 21 bits in 3D.
+ */
+static inline uint64_t
+p4est_morton_spread (uint64_t c)
 {
-  int                 i;
-  uint64_t            id;
-  uint64_t            x, y;
-#ifdef P4_TO_P8
-  uint64_t            z;
+#ifndef P4_TO_P8
+  c &= 0x00000000ffffffffULL;
+  c = (c | (c << 16)) & 0x0000ffff0000ffffULL;
+  c = (c | (c << 8)) & 0x00ff00ff00ff00ffULL;
+  c = (c | (c << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  c = (c | (c << 2)) & 0x3333333333333333ULL;
+  c = (c | (c << 1)) & 0x5555555555555555ULL;
+#else
+  c &= 0x00000000001fffffULL;
+  c = (c | (c << 32)) & 0x001f00000000ffffULL;
+  c = (c | (c << 16)) & 0x001f0000ff0000ffULL;
+  c = (c | (c << 8)) & 0x100f00f00f00f00fULL;
+  c = (c | (c << 4)) & 0x10c30c30c30c30c3ULL;
+  c = (c | (c << 2)) & 0x1249249249249249ULL;
 #endif
+  return c;
+}
 
-  P4EST_ASSERT (p4est_quadrant_is_extended (quadrant));
-  P4EST_ASSERT (0 <= level && level <= P4EST_OLD_MAXLEVEL);
+/** Gather every P4EST_DIM-th bit of a Morton index, the inverse of
+ * p4est_morton_spread.
+ */
+static inline uint64_t
+p4est_morton_compact (uint64_t id)
+{
+#ifndef P4_TO_P8
+  id &= 0x5555555555555555ULL;
+  id = (id | (id >> 1)) & 0x3333333333333333ULL;
+  id = (id | (id >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+  id = (id | (id >> 4)) & 0x00ff00ff00ff00ffULL;
+  id = (id | (id >> 8)) & 0x0000ffff0000ffffULL;
+  id = (id | (id >> 16)) & 0x00000000ffffffffULL;
+#else
+  id &= 0x1249249249249249ULL;
+  id = (id | (id >> 2)) & 0x10c30c30c30c30c3ULL;
+  id = (id | (id >> 4)) & 0x100f00f00f00f00fULL;
+  id = (id | (id >> 8)) & 0x001f0000ff0000ffULL;
+  id = (id | (id >> 16)) & 0x001f00000000ffffULL;
+  id = (id | (id >> 32)) & 0x00000000001fffffULL;
+#endif
+  return id;
+}
 
+/** Interleave the coordinates of a quadrant shifted to a grid level.
+ * \param [in] shift   P4EST_MAXLEVEL minus the level of the grid.
+ * \param [in] mask    The lowest level + 2 bits are set.
+ */
+static inline uint64_t
+p4est_morton_encode (const p4est_quadrant_t * q, int shift, uint64_t mask)
+{
   /* this preserves the high bits from negative numbers */
-  x = quadrant->x >> (P4EST_MAXLEVEL - level);
-  y = quadrant->y >> (P4EST_MAXLEVEL - level);
+  return p4est_morton_spread ((uint64_t) (q->x >> shift) & mask) |
+    p4est_morton_spread ((uint64_t) (q->y >> shift) & mask) << 1 |
 #ifdef P4_TO_P8
-  z = quadrant->z >> (P4EST_MAXLEVEL - level);
+    p4est_morton_spread ((uint64_t) (q->z >> shift) & mask) << 2 |
 #endif
+    0;
+}
 
-  id = 0;
-  for (i = 0; i < level + 2; ++i) {
-    id |= ((x & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i));
-    id |= ((y & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i + 1));
+/** Set the coordinates of a quadrant from a Morton index of a grid level.
+ * \param [in] shift   P4EST_MAXLEVEL minus the level of the grid.
+ */
+static inline void
+p4est_morton_decode (p4est_quadrant_t * q, int shift, uint64_t id)
+{
+  /* this may set the sign bit to create negative numbers */
+  q->x = (p4est_qcoord_t) ((uint32_t) p4est_morton_compact (id) << shift);
+  q->y = (p4est_qcoord_t) ((uint32_t) p4est_morton_compact (id >> 1)
+                           << shift);
+#ifdef P4_TO_P8
+  q->z = (p4est_qcoord_t) ((uint32_t) p4est_morton_compact (id >> 2)
+                           << shift);
+#endif
+}
+
+#ifdef P4EST_BITS_BMI2
+
+static void         __attribute__ ((target ("bmi2")))
+p4est_linear_id_batch_bmi2 (const p4est_quadrant_t * quadrants,
+                            size_t count, int shift, uint64_t mask,
+                            uint64_t * ids)
+{
+  size_t              zz;
+  const p4est_quadrant_t *q;
+
+  for (zz = 0; zz < count; ++zz) {
+    q = quadrants + zz;
+    ids[zz] =
+      _pdep_u64 ((uint64_t) (q->x >> shift) & mask, P4EST_MORTON_MASK) |
+      _pdep_u64 ((uint64_t) (q->y >> shift) & mask, P4EST_MORTON_MASK << 1) |
 #ifdef P4_TO_P8
-    id |= ((z & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i + 2));
+      _pdep_u64 ((uint64_t) (q->z >> shift) & mask, P4EST_MORTON_MASK << 2) |
 #endif
+      0;
   }
+}
 
-  return id;
+static void         __attribute__ ((target ("bmi2")))
+p4est_set_morton_batch_bmi2 (p4est_quadrant_t * quadrants, size_t count,
+                             int level, const uint64_t * ids)
+{
+  const int           shift = P4EST_MAXLEVEL - level;
+  size_t              zz;
+  p4est_quadrant_t   *q;
+
+  for (zz = 0; zz < count; ++zz) {
+    q = quadrants + zz;
+    q->x = (p4est_qcoord_t)
+      ((uint32_t) _pext_u64 (ids[zz], P4EST_MORTON_MASK) << shift);
+    q->y = (p4est_qcoord_t)
+      ((uint32_t) _pext_u64 (ids[zz], P4EST_MORTON_MASK << 1) << shift);
+#ifdef P4_TO_P8
+    q->z = (p4est_qcoord_t)
+      ((uint32_t) _pext_u64 (ids[zz], P4EST_MORTON_MASK << 2) << shift);
+#endif
+    q->level = (int8_t) level;
+  }
+}
+
+#endif /* P4EST_BITS_BMI2 */
+
+uint64_t
+p4est_quadrant_linear_id (const p4est_quadrant_t * quadrant, int level)
+{
+  P4EST_ASSERT (p4est_quadrant_is_extended (quadrant));
+  P4EST_ASSERT (0 <= level && level <= P4EST_OLD_MAXLEVEL);
+
+  return p4est_morton_encode (quadrant, P4EST_MAXLEVEL - level,
+                              ((uint64_t) 1 << (level + 2)) - 1);
+}
+
+void
+p4est_quadrant_linear_id_batch (const p4est_quadrant_t * quadrants,
+                                size_t count, int level, uint64_t * ids)
+{
+  const int           shift = P4EST_MAXLEVEL - level;
+  const uint64_t      mask = ((uint64_t) 1 << (level + 2)) - 1;
+  size_t              zz;
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_OLD_MAXLEVEL);
+
+#ifdef P4EST_BITS_BMI2
+  if (__builtin_cpu_supports ("bmi2")) {
+    p4est_linear_id_batch_bmi2 (quadrants, count, shift, mask, ids);
+    return;
+  }
+#endif
+  for (zz = 0; zz < count; ++zz) {
+    P4EST_ASSERT (p4est_quadrant_is_extended (quadrants + zz));
+    ids[zz] = p4est_morton_encode (quadrants + zz, shift, mask);
+  }
 }
 
 void
@@ -2182,48 +2370,178 @@ void
 p4est_quadrant_set_morton (p4est_quadrant_t * quadrant,
                            int level, uint64_t id)
 {
-  int                 i;
-
   P4EST_ASSERT (0 <= level && level <= P4EST_OLD_QMAXLEVEL);
   P4EST_ASSERT (id < ((uint64_t) 1 << P4EST_DIM * (level + 2)));
 
   quadrant->level = (int8_t) level;
-  quadrant->x = 0;
-  quadrant->y = 0;
-#ifdef P4_TO_P8
-  quadrant->z = 0;
-#endif
+  p4est_morton_decode (quadrant, P4EST_MAXLEVEL - level, id);
 
-  /* this may set the sign bit to create negative numbers */
-  for (i = 0; i < level + 2; ++i) {
-    quadrant->x |= (p4est_qcoord_t) ((id & (1ULL << (P4EST_DIM * i)))
-                                     >> ((P4EST_DIM - 1) * i));
-    quadrant->y |= (p4est_qcoord_t) ((id & (1ULL << (P4EST_DIM * i + 1)))
-                                     >> ((P4EST_DIM - 1) * i + 1));
-#ifdef P4_TO_P8
-    quadrant->z |= (p4est_qcoord_t) ((id & (1ULL << (P4EST_DIM * i + 2)))
-                                     >> ((P4EST_DIM - 1) * i + 2));
+  P4EST_ASSERT (p4est_quadrant_is_extended (quadrant));
+}
+
+void
+p4est_quadrant_set_morton_batch (p4est_quadrant_t * quadrants, size_t count,
+                                 int level, const uint64_t * ids)
+{
+  size_t              zz;
+
+  P4EST_ASSERT (0 <= level && level <= P4EST_OLD_QMAXLEVEL);
+
+#ifdef P4EST_BITS_BMI2
+  if (__builtin_cpu_supports ("bmi2")) {
+    p4est_set_morton_batch_bmi2 (quadrants, count, level, ids);
+    return;
+  }
 #endif
+  for (zz = 0; zz < count; ++zz) {
+    P4EST_ASSERT (ids[zz] < ((uint64_t) 1 << P4EST_DIM * (level + 2)));
+    quadrants[zz].level = (int8_t) level;
+    p4est_morton_decode (quadrants + zz, P4EST_MAXLEVEL - level, ids[zz]);
   }
+}
 
-  quadrant->x <<= (P4EST_MAXLEVEL - level);
-  quadrant->y <<= (P4EST_MAXLEVEL - level);
-#ifdef P4_TO_P8
-  quadrant->z <<= (P4EST_MAXLEVEL - level);
+/** Arrays shorter than this are sorted by comparison. */
+#define P4EST_RADIX_MIN 128
 
-#if P4EST_MAXLEVEL < 30         /* This is never true on purpose. */
-  SC_ABORT_NOT_REACHED ();
-  /* this was needed when number of bits could be more than MAXLEVEL + 2 */
-  if (quadrant->x >= (p4est_qcoord_t) 1 << (P4EST_MAXLEVEL + 1))
-    quadrant->x -= (p4est_qcoord_t) 1 << (P4EST_MAXLEVEL + 2);
-  if (quadrant->y >= (p4est_qcoord_t) 1 << (P4EST_MAXLEVEL + 1))
-    quadrant->y -= (p4est_qcoord_t) 1 << (P4EST_MAXLEVEL + 2);
-  if (quadrant->z >= (p4est_qcoord_t) 1 << (P4EST_MAXLEVEL + 1))
-    quadrant->z -= (p4est_qcoord_t) 1 << (P4EST_MAXLEVEL + 2);
-#endif
+/** Key words of a radix record: level, Morton index, and tree. */
+#define P4EST_RADIX_WORDS (P4EST_DIM + 2)
+
+/** Number of 8-bit digits in a key; the level needs only one. */
+#define P4EST_RADIX_DIGITS (1 + 4 * (P4EST_RADIX_WORDS - 1))
+
+/** A sort key and the original position of a quadrant.
+ * The key words are ordered from least to most significant.
+ */
+typedef struct p4est_radix_record
+{
+  uint32_t            key[P4EST_RADIX_WORDS];
+  size_t              index;
+}
+p4est_radix_record_t;
+
+/** Compute the radix sort key of a quadrant.
+ * Sorting the keys lexicographically is the order of
+ * \ref p4est_quadrant_compare_piggy if \a piggy is true and
+ * \ref p4est_quadrant_compare otherwise.
+ */
+static void
+p4est_radix_key (const p4est_quadrant_t * q, int piggy, uint32_t * key)
+{
+  /* adding 2^(P4EST_MAXLEVEL + 2) to negative coordinates is a cast */
+  const uint32_t      ux = (uint32_t) q->x;
+  const uint32_t      uy = (uint32_t) q->y;
+#ifndef P4_TO_P8
+  uint64_t            m;
+
+  m = p4est_morton_spread (ux) | p4est_morton_spread (uy) << 1;
+  key[1] = (uint32_t) m;
+  key[2] = (uint32_t) (m >> 32);
+#else
+  const uint32_t      uz = (uint32_t) q->z;
+  uint64_t            lo, hi;
+
+  /* the 96-bit index is split into the low 21 and high 11 bits per axis */
+  lo = p4est_morton_spread (ux) | p4est_morton_spread (uy) << 1 |
+    p4est_morton_spread (uz) << 2;
+  hi = p4est_morton_spread (ux >> 21) | p4est_morton_spread (uy >> 21) << 1 |
+    p4est_morton_spread (uz >> 21) << 2;
+  key[1] = (uint32_t) lo;
+  key[2] = (uint32_t) (lo >> 32 | hi << 31);
+  key[3] = (uint32_t) (hi >> 1);
 #endif
+  key[0] = (uint32_t) q->level;
+  P4EST_ASSERT (!piggy || q->p.which_tree >= 0);
+  key[P4EST_RADIX_WORDS - 1] = piggy ? (uint32_t) q->p.which_tree : 0;
+}
 
-  P4EST_ASSERT (p4est_quadrant_is_extended (quadrant));
+/** Sort an array of quadrants by a least significant digit radix sort. */
+static void
+p4est_radix_sort (sc_array_t * quadrants, int piggy)
+{
+  const size_t        n = quadrants->elem_count;
+  int                 d, w, s;
+  size_t              zz, sum, c;
+  size_t             *hist, *h;
+  uint32_t            digit;
+  p4est_radix_record_t *rec, *tmp, *swap;
+  p4est_quadrant_t   *q, *sorted;
+
+  P4EST_ASSERT (quadrants->elem_size == sizeof (p4est_quadrant_t));
+
+  if (n < P4EST_RADIX_MIN) {
+    sc_array_sort (quadrants, piggy ? p4est_quadrant_compare_piggy :
+                   p4est_quadrant_compare);
+    return;
+  }
+
+  /* compute the keys and the histograms of all digits in one pass */
+  rec = P4EST_ALLOC (p4est_radix_record_t, n);
+  tmp = P4EST_ALLOC (p4est_radix_record_t, n);
+  hist = P4EST_ALLOC_ZERO (size_t, P4EST_RADIX_DIGITS * 256);
+  q = (p4est_quadrant_t *) quadrants->array;
+  for (zz = 0; zz < n; ++zz) {
+    P4EST_ASSERT (p4est_quadrant_is_node (q + zz, 1) ||
+                  p4est_quadrant_is_extended (q + zz));
+    p4est_radix_key (q + zz, piggy, rec[zz].key);
+    rec[zz].index = zz;
+    ++hist[rec[zz].key[0] & 0xff];
+    for (d = 1; d < P4EST_RADIX_DIGITS; ++d) {
+      w = 1 + (d - 1) / 4;
+      s = 8 * ((d - 1) % 4);
+      ++hist[256 * d + ((rec[zz].key[w] >> s) & 0xff)];
+    }
+  }
+
+  /* stable counting sort by each digit that is not constant */
+  for (d = 0; d < P4EST_RADIX_DIGITS; ++d) {
+    w = (d == 0) ? 0 : 1 + (d - 1) / 4;
+    s = (d == 0) ? 0 : 8 * ((d - 1) % 4);
+    h = hist + 256 * d;
+    for (c = 0; c < 256; ++c) {
+      if (h[c] == n) {
+        break;
+      }
+    }
+    if (c < 256) {
+      continue;
+    }
+    for (sum = 0, c = 0; c < 256; ++c) {
+      zz = h[c];
+      h[c] = sum;
+      sum += zz;
+    }
+    for (zz = 0; zz < n; ++zz) {
+      digit = (rec[zz].key[w] >> s) & 0xff;
+      tmp[h[digit]++] = rec[zz];
+    }
+    swap = rec;
+    rec = tmp;
+    tmp = swap;
+  }
+
+  /* apply the permutation */
+  sorted = P4EST_ALLOC (p4est_quadrant_t, n);
+  for (zz = 0; zz < n; ++zz) {
+    sorted[zz] = q[rec[zz].index];
+  }
+  memcpy (q, sorted, n * sizeof (p4est_quadrant_t));
+
+  P4EST_FREE (sorted);
+  P4EST_FREE (hist);
+  P4EST_FREE (tmp);
+  P4EST_FREE (rec);
+}
+
+void
+p4est_quadrant_array_sort (sc_array_t * quadrants)
+{
+  p4est_radix_sort (quadrants, 0);
+}
+
+void
+p4est_quadrant_array_sort_piggy (sc_array_t * quadrants)
+{
+  p4est_radix_sort (quadrants, 1);
 }
 
 void
@@ -88,6 +88,20 @@ int                 p4est_quadrant_is_equal_piggy (const p4est_quadrant_t *
  */
 int                 p4est_quadrant_compare (const void *v1, const void *v2);
 
+/** Compare an array of quadrants against one quadrant in Morton ordering.
+ * The result is the sign of \ref p4est_quadrant_compare for every quadrant.
+ * \param [in] quadrants   Array of \a count valid quadrants.
+ * \param [in] count       Number of quadrants.
+ * \param [in] pivot       Valid quadrant to compare against.
+ * \param [out] results    Array of \a count entries set to -1, 0, or 1
+ *                         if the quadrant is smaller than, equal to,
+ *                         or larger than \a pivot.
+ */
+void                p4est_quadrant_compare_batch (const p4est_quadrant_t *
+                                                quadrants, size_t count,
+                                                const p4est_quadrant_t *
+                                                pivot, int *results);
+
 /** Compare two quadrants in their Morton ordering, with equivalence if the
  * two quadrants overlap.
  * \return Returns < 0 if \a v1 < \a v2 and \a v1 and \a v2 do not overlap,
@@ -105,6 +119,21 @@ int                 p4est_quadrant_disjoint (const void *v1, const void *v2);
 int                 p4est_quadrant_compare_piggy (const void *v1,
                                                   const void *v2);
 
+/** Sort an array of quadrants in the order of \ref p4est_quadrant_compare.
+ * This is a radix sort on the Morton index and level of the quadrants.
+ * \param [in,out] quadrants    Array of extended quadrants or nodes.
+ */
+void                p4est_quadrant_array_sort (sc_array_t * quadrants);
+
+/** Sort an array of quadrants in the order of
+ * \ref p4est_quadrant_compare_piggy.
+ * This is a radix sort on the tree, Morton index, and level of the quadrants.
+ * \param [in,out] quadrants    Array of extended quadrants or nodes
+ *                              with non-negative which_tree members.
+ */
+void                p4est_quadrant_array_sort_piggy (sc_array_t *
+                                                        quadrants);
+
 /** Compare two quadrants with respect to their local_num in the piggy3 member.
  * \return Returns < 0 if \a v1 < \a v2,
  *                   0 if \a v1 == \a v2,
@@ -658,6 +687,18 @@ void                p4est_quadrant_shift_corner (const p4est_quadrant_t * q,
 uint64_t            p4est_quadrant_linear_id (const p4est_quadrant_t *
                                               quadrant, int level);
 
+/** Compute the linear positions of an array of quadrants in a uniform grid.
+ * The result is that of \ref p4est_quadrant_linear_id for every quadrant.
+ * Where the processor supports it, this uses the BMI2 instructions.
+ * \param [in] quadrants   Array of \a count quadrants.
+ * \param [in] count       Number of quadrants.
+ * \param [in] level       The level of the regular grid.
+ * \param [out] ids        Array of \a count linear positions.
+ */
+void                p4est_quadrant_linear_id_batch (const p4est_quadrant_t *
+                                                  quadrants, size_t count,
+                                                  int level, uint64_t * ids);
+
 /** Set quadrant Morton indices based on linear position in uniform grid.
  * This is the inverse operation of \ref p4est_quadrant_linear_id.
  * \param [in,out] quadrant  Quadrant whose Morton indices will be set.
@@ -668,6 +709,20 @@ uint64_t            p4est_quadrant_linear_id (const p4est_quadrant_t *
 void                p4est_quadrant_set_morton (p4est_quadrant_t * quadrant,
                                                int level, uint64_t id);
 
+/** Set an array of quadrants from their linear positions in a uniform grid.
+ * The result is that of \ref p4est_quadrant_set_morton for every quadrant.
+ * Where the processor supports it, this uses the BMI2 instructions.
+ * \param [out] quadrants  Array of \a count quadrants whose coordinates
+ *                         and level are set.  The user_data is not modified.
+ * \param [in] count       Number of quadrants.
+ * \param [in] level       Level of the grid and of the resulting quadrants.
+ * \param [in] ids         Array of \a count linear positions.
+ */
+void                p4est_quadrant_set_morton_batch (p4est_quadrant_t *
+                                                   quadrants, size_t count,
+                                                   int level,
+                                                   const uint64_t * ids);
+
 /** Compute the successor according to the Morton index in a uniform mesh.
  * \param[in] quadrant  Quadrant whose Morton successor will be computed.
  *                      Must not be the last (top right) quadrant in the tree.
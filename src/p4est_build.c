@@ -105,10 +105,15 @@ p4est_build_new (p4est_t * from, size_t data_size,
   p4est->data_size = data_size;
   p4est->user_pointer = user_pointer;
   p4est->revision = 0;
+  p4est->balance_type = 0;
   p4est->local_num_quadrants = 0;
   p4est->global_num_quadrants = 0;
   p4est->global_first_quadrant = NULL;
   p4est->global_first_position = NULL;
+  p4est->partition_shared = NULL;
+  p4est->cow = NULL;
+  p4est->fields = NULL;
+  p4est->compact = NULL;
   p4est->trees = NULL;
   p4est->user_data_pool = NULL;
   p4est->quadrant_pool = NULL;
@@ -137,6 +142,8 @@ p4est_build_new (p4est_t * from, size_t data_size,
 
     /* this is tempmorary just to pass the information along */
     ptree->maxlevel = ftree->maxlevel;
+    ptree->changed = 0;
+    ptree->unbalanced = 0;
   }
   if (p4est->data_size > 0) {
     p4est->user_data_pool = sc_mempool_new (p4est->data_size);
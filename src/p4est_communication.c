@@ -167,6 +167,12 @@ p4est_comm_parallel_env_reduce_ext (p4est_t ** p4est_supercomm,
     return 1;
   }
 
+  /* the reduced forest keeps private partition arrays */
+  if (p4est->partition_shared != NULL) {
+    p4est_comm_partition_unshare (p4est);
+    global_first_position = p4est->global_first_position;
+  }
+
   /* create sub-group of non-empty processors */
   mpiret = sc_MPI_Comm_group (mpicomm, &group);
   SC_CHECK_MPI (mpiret);
@@ -302,6 +308,255 @@ p4est_comm_parallel_env_reduce_ext (p4est_t ** p4est_supercomm,
   return 1;
 }
 
+#if defined P4EST_ENABLE_MPICOMMSHARED && defined P4EST_ENABLE_MPIWINSHARED
+
+/** Make the leader's writes to the window visible to the node. */
+static void
+p4est_partition_shared_sync (p4est_partition_shared_t * ps)
+{
+  int                 mpiret;
+
+  mpiret = MPI_Win_sync (ps->win);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Barrier (ps->nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Win_sync (ps->win);
+  SC_CHECK_MPI (mpiret);
+}
+
+/** Collect one item per process on the leaders, ordered by node.
+ * \param [in] ps       The node-shared storage.
+ * \param [in] item     This process's item.
+ * \param [in] size     The size of each item in bytes.
+ * \param [out] dest    On leaders, room for one item per process.
+ *                      Not accessed on other processes.
+ */
+static void
+p4est_partition_shared_gather (p4est_partition_shared_t * ps,
+                               const void *item, size_t size, void *dest)
+{
+  int                 mpiret;
+  int                 i;
+  int                *counts, *displs;
+  char               *nodebuf = NULL;
+
+  if (ps->noderank == 0) {
+    nodebuf = P4EST_ALLOC (char, ps->nodesize * size);
+  }
+  mpiret = MPI_Gather ((void *) item, (int) size, MPI_BYTE,
+                       nodebuf, (int) size, MPI_BYTE, 0, ps->nodecomm);
+  SC_CHECK_MPI (mpiret);
+  if (ps->noderank == 0) {
+    counts = P4EST_ALLOC (int, 2 * ps->num_nodes);
+    displs = counts + ps->num_nodes;
+    for (i = 0; i < ps->num_nodes; ++i) {
+      counts[i] = ps->node_counts[i] * (int) size;
+      displs[i] = i == 0 ? 0 : displs[i - 1] + counts[i - 1];
+    }
+    mpiret = MPI_Allgatherv (nodebuf, ps->nodesize * (int) size, MPI_BYTE,
+                             dest, counts, displs, MPI_BYTE, ps->leadercomm);
+    SC_CHECK_MPI (mpiret);
+    P4EST_FREE (counts);
+    P4EST_FREE (nodebuf);
+  }
+}
+
+/** Collect one item per process into an array indexed by rank.
+ * The array is only written by the leaders.
+ * \param [in] p4est    The forest whose arrays are shared.
+ * \param [in] item     This process's item.
+ * \param [in] size     The size of each item in bytes.
+ * \param [out] dest    The shared array receiving the item of rank p
+ *                      at position p.
+ */
+static void
+p4est_partition_shared_allgather (p4est_t * p4est, const void *item,
+                                  size_t size, void *dest)
+{
+  const int           num_procs = p4est->mpisize;
+  int                 p;
+  char               *bynode = NULL;
+  p4est_partition_shared_t *ps = p4est->partition_shared;
+
+  if (ps->noderank == 0) {
+    bynode = P4EST_ALLOC (char, num_procs * size);
+  }
+  p4est_partition_shared_gather (ps, item, size, bynode);
+  if (ps->noderank == 0) {
+    for (p = 0; p < num_procs; ++p) {
+      memcpy ((char *) dest + ps->node_ranks[p] * size, bynode + p * size,
+              size);
+    }
+    P4EST_FREE (bynode);
+  }
+}
+
+#endif /* P4EST_ENABLE_MPICOMMSHARED && P4EST_ENABLE_MPIWINSHARED */
+
+int
+p4est_comm_partition_share (p4est_t * p4est)
+{
+#if defined P4EST_ENABLE_MPICOMMSHARED && defined P4EST_ENABLE_MPIWINSHARED
+  const int           num_procs = p4est->mpisize;
+  const size_t        gfq_bytes = (num_procs + 1) * sizeof (p4est_gloidx_t);
+  const size_t        gfp_bytes = (num_procs + 1) * sizeof (p4est_quadrant_t);
+  int                 mpiret;
+  int                 disp_unit;
+  char               *base;
+  MPI_Aint            bytes;
+  p4est_partition_shared_t *ps;
+
+  if (p4est->partition_shared != NULL) {
+    return 1;
+  }
+
+  /* processes sharing memory and the leaders of all nodes */
+  ps = P4EST_ALLOC_ZERO (p4est_partition_shared_t, 1);
+  mpiret = MPI_Comm_split_type (p4est->mpicomm, MPI_COMM_TYPE_SHARED,
+                                p4est->mpirank, MPI_INFO_NULL,
+                                &ps->nodecomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_size (ps->nodecomm, &ps->nodesize);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_rank (ps->nodecomm, &ps->noderank);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Comm_split (p4est->mpicomm,
+                           ps->noderank == 0 ? 0 : MPI_UNDEFINED,
+                           p4est->mpirank, &ps->leadercomm);
+  SC_CHECK_MPI (mpiret);
+  if (ps->noderank == 0) {
+    mpiret = MPI_Comm_size (ps->leadercomm, &ps->num_nodes);
+    SC_CHECK_MPI (mpiret);
+    ps->node_counts = P4EST_ALLOC (int, ps->num_nodes);
+    mpiret = MPI_Allgather (&ps->nodesize, 1, MPI_INT, ps->node_counts,
+                            1, MPI_INT, ps->leadercomm);
+    SC_CHECK_MPI (mpiret);
+  }
+
+  /* the leader allocates the window, everybody maps the leader's part */
+  bytes = (MPI_Aint) (ps->noderank == 0 ?
+                      gfq_bytes + gfp_bytes + num_procs * sizeof (int) : 0);
+  mpiret = MPI_Win_allocate_shared (bytes, 1, MPI_INFO_NULL, ps->nodecomm,
+                                    &base, &ps->win);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Win_shared_query (ps->win, 0, &bytes, &disp_unit, &base);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Win_lock_all (MPI_MODE_NOCHECK, ps->win);
+  SC_CHECK_MPI (mpiret);
+
+  /* the leader fills in the current arrays and the node order of ranks */
+  if (ps->noderank == 0) {
+    ps->node_ranks = (int *) (base + gfq_bytes + gfp_bytes);
+    memcpy (base, p4est->global_first_quadrant, gfq_bytes);
+    memcpy (base + gfq_bytes, p4est->global_first_position, gfp_bytes);
+  }
+  p4est_partition_shared_gather (ps, &p4est->mpirank, sizeof (int),
+                                 ps->node_ranks);
+  p4est_partition_shared_sync (ps);
+
+  P4EST_FREE (p4est->global_first_quadrant);
+  P4EST_FREE (p4est->global_first_position);
+  p4est->global_first_quadrant = (p4est_gloidx_t *) base;
+  p4est->global_first_position = (p4est_quadrant_t *) (base + gfq_bytes);
+  p4est->partition_shared = ps;
+
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/** Free the window and communicators of node-shared partition arrays. */
+static void
+p4est_partition_shared_destroy (p4est_t * p4est)
+{
+#if defined P4EST_ENABLE_MPICOMMSHARED && defined P4EST_ENABLE_MPIWINSHARED
+  int                 mpiret;
+  p4est_partition_shared_t *ps = p4est->partition_shared;
+
+  P4EST_ASSERT (ps != NULL);
+  mpiret = MPI_Win_unlock_all (ps->win);
+  SC_CHECK_MPI (mpiret);
+  mpiret = MPI_Win_free (&ps->win);
+  SC_CHECK_MPI (mpiret);
+  if (ps->leadercomm != MPI_COMM_NULL) {
+    mpiret = MPI_Comm_free (&ps->leadercomm);
+    SC_CHECK_MPI (mpiret);
+  }
+  mpiret = MPI_Comm_free (&ps->nodecomm);
+  SC_CHECK_MPI (mpiret);
+  P4EST_FREE (ps->node_counts);
+  P4EST_FREE (ps);
+#else
+  SC_ABORT_NOT_REACHED ();
+#endif
+  p4est->partition_shared = NULL;
+}
+
+void
+p4est_comm_partition_unshare (p4est_t * p4est)
+{
+  const int           num_procs = p4est->mpisize;
+  p4est_gloidx_t     *gfq;
+  p4est_quadrant_t   *gfp;
+
+  if (p4est->partition_shared == NULL) {
+    return;
+  }
+
+  /* copy the arrays before the window goes away */
+  gfq = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  memcpy (gfq, p4est->global_first_quadrant,
+          (num_procs + 1) * sizeof (p4est_gloidx_t));
+  gfp = P4EST_ALLOC (p4est_quadrant_t, num_procs + 1);
+  memcpy (gfp, p4est->global_first_position,
+          (num_procs + 1) * sizeof (p4est_quadrant_t));
+  p4est_partition_shared_destroy (p4est);
+  p4est->global_first_quadrant = gfq;
+  p4est->global_first_position = gfp;
+}
+
+void
+p4est_comm_partition_release (p4est_t * p4est)
+{
+  if (p4est->partition_shared != NULL) {
+    p4est_partition_shared_destroy (p4est);
+  }
+  else {
+    P4EST_FREE (p4est->global_first_quadrant);
+    P4EST_FREE (p4est->global_first_position);
+  }
+  p4est->global_first_quadrant = NULL;
+  p4est->global_first_position = NULL;
+}
+
+int
+p4est_comm_partition_write_begin (p4est_t * p4est)
+{
+#if defined P4EST_ENABLE_MPICOMMSHARED && defined P4EST_ENABLE_MPIWINSHARED
+  int                 mpiret;
+  p4est_partition_shared_t *ps = p4est->partition_shared;
+
+  if (ps != NULL) {
+    /* nobody on this node may still be reading the old values */
+    mpiret = MPI_Barrier (ps->nodecomm);
+    SC_CHECK_MPI (mpiret);
+    return ps->noderank == 0;
+  }
+#endif
+  return 1;
+}
+
+void
+p4est_comm_partition_write_end (p4est_t * p4est)
+{
+#if defined P4EST_ENABLE_MPICOMMSHARED && defined P4EST_ENABLE_MPIWINSHARED
+  if (p4est->partition_shared != NULL) {
+    p4est_partition_shared_sync (p4est->partition_shared);
+  }
+#endif
+}
+
 void
 p4est_comm_count_quadrants (p4est_t * p4est)
 {
@@ -311,14 +566,34 @@ p4est_comm_count_quadrants (p4est_t * p4est)
   int                 i;
   const int           num_procs = p4est->mpisize;
 
-  global_first_quadrant[0] = 0;
-  mpiret = sc_MPI_Allgather (&qlocal, 1, P4EST_MPI_GLOIDX,
-                             global_first_quadrant + 1, 1, P4EST_MPI_GLOIDX,
-                             p4est->mpicomm);
-  SC_CHECK_MPI (mpiret);
+  if (p4est->partition_shared != NULL) {
+#if defined P4EST_ENABLE_MPICOMMSHARED && defined P4EST_ENABLE_MPIWINSHARED
+    /* only the node leaders receive the counts */
+    if (p4est_comm_partition_write_begin (p4est)) {
+      global_first_quadrant[0] = 0;
+    }
+    p4est_partition_shared_allgather (p4est, &qlocal, sizeof (p4est_gloidx_t),
+                                      global_first_quadrant + 1);
+    if (p4est->partition_shared->noderank == 0) {
+      for (i = 0; i < num_procs; ++i) {
+        global_first_quadrant[i + 1] += global_first_quadrant[i];
+      }
+    }
+    p4est_comm_partition_write_end (p4est);
+#else
+    SC_ABORT_NOT_REACHED ();
+#endif
+  }
+  else {
+    global_first_quadrant[0] = 0;
+    mpiret = sc_MPI_Allgather (&qlocal, 1, P4EST_MPI_GLOIDX,
+                               global_first_quadrant + 1, 1, P4EST_MPI_GLOIDX,
+                               p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
 
-  for (i = 0; i < num_procs; ++i) {
-    global_first_quadrant[i + 1] += global_first_quadrant[i];
+    for (i = 0; i < num_procs; ++i) {
+      global_first_quadrant[i + 1] += global_first_quadrant[i];
+    }
   }
   p4est->global_num_quadrants = global_first_quadrant[num_procs];
 }
@@ -334,10 +609,7 @@ p4est_comm_global_partition (p4est_t * p4est, p4est_quadrant_t * first_quad)
   p4est_tree_t       *tree;
   p4est_quadrant_t   *quadrant;
   p4est_quadrant_t   *pi, input;
-
-  SC_BZERO (&p4est->global_first_position[num_procs], 1);
-  p4est->global_first_position[num_procs].level = P4EST_QMAXLEVEL;
-  p4est->global_first_position[num_procs].p.which_tree = num_trees;
+  int                 write = 1;
 
   SC_BZERO (&input, 1);
   if (first_tree < 0) {
@@ -367,14 +639,32 @@ p4est_comm_global_partition (p4est_t * p4est, p4est_quadrant_t * first_quad)
   }
   input.level = P4EST_QMAXLEVEL;
   input.p.which_tree = first_tree;
-  mpiret = sc_MPI_Allgather (&input, (int) sizeof (p4est_quadrant_t),
-                             sc_MPI_BYTE, p4est->global_first_position,
-                             (int) sizeof (p4est_quadrant_t), sc_MPI_BYTE,
-                             p4est->mpicomm);
-  SC_CHECK_MPI (mpiret);
+  if (p4est->partition_shared != NULL) {
+#if defined P4EST_ENABLE_MPICOMMSHARED && defined P4EST_ENABLE_MPIWINSHARED
+    /* only the node leaders receive and correct the positions */
+    write = p4est_comm_partition_write_begin (p4est);
+    p4est_partition_shared_allgather (p4est, &input,
+                                      sizeof (p4est_quadrant_t),
+                                      p4est->global_first_position);
+#else
+    SC_ABORT_NOT_REACHED ();
+#endif
+  }
+  else {
+    mpiret = sc_MPI_Allgather (&input, (int) sizeof (p4est_quadrant_t),
+                               sc_MPI_BYTE, p4est->global_first_position,
+                               (int) sizeof (p4est_quadrant_t), sc_MPI_BYTE,
+                               p4est->mpicomm);
+    SC_CHECK_MPI (mpiret);
+  }
+  if (write) {
+    SC_BZERO (&p4est->global_first_position[num_procs], 1);
+    p4est->global_first_position[num_procs].level = P4EST_QMAXLEVEL;
+    p4est->global_first_position[num_procs].p.which_tree = num_trees;
+  }
 
   /* correct for processors that don't have any quadrants */
-  for (i = num_procs - 1; i >= 0; --i) {
+  for (i = num_procs - 1; write && i >= 0; --i) {
     pi = &p4est->global_first_position[i];
     if (pi->p.which_tree < 0) {
       P4EST_ASSERT (pi->x == -1 && pi->y == -1);
@@ -389,6 +679,7 @@ p4est_comm_global_partition (p4est_t * p4est, p4est_quadrant_t * first_quad)
 #endif
     P4EST_ASSERT (pi->p.which_tree >= 0 && pi->level == P4EST_QMAXLEVEL);
   }
+  p4est_comm_partition_write_end (p4est);
 }
 
 void
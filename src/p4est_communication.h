@@ -120,6 +120,65 @@ void                p4est_comm_global_partition (p4est_t * p4est,
                                                  p4est_quadrant_t *
                                                  first_quad);
 
+/** Storage of the partition arrays shared by the processes of a node.
+ * The first process of each node, its leader, owns an MPI-3 shared memory
+ * window holding global_first_quadrant, global_first_position and the
+ * ranks of all processes ordered by node.  The other processes map the
+ * leader's window and only read from it.
+ */
+struct p4est_partition_shared
+{
+  sc_MPI_Comm         nodecomm;         /**< processes of this node */
+  sc_MPI_Comm         leadercomm;       /**< leaders of all nodes, or
+                                             sc_MPI_COMM_NULL */
+  int                 noderank, nodesize;
+  int                 num_nodes;        /**< number of nodes, leaders only */
+  int                *node_counts;      /**< processes per node, leaders only */
+  int                *node_ranks;       /**< ranks ordered by node, in the
+                                             window, leaders only */
+#if defined P4EST_ENABLE_MPICOMMSHARED && defined P4EST_ENABLE_MPIWINSHARED
+  MPI_Win             win;              /**< the shared window */
+#endif
+};
+
+/** Store global_first_quadrant and global_first_position once per node.
+ * The arrays are moved into a shared memory window of the node's first
+ * process; all other functions keep reading them through the p4est
+ * members.  Partitioning updates the shared arrays in place.
+ * This function is collective and has no effect if the forest is shared
+ * already or if MPI-3 shared windows are not configured.
+ * \param [in,out] p4est  The forest whose partition arrays are shared.
+ * \return                True if the arrays are shared on return.
+ */
+int                 p4est_comm_partition_share (p4est_t * p4est);
+
+/** Return to private copies of the partition arrays on each process.
+ * This function is collective and has no effect if the forest is not
+ * shared.
+ * \param [in,out] p4est  The forest whose partition arrays are unshared.
+ */
+void                p4est_comm_partition_unshare (p4est_t * p4est);
+
+/** Free the partition arrays, shared or not.  Collective if shared.
+ * \param [in,out] p4est  The arrays are freed and set to NULL.
+ */
+void                p4est_comm_partition_release (p4est_t * p4est);
+
+/** Prepare to overwrite the partition arrays with values known to all
+ * processes.  If shared, this waits for all processes of the node to stop
+ * reading the old values and only the leader should write.
+ * Must be matched by \ref p4est_comm_partition_write_end.
+ * \param [in] p4est      The forest whose arrays are overwritten.
+ * \return                True if this process should write the arrays.
+ */
+int                 p4est_comm_partition_write_begin (p4est_t * p4est);
+
+/** Publish the partition arrays written after
+ * \ref p4est_comm_partition_write_begin to all processes of the node.
+ * \param [in] p4est      The forest whose arrays were overwritten.
+ */
+void                p4est_comm_partition_write_end (p4est_t * p4est);
+
 /** Compute and distribute the cumulative number of quadrants per tree.
  * \param [in] p4est    This p4est needs to have correct values for
  *                      global_first_quadrant and global_first_position.
@@ -123,7 +123,12 @@ p4est_connectivity_memory_used (p4est_connectivity_t * conn)
     conn->num_trees * P4EST_CHILDREN * sizeof (p4est_topidx_t) +
     (conn->num_corners + 1) * sizeof (p4est_topidx_t) +
     conn->ctt_offset[conn->num_corners] * (sizeof (p4est_topidx_t) +
-                                           sizeof (int8_t));
+                                           sizeof (int8_t)) +
+    (conn->transforms == NULL ? 0 : sizeof (p4est_transform_cache_t) +
+     conn->num_trees * P4EST_FACES * P4EST_FTRANSFORM * sizeof (int8_t) +
+     (conn->num_trees * P4EST_CHILDREN + 1) * sizeof (p4est_topidx_t) +
+     conn->transforms->ct_offset[conn->num_trees * P4EST_CHILDREN] *
+     sizeof (p4est_corner_transform_t));
 }
 
 p4est_connectivity_t *
@@ -429,6 +434,7 @@ p4est_connectivity_destroy (p4est_connectivity_t * conn)
   P4EST_FREE (conn->corner_to_corner);
 
   p4est_connectivity_set_attr (conn, 0);
+  p4est_connectivity_uncache_transforms (conn);
 
   P4EST_FREE (conn);
 }
@@ -2962,6 +2968,17 @@ p4est_find_face_transform (p4est_connectivity_t * connectivity,
     return -1;
   }
 
+  if (connectivity->transforms != NULL) {
+    const int8_t       *cached = connectivity->transforms->face_transforms +
+      P4EST_FTRANSFORM * (P4EST_FACES * itree + iface);
+    int                 i;
+
+    for (i = 0; i < P4EST_FTRANSFORM; ++i) {
+      ftransform[i] = (int) cached[i];
+    }
+    return target_tree;
+  }
+
   p4est_expand_face_transform_internal (iface, target_face, orientation,
                                         ftransform);
 
@@ -3122,6 +3139,17 @@ p4est_find_corner_transform (p4est_connectivity_t * conn,
   /* check if this corner exists at all */
   ci->icorner = (int8_t) icorner;
   sc_array_resize (cta, 0);
+  if (conn->transforms != NULL) {
+    const p4est_topidx_t *offset =
+      conn->transforms->ct_offset + P4EST_CHILDREN * itree + icorner;
+
+    sc_array_resize (cta, (size_t) (offset[1] - offset[0]));
+    if (cta->elem_count > 0) {
+      memcpy (cta->array, conn->transforms->corner_transforms + offset[0],
+              cta->elem_count * sizeof (p4est_corner_transform_t));
+    }
+    return;
+  }
   if (conn->num_corners == 0) {
     return;
   }
@@ -3150,6 +3178,85 @@ p4est_find_corner_transform (p4est_connectivity_t * conn,
   P4EST_ASSERT (corner_trees == (p4est_topidx_t) (cta->elem_count + ignored));
 }
 
+void
+p4est_connectivity_cache_transforms (p4est_connectivity_t * conn)
+{
+  const p4est_topidx_t num_trees = conn->num_trees;
+  int                 face, corner, i;
+  int                 ftransform[P4EST_FTRANSFORM];
+  int8_t             *cached;
+  p4est_topidx_t      jt, k;
+  sc_array_t          corners;
+  p4est_corner_info_t ci;
+  p4est_transform_cache_t *tc;
+
+  if (conn->transforms != NULL) {
+    return;
+  }
+  P4EST_ASSERT (p4est_connectivity_is_valid (conn));
+
+  tc = P4EST_ALLOC (p4est_transform_cache_t, 1);
+  tc->face_transforms =
+    P4EST_ALLOC_ZERO (int8_t, num_trees * P4EST_FACES * P4EST_FTRANSFORM);
+  tc->ct_offset = P4EST_ALLOC (p4est_topidx_t,
+                               num_trees * P4EST_CHILDREN + 1);
+  sc_array_init (&corners, sizeof (p4est_corner_transform_t));
+  sc_array_init (&ci.corner_transforms, sizeof (p4est_corner_transform_t));
+
+  /* the boundary faces are not looked up and stay zero */
+  k = 0;
+  for (jt = 0; jt < num_trees; ++jt) {
+    for (face = 0; face < P4EST_FACES; ++face) {
+      if (p4est_find_face_transform (conn, jt, face, ftransform) >= 0) {
+        cached = tc->face_transforms +
+          P4EST_FTRANSFORM * (P4EST_FACES * jt + face);
+        for (i = 0; i < P4EST_FTRANSFORM; ++i) {
+          cached[i] = (int8_t) ftransform[i];
+        }
+      }
+    }
+    for (corner = 0; corner < P4EST_CHILDREN; ++corner) {
+      tc->ct_offset[k++] = (p4est_topidx_t) corners.elem_count;
+      p4est_find_corner_transform (conn, jt, corner, &ci);
+      if (ci.corner_transforms.elem_count > 0) {
+        memcpy (sc_array_push_count (&corners,
+                                     ci.corner_transforms.elem_count),
+                ci.corner_transforms.array,
+                ci.corner_transforms.elem_count *
+                sizeof (p4est_corner_transform_t));
+      }
+    }
+  }
+  tc->ct_offset[k] = (p4est_topidx_t) corners.elem_count;
+  sc_array_reset (&ci.corner_transforms);
+
+  /* the cache owns the corner transforms without the array header */
+  tc->corner_transforms = P4EST_ALLOC (p4est_corner_transform_t,
+                                       corners.elem_count);
+  if (corners.elem_count > 0) {
+    memcpy (tc->corner_transforms, corners.array,
+            corners.elem_count * sizeof (p4est_corner_transform_t));
+  }
+  sc_array_reset (&corners);
+
+  conn->transforms = tc;
+}
+
+void
+p4est_connectivity_uncache_transforms (p4est_connectivity_t * conn)
+{
+  p4est_transform_cache_t *tc = conn->transforms;
+
+  if (tc == NULL) {
+    return;
+  }
+  P4EST_FREE (tc->face_transforms);
+  P4EST_FREE (tc->ct_offset);
+  P4EST_FREE (tc->corner_transforms);
+  P4EST_FREE (tc);
+  conn->transforms = NULL;
+}
+
 void
 p4est_connectivity_complete (p4est_connectivity_t * conn)
 {
@@ -3181,6 +3288,8 @@ p4est_connectivity_complete (p4est_connectivity_t * conn)
   sc_array_t         *node_corners, *nc;
   sc_array_t         *cta = &cinfo.corner_transforms;
 
+  p4est_connectivity_uncache_transforms (conn);
+
   P4EST_ASSERT (p4est_connectivity_is_valid (conn));
 
   /* prepare data structures and remove previous connectivity information */
@@ -3561,6 +3670,8 @@ p4est_connectivity_complete (p4est_connectivity_t * conn)
 void
 p4est_connectivity_reduce (p4est_connectivity_t * conn)
 {
+  p4est_connectivity_uncache_transforms (conn);
+
   conn->num_corners = 0;
   conn->ctt_offset[conn->num_corners] = 0;
   P4EST_FREE (conn->tree_to_corner);
@@ -3593,6 +3704,8 @@ p4est_connectivity_permute (p4est_connectivity_t * conn, sc_array_t * inperm,
   sc_array_t          array_view;
   int                 j;
 
+  p4est_connectivity_uncache_transforms (conn);
+
   /* we want the permutation to be the current to new map, not
    * the new to current map */
   if (is_current_to_new) {
@@ -4354,6 +4467,8 @@ p4est_connectivity_join_faces (p4est_connectivity_t * conn,
   P4EST_ASSERT (conn->tree_to_face[P4EST_FACES * tree_right + face_right] ==
                 (int8_t) face_right);
 
+  p4est_connectivity_uncache_transforms (conn);
+
 #ifdef P4_TO_P8
   /* figure out which edges are next to each other */
   ref = p8est_face_permutation_refs[face_left][face_right];
@@ -117,6 +117,11 @@ int                 p4est_connect_type_int (p4est_connect_type_t btype);
  */
 const char         *p4est_connect_type_string (p4est_connect_type_t btype);
 
+/** Face and corner transforms precomputed for all trees.
+ * Defined below the corner transform types.
+ */
+typedef struct p4est_transform_cache p4est_transform_cache_t;
+
 /** This structure holds the 2D inter-tree connectivity information.
  * Identification of arbitrary faces and corners is possible.
  *
@@ -147,6 +152,9 @@ const char         *p4est_connect_type_string (p4est_connect_type_t btype);
  * The size of the corner_to_* arrays is num_ctt = ctt_offset[num_corners].
  *
  * The *_to_attr arrays may have arbitrary contents defined by the user.
+ *
+ * The transforms member is a cache derived from the arrays above.
+ * It is created by \ref p4est_connectivity_cache_transforms.
  */
 typedef struct p4est_connectivity
 {
@@ -177,6 +185,9 @@ typedef struct p4est_connectivity
   p4est_topidx_t     *corner_to_tree; /**< list of trees that meet at a corner */
   int8_t             *corner_to_corner; /**< list of tree-corners that meet at
                                              a corner */
+
+  p4est_transform_cache_t *transforms; /**< NULL or face and corner
+                                            transforms of all trees */
 }
 p4est_connectivity_t;
 
@@ -201,6 +212,20 @@ typedef struct
 }
 p4est_corner_info_t;
 
+/** The cached transforms of a connectivity.
+ * They are the results of \ref p4est_find_face_transform and
+ * \ref p4est_find_corner_transform for every tree face and corner.
+ */
+struct p4est_transform_cache
+{
+  int8_t             *face_transforms;  /**< (9 * 4 * num_trees) entries
+                                             of the face transforms */
+  p4est_topidx_t     *ct_offset;        /**< (4 * num_trees + 1) offsets
+                                             into corner_transforms */
+  p4est_corner_transform_t *corner_transforms; /**< corner transforms of
+                                                    all tree corners */
+};
+
 /** Store the corner numbers 0..4 for each tree face. */
 extern const int    p4est_face_corners[4][2];
 
@@ -571,6 +596,24 @@ void                p4est_find_corner_transform (p4est_connectivity_t *
                                                  int icorner,
                                                  p4est_corner_info_t * ci);
 
+/** Precompute the face and corner transforms of all trees.
+ * Afterwards \ref p4est_find_face_transform and
+ * \ref p4est_find_corner_transform copy their results from the cache.
+ * This is called when a forest is created and does nothing if the cache
+ * exists.  The functions that modify a connectivity in place drop it.
+ * \param [in,out] conn     Valid connectivity whose transforms are cached.
+ */
+void                p4est_connectivity_cache_transforms
+  (p4est_connectivity_t * conn);
+
+/** Free the cached transforms of a connectivity.
+ * This must be called when the arrays of a connectivity with cached
+ * transforms are changed directly.
+ * \param [in,out] conn     Connectivity whose cache is freed if it exists.
+ */
+void                p4est_connectivity_uncache_transforms
+  (p4est_connectivity_t * conn);
+
 /** Internally connect a connectivity based on tree_to_vertex information.
  * Periodicity that is not inherent in the list of vertices will be lost.
  * \param [in,out] conn     The connectivity needs to have proper vertices
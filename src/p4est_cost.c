@@ -0,0 +1,292 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_communication.h>
+#include <p4est_cost.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_communication.h>
+#include <p8est_cost.h>
+#endif
+
+/** Size the arrays to the current forest and forget all history. */
+static void
+p4est_cost_reset (p4est_cost_t * cost)
+{
+  const size_t        lnq = (size_t) cost->p4est->local_num_quadrants;
+
+  sc_array_resize (cost->measured, lnq);
+  sc_array_memset (cost->measured, 0);
+  sc_array_resize (cost->estimate, lnq);
+  cost->has_estimate = 0;
+  cost->num_steps = 0;
+  cost->revision = p4est_revision (cost->p4est);
+}
+
+/** Reset the state if the forest has been modified behind our back. */
+static void
+p4est_cost_sync (p4est_cost_t * cost)
+{
+  if (cost->revision != p4est_revision (cost->p4est)) {
+    P4EST_VERBOSE ("Forest changed: resetting cost estimate\n");
+    p4est_cost_reset (cost);
+  }
+  P4EST_ASSERT (cost->measured->elem_count ==
+                (size_t) cost->p4est->local_num_quadrants);
+  P4EST_ASSERT (cost->estimate->elem_count ==
+                (size_t) cost->p4est->local_num_quadrants);
+}
+
+p4est_cost_t       *
+p4est_cost_new (p4est_t * p4est, double smoothing)
+{
+  p4est_cost_t       *cost;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (0. < smoothing && smoothing <= 1.);
+
+  cost = P4EST_ALLOC_ZERO (p4est_cost_t, 1);
+  cost->p4est = p4est;
+  cost->smoothing = smoothing;
+  cost->measured = sc_array_new (sizeof (double));
+  cost->estimate = sc_array_new (sizeof (double));
+  p4est_cost_reset (cost);
+
+  return cost;
+}
+
+void
+p4est_cost_destroy (p4est_cost_t * cost)
+{
+  sc_array_destroy (cost->measured);
+  sc_array_destroy (cost->estimate);
+  P4EST_FREE (cost);
+}
+
+void
+p4est_cost_add_quadrant (p4est_cost_t * cost,
+                         p4est_locidx_t local_num, double value)
+{
+  p4est_cost_sync (cost);
+  P4EST_ASSERT (0 <= local_num
+                && local_num < cost->p4est->local_num_quadrants);
+  P4EST_ASSERT (value >= 0.);
+
+  *(double *) sc_array_index (cost->measured, (size_t) local_num) += value;
+}
+
+void
+p4est_cost_add_tree (p4est_cost_t * cost,
+                     p4est_topidx_t which_tree, double value)
+{
+  size_t              zz, count;
+  double             *measured;
+  double              share;
+  p4est_tree_t       *tree;
+
+  p4est_cost_sync (cost);
+  P4EST_ASSERT (cost->p4est->first_local_tree <= which_tree &&
+                which_tree <= cost->p4est->last_local_tree);
+  P4EST_ASSERT (value >= 0.);
+
+  tree = p4est_tree_array_index (cost->p4est->trees, which_tree);
+  count = tree->quadrants.elem_count;
+  if (count == 0) {
+    return;
+  }
+  share = value / count;
+  measured = (double *) sc_array_index (cost->measured,
+                                        (size_t) tree->quadrants_offset);
+  for (zz = 0; zz < count; ++zz) {
+    measured[zz] += share;
+  }
+}
+
+void
+p4est_cost_step (p4est_cost_t * cost)
+{
+  size_t              zz, lnq;
+  double             *measured, *estimate;
+  const double        alpha = cost->smoothing;
+
+  p4est_cost_sync (cost);
+
+  lnq = cost->measured->elem_count;
+  if (lnq > 0) {
+    measured = (double *) cost->measured->array;
+    estimate = (double *) cost->estimate->array;
+    if (!cost->has_estimate) {
+      /* the first step after a reset provides the initial estimate */
+      memcpy (estimate, measured, lnq * sizeof (double));
+    }
+    else {
+      for (zz = 0; zz < lnq; ++zz) {
+        estimate[zz] += alpha * (measured[zz] - estimate[zz]);
+      }
+    }
+    sc_array_memset (cost->measured, 0);
+  }
+  cost->has_estimate = 1;
+  ++cost->num_steps;
+}
+
+/** Compute the predicted imbalance and the largest quadrant cost.
+ * \return      The imbalance as documented in \ref p4est_cost_imbalance.
+ */
+static double
+p4est_cost_reduce (p4est_cost_t * cost, double *max_quadrant)
+{
+  int                 mpiret;
+  size_t              zz;
+  double              local[3], global[3];
+  double              local_sum, global_sum;
+  const double       *estimate;
+
+  p4est_cost_sync (cost);
+
+  local_sum = local[1] = 0.;
+  if (cost->has_estimate) {
+    estimate = (const double *) cost->estimate->array;
+    for (zz = 0; zz < cost->estimate->elem_count; ++zz) {
+      local_sum += estimate[zz];
+      local[1] = SC_MAX (local[1], estimate[zz]);
+    }
+  }
+  local[0] = local_sum;
+  local[2] = cost->has_estimate ? 0. : 1.;
+
+  /* process maximum, quadrant maximum, and whether any estimate is missing */
+  mpiret = sc_MPI_Allreduce (local, global, 3, sc_MPI_DOUBLE, sc_MPI_MAX,
+                             cost->p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+  mpiret = sc_MPI_Allreduce (&local_sum, &global_sum, 1, sc_MPI_DOUBLE,
+                             sc_MPI_SUM, cost->p4est->mpicomm);
+  SC_CHECK_MPI (mpiret);
+
+  *max_quadrant = global[1];
+  if (global[2] > 0.) {
+    return -1.;
+  }
+  if (global_sum <= 0.) {
+    return 1.;
+  }
+  return global[0] * cost->p4est->mpisize / global_sum;
+}
+
+double
+p4est_cost_imbalance (p4est_cost_t * cost)
+{
+  double              max_quadrant;
+
+  return p4est_cost_reduce (cost, &max_quadrant);
+}
+
+static int
+p4est_cost_weight (p4est_t * p4est, p4est_topidx_t which_tree,
+                   p4est_quadrant_t * quadrant)
+{
+  p4est_cost_t       *cost = (p4est_cost_t *) p4est->user_pointer;
+  double              estimate;
+
+  P4EST_ASSERT (cost->p4est == p4est);
+  estimate = *(double *) sc_array_index (cost->estimate,
+                                         (size_t) cost->counter++);
+
+  return (int) (cost->scale * estimate + .5);
+}
+
+p4est_gloidx_t
+p4est_cost_partition (p4est_cost_t * cost, int partition_for_coarsening,
+                      double threshold, double *imbalance)
+{
+  const int           num_procs = cost->p4est->mpisize;
+  double              predicted, max_quadrant;
+  p4est_gloidx_t      shipped;
+  p4est_gloidx_t     *src_gfq;
+  p4est_t            *p4est = cost->p4est;
+  sc_array_t         *estimate;
+
+  P4EST_ASSERT (threshold >= 0.);
+
+  predicted = p4est_cost_reduce (cost, &max_quadrant);
+  if (imbalance != NULL) {
+    *imbalance = predicted;
+  }
+  if (predicted < 0.) {
+    P4EST_GLOBAL_INFO ("No cost estimate: skipping partition\n");
+    return 0;
+  }
+  if (predicted <= 1. + threshold) {
+    P4EST_GLOBAL_INFOF ("Predicted cost imbalance %g: skipping partition\n",
+                        predicted);
+    return 0;
+  }
+  P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING
+                            "_cost_partition with imbalance %g\n", predicted);
+  P4EST_ASSERT (max_quadrant > 0.);
+
+  /* map the largest quadrant cost to a weight of 2^20 */
+  cost->scale = (double) (1 << 20) / max_quadrant;
+  cost->counter = 0;
+
+  /* remember the partition the estimates refer to */
+  src_gfq = P4EST_ALLOC (p4est_gloidx_t, num_procs + 1);
+  memcpy (src_gfq, p4est->global_first_quadrant,
+          (num_procs + 1) * sizeof (p4est_gloidx_t));
+
+  /* the weight callback finds the cost object by the user pointer */
+  cost->user_pointer = p4est->user_pointer;
+  p4est->user_pointer = cost;
+  shipped = p4est_partition_ext (p4est, partition_for_coarsening,
+                                 p4est_cost_weight);
+  p4est->user_pointer = cost->user_pointer;
+  cost->user_pointer = NULL;
+  P4EST_ASSERT (num_procs == 1 ||
+                (size_t) cost->counter == cost->estimate->elem_count);
+
+  if (shipped > 0) {
+    /* send the estimates along with their quadrants */
+    estimate = sc_array_new_count (sizeof (double),
+                                   (size_t) p4est->local_num_quadrants);
+    p4est_transfer_fixed (p4est->global_first_quadrant, src_gfq,
+                          p4est->mpicomm, P4EST_COMM_COST_TRANSFER,
+                          estimate->array, cost->estimate->array,
+                          sizeof (double));
+    sc_array_destroy (cost->estimate);
+    cost->estimate = estimate;
+
+    /* measurements of an unfinished step are dropped */
+    sc_array_resize (cost->measured, (size_t) p4est->local_num_quadrants);
+    sc_array_memset (cost->measured, 0);
+    cost->revision = p4est_revision (p4est);
+  }
+  P4EST_FREE (src_gfq);
+
+  P4EST_GLOBAL_PRODUCTIONF ("Done " P4EST_STRING
+                            "_cost_partition shipped %lld quadrants\n",
+                            (long long) shipped);
+  return shipped;
+}
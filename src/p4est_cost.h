@@ -0,0 +1,134 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4EST_COST_H
+#define P4EST_COST_H
+
+/** \file p4est_cost.h
+ * Measure the computational cost of local quadrants and use it to partition.
+ *
+ * Choosing weights for \ref p4est_partition_ext by hand is guesswork.
+ * A \ref p4est_cost_t object lets the application attribute elapsed time or
+ * operation counts to local quadrants or trees while it executes a step.
+ * At the end of each step \ref p4est_cost_step folds the measurements into
+ * an exponentially smoothed estimate per quadrant.  \ref p4est_cost_partition
+ * predicts the load imbalance from these estimates and repartitions with
+ * weights derived from them only if the imbalance exceeds a threshold.
+ *
+ * The estimates follow the forest through partitioning by this module.
+ * Any other change of the forest, detected by \ref p4est_revision, discards
+ * the history and restarts the estimates from the next measurement.
+ */
+
+#include <p4est_extended.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** The cost measurement state attached to a forest. */
+typedef struct p4est_cost
+{
+  p4est_t            *p4est;    /**< The forest measured, not owned. */
+  long                revision; /**< Forest revision of the arrays below. */
+  double              smoothing;        /**< Weight of newest step in (0, 1]. */
+  int                 has_estimate;     /**< Boolean: \a estimate is valid. */
+  int                 num_steps;        /**< Steps since the last reset. */
+  sc_array_t         *measured; /**< Per local quadrant, current step. */
+  sc_array_t         *estimate; /**< Per local quadrant, smoothed. */
+  p4est_locidx_t      counter;  /**< Internal use during partitioning. */
+  double              scale;    /**< Internal use during partitioning. */
+  void               *user_pointer;     /**< Internal use during partitioning. */
+}
+p4est_cost_t;
+
+/** Create a cost measurement object for a forest.
+ * \param [in] p4est        The forest must stay alive while the cost object
+ *                          is in use.  Its user_pointer is used temporarily
+ *                          inside \ref p4est_cost_partition and restored.
+ * \param [in] smoothing    Weight of the newest measurement in the moving
+ *                          average, 0 < \a smoothing <= 1.  With 1, only the
+ *                          most recent step is taken into account.
+ * \return                  A cost object without any measurements.
+ */
+p4est_cost_t       *p4est_cost_new (p4est_t * p4est, double smoothing);
+
+/** Free all memory of a cost object.  The forest is not touched. */
+void                p4est_cost_destroy (p4est_cost_t * cost);
+
+/** Attribute a measured cost to one local quadrant in the current step.
+ * \param [in,out] cost     The cost object.
+ * \param [in] local_num    Process-local index of the quadrant, counted
+ *                          through all local trees.
+ * \param [in] value        Non-negative cost, added to earlier values.
+ */
+void                p4est_cost_add_quadrant (p4est_cost_t * cost,
+                                             p4est_locidx_t local_num,
+                                             double value);
+
+/** Attribute a measured cost to the local part of a tree.
+ * The value is divided evenly among the tree's local quadrants.
+ * \param [in,out] cost     The cost object.
+ * \param [in] which_tree   A local tree of the forest.
+ * \param [in] value        Non-negative cost, added to earlier values.
+ */
+void                p4est_cost_add_tree (p4est_cost_t * cost,
+                                         p4est_topidx_t which_tree,
+                                         double value);
+
+/** Conclude a step: fold the current measurements into the estimate.
+ * The measurements are reset to zero for the next step.
+ * This function is not collective.
+ * \param [in,out] cost     The cost object.
+ */
+void                p4est_cost_step (p4est_cost_t * cost);
+
+/** Predict the load imbalance of the current partition from the estimate.
+ * This function is collective.
+ * \param [in] cost         The cost object.
+ * \return                  The maximum over the average process cost,
+ *                          1 if nothing has been measured on any process,
+ *                          or -1 if some process has no estimate yet.
+ */
+double              p4est_cost_imbalance (p4est_cost_t * cost);
+
+/** Repartition the forest by the estimated costs if it is imbalanced.
+ * The estimates are transferred to the new partition.
+ * This function is collective.
+ * \param [in,out] cost     The cost object.
+ * \param [in] partition_for_coarsening     Passed to \ref p4est_partition_ext.
+ * \param [in] threshold    The forest is repartitioned only if the
+ *                          predicted imbalance exceeds 1 + \a threshold.
+ * \param [out] imbalance   If not NULL, the imbalance predicted before
+ *                          partitioning as in \ref p4est_cost_imbalance.
+ * \return                  The global number of quadrants shipped; 0 if the
+ *                          forest is within the threshold or if some process
+ *                          has not completed a step since the last reset.
+ */
+p4est_gloidx_t      p4est_cost_partition (p4est_cost_t * cost,
+                                          int partition_for_coarsening,
+                                          double threshold,
+                                          double *imbalance);
+
+SC_EXTERN_C_END;
+
+#endif /* !P4EST_COST_H */
@@ -44,6 +44,7 @@
 #include <p4est_mesh.h>
 #include <p4est_iterate.h>
 #include <p4est_lnodes.h>
+#include <sc_statistics.h>
 
 SC_EXTERN_C_BEGIN;
 
@@ -68,12 +69,27 @@ struct p4est_inspect
   int                 use_balance_ranges_notify;
   /** Verify sc_ranges and/or sc_notify as applicable. */
   int                 use_balance_verify;
+  /** If true, p4est_balance_ext skips the local balance of the trees
+   * that have not changed since the last balance of the forest and sends
+   * only quadrants of changed trees to other processes.  This is used when
+   * the forest has been balanced before and only been modified by refine,
+   * coarsen and adapt since; otherwise the full algorithm runs. */
+  int                 use_balance_incremental;
+  /** If true, p4est_balance_ext finds the quadrants of a tree that
+   * overlap the insulation layers of received quadrants by binary searches
+   * instead of a sorted sweep.  The result is the same; this is slower and
+   * meant for comparison. */
+  int                 use_balance_overlap_bsearch;
   /** If positive and smaller than p4est_num ranges, overrides it */
   int                 balance_max_ranges;
   size_t              balance_A_count_in;
   size_t              balance_A_count_out;
   size_t              balance_comm_sent;
   size_t              balance_comm_nzpeers;
+  /** bytes of the encoded quadrants sent to other processes in balance */
+  size_t              balance_comm_bytes;
+  /** bytes the same quadrants take in memory without the encoding */
+  size_t              balance_comm_bytes_raw;
   size_t              balance_B_count_in;
   size_t              balance_B_count_out;
   size_t              balance_zero_sends[2], balance_zero_receives[2];
@@ -84,7 +100,49 @@ struct p4est_inspect
   double              balance_notify;   /**< time spent in sc_notify */
   /** time spent in sc_notify_allgather */
   double              balance_notify_allgather;
+  /** time spent computing the overlap with received quadrants */
+  double              balance_overlap;
+  /** Set by p4est_balance_ext: true if no refinement or coarsening since the
+   * last balance can have created a level jump and the balance was skipped.
+   * The other balance statistics are zero in this case. */
+  int                 balance_skipped;
   int                 use_B;
+  /** If true, p4est_partition_ext adds hysteresis at the boundaries of
+   * the compute nodes, found as runs of consecutive ranks that share
+   * memory.  While no node exceeds its share of the load by more than the
+   * relative \a partition_node_hysteresis, the node boundaries stay in
+   * place and the load is split evenly within each node, such that all
+   * migration stays on node.  Otherwise the partition is the flat one.
+   * This is not a two-level partition: the pairing of senders and
+   * receivers is that of p4est_partition_given in either case. */
+  int                 use_partition_node_hysteresis;
+  double              partition_node_hysteresis;
+  /** Ratio of maximum to average load between nodes designated by the
+   * last partition.  Without \a use_partition_node_hysteresis every
+   * process counts as a node of its own. */
+  double              partition_node_imbalance;
+  /** Ratio of maximum to average load between processes designated by the
+   * last partition. */
+  double              partition_rank_imbalance;
+  /** If positive, p4est_refine_ext splits the local trees, and large trees
+   * at quadrant boundaries, into independent work units that are refined
+   * on this many threads and merged in order.  The result is identical to
+   * the serial algorithm.  The callbacks are invoked concurrently and must
+   * be thread safe.  Without OpenMP the units are processed one by one. */
+  int                 refine_threads;
+  /** If positive, p4est_balance_ext balances the local trees, and the
+   * border regions of the trees, on this many threads.  The result is
+   * identical to the serial algorithm.  The callbacks are invoked
+   * concurrently and must be thread safe.  Without OpenMP the trees and
+   * regions are processed one by one. */
+  int                 balance_threads;
+  /** Bytes in use on this process by each \ref p4est_memory_phase_t at its
+   * last checkpoint.  The algorithms record their working storage where it
+   * is largest and the size of their result when done.  The entries for
+   * the forest and connectivity are updated by \ref p4est_memory_stats. */
+  size_t              memory_current[P4EST_MEMORY_NUM_PHASES];
+  /** Largest bytes recorded for each phase since this array was zeroed. */
+  size_t              memory_peak[P4EST_MEMORY_NUM_PHASES];
 };
 
 /** Callback function prototype to replace one set of quadrants with another.
@@ -113,6 +171,75 @@ typedef void        (*p4est_replace_t) (p4est_t * p4est,
                                         int num_incoming,
                                         p4est_quadrant_t * incoming[]);
 
+/** Callback function prototype to decide for refinement of many quadrants.
+ *
+ * This is used by p4est_refine_batch to evaluate a refinement criterion in bulk.
+ * \param [in] p4est        The forest before refinement.
+ * \param [in] which_tree   The tree containing the quadrants.
+ * \param [in] first_local  The process-local index of the first quadrant.
+ * \param [in] num_quadrants The number of quadrants.
+ * \param [in] quadrants    Contiguous quadrants of the tree.
+ * \param [out] flags       Set flags[i] to true if quadrants[i] shall be
+ *                          refined, to false otherwise.
+ */
+typedef void        (*p4est_refine_batch_t) (p4est_t * p4est,
+                                             p4est_topidx_t which_tree,
+                                             p4est_locidx_t first_local,
+                                             size_t num_quadrants,
+                                             p4est_quadrant_t * quadrants,
+                                             int8_t * flags);
+
+/** Callback function prototype to decide for coarsening of many quadrants.
+ *
+ * This is used by p4est_coarsen_batch to evaluate a coarsening criterion in
+ * bulk.  A family of quadrants is coarsened if all of its members have been
+ * flagged.  The arguments are the same as for p4est_refine_batch_t.
+ * \param [out] flags       Set flags[i] to true if quadrants[i] may be
+ *                          coarsened, to false otherwise.
+ */
+typedef void        (*p4est_coarsen_batch_t) (p4est_t * p4est,
+                                              p4est_topidx_t which_tree,
+                                              p4est_locidx_t first_local,
+                                              size_t num_quadrants,
+                                              p4est_quadrant_t * quadrants,
+                                              int8_t * flags);
+
+/** Callback function prototype to initialize the data of many quadrants.
+ *
+ * This is used by p4est_new_uniform to initialize the user data in bulk.
+ * \param [in] p4est        The forest being created.
+ * \param [in] which_tree   The tree containing the quadrants.
+ * \param [in] first_local  The process-local index of the first quadrant.
+ * \param [in] num_quadrants The number of quadrants.
+ * \param [in,out] quadrants Contiguous quadrants of the tree.  Their
+ *                          user_data is allocated if data_size is nonzero.
+ */
+typedef void        (*p4est_init_batch_t) (p4est_t * p4est,
+                                           p4est_topidx_t which_tree,
+                                           p4est_locidx_t first_local,
+                                           size_t num_quadrants,
+                                           p4est_quadrant_t * quadrants);
+
+/** Callback function prototype to calculate several weights for partitioning.
+ *
+ * This is used by p4est_partition_multi to balance several constraints.
+ * \param [in] p4est       The forest.
+ * \param [in] which_tree  The tree containing \a quadrant.
+ * \param [in] quadrant    The quadrant to be weighted.
+ * \param [out] weights    A 32bit integer >= 0 for every constraint.
+ * \note    Global sum of each weight must fit into a 64bit integer.
+ */
+typedef void        (*p4est_weights_t) (p4est_t * p4est,
+                                        p4est_topidx_t which_tree,
+                                        p4est_quadrant_t * quadrant,
+                                        int *weights);
+
+/** Context data of a partition whose messages are in transit.
+ * It is created by \ref p4est_partition_begin and freed by
+ * \ref p4est_partition_end; see \ref p4est_partition_given_begin.
+ */
+typedef struct p4est_partition_context p4est_partition_context_t;
+
 /** Compare the p4est_lid_t \a a and the p4est_lid_t \a b.
  * \param [in]  a A pointer to a p4est_lid_t.
  * \param [in]  b A pointer to a p4est_lid_t.
@@ -381,6 +508,44 @@ p4est_t            *p4est_new_ext (sc_MPI_Comm mpicomm,
                                    size_t data_size, p4est_init_t init_fn,
                                    void *user_pointer);
 
+/** Create a new forest uniformly refined to a given level.
+ * The result is the same as that of \ref p4est_new_ext with fill_uniform
+ * set and min_quadrants 0.  The partition and the coordinates of every
+ * quadrant are computed in closed form from its Morton index, which makes
+ * this function the fastest way to create a fine uniform forest.
+ * The quadrants are filled in chunks of contiguous quadrants of a tree,
+ * which are processed concurrently if OpenMP is enabled.
+ *
+ * \param [in] mpicomm          A valid MPI communicator.
+ * \param [in] connectivity     This is the connectivity information that
+ *                              the forest is built with.  Note the forest
+ *                              does not take ownership of the memory.
+ * \param [in] level            The level of all quadrants, at most
+ *                              \ref P4EST_OLD_QMAXLEVEL.
+ * \param [in] num_threads      Number of threads to fill the trees with.
+ *                              With more than one thread, the callbacks
+ *                              are invoked concurrently and must be
+ *                              thread safe.  Values below 2 run serially.
+ * \param [in] data_size        The size of data for each quadrant.
+ * \param [in] init_fn          Callback function to initialize the user_data
+ *                              of one quadrant; may be NULL.
+ * \param [in] init_batch_fn    Callback function to initialize the user_data
+ *                              of a contiguous range of quadrants; may be
+ *                              NULL.  At most one of the callbacks may be
+ *                              given.  The ranges are disjoint and cover
+ *                              all local quadrants exactly once.
+ * \param [in] user_pointer     Assigned to the user_pointer member of the
+ *                              forest before a callback is called.
+ * \return                      Valid p4est object.
+ */
+p4est_t            *p4est_new_uniform (sc_MPI_Comm mpicomm,
+                                       p4est_connectivity_t * connectivity,
+                                       int level, int num_threads,
+                                       size_t data_size,
+                                       p4est_init_t init_fn,
+                                       p4est_init_batch_t init_batch_fn,
+                                       void *user_pointer);
+
 /** Create a new mesh.
  * \param [in] p4est                A forest that is fully 2:1 balanced.
  * \param [in] ghost                The ghost layer created from the
@@ -416,6 +581,87 @@ p4est_mesh_t       *p4est_mesh_new_ext (p4est_t * p4est,
 p4est_t            *p4est_copy_ext (p4est_t * input, int copy_data,
                                     int duplicate_mpicomm);
 
+/** Make a copy of a p4est that shares storage with the input until modified.
+ * The local trees of both forests refer to the same quadrant arrays and
+ * user data.  A tree gets its own storage when refinement, coarsening,
+ * balance, partitioning or \ref p4est_reset_data change it in one of the
+ * forests.  Thus the copy is cheap as long as few trees are modified.
+ * The forests use the same user data pool, which is destroyed with the last
+ * of them.  User data of shared trees must not be changed in place; call
+ * \ref p4est_unshare first to do this.
+ * Otherwise the copy behaves like the result of \ref p4est_copy_ext with
+ * copy_data set to true.
+ *
+ * \param [in,out] input  Its local trees are converted to shared storage.
+ * \param [in]  duplicate_mpicomm  If true, MPI communicator is copied.
+ * \return  Returns a valid p4est with a revision counter of 0.
+ */
+p4est_t            *p4est_copy_cow (p4est_t * input, int duplicate_mpicomm);
+
+/** Give a forest private storage for all trees shared with other forests.
+ * The user data of the quadrants is copied, so that it may be modified.
+ * The user data pool remains shared with the forests of \ref p4est_copy_cow.
+ * \param [in,out] p4est  Valid forest.
+ */
+void                p4est_unshare (p4est_t * p4est);
+
+/** Store the local quadrants of a forest in a compact format.
+ * Each quadrant is reduced to the Morton index of its first descendant at
+ * level \ref P4EST_OLD_QMAXLEVEL and its level, 9 bytes instead of
+ * sizeof (p4est_quadrant_t).  If data_size is nonzero, the user data pointers
+ * are kept in an array of their own.  The tree quadrant arrays are freed;
+ * all other members of the forest and the trees remain valid.
+ * Copy-on-write storage shared with other forests is unshared first.
+ *
+ * A compact forest may be passed to \ref p4est_expand,
+ * \ref p4est_compact_quadrant, \ref p4est_iterate_compact,
+ * \ref p4est_memory_used, \ref p4est_revision and \ref p4est_destroy.
+ * Refine, coarsen, adapt, balance and \ref p4est_partition_ext accept it
+ * too: they expand the forest on entry and compact it again on exit, which
+ * leaves the forest expanded if a quadrant has become finer than
+ * \ref P4EST_OLD_QMAXLEVEL.  \ref p4est_is_valid fails for a compact forest,
+ * and ghost, nodes, lnodes, search, copy, save and the split-phase partition
+ * abort on it.
+ * This function is not collective.
+ * \param [in,out] p4est  Valid forest.
+ * \return         True if the forest has been compacted.  False if a local
+ *                 quadrant is finer than \ref P4EST_OLD_QMAXLEVEL, in which
+ *                 case the forest is not changed.
+ */
+int                 p4est_compact (p4est_t * p4est);
+
+/** Restore the tree quadrant arrays of a compact forest.
+ * The quadrants are the same as before \ref p4est_compact, including their
+ * user data if data_size is nonzero.  This function is not collective.
+ * \param [in,out] p4est  Forest compacted by \ref p4est_compact.
+ */
+void                p4est_expand (p4est_t * p4est);
+
+/** Return a quadrant of a compact forest by its local index.
+ * \param [in] p4est       Forest compacted by \ref p4est_compact.
+ * \param [in] local_num   Process-local index of the quadrant, counted
+ *                         through all local trees.
+ * \param [out] quadrant   The quadrant.  Its user_data is set if data_size
+ *                         is nonzero and to NULL otherwise.
+ * \return                 The tree containing the quadrant.
+ */
+p4est_topidx_t      p4est_compact_quadrant (p4est_t * p4est,
+                                            p4est_locidx_t local_num,
+                                            p4est_quadrant_t * quadrant);
+
+/** Reduce the memory accounting of a forest over its communicator.
+ * The entries of \a p4est->inspect for the forest and its connectivity are
+ * updated first.  This function is collective.
+ * \param [in,out] p4est  Valid forest with an inspect structure.
+ * \param [out] stats     Array of 2 * P4EST_MEMORY_NUM_PHASES entries.  The
+ *                        current bytes of every \ref p4est_memory_phase_t
+ *                        are followed by the peak bytes.  Minimum, maximum
+ *                        and average over all processes are computed and
+ *                        may be printed by sc_stats_print.
+ */
+void                p4est_memory_stats (p4est_t * p4est,
+                                        sc_statinfo_t * stats);
+
 /** Refine a forest with a bounded refinement level and a replace option.
  * \param [in,out] p4est The forest is changed in place.
  * \param [in] refine_recursive Boolean to decide on recursive refinement.
@@ -426,7 +672,8 @@ p4est_t            *p4est_copy_ext (p4est_t * input, int copy_data,
  *                        shall be refined.  If refine_recursive is true,
  *                        refine_fn is called for every existing and newly
  *                        created quadrant.  Otherwise, it is called for every
- *                        existing quadrant.  It is possible that a refinement
+ *                        existing quadrant before any quadrant is created.
+ *                        It is possible that a refinement
  *                        request made by the callback is ignored.  To catch
  *                        this case, you can examine whether init_fn or
  *                        replace_fn gets called.
@@ -470,6 +717,72 @@ void                p4est_coarsen_ext (p4est_t * p4est, int coarsen_recursive,
                                        p4est_init_t init_fn,
                                        p4est_replace_t replace_fn);
 
+/** Refine a forest non-recursively with a bulk refinement callback.
+ * The callback is passed contiguous ranges of the quadrants of a tree.
+ * The ranges are disjoint and cover all local quadrants exactly once.
+ * With threads enabled by the inspect member, the callback is invoked
+ * concurrently.  Otherwise, it is called once for every local tree.
+ * \param [in,out] p4est The forest is changed in place.
+ * \param [in] maxlevel   Maximum allowed refinement level (inclusive).
+ *                        If this is negative the level is restricted only
+ *                        by the compile-time constant QMAXLEVEL in p4est.h.
+ * \param [in] refine_fn  Callback function that flags the quadrants to refine.
+ * \param [in] init_fn    Callback function to initialize the user_data for
+ *                        newly created quadrants, which is guaranteed to be
+ *                        allocated.  This function pointer may be NULL.
+ * \param [in] replace_fn Callback function that allows the user to change
+ *                        incoming quadrants based on the quadrants they
+ *                        replace; may be NULL.
+ */
+void                p4est_refine_batch (p4est_t * p4est, int maxlevel,
+                                        p4est_refine_batch_t refine_fn,
+                                        p4est_init_t init_fn,
+                                        p4est_replace_t replace_fn);
+
+/** Coarsen a forest non-recursively with a bulk coarsening callback.
+ * The callback is called once for every local tree with all its quadrants.
+ * A family is coarsened if all of its quadrants are flagged.
+ * \param [in,out] p4est The forest is changed in place.
+ * \param [in] coarsen_fn Callback function that flags the quadrants that may
+ *                        be coarsened.
+ * \param [in] init_fn    Callback function to initialize the user_data
+ *                        which is already allocated automatically.
+ * \param [in] replace_fn Callback function that allows the user to change
+ *                        incoming quadrants based on the quadrants they
+ *                        replace.
+ */
+void                p4est_coarsen_batch (p4est_t * p4est,
+                                         p4est_coarsen_batch_t coarsen_fn,
+                                         p4est_init_t init_fn,
+                                         p4est_replace_t replace_fn);
+
+/** Refine, coarsen and optionally balance a forest according to flags.
+ * The quadrants are refined and coarsened in a single pass over each tree,
+ * calling replace_fn once for every refined quadrant and coarsened family.
+ * Coarsening is not recursive, and newly created quadrants are not refined.
+ * \param [in,out] p4est The forest is changed in place.
+ * \param [in] flags      One flag for each local quadrant: positive to
+ *                        refine, negative to coarsen, zero to keep it.
+ *                        A family is coarsened if all its members are
+ *                        flagged for coarsening.
+ * \param [in] maxlevel   Maximum allowed refinement level (inclusive).
+ *                        If this is negative the level is restricted only
+ *                        by the compile-time constant QMAXLEVEL in p4est.h.
+ * \param [in] balance    If true, 2:1 balance the forest if it has changed.
+ * \param [in] btype      Balance type if \a balance is true.
+ * \param [in] init_fn    Callback function to initialize the user_data
+ *                        which is already allocated automatically.
+ * \param [in] replace_fn Callback function that allows the user to change
+ *                        incoming quadrants based on the quadrants they
+ *                        replace; may be NULL.  It is also passed to balance.
+ * \return               True if the forest has changed on any process.
+ */
+int                 p4est_adapt (p4est_t * p4est, const int8_t * flags,
+                                 int maxlevel, int balance,
+                                 p4est_connect_type_t btype,
+                                 p4est_init_t init_fn,
+                                 p4est_replace_t replace_fn);
+
 /** 2:1 balance the size differences of neighboring elements in a forest.
  * \param [in,out] p4est  The p4est to be worked on.
  * \param [in] btype      Balance type (face or corner/full).
@@ -512,6 +825,100 @@ p4est_gloidx_t      p4est_partition_ext (p4est_t * p4est,
                                          int partition_for_coarsening,
                                          p4est_weight_t weight_fn);
 
+/** Begin to repartition the forest without waiting for the messages.
+ *
+ * The new partition is computed as in \ref p4est_partition_ext and the
+ * messages carrying quadrants and their user data are posted.  The forest
+ * is unchanged on return and may be used for computation until the call
+ * to \ref p4est_partition_end, which switches it to the new partition.
+ * The forest must not be modified in between.  The user data of quadrants
+ * that leave this process is copied here; later changes to it are lost.
+ *
+ * \param [in,out] p4est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     weight_fn  A weighting function or NULL
+ *                            for uniform partitioning.
+ * \return         The context to be passed to \ref p4est_partition_end.
+ */
+p4est_partition_context_t *p4est_partition_begin (p4est_t * p4est,
+                                                  int partition_for_coarsening,
+                                                  p4est_weight_t weight_fn);
+
+/** Complete a partition started by \ref p4est_partition_begin.
+ * Wait for the messages and rebuild the forest in the new partition.
+ * \param [in] pc     The context returned by the begin call; it is freed.
+ * \return            The global number of shipped quadrants
+ */
+p4est_gloidx_t      p4est_partition_end (p4est_partition_context_t * pc);
+
+/** Repartition the forest and ship a variable-size payload per quadrant.
+ *
+ * This function works like \ref p4est_partition_ext.  In addition, the
+ * payload of each quadrant travels in the same message as the quadrant,
+ * which saves a separate pass of \ref p4est_transfer_custom.  It is copied
+ * straight from the given pointers into the message buffer.
+ *
+ * \param [in,out] p4est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     weight_fn  A weighting function or NULL
+ *                            for uniform partitioning.
+ * \param [in]     src_sizes  The payload byte count of each local quadrant.
+ * \param [in]     src_payloads  For each local quadrant the address of its
+ *                            payload, may be NULL where the size is 0.
+ * \param [out]    dest_sizes Array of int, resized to the new count of
+ *                            local quadrants and filled with their sizes.
+ * \param [out]    dest_data  Array of elem_size 1, resized to hold the
+ *                            payloads of the new local quadrants in order.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p4est_partition_payload (p4est_t * p4est,
+                                             int partition_for_coarsening,
+                                             p4est_weight_t weight_fn,
+                                             const int *src_sizes,
+                                             const void *const *src_payloads,
+                                             sc_array_t * dest_sizes,
+                                             sc_array_t * dest_data);
+
+/** Begin a partition with payload; see \ref p4est_partition_payload.
+ * The source arrays must stay alive until \ref p4est_partition_end,
+ * which fills \a dest_sizes and \a dest_data.
+ */
+p4est_partition_context_t *p4est_partition_payload_begin
+  (p4est_t * p4est, int partition_for_coarsening, p4est_weight_t weight_fn,
+   const int *src_sizes, const void *const *src_payloads,
+   sc_array_t * dest_sizes, sc_array_t * dest_data);
+
+/** Repartition the forest balancing several weights per quadrant at once.
+ *
+ * Every constraint is measured in units of its even share per process.
+ * A cut is placed where the summed normalized weight is divided evenly,
+ * unless some constraint deviates from its share by more than \a tolerance
+ * there.  Then the cut is moved to minimize the largest deviation of any
+ * constraint, searching the quadrants of the process that holds it.
+ *
+ * \param [in,out] p4est      The forest that will be partitioned.
+ * \param [in]     partition_for_coarsening     If true, the partition
+ *                            is modified to allow one level of coarsening.
+ * \param [in]     num_constraints  The number of weights per quadrant.
+ * \param [in]     weights_fn Callback for the weights of a quadrant.
+ *                            When running with mpisize == 1, never called.
+ *                            Otherwise, called in order for all quadrants.
+ * \param [in]     tolerance  Deviation of a cut from the share of each
+ *                            constraint that is accepted, relative to it.
+ * \param [out]    imbalance  If not NULL, receives for every constraint
+ *                            the ratio of maximum to average load of the
+ *                            designated partition.
+ * \return         The global number of shipped quadrants
+ */
+p4est_gloidx_t      p4est_partition_multi (p4est_t * p4est,
+                                           int partition_for_coarsening,
+                                           int num_constraints,
+                                           p4est_weights_t weights_fn,
+                                           double tolerance,
+                                           double *imbalance);
+
 /** Correct partition to allow one level of coarsening.
  *
  * \param [in] p4est                     forest whose partition is corrected
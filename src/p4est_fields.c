@@ -0,0 +1,281 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_communication.h>
+#include <p4est_fields.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_communication.h>
+#include <p8est_fields.h>
+#endif
+
+/** Copy the data of contiguous quadrants from the old to the new arrays. */
+static void
+p4est_fields_copy (p4est_fields_t * fields, p4est_locidx_t old_first,
+                   p4est_locidx_t new_first, p4est_locidx_t count)
+{
+  int                 k;
+  size_t              size;
+
+  P4EST_ASSERT (count > 0);
+  for (k = 0; k < fields->num_fields; ++k) {
+    size = fields->data[k].elem_size;
+    memcpy (sc_array_index (&fields->data[k], (size_t) new_first),
+            sc_array_index (&fields->old_data[k], (size_t) old_first),
+            (size_t) count * size);
+  }
+}
+
+/** Children inherit the data of their parent and a parent that of its first
+ * child; used if the user does not provide a replace callback.
+ */
+static void
+p4est_fields_replace_default (p4est_fields_t * fields,
+                              p4est_topidx_t which_tree,
+                              p4est_locidx_t num_outgoing,
+                              p4est_locidx_t first_outgoing,
+                              const p4est_quadrant_t * outgoing,
+                              p4est_locidx_t num_incoming,
+                              p4est_locidx_t first_incoming,
+                              const p4est_quadrant_t * incoming)
+{
+  p4est_locidx_t      li;
+
+  for (li = 0; li < num_incoming; ++li) {
+    p4est_fields_copy (fields, first_outgoing, first_incoming + li, 1);
+  }
+}
+
+p4est_fields_t     *
+p4est_fields_new (p4est_t * p4est, int num_fields,
+                  const size_t *field_sizes,
+                  p4est_fields_replace_t replace_fn, void *user_pointer)
+{
+  int                 k;
+  const size_t        lnq = (size_t) p4est->local_num_quadrants;
+  p4est_fields_t     *fields;
+
+  P4EST_ASSERT (p4est_is_valid (p4est));
+  P4EST_ASSERT (p4est->fields == NULL);
+  P4EST_ASSERT (num_fields > 0);
+
+  fields = P4EST_ALLOC_ZERO (p4est_fields_t, 1);
+  fields->p4est = p4est;
+  fields->num_fields = num_fields;
+  fields->data = P4EST_ALLOC (sc_array_t, num_fields);
+  fields->old_data = P4EST_ALLOC (sc_array_t, num_fields);
+  for (k = 0; k < num_fields; ++k) {
+    P4EST_ASSERT (field_sizes[k] > 0);
+    sc_array_init_count (&fields->data[k], field_sizes[k], lnq);
+    sc_array_memset (&fields->data[k], 0);
+    sc_array_init (&fields->old_data[k], field_sizes[k]);
+  }
+  fields->replace_fn =
+    replace_fn != NULL ? replace_fn : p4est_fields_replace_default;
+  fields->user_pointer = user_pointer;
+  fields->quadrants = sc_array_new (sizeof (p4est_quadrant_t));
+  fields->offsets = sc_array_new (sizeof (p4est_locidx_t));
+  p4est->fields = fields;
+
+  return fields;
+}
+
+void
+p4est_fields_destroy (p4est_fields_t * fields)
+{
+  int                 k;
+
+  P4EST_ASSERT (fields->p4est->fields == fields);
+  P4EST_ASSERT (fields->depth == 0);
+
+  fields->p4est->fields = NULL;
+  for (k = 0; k < fields->num_fields; ++k) {
+    sc_array_reset (&fields->data[k]);
+    sc_array_reset (&fields->old_data[k]);
+  }
+  P4EST_FREE (fields->data);
+  P4EST_FREE (fields->old_data);
+  sc_array_destroy (fields->quadrants);
+  sc_array_destroy (fields->offsets);
+  P4EST_FREE (fields);
+}
+
+void               *
+p4est_fields_index (p4est_fields_t * fields, int field,
+                    p4est_locidx_t local_num)
+{
+  P4EST_ASSERT (0 <= field && field < fields->num_fields);
+  P4EST_ASSERT (0 <= local_num &&
+                local_num < fields->p4est->local_num_quadrants);
+
+  return sc_array_index (&fields->data[field], (size_t) local_num);
+}
+
+void
+p4est_fields_save (p4est_t * p4est)
+{
+  p4est_fields_t     *fields = p4est->fields;
+  size_t              count;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+
+  if (fields == NULL || fields->depth++ > 0) {
+    return;
+  }
+  P4EST_ASSERT (fields->data[0].elem_count ==
+                (size_t) p4est->local_num_quadrants);
+  fields->revision = p4est->revision;
+
+  /* the local trees keep their order, only their quadrants change */
+  sc_array_resize (fields->quadrants, (size_t) p4est->local_num_quadrants);
+  sc_array_resize (fields->offsets, 0);
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    *(p4est_locidx_t *) sc_array_push (fields->offsets) =
+      tree->quadrants_offset;
+    count = tree->quadrants.elem_count;
+    if (count > 0) {
+      memcpy (sc_array_index (fields->quadrants,
+                              (size_t) tree->quadrants_offset),
+              tree->quadrants.array, count * sizeof (p4est_quadrant_t));
+    }
+  }
+  *(p4est_locidx_t *) sc_array_push (fields->offsets) =
+    p4est->local_num_quadrants;
+}
+
+void
+p4est_fields_remap (p4est_t * p4est)
+{
+  p4est_fields_t     *fields = p4est->fields;
+  int                 k;
+  sc_array_t          swap;
+  p4est_topidx_t      jt;
+  p4est_locidx_t      ofirst, ocount, nfirst, ncount;
+  p4est_locidx_t      i, j, l, *offsets;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *oq, *nq;
+
+  if (fields == NULL || --fields->depth > 0) {
+    return;
+  }
+  P4EST_ASSERT (fields->depth == 0);
+
+  if (fields->revision != p4est->revision) {
+    /* move the data aside and size the arrays to the new forest */
+    for (k = 0; k < fields->num_fields; ++k) {
+      swap = fields->old_data[k];
+      fields->old_data[k] = fields->data[k];
+      fields->data[k] = swap;
+      sc_array_resize (&fields->data[k],
+                       (size_t) p4est->local_num_quadrants);
+    }
+
+    /* old and new quadrants of a tree are either equal or nested */
+    offsets = (p4est_locidx_t *) fields->offsets->array;
+    for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+      tree = p4est_tree_array_index (p4est->trees, jt);
+      ofirst = offsets[jt - p4est->first_local_tree];
+      ocount = offsets[jt - p4est->first_local_tree + 1] - ofirst;
+      nfirst = tree->quadrants_offset;
+      ncount = (p4est_locidx_t) tree->quadrants.elem_count;
+      oq = (p4est_quadrant_t *) sc_array_index (fields->quadrants,
+                                                (size_t) ofirst);
+      nq = p4est_quadrant_array_index (&tree->quadrants, 0);
+      i = j = 0;
+      while (j < ncount) {
+        P4EST_ASSERT (i < ocount);
+
+        /* unchanged quadrants are copied in runs */
+        for (l = 0; i + l < ocount && j + l < ncount &&
+             p4est_quadrant_is_equal (oq + i + l, nq + j + l); ++l);
+        if (l > 0) {
+          p4est_fields_copy (fields, ofirst + i, nfirst + j, l);
+          i += l;
+          j += l;
+        }
+        else if (oq[i].level < nq[j].level) {
+          /* the old quadrant has been refined */
+          P4EST_ASSERT (p4est_quadrant_is_ancestor (oq + i, nq + j));
+          for (l = 1; j + l < ncount &&
+               p4est_quadrant_is_ancestor (oq + i, nq + j + l); ++l);
+          fields->replace_fn (fields, jt, 1, ofirst + i, oq + i,
+                              l, nfirst + j, nq + j);
+          ++i;
+          j += l;
+        }
+        else {
+          /* the new quadrant has replaced one or more families */
+          P4EST_ASSERT (p4est_quadrant_is_ancestor (nq + j, oq + i));
+          for (l = 1; i + l < ocount &&
+               p4est_quadrant_is_ancestor (nq + j, oq + i + l); ++l);
+          fields->replace_fn (fields, jt, l, ofirst + i, oq + i,
+                              1, nfirst + j, nq + j);
+          i += l;
+          ++j;
+        }
+      }
+      P4EST_ASSERT (i == ocount);
+    }
+    for (k = 0; k < fields->num_fields; ++k) {
+      sc_array_reset (&fields->old_data[k]);
+    }
+  }
+  sc_array_reset (fields->quadrants);
+  sc_array_reset (fields->offsets);
+}
+
+void
+p4est_fields_transfer (p4est_t * p4est, const p4est_gloidx_t * src_gfq)
+{
+  p4est_fields_t     *fields = p4est->fields;
+  int                 k;
+  p4est_transfer_context_t **tc;
+
+  if (fields == NULL) {
+    return;
+  }
+  P4EST_ASSERT (fields->depth == 0);
+
+  /* the messages of all fields are in flight at the same time */
+  tc = P4EST_ALLOC (p4est_transfer_context_t *, fields->num_fields);
+  for (k = 0; k < fields->num_fields; ++k) {
+    fields->old_data[k] = fields->data[k];
+    sc_array_init_count (&fields->data[k], fields->old_data[k].elem_size,
+                         (size_t) p4est->local_num_quadrants);
+    tc[k] = p4est_transfer_fixed_begin
+      (p4est->global_first_quadrant, src_gfq, p4est->mpicomm,
+       P4EST_COMM_FIELDS_TRANSFER, fields->data[k].array,
+       fields->old_data[k].array, fields->data[k].elem_size);
+  }
+  for (k = 0; k < fields->num_fields; ++k) {
+    p4est_transfer_fixed_end (tc[k]);
+    sc_array_reset (&fields->old_data[k]);
+  }
+  P4EST_FREE (tc);
+}
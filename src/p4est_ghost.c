@@ -57,10 +57,24 @@ p4est_ghost_tolerance_t;
 size_t
 p4est_ghost_memory_used (p4est_ghost_t * ghost)
 {
-  return sizeof (p4est_ghost_t) +
+  size_t              size;
+
+  size = sizeof (p4est_ghost_t) +
     sc_array_memory_used (&ghost->ghosts, 0) +
-    (ghost->mpisize + 1) * sizeof (p4est_locidx_t) +
-    (ghost->num_trees + 1) * sizeof (p4est_locidx_t);
+    sc_array_memory_used (&ghost->mirrors, 0) +
+    2 * (ghost->mpisize + 1) * sizeof (p4est_locidx_t) +
+    2 * (ghost->num_trees + 1) * sizeof (p4est_locidx_t);
+  if (ghost->mirror_proc_mirrors != NULL) {
+    size += ghost->mirror_proc_offsets[ghost->mpisize] *
+      sizeof (p4est_locidx_t);
+  }
+  if (ghost->mirror_proc_fronts != ghost->mirror_proc_mirrors) {
+    /* the fronts are stored separately after p4est_ghost_expand */
+    size += (ghost->mpisize + 1) * sizeof (p4est_locidx_t) +
+      ghost->mirror_proc_front_offsets[ghost->mpisize] *
+      sizeof (p4est_locidx_t);
+  }
+  return size;
 }
 
 #ifdef P4EST_ENABLE_MPI
@@ -73,6 +87,32 @@ p4est_ghost_array_index (sc_array_t * array, int i)
 
 #endif
 
+#ifdef P4EST_ENABLE_MPI
+
+/** Return the bytes of a ghost layer and its send buffers under
+ * construction in p4est_ghost_new_check. */
+static size_t
+p4est_ghost_new_memory (p4est_ghost_t * gl, sc_array_t * send_bufs,
+                        int num_peers)
+{
+  int                 i;
+  size_t              size;
+
+  size = sizeof (p4est_ghost_t) +
+    sc_array_memory_used (&gl->ghosts, 0) +
+    sc_array_memory_used (&gl->mirrors, 0) +
+    2 * (gl->mpisize + 1) * sizeof (p4est_locidx_t) +
+    2 * (gl->num_trees + 1) * sizeof (p4est_locidx_t) +
+    2 * num_peers * (2 * sizeof (MPI_Request) + sizeof (p4est_locidx_t));
+  size += sc_array_memory_used (send_bufs, 0);
+  for (i = 0; i < gl->mpisize; ++i) {
+    size += sc_array_memory_used (p4est_ghost_array_index (send_bufs, i), 0);
+  }
+  return size;
+}
+
+#endif /* P4EST_ENABLE_MPI */
+
 static p4est_ghost_t *p4est_ghost_new_check (p4est_t * p4est,
                                              p4est_connect_type_t btype,
                                              p4est_ghost_tolerance_t tol);
@@ -1497,6 +1537,9 @@ p4est_ghost_new_check (p4est_t * p4est, p4est_connect_type_t btype,
   p4est_topidx_t      nt;
   p4est_ghost_t      *gl;
 
+  SC_CHECK_ABORT (p4est->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_ghost_new %s\n",
                             p4est_connect_type_string (btype));
   p4est_log_indent_push ();
@@ -2147,6 +2190,12 @@ failtest:
     SC_CHECK_MPI (mpiret);
   }
 
+  /* the ghost layer and all send buffers are complete */
+  if (p4est->inspect != NULL) {
+    p4est_memory_record (p4est, P4EST_MEMORY_GHOST,
+                         p4est_ghost_new_memory (gl, &send_bufs, num_peers));
+  }
+
   /* Clean up */
   P4EST_FREE (recv_counts);
 
@@ -2215,6 +2264,8 @@ failtest:
   gl->mirror_proc_front_offsets = gl->mirror_proc_offsets;
 
   P4EST_ASSERT (p4est_ghost_is_valid (p4est, gl));
+  p4est_memory_record (p4est, P4EST_MEMORY_GHOST,
+                       p4est_ghost_memory_used (gl));
 
   p4est_log_indent_pop ();
   P4EST_GLOBAL_PRODUCTION ("Done " P4EST_STRING "_ghost_new\n");
@@ -2340,6 +2391,30 @@ p4est_ghost_exchange_data (p4est_t * p4est, p4est_ghost_t * ghost,
                                  (p4est, ghost, ghost_data));
 }
 
+/** Return the user data of a mirror as sent by p4est_ghost_exchange_data.
+ * This is the user_data pointer itself if the data size of the forest is 0.
+ */
+static void        *
+p4est_ghost_mirror_user_data (p4est_t * p4est, p4est_ghost_t * ghost,
+                              size_t mirror_index)
+{
+  p4est_topidx_t      which_tree;
+  p4est_locidx_t      which_quad;
+  p4est_quadrant_t   *mirror, *q;
+  p4est_tree_t       *tree;
+
+  mirror = p4est_quadrant_array_index (&ghost->mirrors, mirror_index);
+  which_tree = mirror->p.piggy3.which_tree;
+  P4EST_ASSERT (p4est->first_local_tree <= which_tree &&
+                which_tree <= p4est->last_local_tree);
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  which_quad = mirror->p.piggy3.local_num - tree->quadrants_offset;
+  P4EST_ASSERT (0 <= which_quad &&
+                which_quad < (p4est_locidx_t) tree->quadrants.elem_count);
+  q = p4est_quadrant_array_index (&tree->quadrants, which_quad);
+  return p4est->data_size == 0 ? &q->p.user_data : q->p.user_data;
+}
+
 p4est_ghost_exchange_t *
 p4est_ghost_exchange_data_begin (p4est_t * p4est, p4est_ghost_t * ghost,
                                  void *ghost_data)
@@ -2348,11 +2423,8 @@ p4est_ghost_exchange_data_begin (p4est_t * p4est, p4est_ghost_t * ghost,
   size_t              data_size;
 #ifdef P4EST_ENABLE_DEBUG
   p4est_topidx_t      prev_tree;
+  p4est_quadrant_t   *mirror;
 #endif
-  p4est_topidx_t      which_tree;
-  p4est_locidx_t      which_quad;
-  p4est_quadrant_t   *mirror, *q;
-  p4est_tree_t       *tree;
   p4est_ghost_exchange_t *exc;
   void              **mirror_data;
 
@@ -2364,21 +2436,12 @@ p4est_ghost_exchange_data_begin (p4est_t * p4est, p4est_ghost_t * ghost,
   prev_tree = -1;
 #endif
   for (zz = 0; zz < ghost->mirrors.elem_count; ++zz) {
-    mirror = p4est_quadrant_array_index (&ghost->mirrors, zz);
-    which_tree = mirror->p.piggy3.which_tree;
-    P4EST_ASSERT (p4est->first_local_tree <= which_tree &&
-                  which_tree <= p4est->last_local_tree);
-    P4EST_ASSERT (prev_tree <= which_tree);
 #ifdef P4EST_ENABLE_DEBUG
-    prev_tree = which_tree;
+    mirror = p4est_quadrant_array_index (&ghost->mirrors, zz);
+    P4EST_ASSERT (prev_tree <= mirror->p.piggy3.which_tree);
+    prev_tree = mirror->p.piggy3.which_tree;
 #endif
-    tree = p4est_tree_array_index (p4est->trees, which_tree);
-    which_quad = mirror->p.piggy3.local_num - tree->quadrants_offset;
-    P4EST_ASSERT (0 <= which_quad &&
-                  which_quad < (p4est_locidx_t) tree->quadrants.elem_count);
-    q = p4est_quadrant_array_index (&tree->quadrants, which_quad);
-    mirror_data[zz] =
-      p4est->data_size == 0 ? &q->p.user_data : q->p.user_data;
+    mirror_data[zz] = p4est_ghost_mirror_user_data (p4est, ghost, zz);
   }
 
   /* delegate the rest of the work */
@@ -2762,6 +2825,157 @@ p4est_ghost_exchange_custom_levels_end (p4est_ghost_exchange_t * exc)
   P4EST_FREE (exc);
 }
 
+p4est_ghost_exchange_plan_t *
+p4est_ghost_exchange_plan_new (p4est_t * p4est, p4est_ghost_t * ghost,
+                               size_t data_size, void *ghost_data)
+{
+  const int           num_procs = p4est->mpisize;
+  p4est_ghost_exchange_plan_t *plan;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 q;
+  p4est_locidx_t      ng_excl, ng_incl, ng;
+#endif
+
+  plan = P4EST_ALLOC_ZERO (p4est_ghost_exchange_plan_t, 1);
+  plan->p4est = p4est;
+  plan->ghost = ghost;
+  plan->data_size = data_size;
+  plan->ghost_data = ghost_data;
+  plan->sbuffer = P4EST_ALLOC (char, ghost->mirror_proc_offsets[num_procs] *
+                               data_size);
+  plan->requests = P4EST_ALLOC (sc_MPI_Request, 2 * num_procs);
+  if (data_size == 0) {
+    return plan;
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  /* the receives go straight into the ghost data */
+  ng_excl = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng_incl = ghost->proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      mpiret = MPI_Recv_init ((char *) ghost_data + ng_excl * data_size,
+                              (int) (ng * data_size), MPI_BYTE, q,
+                              P4EST_COMM_GHOST_EXCHANGE_PLAN, p4est->mpicomm,
+                              &plan->requests[plan->num_requests++]);
+      SC_CHECK_MPI (mpiret);
+      ng_excl = ng_incl;
+    }
+  }
+  P4EST_ASSERT (ng_excl == (p4est_locidx_t) ghost->ghosts.elem_count);
+
+  /* the mirrors are packed in the order of mirror_proc_mirrors */
+  ng_excl = 0;
+  for (q = 0; q < num_procs; ++q) {
+    ng_incl = ghost->mirror_proc_offsets[q + 1];
+    ng = ng_incl - ng_excl;
+    P4EST_ASSERT (ng >= 0);
+    if (ng > 0) {
+      mpiret = MPI_Send_init (plan->sbuffer + ng_excl * data_size,
+                              (int) (ng * data_size), MPI_BYTE, q,
+                              P4EST_COMM_GHOST_EXCHANGE_PLAN, p4est->mpicomm,
+                              &plan->requests[plan->num_requests++]);
+      SC_CHECK_MPI (mpiret);
+      ng_excl = ng_incl;
+    }
+  }
+#else
+  P4EST_ASSERT (ghost->ghosts.elem_count == 0);
+#endif
+
+  return plan;
+}
+
+void
+p4est_ghost_exchange_plan_begin (p4est_ghost_exchange_plan_t * plan,
+                                 void **mirror_data)
+{
+  p4est_t            *p4est = plan->p4est;
+  p4est_ghost_t      *ghost = plan->ghost;
+  const size_t        data_size = plan->data_size;
+  char               *mem;
+  p4est_locidx_t      theg, num_send, mirr;
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+#endif
+
+  P4EST_ASSERT (!plan->is_active);
+  P4EST_ASSERT (mirror_data != NULL || data_size ==
+                (p4est->data_size == 0 ? sizeof (void *) : p4est->data_size));
+  plan->is_active = 1;
+  if (data_size == 0) {
+    return;
+  }
+
+  /* pack the mirror data for all peers in one pass */
+  mem = plan->sbuffer;
+  num_send = ghost->mirror_proc_offsets[p4est->mpisize];
+  for (theg = 0; theg < num_send; ++theg) {
+    mirr = ghost->mirror_proc_mirrors[theg];
+    P4EST_ASSERT (0 <= mirr && (size_t) mirr < ghost->mirrors.elem_count);
+    memcpy (mem, mirror_data != NULL ? mirror_data[mirr] :
+            p4est_ghost_mirror_user_data (p4est, ghost, (size_t) mirr),
+            data_size);
+    mem += data_size;
+  }
+
+#ifdef P4EST_ENABLE_MPI
+  if (plan->num_requests > 0) {
+    mpiret = MPI_Startall (plan->num_requests, plan->requests);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+}
+
+void
+p4est_ghost_exchange_plan_end (p4est_ghost_exchange_plan_t * plan)
+{
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+#endif
+
+  P4EST_ASSERT (plan->is_active);
+#ifdef P4EST_ENABLE_MPI
+  if (plan->num_requests > 0) {
+    mpiret = MPI_Waitall (plan->num_requests, plan->requests,
+                          MPI_STATUSES_IGNORE);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+  plan->is_active = 0;
+}
+
+void
+p4est_ghost_exchange_plan_execute (p4est_ghost_exchange_plan_t * plan,
+                                   void **mirror_data)
+{
+  p4est_ghost_exchange_plan_begin (plan, mirror_data);
+  p4est_ghost_exchange_plan_end (plan);
+}
+
+void
+p4est_ghost_exchange_plan_destroy (p4est_ghost_exchange_plan_t * plan)
+{
+#ifdef P4EST_ENABLE_MPI
+  int                 mpiret;
+  int                 i;
+#endif
+
+  P4EST_ASSERT (!plan->is_active);
+#ifdef P4EST_ENABLE_MPI
+  for (i = 0; i < plan->num_requests; ++i) {
+    mpiret = MPI_Request_free (&plan->requests[i]);
+    SC_CHECK_MPI (mpiret);
+  }
+#endif
+  P4EST_FREE (plan->requests);
+  P4EST_FREE (plan->sbuffer);
+  P4EST_FREE (plan);
+}
+
 #ifdef P4EST_ENABLE_MPI
 
 static void
@@ -3526,7 +3740,7 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
     }
 
     if (buf->elem_count) {
-      sc_array_sort (buf, p4est_quadrant_compare_piggy);
+      p4est_quadrant_array_sort_piggy (buf);
       sc_array_uniq (buf, p4est_quadrant_compare_piggy_proc);
     }
     send_counts[peer] = (p4est_locidx_t) buf->elem_count;
@@ -3758,14 +3972,14 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
     for (p = 0; p < mpisize; p++) {
       buf = (sc_array_t *) sc_array_index_int (send_bufs, p);
 
-      sc_array_sort (buf, p4est_quadrant_compare_piggy);
+      p4est_quadrant_array_sort_piggy (buf);
       sc_array_uniq (buf, p4est_quadrant_compare_piggy);
     }
 
     sc_array_resize (ghost_layer, (size_t) (old_num_ghosts + num_new_ghosts));
     if (num_new_ghosts) {
       /* update the ghost layer */
-      sc_array_sort (ghost_layer, p4est_quadrant_compare_piggy);
+      p4est_quadrant_array_sort_piggy (ghost_layer);
       sc_array_uniq (ghost_layer, p4est_quadrant_compare_piggy);
 
       num_new_ghosts = ghost_layer->elem_count - old_num_ghosts;
@@ -3818,7 +4032,7 @@ p4est_ghost_expand_internal (p4est_t * p4est, p4est_lnodes_t * lnodes,
               buf->array, buf->elem_count * buf->elem_size);
     }
   }
-  sc_array_sort (new_mirrors, p4est_quadrant_compare_piggy);
+  p4est_quadrant_array_sort_piggy (new_mirrors);
   sc_array_uniq (new_mirrors, p4est_quadrant_compare_piggy);
   new_num_mirrors = (p4est_locidx_t) new_mirrors->elem_count;
   P4EST_ASSERT (new_num_mirrors >= old_num_mirrors);
@@ -127,6 +127,7 @@ p4est_inflate (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   p4est->user_pointer = user_pointer;
   p4est->connectivity = connectivity;
   num_trees = connectivity->num_trees;
+  p4est_connectivity_cache_transforms (connectivity);
 
   /* set parallel environment */
   p4est_comm_parallel_env_assign (p4est, mpicomm);
@@ -205,6 +206,8 @@ p4est_inflate (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
     }
     q = NULL;
     tree->maxlevel = 0;
+    tree->changed = 0;
+    tree->unbalanced = 0;
     if (jt >= p4est->first_local_tree && jt <= p4est->last_local_tree) {
       /* this tree has local quadrants */
       gtreeremain = pertree[jt + 1] - pertree[jt] - gtreeskip;
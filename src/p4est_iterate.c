@@ -3178,6 +3178,9 @@ p4est_iterate_ext (p4est_t * p4est, p4est_ghost_t * Ghost_layer,
   int32_t            *owned;
   int32_t             mask, touch;
 
+  SC_CHECK_ABORT (p4est->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+
   P4EST_ASSERT (p4est_is_valid (p4est));
 
   if (p4est->first_local_tree < 0 ||
@@ -3326,3 +3329,51 @@ p4est_iterate (p4est_t * p4est, p4est_ghost_t * Ghost_layer, void *user_data,
 #endif
                      iter_corner, 0);
 }
+
+/** The number of quadrants expanded at a time by p4est_iterate_compact. */
+#define P4EST_ITER_COMPACT_CHUNK 256
+
+void
+p4est_iterate_compact (p4est_t * p4est, void *user_data,
+                       p4est_iter_volume_t iter_volume)
+{
+  const int           with_data = (p4est->data_size > 0);
+  size_t              count, zz, zc, chunk;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree, *next;
+  p4est_quadrant_t    quads[P4EST_ITER_COMPACT_CHUNK];
+  p4est_iter_volume_info_t info;
+
+  P4EST_ASSERT (p4est->compact != NULL);
+
+  if (iter_volume == NULL) {
+    return;
+  }
+
+  info.p4est = p4est;
+  info.ghost_layer = NULL;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    if (jt == p4est->last_local_tree) {
+      count = (size_t) (p4est->local_num_quadrants - tree->quadrants_offset);
+    }
+    else {
+      next = p4est_tree_array_index (p4est->trees, jt + 1);
+      count = (size_t) (next->quadrants_offset - tree->quadrants_offset);
+    }
+    info.treeid = jt;
+
+    /* expand a chunk of quadrants at a time */
+    for (zz = 0; zz < count; zz += chunk) {
+      chunk = SC_MIN (count - zz, (size_t) P4EST_ITER_COMPACT_CHUNK);
+      p4est_compact_decode (p4est->compact,
+                            tree->quadrants_offset + (p4est_locidx_t) zz,
+                            chunk, quads, with_data);
+      for (zc = 0; zc < chunk; ++zc) {
+        info.quad = &quads[zc];
+        info.quadid = (p4est_locidx_t) (zz + zc);
+        iter_volume (&info, user_data);
+      }
+    }
+  }
+}
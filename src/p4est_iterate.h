@@ -237,6 +237,19 @@ void                p4est_iterate (p4est_t * p4est,
                                    p4est_iter_face_t iter_face,
                                    p4est_iter_corner_t iter_corner);
 
+/** Execute a volume callback for every local quadrant of a compact forest.
+ * Each quadrant is expanded from the storage of \ref p4est_compact into a
+ * temporary p4est_quadrant_t just before the callback, such that callbacks
+ * written for \ref p4est_iterate can be used unchanged.  Changes to the
+ * temporary quadrant are discarded, while its user_data points to the data
+ * of the forest.  The ghost_layer of the info is NULL.
+ * \param[in] p4est          forest compacted by \ref p4est_compact
+ * \param[in,out] user_data  optional context to supply to each callback
+ * \param[in] iter_volume    callback function for every quadrant's interior
+ */
+void                p4est_iterate_compact (p4est_t * p4est, void *user_data,
+                                           p4est_iter_volume_t iter_volume);
+
 /** Return a pointer to a iter_corner_side array element indexed by a int.
  */
 /*@unused@*/
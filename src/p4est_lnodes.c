@@ -24,12 +24,14 @@
 
 #include <sc_statistics.h>
 #ifndef P4_TO_P8
+#include <p4est_algorithms.h>
 #include <p4est_bits.h>
 #include <p4est_communication.h>
 #include <p4est_extended.h>
 #include <p4est_ghost.h>
 #include <p4est_lnodes.h>
 #else
+#include <p8est_algorithms.h>
 #include <p8est_bits.h>
 #include <p8est_communication.h>
 #include <p8est_extended.h>
@@ -1855,6 +1857,28 @@ p4est_lnodes_init_data (p4est_lnodes_data_t * data, int p, p4est_t * p4est,
   data->all_procs = sc_array_new (sizeof (int));
 }
 
+/** Return the bytes of the working storage of p4est_lnodes_new. */
+static size_t
+p4est_lnodes_data_memory (p4est_lnodes_data_t * data, p4est_t * p4est,
+                          p4est_ghost_t * ghost_layer)
+{
+  int                 i;
+  size_t              size;
+
+  size = (p4est->local_num_quadrants + ghost_layer->ghosts.elem_count) *
+    sizeof (p4est_lnodes_dep_t) +
+    (p4est->mpisize + 1) * sizeof (p4est_locidx_t) +
+    sc_array_memory_used (data->inodes, 1) +
+    sc_array_memory_used (data->inode_sharers, 1) +
+    sc_array_memory_used (data->touching_procs, 1) +
+    sc_array_memory_used (data->all_procs, 1);
+  for (i = 0; i < p4est->mpisize; i++) {
+    size += sc_array_memory_used (&data->send_buf_info[i], 1) +
+      sc_array_memory_used (&data->recv_buf_info[i], 1);
+  }
+  return size;
+}
+
 static void
 p4est_lnodes_reset_data (p4est_lnodes_data_t * data, p4est_t * p4est)
 {
@@ -2566,6 +2590,9 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
   p4est_lnodes_t     *lnodes = P4EST_ALLOC (p4est_lnodes_t, 1);
   p4est_gloidx_t      gtotal;
 
+  SC_CHECK_ABORT (p4est->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+
   P4EST_GLOBAL_PRODUCTIONF ("Into " P4EST_STRING "_lnodes_new, degree %d\n",
                             degree);
   p4est_log_indent_push ();
@@ -2641,7 +2668,16 @@ p4est_lnodes_new (p4est_t * p4est, p4est_ghost_t * ghost_layer, int degree)
 
   gtotal = p4est_lnodes_global_and_sharers (&data, lnodes, p4est);
 
+  /* the working storage is complete along with the result */
+  if (p4est->inspect != NULL) {
+    p4est_memory_record (p4est, P4EST_MEMORY_LNODES,
+                         p4est_lnodes_memory_used (lnodes) +
+                         p4est_lnodes_data_memory (&data, p4est,
+                                                   ghost_layer));
+  }
   p4est_lnodes_reset_data (&data, p4est);
+  p4est_memory_record (p4est, P4EST_MEMORY_LNODES,
+                       p4est_lnodes_memory_used (lnodes));
 
 #ifdef P4EST_ENABLE_DEBUG
   {
@@ -2682,6 +2718,29 @@ p4est_lnodes_destroy (p4est_lnodes_t * lnodes)
   P4EST_FREE (lnodes);
 }
 
+size_t
+p4est_lnodes_memory_used (p4est_lnodes_t * lnodes)
+{
+  int                 mpiret, mpisize;
+  size_t              zz, size;
+  p4est_lnodes_rank_t *lrank;
+
+  mpiret = sc_MPI_Comm_size (lnodes->mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+
+  size = sizeof (p4est_lnodes_t) +
+    (size_t) lnodes->num_local_elements *
+    (lnodes->vnodes * sizeof (p4est_locidx_t) + sizeof (p4est_lnodes_code_t)) +
+    (size_t) (lnodes->num_local_nodes - lnodes->owned_count) *
+    sizeof (p4est_gloidx_t) + mpisize * sizeof (p4est_locidx_t);
+  size += sc_array_memory_used (lnodes->sharers, 1);
+  for (zz = 0; zz < lnodes->sharers->elem_count; zz++) {
+    lrank = p4est_lnodes_rank_array_index (lnodes->sharers, zz);
+    size += sc_array_memory_used (&lrank->shared_nodes, 0);
+  }
+  return size;
+}
+
 #ifdef P4EST_ENABLE_MPI
 
 static              size_t
@@ -2846,7 +2905,7 @@ p4est_ghost_support_lnodes (p4est_t * p4est, p4est_lnodes_t * lnodes,
           *q = node_to_quad[qid];
         }
       }
-      sc_array_sort (send_quads, p4est_quadrant_compare_piggy);
+      p4est_quadrant_array_sort_piggy (send_quads);
       sc_array_uniq (send_quads, p4est_quadrant_compare_piggy);
 
       nquads = (p4est_locidx_t) send_quads->elem_count;
@@ -2938,7 +2997,7 @@ p4est_ghost_support_lnodes (p4est_t * p4est, p4est_lnodes_t * lnodes,
     new_mirror_proc_mirrors =
       P4EST_ALLOC (p4est_locidx_t, newmpoffset[mpisize]);
 
-    sc_array_sort (new_mirrors, p4est_quadrant_compare_piggy);
+    p4est_quadrant_array_sort_piggy (new_mirrors);
     sc_array_uniq (new_mirrors, p4est_quadrant_compare_piggy);
     new_num_mirrors = (p4est_locidx_t) new_mirrors->elem_count;
     P4EST_ASSERT (new_num_mirrors >= old_num_mirrors);
@@ -3147,7 +3206,7 @@ p4est_ghost_support_lnodes (p4est_t * p4est, p4est_lnodes_t * lnodes,
 
         sc_array_init_view (&pview, new_ghosts, startidx,
                             (size_t) (endidx - startidx));
-        sc_array_sort (&pview, p4est_quadrant_compare_piggy);
+        p4est_quadrant_array_sort_piggy (&pview);
         sc_array_reset (&pview);
       }
     }
@@ -212,6 +212,12 @@ p4est_lnodes_t     *p4est_lnodes_new (p4est_t * p4est,
 
 void                p4est_lnodes_destroy (p4est_lnodes_t * lnodes);
 
+/** Calculate the memory usage of the lnodes structure.
+ * \param [in] lnodes   Valid lnodes structure.
+ * \return              Memory used in bytes.
+ */
+size_t              p4est_lnodes_memory_used (p4est_lnodes_t * lnodes);
+
 /** Expand the ghost layer to include the support of all nodes supported on
  * the local partition.
  *
@@ -123,6 +123,9 @@ p4est_nodes_new_local (p4est_t * p4est)
   p4est_indep_t      *in;
   p4est_nodes_t      *nodes;
 
+  SC_CHECK_ABORT (p4est->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+
   P4EST_GLOBAL_PRODUCTION ("Into " P4EST_STRING "_nodes_new_local\n");
   p4est_log_indent_push ();
   P4EST_ASSERT (p4est_is_valid (p4est));
@@ -557,6 +560,9 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
   sc_hash_array_t    *edge_hangings;
 #endif
 
+  SC_CHECK_ABORT (p4est->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+
   if (ghost == NULL)
     return p4est_nodes_new_local (p4est);
 
@@ -722,7 +728,7 @@ p4est_nodes_new (p4est_t * p4est, p4est_ghost_t * ghost)
     in->pad16 = (int16_t) (-1);
     in->p.piggy3.local_num = il;
   }
-  sc_array_sort (inda, p4est_quadrant_compare_piggy);
+  p4est_quadrant_array_sort_piggy (inda);
   for (il = 0; il < num_indep_nodes; ++il) {
     in = (p4est_indep_t *) sc_array_index (inda, (size_t) il);
     new_node_number[in->p.piggy3.local_num] = il;
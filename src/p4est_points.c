@@ -175,6 +175,7 @@ p4est_new_points (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
   p4est->user_pointer = &ppstate;
   p4est->connectivity = connectivity;
   num_trees = connectivity->num_trees;
+  p4est_connectivity_cache_transforms (connectivity);
 
   /* set parallel environment */
   p4est_comm_parallel_env_assign (p4est, mpicomm);
@@ -203,6 +204,8 @@ p4est_new_points (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
       tree->quadrants_per_level[i] = -1;
     }
     tree->maxlevel = 0;
+    tree->changed = 0;
+    tree->unbalanced = 0;
   }
   p4est->local_num_quadrants = 0;
   p4est->global_num_quadrants = 0;
@@ -725,6 +725,9 @@ p4est_search_local (p4est_t * p4est,
   p4est_local_recursion_t srec, *rec = &srec;
   sc_array_t         *tquadrants;
 
+  SC_CHECK_ABORT (p4est->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+
   /* correct call convention? */
   P4EST_ASSERT (p4est != NULL);
   P4EST_ASSERT (points == NULL || point_fn != NULL);
@@ -1415,6 +1418,9 @@ p4est_search_all (p4est_t * p4est,
   p4est_quadrant_t    root;
   p4est_all_recursion_t srec, *rec = &srec;
 
+  SC_CHECK_ABORT (p4est->compact == NULL,
+                  "Forest is compact, call " P4EST_STRING "_expand");
+
   /* we do nothing if there is nothing to be done */
   P4EST_ASSERT (p4est != NULL);
   P4EST_ASSERT (points == NULL || point_fn != NULL);
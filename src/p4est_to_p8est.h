@@ -63,6 +63,7 @@
 #define P4EST_LAST_OFFSET               P8EST_LAST_OFFSET
 #define P4EST_QUADRANT_INIT             P8EST_QUADRANT_INIT
 #define P4EST_LEAF_IS_FIRST_IN_TREE     P8EST_LEAF_IS_FIRST_IN_TREE
+#define P4EST_BALANCE_RECORD_BYTES      P8EST_BALANCE_RECORD_BYTES
 
 /* redefine enums */
 #define P4EST_CONNECT_FACE              P8EST_CONNECT_FACE
@@ -87,11 +88,17 @@
 #define p4est_connectivity_t            p8est_connectivity_t
 #define p4est_corner_transform_t        p8est_corner_transform_t
 #define p4est_corner_info_t             p8est_corner_info_t
+#define p4est_transform_cache_t         p8est_transform_cache_t
 #define p4est_geometry_t                p8est_geometry_t
 #define p4est_t                         p8est_t
 #define p4est_tree_t                    p8est_tree_t
 #define p4est_quadrant_t                p8est_quadrant_t
 #define p4est_inspect_t                 p8est_inspect_t
+#define p4est_partition_shared_t        p8est_partition_shared_t
+#define p4est_cow_t                     p8est_cow_t
+#define p4est_fields_t                  p8est_fields_t
+#define p4est_compact_t                 p8est_compact_t
+#define p4est_fields_replace_t          p8est_fields_replace_t
 #define p4est_position_t                p8est_position_t
 #define p4est_init_t                    p8est_init_t
 #define p4est_refine_t                  p8est_refine_t
@@ -99,6 +106,7 @@
 #define p4est_weight_t                  p8est_weight_t
 #define p4est_ghost_t                   p8est_ghost_t
 #define p4est_ghost_exchange_t          p8est_ghost_exchange_t
+#define p4est_ghost_exchange_plan_t     p8est_ghost_exchange_plan_t
 #define p4est_indep_t                   p8est_indep_t
 #define p4est_nodes_t                   p8est_nodes_t
 #define p4est_lid_t                     p8est_lid_t
@@ -128,6 +136,9 @@
 #define p4est_wrap_leaf_t               p8est_wrap_leaf_t
 #define p4est_wrap_flags_t              p8est_wrap_flags_t
 #define p4est_vtk_context_t             p8est_vtk_context_t
+#define p4est_cost_t                    p8est_cost_t
+#define p4est_partition_context_t       p8est_partition_context_t
+#define p4est_cow_tree_t                p8est_cow_tree_t
 
 /* redefine external variables */
 #define p4est_face_corners              p8est_face_corners
@@ -170,6 +181,10 @@
 #define p4est_connectivity_reorder_newid                \
         p8est_connectivity_reorder_newid
 #define p4est_connectivity_permute      p8est_connectivity_permute
+#define p4est_connectivity_cache_transforms             \
+        p8est_connectivity_cache_transforms
+#define p4est_connectivity_uncache_transforms           \
+        p8est_connectivity_uncache_transforms
 #define p4est_connectivity_join_faces   p8est_connectivity_join_faces
 #define p4est_connectivity_is_equivalent p8est_connectivity_is_equivalent
 #define p4est_connectivity_read_inp_stream p8est_connectivity_read_inp_stream
@@ -201,6 +216,10 @@
 
 /* functions in p4est_extended */
 #define p4est_replace_t                 p8est_replace_t
+#define p4est_refine_batch_t            p8est_refine_batch_t
+#define p4est_coarsen_batch_t           p8est_coarsen_batch_t
+#define p4est_init_batch_t              p8est_init_batch_t
+#define p4est_weights_t                 p8est_weights_t
 #define p4est_lid_compare               p8est_lid_compare
 #define p4est_lid_is_equal              p8est_lid_is_equal
 #define p4est_lid_init                  p8est_lid_init
@@ -224,13 +243,28 @@
 #define p4est_quadrant_linear_id_ext128 p8est_quadrant_linear_id_ext128
 #define p4est_quadrant_set_morton_ext128 p8est_quadrant_set_morton_ext128
 #define p4est_new_ext                   p8est_new_ext
+#define p4est_new_uniform               p8est_new_uniform
 #define p4est_mesh_new_ext              p8est_mesh_new_ext
 #define p4est_copy_ext                  p8est_copy_ext
+#define p4est_copy_cow                  p8est_copy_cow
+#define p4est_unshare                   p8est_unshare
+#define p4est_compact                   p8est_compact
+#define p4est_expand                    p8est_expand
+#define p4est_compact_quadrant          p8est_compact_quadrant
+#define p4est_memory_stats              p8est_memory_stats
 #define p4est_refine_ext                p8est_refine_ext
 #define p4est_coarsen_ext               p8est_coarsen_ext
+#define p4est_refine_batch              p8est_refine_batch
+#define p4est_coarsen_batch             p8est_coarsen_batch
+#define p4est_adapt                     p8est_adapt
 #define p4est_balance_ext               p8est_balance_ext
 #define p4est_balance_subtree_ext       p8est_balance_subtree_ext
 #define p4est_partition_ext             p8est_partition_ext
+#define p4est_partition_begin           p8est_partition_begin
+#define p4est_partition_end             p8est_partition_end
+#define p4est_partition_payload         p8est_partition_payload
+#define p4est_partition_payload_begin   p8est_partition_payload_begin
+#define p4est_partition_multi           p8est_partition_multi
 #define p4est_partition_for_coarsening  p8est_partition_for_coarsening
 #define p4est_save_ext                  p8est_save_ext
 #define p4est_load_ext                  p8est_load_ext
@@ -239,6 +273,7 @@
 /* functions in p4est_iterate */
 #define p4est_iterate                   p8est_iterate
 #define p4est_iterate_ext               p8est_iterate_ext
+#define p4est_iterate_compact           p8est_iterate_compact
 #define p4est_iter_fside_array_index    p8est_iter_fside_array_index
 #define p4est_iter_fside_array_index_int p8est_iter_fside_array_index_int
 #define p4est_iter_cside_array_index    p8est_iter_cside_array_index
@@ -254,6 +289,9 @@
 #define p4est_quadrant_overlaps         p8est_quadrant_overlaps
 #define p4est_quadrant_is_equal_piggy   p8est_quadrant_is_equal_piggy
 #define p4est_quadrant_compare          p8est_quadrant_compare
+#define p4est_quadrant_compare_batch    p8est_quadrant_compare_batch
+#define p4est_quadrant_array_sort       p8est_quadrant_array_sort
+#define p4est_quadrant_array_sort_piggy p8est_quadrant_array_sort_piggy
 #define p4est_quadrant_disjoint         p8est_quadrant_disjoint
 #define p4est_quadrant_compare_piggy    p8est_quadrant_compare_piggy
 #define p4est_quadrant_compare_local_num p8est_quadrant_compare_local_num
@@ -317,7 +355,9 @@
 #define p4est_quadrant_transform_corner p8est_quadrant_transform_corner
 #define p4est_quadrant_shift_corner     p8est_quadrant_shift_corner
 #define p4est_quadrant_linear_id        p8est_quadrant_linear_id
+#define p4est_quadrant_linear_id_batch  p8est_quadrant_linear_id_batch
 #define p4est_quadrant_set_morton       p8est_quadrant_set_morton
+#define p4est_quadrant_set_morton_batch p8est_quadrant_set_morton_batch
 #define p4est_quadrant_successor        p8est_quadrant_successor
 #define p4est_quadrant_predecessor      p8est_quadrant_predecessor
 #define p4est_quadrant_srand            p8est_quadrant_srand
@@ -352,17 +392,36 @@
 #define p4est_quadrant_copy             p8est_quadrant_copy
 #define p4est_is_valid                  p8est_is_valid
 #define p4est_tree_compute_overlap      p8est_tree_compute_overlap
+#define p4est_tree_compute_overlap_sweep                \
+        p8est_tree_compute_overlap_sweep
 #define p4est_tree_uniqify_overlap      p8est_tree_uniqify_overlap
 #define p4est_tree_remove_nonowned      p8est_tree_remove_nonowned
 #define p4est_complete_region           p8est_complete_region
 #define p4est_complete_subtree          p8est_complete_subtree
 #define p4est_balance_subtree           p8est_balance_subtree
 #define p4est_balance_border            p8est_balance_border
+#define p4est_balance_borders           p8est_balance_borders
+#define p4est_balance_subtrees          p8est_balance_subtrees
 #define p4est_linearize_tree            p8est_linearize_tree
 #define p4est_next_nonempty_process     p8est_next_nonempty_process
 #define p4est_partition_correction      p8est_partition_correction
 #define p4est_partition_for_coarsening  p8est_partition_for_coarsening
 #define p4est_partition_given           p8est_partition_given
+#define p4est_partition_given_begin     p8est_partition_given_begin
+#define p4est_partition_given_end       p8est_partition_given_end
+#define p4est_cow_share                 p8est_cow_share
+#define p4est_cow_is_shared             p8est_cow_is_shared
+#define p4est_cow_reclaim               p8est_cow_reclaim
+#define p4est_cow_unshare_tree          p8est_cow_unshare_tree
+#define p4est_cow_unshare               p8est_cow_unshare
+#define p4est_cow_release_tree          p8est_cow_release_tree
+#define p4est_cow_release               p8est_cow_release
+#define p4est_compact_encode            p8est_compact_encode
+#define p4est_compact_decode            p8est_compact_decode
+#define p4est_balance_encode            p8est_balance_encode
+#define p4est_balance_decode            p8est_balance_decode
+#define p4est_memory_record             p8est_memory_record
+#define p4est_partition_given_payload_begin p8est_partition_given_payload_begin
 
 /* functions in p4est_communication */
 #define p4est_comm_parallel_env_assign  p8est_comm_parallel_env_assign
@@ -375,6 +434,11 @@
 #define p4est_comm_parallel_env_reduce_ext p8est_comm_parallel_env_reduce_ext
 #define p4est_comm_count_quadrants      p8est_comm_count_quadrants
 #define p4est_comm_global_partition     p8est_comm_global_partition
+#define p4est_comm_partition_share      p8est_comm_partition_share
+#define p4est_comm_partition_unshare    p8est_comm_partition_unshare
+#define p4est_comm_partition_release    p8est_comm_partition_release
+#define p4est_comm_partition_write_begin p8est_comm_partition_write_begin
+#define p4est_comm_partition_write_end  p8est_comm_partition_write_end
 #define p4est_comm_count_pertree        p8est_comm_count_pertree
 #define p4est_comm_is_empty             p8est_comm_is_empty
 #define p4est_comm_is_contained         p8est_comm_is_contained
@@ -436,6 +500,13 @@
         p8est_ghost_exchange_custom_levels_begin
 #define p4est_ghost_exchange_custom_levels_end  \
         p8est_ghost_exchange_custom_levels_end
+#define p4est_ghost_exchange_plan_new   p8est_ghost_exchange_plan_new
+#define p4est_ghost_exchange_plan_begin p8est_ghost_exchange_plan_begin
+#define p4est_ghost_exchange_plan_end   p8est_ghost_exchange_plan_end
+#define p4est_ghost_exchange_plan_execute       \
+        p8est_ghost_exchange_plan_execute
+#define p4est_ghost_exchange_plan_destroy       \
+        p8est_ghost_exchange_plan_destroy
 #define p4est_ghost_bsearch             p8est_ghost_bsearch
 #define p4est_ghost_contains            p8est_ghost_contains
 #define p4est_ghost_is_valid            p8est_ghost_is_valid
@@ -453,6 +524,7 @@
 /* functions in p4est_lnodes */
 #define p4est_lnodes_new                p8est_lnodes_new
 #define p4est_lnodes_destroy            p8est_lnodes_destroy
+#define p4est_lnodes_memory_used        p8est_lnodes_memory_used
 #define p4est_ghost_support_lnodes      p8est_ghost_support_lnodes
 #define p4est_ghost_expand_by_lnodes    p8est_ghost_expand_by_lnodes
 #define p4est_partition_lnodes          p8est_partition_lnodes
@@ -506,6 +578,23 @@
 #define p4est_wrap_leaf_next            p8est_wrap_leaf_next
 #define p4est_wrap_leaf_first           p8est_wrap_leaf_first
 
+/* functions in p4est_cost */
+#define p4est_cost_new                  p8est_cost_new
+#define p4est_cost_destroy              p8est_cost_destroy
+#define p4est_cost_add_quadrant         p8est_cost_add_quadrant
+#define p4est_cost_add_tree             p8est_cost_add_tree
+#define p4est_cost_step                 p8est_cost_step
+#define p4est_cost_imbalance            p8est_cost_imbalance
+#define p4est_cost_partition            p8est_cost_partition
+
+/* functions in p4est_fields */
+#define p4est_fields_new                p8est_fields_new
+#define p4est_fields_destroy            p8est_fields_destroy
+#define p4est_fields_index              p8est_fields_index
+#define p4est_fields_save               p8est_fields_save
+#define p4est_fields_remap              p8est_fields_remap
+#define p4est_fields_transfer           p8est_fields_transfer
+
 /* functions in p4est_plex */
 #define p4est_get_plex_data             p8est_get_plex_data
 #define p4est_get_plex_data_ext         p8est_get_plex_data_ext
@@ -118,6 +118,14 @@ typedef struct p8est_tree
   p4est_locidx_t      quadrants_per_level[P8EST_MAXLEVEL + 1];
                                              /**< locals only */
   int8_t              maxlevel;              /**< highest local quadrant level */
+  int8_t              changed;               /**< nonzero if modified since the
+                                                  last balance, see
+                                                  p8est_t::balance_type */
+  int8_t              unbalanced;            /**< nonzero if refinement or
+                                                  coarsening since the last
+                                                  balance may have created a
+                                                  level jump of more than one
+                                                  in or next to this tree */
 }
 p8est_tree_t;
 
@@ -127,6 +135,26 @@ p8est_tree_t;
  */
 typedef struct p8est_inspect p8est_inspect_t;
 
+/** Storage of the partition arrays shared by the processes of a node.
+ * Declared in p8est_communication.h, see \ref p8est_comm_partition_share.
+ */
+typedef struct p8est_partition_shared p8est_partition_shared_t;
+
+/** Storage shared between copies made by p8est_copy_cow.
+ * Declared in p8est_algorithms.h.
+ */
+typedef struct p8est_cow p8est_cow_t;
+
+/** Per-quadrant data stored in contiguous arrays, one for each field.
+ * Declared in p8est_fields.h.
+ */
+typedef struct p8est_fields p8est_fields_t;
+
+/** Compact storage of the local quadrants made by p8est_compact.
+ * Declared in p8est_algorithms.h.
+ */
+typedef struct p8est_compact p8est_compact_t;
+
 /** The p8est forest datatype */
 typedef struct p8est
 {
@@ -165,6 +193,28 @@ typedef struct p8est
   sc_mempool_t       *quadrant_pool;  /**< memory allocator for temporary
                                            quadrants */
   p8est_inspect_t    *inspect;        /**< algorithmic switches */
+  int                 balance_type;     /**< connect type of the last
+                                             balance, 0 if unknown */
+  long                balance_revision; /**< revision at which the changed
+                                             flags of the trees are
+                                             complete; the forest is known
+                                             to be balanced up to the
+                                             changed trees if it equals
+                                             the revision */
+  p8est_partition_shared_t *partition_shared; /**< if not NULL,
+                                             global_first_quadrant and
+                                             global_first_position are
+                                             stored once per node */
+  p8est_cow_t       *cow;             /**< if not NULL, trees may share
+                                             storage with copies, see
+                                             p8est_copy_cow */
+  p8est_fields_t    *fields;          /**< if not NULL, field data that
+                                             follows the quadrants, see
+                                             p8est_fields_new */
+  p8est_compact_t   *compact;         /**< if not NULL, the local
+                                             quadrants are stored here
+                                             instead of in the trees, see
+                                             p8est_compact */
 }
 p8est_t;
 
@@ -284,7 +334,7 @@ void                p8est_destroy (p8est_t * p8est);
  * The connectivity is not duplicated.
  * Copying of quadrant user data is optional.
  * If old and new data sizes are 0, the user_data field is copied regardless.
- * The inspect member of the copy is set to NULL.
+ * The inspect and fields members of the copy are set to NULL.
  * The revision counter of the copy is set to zero.
  *
  * \param [in]  copy_data  If true, data are copied.
@@ -319,7 +369,8 @@ void                p8est_reset_data (p8est_t * p8est, size_t data_size,
  *                       shall be refined.  If refine_recursive is true,
  *                       refine_fn is called for every existing and newly
  *                       created quadrant.  Otherwise, it is called for every
- *                       existing quadrant.  It is possible that a refinement
+ *                       existing quadrant before any quadrant is created.
+ *                       It is possible that a refinement
  *                       request made by the callback is ignored.  To catch
  *                       this case, you can examine whether init_fn gets
  *                       called, or use p8est_refine_ext in p8est_extended.h
@@ -120,6 +120,11 @@ int                 p8est_connect_type_int (p8est_connect_type_t btype);
  */
 const char         *p8est_connect_type_string (p8est_connect_type_t btype);
 
+/** Face and corner transforms precomputed for all trees.
+ * Defined below the corner transform types.
+ */
+typedef struct p8est_transform_cache p8est_transform_cache_t;
+
 /** This structure holds the 3D inter-tree connectivity information.
  * Identification of arbitrary faces, edges and corners is possible.
  *
@@ -168,6 +173,9 @@ const char         *p8est_connect_type_string (p8est_connect_type_t btype);
  * The size of the corner_to_* arrays is num_ctt = ctt_offset[num_corners].
  *
  * The *_to_attr arrays may have arbitrary contents defined by the user.
+ *
+ * The transforms member is a cache derived from the arrays above.
+ * It is created by \ref p8est_connectivity_cache_transforms.
  */
 typedef struct p8est_connectivity
 {
@@ -207,6 +215,9 @@ typedef struct p8est_connectivity
   p4est_topidx_t     *corner_to_tree; /**< list of trees that meet at a corner */
   int8_t             *corner_to_corner; /**< list of tree-corners that meet at
                                              a corner */
+
+  p8est_transform_cache_t *transforms; /**< NULL or face and corner
+                                            transforms of all trees */
 }
 p8est_connectivity_t;
 
@@ -245,6 +256,20 @@ typedef struct
 }
 p8est_corner_info_t;
 
+/** The cached transforms of a connectivity.
+ * They are the results of \ref p8est_find_face_transform and
+ * \ref p8est_find_corner_transform for every tree face and corner.
+ */
+struct p8est_transform_cache
+{
+  int8_t             *face_transforms;  /**< (9 * 6 * num_trees) entries
+                                             of the face transforms */
+  p4est_topidx_t     *ct_offset;        /**< (8 * num_trees + 1) offsets
+                                             into corner_transforms */
+  p8est_corner_transform_t *corner_transforms; /**< corner transforms of
+                                                    all tree corners */
+};
+
 /** Store the corner numbers 0..7 for each tree face. */
 extern const int    p8est_face_corners[6][4];
 
@@ -692,6 +717,24 @@ void                p8est_find_corner_transform (p8est_connectivity_t *
                                                  int icorner,
                                                  p8est_corner_info_t * ci);
 
+/** Precompute the face and corner transforms of all trees.
+ * Afterwards \ref p8est_find_face_transform and
+ * \ref p8est_find_corner_transform copy their results from the cache.
+ * This is called when a forest is created and does nothing if the cache
+ * exists.  The functions that modify a connectivity in place drop it.
+ * \param [in,out] conn     Valid connectivity whose transforms are cached.
+ */
+void                p8est_connectivity_cache_transforms
+  (p8est_connectivity_t * conn);
+
+/** Free the cached transforms of a connectivity.
+ * This must be called when the arrays of a connectivity with cached
+ * transforms are changed directly.
+ * \param [in,out] conn     Connectivity whose cache is freed if it exists.
+ */
+void                p8est_connectivity_uncache_transforms
+  (p8est_connectivity_t * conn);
+
 /** Internally connect a connectivity based on tree_to_vertex information.
  * Periodicity that is not inherent in the list of vertices will be lost.
  * \param [in,out] conn     The connectivity needs to have proper vertices
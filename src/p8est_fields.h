@@ -0,0 +1,152 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P8EST_FIELDS_H
+#define P8EST_FIELDS_H
+
+/** \file p8est_fields.h
+ * Store per-quadrant data in contiguous arrays, one for each field.
+ *
+ * The user_data of a quadrant lives in a block of its own, which scatters
+ * the data of neighboring quadrants through memory.  A \ref p8est_fields_t
+ * object instead keeps each field in one array indexed by the process-local
+ * quadrant number, such that numerical kernels stream through it with unit
+ * stride.  The fields are independent of the data_size of the forest.
+ *
+ * The fields are attached to the forest and follow it through
+ * \ref p8est_refine, \ref p8est_coarsen, \ref p8est_adapt,
+ * \ref p8est_balance, \ref p8est_partition and their variants.
+ * Refined and coarsened quadrants are passed to a replace callback as
+ * contiguous ranges of old and new local indices.
+ */
+
+#include <p8est_extended.h>
+
+SC_EXTERN_C_BEGIN;
+
+/** Callback function prototype to replace the field data of quadrants.
+ *
+ * The outgoing and incoming quadrants are contiguous in the old and new
+ * local numbering, respectively.  Either \a num_outgoing or \a num_incoming
+ * is 1; the other is the number of descendants that replace the quadrant or
+ * that are replaced by it.  The old values are read from the old_data
+ * member and the new values are written to the data member of \a fields.
+ * \param [in,out] fields        The fields being remapped.
+ * \param [in] which_tree        The tree containing the quadrants.
+ * \param [in] num_outgoing      The number of outgoing quadrants.
+ * \param [in] first_outgoing    Old local index of the first of them.
+ * \param [in] outgoing          The outgoing quadrants.  Only their
+ *                               coordinates and levels are valid.
+ * \param [in] num_incoming      The number of incoming quadrants.
+ * \param [in] first_incoming    New local index of the first of them.
+ * \param [in] incoming          The incoming quadrants.
+ */
+typedef void        (*p8est_fields_replace_t) (p8est_fields_t * fields,
+                                               p4est_topidx_t which_tree,
+                                               p4est_locidx_t num_outgoing,
+                                               p4est_locidx_t first_outgoing,
+                                               const p8est_quadrant_t *
+                                               outgoing,
+                                               p4est_locidx_t num_incoming,
+                                               p4est_locidx_t first_incoming,
+                                               const p8est_quadrant_t *
+                                               incoming);
+
+/** Contiguous per-quadrant data attached to a forest. */
+struct p8est_fields
+{
+  p8est_t            *p4est;    /**< The forest, not owned. */
+  int                 num_fields;       /**< Number of arrays in \a data. */
+  sc_array_t         *data;     /**< Per field, indexed by local quadrant. */
+  sc_array_t         *old_data; /**< Per field, the values before the
+                                     forest changed; valid inside the
+                                     replace callback only. */
+  p8est_fields_replace_t replace_fn;    /**< Replace callback, not NULL. */
+  void               *user_pointer;     /**< Never touched by p4est. */
+  int                 depth;    /**< Internal: nesting of modifications. */
+  long                revision; /**< Internal: revision before modifying. */
+  sc_array_t         *quadrants;        /**< Internal: quadrants before. */
+  sc_array_t         *offsets;  /**< Internal: tree offsets before. */
+};
+
+/** Create fields and attach them to a forest.
+ * The forest may not have fields attached already.  Its local quadrants are
+ * assigned zeroed data.  This function is not collective, but the fields
+ * must be attached on all processes when the forest is partitioned.
+ * \param [in,out] p4est        The forest must stay alive while the fields
+ *                              are attached to it; destroy them first.
+ * \param [in] num_fields       Number of fields, positive.
+ * \param [in] field_sizes      Byte count per quadrant of every field.
+ * \param [in] replace_fn       Callback to compute the data of refined and
+ *                              coarsened quadrants.  If NULL, children
+ *                              inherit the data of their parent and a
+ *                              parent that of its first child.
+ * \param [in] user_pointer     Assigned to the user_pointer member.
+ * \return                      Fields registered in p4est->fields.
+ */
+p8est_fields_t     *p8est_fields_new (p8est_t * p4est, int num_fields,
+                                      const size_t *field_sizes,
+                                      p8est_fields_replace_t replace_fn,
+                                      void *user_pointer);
+
+/** Detach the fields from their forest and free all memory. */
+void                p8est_fields_destroy (p8est_fields_t * fields);
+
+/** Return the data of a field for one quadrant.
+ * \param [in] fields       The fields attached to a forest.
+ * \param [in] field        The index of the field.
+ * \param [in] local_num    Process-local index of the quadrant, counted
+ *                          through all local trees.
+ * \return                  The address of the quadrant's data.  The data of
+ *                          the field is contiguous in the local index.
+ */
+void               *p8est_fields_index (p8est_fields_t * fields, int field,
+                                        p4est_locidx_t local_num);
+
+/** Remember the local quadrants before the forest is refined or coarsened.
+ * Must be matched by \ref p8est_fields_remap.  Calls may be nested, in which
+ * case only the outermost pair takes effect.  Does nothing without fields.
+ * \param [in] p4est        The forest about to be modified locally.
+ */
+void                p8est_fields_save (p8est_t * p4est);
+
+/** Reorder the fields to match the forest after refinement or coarsening.
+ * The old and new quadrants of each tree are matched in a merge.  Unchanged
+ * quadrants keep their data, the others are passed to the replace callback.
+ * \param [in] p4est        The modified forest with the same local trees.
+ */
+void                p8est_fields_remap (p8est_t * p4est);
+
+/** Send the fields along with the quadrants after partitioning.
+ * This function is collective.  Does nothing without fields.
+ * \param [in] p4est        The forest in its new partition.
+ * \param [in] src_gfq      The global_first_quadrant array of the
+ *                          partition before.
+ */
+void                p8est_fields_transfer (p8est_t * p4est,
+                                           const p4est_gloidx_t * src_gfq);
+
+SC_EXTERN_C_END;
+
+#endif /* !P8EST_FIELDS_H */
@@ -372,6 +372,77 @@ p8est_ghost_exchange_t *p8est_ghost_exchange_custom_levels_begin
 void                p8est_ghost_exchange_custom_levels_end
   (p8est_ghost_exchange_t * exc);
 
+/** Persistent storage for repeated ghost exchanges of a fixed data size.
+ * The peers, the send buffer and the MPI requests are set up once by
+ * p8est_ghost_exchange_plan_new.  An exchange then only packs the mirror
+ * data and starts and completes the persistent requests.
+ */
+typedef struct p8est_ghost_exchange_plan
+{
+  p8est_t            *p4est;
+  p8est_ghost_t      *ghost;
+  size_t              data_size;
+  void               *ghost_data;       /**< Receives the data of all ghosts */
+  char               *sbuffer;          /**< Mirror data in send order */
+  int                 num_requests;     /**< Receives followed by sends */
+  int                 is_active;        /**< Boolean: messages in progress */
+  sc_MPI_Request     *requests;
+}
+p8est_ghost_exchange_plan_t;
+
+/** Create a plan to exchange ghost data of a fixed size repeatedly.
+ * The plan stays valid as long as the ghost layer is not changed.
+ * \param [in] p8est            The forest used for reference.
+ * \param [in] ghost            The ghost layer used for reference.
+ * \param [in] data_size        The data size to transfer per quadrant.
+ * \param [in,out] ghost_data   Pre-allocated contiguous data for all ghosts
+ *                              in sequence, which must hold at least \c
+ *                              data_size for each ghost.  It receives the
+ *                              data of every exchange and must stay alive at
+ *                              the same address until the plan is destroyed.
+ * \return                      The plan, to be destroyed with
+ *                              p8est_ghost_exchange_plan_destroy.
+ */
+p8est_ghost_exchange_plan_t *p8est_ghost_exchange_plan_new
+  (p8est_t * p8est, p8est_ghost_t * ghost, size_t data_size,
+   void *ghost_data);
+
+/** Begin a ghost data exchange with a plan.
+ * The ghost data must not be accessed before completion.
+ * \param [in,out] plan     A plan without an exchange in progress.
+ * \param [in] mirror_data  One data pointer per mirror quadrant as input.
+ *                          It is copied into the send buffer right away.
+ *                          If NULL, the user data of the mirror quadrants is
+ *                          sent like in p8est_ghost_exchange_data, which
+ *                          requires the plan's data size to be
+ *                          \c p8est->data_size, or sizeof (void *) if zero.
+ */
+void                p8est_ghost_exchange_plan_begin
+  (p8est_ghost_exchange_plan_t * plan, void **mirror_data);
+
+/** Complete a ghost data exchange begun with a plan.
+ * This function waits for all pending MPI communications.
+ * The plan can be used for the next exchange after it returns.
+ * \param [in,out] plan     A plan with an exchange in progress.
+ */
+void                p8est_ghost_exchange_plan_end
+  (p8est_ghost_exchange_plan_t * plan);
+
+/** Exchange ghost data with a plan.
+ * This is equivalent to p8est_ghost_exchange_plan_begin followed by
+ * p8est_ghost_exchange_plan_end.
+ * \param [in,out] plan     A plan without an exchange in progress.
+ * \param [in] mirror_data  See p8est_ghost_exchange_plan_begin.
+ */
+void                p8est_ghost_exchange_plan_execute
+  (p8est_ghost_exchange_plan_t * plan, void **mirror_data);
+
+/** Free the buffers and persistent requests of a plan.
+ * \param [in] plan         A plan without an exchange in progress.
+ */
+void                p8est_ghost_exchange_plan_destroy
+  (p8est_ghost_exchange_plan_t * plan);
+
 /** Expand the size of the ghost layer and mirrors by one additional layer of
  * adjacency.
  * \param [in] p8est            The forest from which the ghost layer was
@@ -321,6 +321,19 @@ void                p8est_iterate (p8est_t * p4est,
                                    p8est_iter_edge_t iter_edge,
                                    p8est_iter_corner_t iter_corner);
 
+/** Execute a volume callback for every local quadrant of a compact forest.
+ * Each quadrant is expanded from the storage of \ref p8est_compact into a
+ * temporary p8est_quadrant_t just before the callback, such that callbacks
+ * written for \ref p8est_iterate can be used unchanged.  Changes to the
+ * temporary quadrant are discarded, while its user_data points to the data
+ * of the forest.  The ghost_layer of the info is NULL.
+ * \param[in] p4est          forest compacted by \ref p8est_compact
+ * \param[in,out] user_data  optional context to supply to each callback
+ * \param[in] iter_volume    callback function for every quadrant's interior
+ */
+void                p8est_iterate_compact (p8est_t * p4est, void *user_data,
+                                           p8est_iter_volume_t iter_volume);
+
 /** Return a pointer to a iter_corner_side array element indexed by a int.
  */
 /*@unused@*/
@@ -251,6 +251,12 @@ p8est_lnodes_t     *p8est_lnodes_new (p8est_t * p8est,
 
 void                p8est_lnodes_destroy (p8est_lnodes_t * lnodes);
 
+/** Calculate the memory usage of the lnodes structure.
+ * \param [in] lnodes   Valid lnodes structure.
+ * \return              Memory used in bytes.
+ */
+size_t              p8est_lnodes_memory_used (p8est_lnodes_t * lnodes);
+
 /** Partition using weights based on the number of nodes assigned to each
  * element in lnodes
  *
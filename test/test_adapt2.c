@@ -0,0 +1,191 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#endif
+
+#ifndef P4_TO_P8
+static const int    start_level = 3;
+#else
+static const int    start_level = 2;
+#endif
+
+static int8_t      *adapt_flags;
+
+static p4est_locidx_t
+index_of (p4est_quadrant_t * q)
+{
+  return *(p4est_locidx_t *) q->p.user_data;
+}
+
+static void
+init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+         p4est_quadrant_t * quadrant)
+{
+  *(p4est_locidx_t *) quadrant->p.user_data = -1;
+}
+
+static void
+replace_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            int num_outgoing, p4est_quadrant_t * outgoing[],
+            int num_incoming, p4est_quadrant_t * incoming[])
+{
+  ++*(int *) p4est->user_pointer;
+}
+
+static int
+refine_init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * quadrant)
+{
+  return (int) quadrant->level < start_level + 2 &&
+    (which_tree + p4est_quadrant_child_id (quadrant)) % 3 == 0;
+}
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  return index_of (quadrant) >= 0 && adapt_flags[index_of (quadrant)] > 0;
+}
+
+static int
+coarsen_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            p4est_quadrant_t * q[])
+{
+  int                 i;
+
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    if (index_of (q[i]) < 0 || adapt_flags[index_of (q[i])] >= 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* store the local index of every quadrant in its user data and flag it */
+static void
+set_flags (p4est_t * p4est, int round)
+{
+  size_t              zz;
+  p4est_locidx_t      lq;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  adapt_flags = P4EST_REALLOC (adapt_flags, int8_t,
+                               p4est->local_num_quadrants);
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      lq = tree->quadrants_offset + (p4est_locidx_t) zz;
+      *(p4est_locidx_t *) q->p.user_data = lq;
+      if ((lq + round) % 7 == 0) {
+        adapt_flags[lq] = 1;
+      }
+      else if ((q->x >> (P4EST_MAXLEVEL - 1)) == round % 2) {
+        adapt_flags[lq] = -1;
+      }
+      else {
+        adapt_flags[lq] = 0;
+      }
+    }
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 round, changed;
+  int                 count_adapt, count_ext;
+  sc_MPI_Comm         mpicomm;
+  p4est_t            *p4est, *copy;
+  p4est_connectivity_t *connectivity;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* create connectivity and forest structures */
+#ifdef P4_TO_P8
+  connectivity = p8est_connectivity_new_rotcubes ();
+#else
+  connectivity = p4est_connectivity_new_star ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, start_level, 1,
+                         sizeof (p4est_locidx_t), init_fn, &count_adapt);
+  p4est_refine (p4est, 1, refine_init_fn, init_fn);
+  p4est_partition (p4est, 0, NULL);
+  adapt_flags = NULL;
+
+  for (round = 0; round < 3; ++round) {
+    /* adapt a copy with the separate algorithms */
+    set_flags (p4est, round);
+    copy = p4est_copy (p4est, 1);
+    copy->user_pointer = &count_ext;
+    count_adapt = count_ext = 0;
+    p4est_refine_ext (copy, 0, start_level + 3, refine_fn, init_fn,
+                      replace_fn);
+    p4est_coarsen_ext (copy, 0, 0, coarsen_fn, init_fn, replace_fn);
+    p4est_balance_ext (copy, P4EST_CONNECT_FULL, init_fn, replace_fn);
+
+    /* adapt the original with the fused algorithm */
+    changed = p4est_adapt (p4est, adapt_flags, start_level + 3, 1,
+                           P4EST_CONNECT_FULL, init_fn, replace_fn);
+    SC_CHECK_ABORT (changed, "Adapt change");
+    SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 0), "Adapt result");
+    SC_CHECK_ABORT (count_adapt == count_ext, "Adapt replace count");
+    p4est_destroy (copy);
+
+    p4est_partition (p4est, 0, NULL);
+  }
+
+  /* a forest without flags does not change */
+  set_flags (p4est, 0);
+  memset (adapt_flags, 0, p4est->local_num_quadrants * sizeof (int8_t));
+  changed = p4est_adapt (p4est, adapt_flags, -1, 1,
+                         P4EST_CONNECT_FULL, init_fn, replace_fn);
+  SC_CHECK_ABORT (!changed, "Adapt no change");
+
+  P4EST_FREE (adapt_flags);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
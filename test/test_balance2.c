@@ -86,6 +86,252 @@ refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
   return 1;
 }
 
+static p4est_topidx_t point_tree;
+
+static int
+refine_point_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                 p4est_quadrant_t * quadrant)
+{
+  const p4est_qcoord_t half = P4EST_ROOT_LEN / 2;
+  const p4est_qcoord_t qh = P4EST_QUADRANT_LEN (quadrant->level);
+
+  return which_tree == point_tree &&
+    quadrant->x <= half && half < quadrant->x + qh &&
+    quadrant->y <= half && half < quadrant->y + qh
+#ifdef P4_TO_P8
+    && quadrant->z <= half && half < quadrant->z + qh
+#endif
+    ;
+}
+
+static int
+coarsen_fine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                 p4est_quadrant_t * q[])
+{
+  return which_tree == point_tree + 1 && (int) q[0]->level > refine_level;
+}
+
+/* modify a balanced forest and compare incremental with full rebalance */
+static void
+balance_incremental (p4est_t * p4est, p4est_topidx_t which_tree)
+{
+  p4est_t            *copy;
+
+  copy = p4est_copy (p4est, 0);
+  p4est->inspect = P4EST_ALLOC_ZERO (p4est_inspect_t, 1);
+  p4est->inspect->use_balance_incremental = 1;
+
+  point_tree = which_tree;
+  p4est_coarsen_ext (p4est, 0, 0, coarsen_fine_fn, NULL, NULL);
+  p4est_refine_ext (p4est, 1, refine_level + 4, refine_point_fn, NULL, NULL);
+  p4est_coarsen_ext (copy, 0, 0, coarsen_fine_fn, NULL, NULL);
+  p4est_refine_ext (copy, 1, refine_level + 4, refine_point_fn, NULL, NULL);
+
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  p4est_balance (copy, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 0), "Incremental balance");
+
+  P4EST_FREE (p4est->inspect);
+  p4est->inspect = NULL;
+  p4est_destroy (copy);
+}
+
+/* compare the sorted sweep for the balance overlap with binary searches */
+static void
+balance_overlap (p4est_t * p4est, p4est_connect_type_t btype)
+{
+  p4est_t            *copy;
+
+  copy = p4est_copy (p4est, 0);
+  copy->inspect = P4EST_ALLOC_ZERO (p4est_inspect_t, 1);
+  copy->inspect->use_balance_overlap_bsearch = 1;
+
+  point_tree = 1;
+  p4est_refine_ext (p4est, 1, refine_level + 4, refine_point_fn, NULL, NULL);
+  p4est_refine_ext (copy, 1, refine_level + 4, refine_point_fn, NULL, NULL);
+
+  p4est_balance (p4est, btype, NULL);
+  p4est_balance (copy, btype, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, copy, 0), "Overlap sweep");
+  SC_CHECK_ABORT (copy->inspect->balance_comm_bytes <=
+                  copy->inspect->balance_comm_bytes_raw, "Balance bytes");
+
+  P4EST_FREE (copy->inspect);
+  copy->inspect = NULL;
+  p4est_destroy (copy);
+}
+
+static int
+refine_quarter_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                   p4est_quadrant_t * quadrant)
+{
+  const p4est_qcoord_t point = P4EST_ROOT_LEN / 4 + P4EST_ROOT_LEN / 32;
+  const p4est_qcoord_t qh = P4EST_QUADRANT_LEN (quadrant->level);
+
+  return quadrant->x <= point && point < quadrant->x + qh &&
+    quadrant->y <= point && point < quadrant->y + qh
+#ifdef P4_TO_P8
+    && quadrant->z <= point && point < quadrant->z + qh
+#endif
+    ;
+}
+
+/* skip the balance if refinement cannot have created a level jump */
+static void
+balance_skip (sc_MPI_Comm mpicomm)
+{
+  int                 mpisize;
+  int                 mpiret;
+  p4est_t            *p4est;
+  p4est_connectivity_t *conn;
+  p4est_inspect_t     inspect;
+
+  mpiret = sc_MPI_Comm_size (mpicomm, &mpisize);
+  SC_CHECK_MPI (mpiret);
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_unitsquare ();
+#else
+  conn = p8est_connectivity_new_unitcube ();
+#endif
+  p4est = p4est_new_ext (mpicomm, conn, 0, 3, 1, 0, NULL, NULL);
+  memset (&inspect, 0, sizeof (inspect));
+  p4est->inspect = &inspect;
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (!inspect.balance_skipped, "Balance skip 1");
+
+  /* the neighbors are local if the first child of the root is local */
+  p4est_refine_ext (p4est, 0, 4, refine_quarter_fn, NULL, NULL);
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (p4est_is_balanced (p4est, P4EST_CONNECT_FULL),
+                  "Balance skip 2");
+  SC_CHECK_ABORT (mpisize > P4EST_CHILDREN || inspect.balance_skipped,
+                  "Balance skip 3");
+
+  /* a jump of two levels is detected */
+  p4est_refine_ext (p4est, 0, 5, refine_quarter_fn, NULL, NULL);
+  SC_CHECK_ABORT (!p4est_is_balanced (p4est, P4EST_CONNECT_FULL),
+                  "Balance skip 4");
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (!inspect.balance_skipped, "Balance skip 5");
+  SC_CHECK_ABORT (p4est_is_balanced (p4est, P4EST_CONNECT_FULL),
+                  "Balance skip 6");
+
+  p4est->inspect = NULL;
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (conn);
+}
+
+/* round trip of the quadrants encoded for the balance exchange */
+static void
+balance_codec (void)
+{
+  const p4est_qcoord_t rh = P4EST_ROOT_LEN;
+  const p4est_qcoord_t mh = P4EST_QUADRANT_LEN (P4EST_QMAXLEVEL);
+  int                 first_round;
+  size_t              zz;
+  p4est_quadrant_t   *q, *r;
+  sc_array_t         *quadrants, *decoded, *bytes;
+
+  quadrants = sc_array_new (sizeof (p4est_quadrant_t));
+  decoded = sc_array_new (sizeof (p4est_quadrant_t));
+  bytes = sc_array_new (1);
+
+  /* coarse quadrant at the lowest extended coordinate */
+  q = p4est_quadrant_array_push (quadrants);
+  P4EST_QUADRANT_INIT (q);
+  q->level = 1;
+  q->x = -rh;
+  q->y = -P4EST_QUADRANT_LEN (1);
+#ifdef P4_TO_P8
+  q->z = rh;
+#endif
+  q->p.piggy2.which_tree = 0;
+  q->p.piggy2.from_tree = 3;
+  q->pad16 = -1;
+
+  /* finest quadrants below and beyond the root */
+  q = p4est_quadrant_array_push (quadrants);
+  P4EST_QUADRANT_INIT (q);
+  q->level = P4EST_QMAXLEVEL;
+  q->x = -mh;
+  q->y = rh + (rh - mh);
+#ifdef P4_TO_P8
+  q->z = -rh;
+#endif
+  q->p.piggy2.which_tree = 0;
+  q->p.piggy2.from_tree = 0;
+  q->pad16 = 0;
+
+  q = p4est_quadrant_array_push (quadrants);
+  P4EST_QUADRANT_INIT (q);
+  q->level = P4EST_QMAXLEVEL;
+  q->x = rh;
+  q->y = rh - mh;
+#ifdef P4_TO_P8
+  q->z = rh + (rh - mh);
+#endif
+  q->p.piggy2.which_tree = 0;
+  q->p.piggy2.from_tree = 1;
+  q->pad16 = P4EST_INSUL - 1;
+
+  /* a large jump of the tree index, coming from a much lower tree */
+  q = p4est_quadrant_array_push (quadrants);
+  P4EST_QUADRANT_INIT (q);
+  q->level = 0;
+  q->x = 0;
+  q->y = rh;
+#ifdef P4_TO_P8
+  q->z = 0;
+#endif
+  q->p.piggy2.which_tree = P4EST_TOPIDX_MAX / 2;
+  q->p.piggy2.from_tree = 1;
+  q->pad16 = 0xfe;
+
+  q = p4est_quadrant_array_push (quadrants);
+  P4EST_QUADRANT_INIT (q);
+  q->level = P4EST_QMAXLEVEL;
+  q->x = rh + (rh - mh);
+  q->y = -rh;
+#ifdef P4_TO_P8
+  q->z = mh;
+#endif
+  q->p.piggy2.which_tree = P4EST_TOPIDX_MAX - 1;
+  q->p.piggy2.from_tree = P4EST_TOPIDX_MAX - 1;
+  q->pad16 = -1;
+
+  for (first_round = 1; first_round >= 0; --first_round) {
+    if (!first_round) {
+      /* the second round carries neither source tree nor contact */
+      for (zz = 0; zz < quadrants->elem_count; ++zz) {
+        q = p4est_quadrant_array_index (quadrants, zz);
+        q->p.piggy2.from_tree = -1;
+        q->pad16 = -1;
+      }
+    }
+    p4est_balance_encode (quadrants, first_round, bytes);
+    SC_CHECK_ABORT (bytes->elem_count <= quadrants->elem_count *
+                    P4EST_BALANCE_RECORD_BYTES, "Balance codec size");
+    p4est_balance_decode (bytes, quadrants->elem_count, first_round,
+                          decoded);
+    SC_CHECK_ABORT (decoded->elem_count == quadrants->elem_count,
+                    "Balance codec count");
+    for (zz = 0; zz < quadrants->elem_count; ++zz) {
+      q = p4est_quadrant_array_index (quadrants, zz);
+      r = p4est_quadrant_array_index (decoded, zz);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (q, r), "Balance codec quad");
+      SC_CHECK_ABORT (q->p.piggy2.which_tree == r->p.piggy2.which_tree,
+                      "Balance codec tree");
+      SC_CHECK_ABORT (q->p.piggy2.from_tree == r->p.piggy2.from_tree,
+                      "Balance codec from tree");
+      SC_CHECK_ABORT (q->pad16 == r->pad16, "Balance codec contact");
+    }
+  }
+
+  sc_array_destroy (quadrants);
+  sc_array_destroy (decoded);
+  sc_array_destroy (bytes);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -189,6 +435,20 @@ main (int argc, char **argv)
   p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
   SC_CHECK_ABORT (p4est_checksum (p4est) == crc, "Rebalance");
 
+  /* local changes and incremental rebalance */
+  balance_incremental (p4est, 0);
+  balance_incremental (p4est, 4);
+
+  /* encoding of the quadrants exchanged by balance */
+  balance_codec ();
+
+  /* overlap of the insulation layers with the trees */
+  balance_overlap (p4est, P4EST_CONNECT_FACE);
+  balance_overlap (p4est, P4EST_CONNECT_FULL);
+
+  /* detect a forest that is still balanced after refinement */
+  balance_skip (mpicomm);
+
   /* clean up and exit */
   P4EST_ASSERT (p4est->user_data_pool->elem_count ==
                 (size_t) p4est->local_num_quadrants);
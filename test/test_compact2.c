@@ -0,0 +1,243 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#include <p4est_iterate.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#include <p8est_iterate.h>
+#endif
+
+#ifndef P4_TO_P8
+static const int    start_level = 3;
+#else
+static const int    start_level = 2;
+#endif
+
+typedef struct
+{
+  p4est_locidx_t      count;
+  p4est_topidx_t      last_tree;
+  p4est_quadrant_t    last_quad;
+}
+compact_visit_t;
+
+/* the user data is a function of the quadrant */
+static long
+data_value (p4est_topidx_t which_tree, const p4est_quadrant_t * q)
+{
+  return (long) which_tree + 7 * (long) q->x + 11 * (long) q->y +
+#ifdef P4_TO_P8
+    13 * (long) q->z +
+#endif
+    (long) q->level;
+}
+
+static void
+init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+         p4est_quadrant_t * quadrant)
+{
+  *(long *) quadrant->p.user_data = data_value (which_tree, quadrant);
+}
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  return (int) quadrant->level < start_level + 2 &&
+    (which_tree + p4est_quadrant_child_id (quadrant)) % 3 == 0;
+}
+
+static int
+coarsen_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            p4est_quadrant_t * quadrants[])
+{
+  return (int) quadrants[0]->level > start_level && which_tree % 2 == 0;
+}
+
+/* refine towards the origin of the first tree */
+static int
+refine_deep_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * quadrant)
+{
+  return which_tree == 0 && quadrant->x == 0 && quadrant->y == 0 &&
+#ifdef P4_TO_P8
+    quadrant->z == 0 &&
+#endif
+    (int) quadrant->level < P4EST_QMAXLEVEL &&
+    (int) quadrant->level <= P4EST_OLD_QMAXLEVEL;
+}
+
+/* every quadrant is visited once and in order */
+static void
+volume_fn (p4est_iter_volume_info_t * info, void *user_data)
+{
+  compact_visit_t    *visit = (compact_visit_t *) user_data;
+  p4est_quadrant_t   *q = info->quad;
+
+  SC_CHECK_ABORT (info->ghost_layer == NULL, "Visit ghost");
+  SC_CHECK_ABORT (p4est_quadrant_is_valid (q), "Visit valid");
+  SC_CHECK_ABORT (*(long *) q->p.user_data == data_value (info->treeid, q),
+                  "Visit data");
+  if (visit->count > 0 && visit->last_tree == info->treeid) {
+    SC_CHECK_ABORT (p4est_quadrant_compare (&visit->last_quad, q) < 0,
+                    "Visit order");
+  }
+  visit->last_tree = info->treeid;
+  visit->last_quad = *q;
+  ++visit->count;
+
+  /* the data may be modified through the callback */
+  *(long *) q->p.user_data += 1;
+}
+
+/* compare the compact quadrants to those of a regular forest */
+static void
+check_quadrants (p4est_t * p4est, p4est_t * ref, long offset)
+{
+  size_t              zz;
+  p4est_topidx_t      jt, which_tree;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, c;
+
+  for (jt = ref->first_local_tree; jt <= ref->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (ref->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      which_tree = p4est_compact_quadrant
+        (p4est, tree->quadrants_offset + (p4est_locidx_t) zz, &c);
+      SC_CHECK_ABORT (which_tree == jt, "Quadrant tree");
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (q, &c) &&
+                      q->level == c.level, "Quadrant equal");
+      SC_CHECK_ABORT (*(long *) c.p.user_data ==
+                      data_value (jt, &c) + offset, "Quadrant data");
+    }
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 fits;
+  unsigned            crc;
+  size_t              used;
+  sc_MPI_Comm         mpicomm;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_t            *p4est, *ref, *nodata;
+  p4est_connectivity_t *connectivity;
+  compact_visit_t     visit;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+#ifndef P4_TO_P8
+  connectivity = p4est_connectivity_new_moebius ();
+#else
+  connectivity = p8est_connectivity_new_rotcubes ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, start_level, 1,
+                         sizeof (long), init_fn, NULL);
+  p4est_refine (p4est, 1, refine_fn, init_fn);
+  p4est_partition (p4est, 0, NULL);
+  crc = p4est_checksum (p4est);
+  ref = p4est_copy (p4est, 1);
+
+  /* the compact storage is smaller than the trees */
+  used = p4est_memory_used (p4est);
+  SC_CHECK_ABORT (p4est_compact (p4est), "Compact");
+  SC_CHECK_ABORT (p4est->local_num_quadrants == 0 ||
+                  p4est_memory_used (p4est) < used, "Compact memory");
+  check_quadrants (p4est, ref, 0);
+
+  /* iterate over the compact forest and modify its data */
+  memset (&visit, 0, sizeof (visit));
+  p4est_iterate_compact (p4est, &visit, volume_fn);
+  SC_CHECK_ABORT (visit.count == p4est->local_num_quadrants, "Visit count");
+  check_quadrants (p4est, ref, 1);
+
+  /* the expanded forest is usable as before */
+  p4est_expand (p4est);
+  SC_CHECK_ABORT (p4est->compact == NULL, "Expand");
+  SC_CHECK_ABORT (p4est_is_equal (p4est, ref, 0), "Expand equal");
+  SC_CHECK_ABORT (crc == p4est_checksum (p4est), "Expand checksum");
+  p4est_refine (p4est, 0, refine_fn, init_fn);
+  p4est_refine (ref, 0, refine_fn, init_fn);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, ref, 0), "Refine expanded");
+
+  /* the adaptation algorithms expand and compact around themselves */
+  SC_CHECK_ABORT (p4est_compact (p4est), "Compact for adapt");
+  p4est_refine (p4est, 0, refine_fn, init_fn);
+  SC_CHECK_ABORT (p4est->compact != NULL, "Refine compact");
+  p4est_coarsen (p4est, 0, coarsen_fn, init_fn);
+  SC_CHECK_ABORT (p4est->compact != NULL, "Coarsen compact");
+  p4est_balance (p4est, P4EST_CONNECT_FULL, init_fn);
+  SC_CHECK_ABORT (p4est->compact != NULL, "Balance compact");
+  p4est_partition (p4est, 0, NULL);
+  SC_CHECK_ABORT (p4est->compact != NULL, "Partition compact");
+  p4est_refine (ref, 0, refine_fn, init_fn);
+  p4est_coarsen (ref, 0, coarsen_fn, init_fn);
+  p4est_balance (ref, P4EST_CONNECT_FULL, init_fn);
+  p4est_partition (ref, 0, NULL);
+  p4est_expand (p4est);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, ref, 0), "Adapt compact equal");
+
+  /* a forest without data is destroyed in compact storage */
+  nodata = p4est_copy (ref, 0);
+  SC_CHECK_ABORT (p4est_compact (nodata), "Compact without data");
+  p4est_destroy (nodata);
+
+  /* a forest with too fine quadrants is left unchanged */
+  p4est_refine (ref, 1, refine_deep_fn, init_fn);
+  fits = 1;
+  for (jt = ref->first_local_tree; jt <= ref->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (ref->trees, jt);
+    fits = fits && (int) tree->maxlevel <= P4EST_OLD_QMAXLEVEL;
+  }
+  SC_CHECK_ABORT (p4est_compact (ref) == fits, "Compact too fine");
+  SC_CHECK_ABORT ((ref->compact == NULL) == !fits, "Compact unchanged");
+
+  /* a compact forest with data is destroyed as well */
+  SC_CHECK_ABORT (p4est_compact (p4est), "Compact again");
+  p4est_destroy (p4est);
+  p4est_destroy (ref);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -177,6 +177,64 @@ test_conn_transformation_check_edge_corners ()
 }
 #endif /* P4_TO_P8 */
 
+/** Checks that the cached transforms agree with the computed ones.
+ * \param [in,out] conn  connectivity whose cache is created
+ */
+static void
+test_conn_transformation_check_cache (p4est_connectivity_t * conn)
+{
+  int                 face, corner, i;
+  size_t              zz;
+  int                 ft1[P4EST_FTRANSFORM], ft2[P4EST_FTRANSFORM];
+  p4est_topidx_t      jt, nt1, nt2;
+  p4est_corner_info_t ci1, ci2;
+  p4est_corner_transform_t *ct1, *ct2;
+  p4est_transform_cache_t *tc;
+
+  p4est_connectivity_cache_transforms (conn);
+  tc = conn->transforms;
+  SC_CHECK_ABORT (tc != NULL, "transform cache");
+
+  sc_array_init (&ci1.corner_transforms, sizeof (p4est_corner_transform_t));
+  sc_array_init (&ci2.corner_transforms, sizeof (p4est_corner_transform_t));
+  for (jt = 0; jt < conn->num_trees; ++jt) {
+    for (face = 0; face < P4EST_FACES; ++face) {
+      conn->transforms = NULL;
+      nt1 = p4est_find_face_transform (conn, jt, face, ft1);
+      conn->transforms = tc;
+      nt2 = p4est_find_face_transform (conn, jt, face, ft2);
+      SC_CHECK_ABORT (nt1 == nt2, "cached face neighbor");
+      for (i = 0; nt1 >= 0 && i < P4EST_FTRANSFORM; ++i) {
+        SC_CHECK_ABORT (ft1[i] == ft2[i], "cached face transform");
+      }
+    }
+    for (corner = 0; corner < P4EST_CHILDREN; ++corner) {
+      conn->transforms = NULL;
+      p4est_find_corner_transform (conn, jt, corner, &ci1);
+      conn->transforms = tc;
+      p4est_find_corner_transform (conn, jt, corner, &ci2);
+      SC_CHECK_ABORT (ci1.icorner == ci2.icorner &&
+                      ci1.corner_transforms.elem_count ==
+                      ci2.corner_transforms.elem_count,
+                      "cached corner count");
+      for (zz = 0; zz < ci1.corner_transforms.elem_count; ++zz) {
+        ct1 = p4est_corner_array_index (&ci1.corner_transforms, zz);
+        ct2 = p4est_corner_array_index (&ci2.corner_transforms, zz);
+        SC_CHECK_ABORT (ct1->ntree == ct2->ntree &&
+                        ct1->ncorner == ct2->ncorner,
+                        "cached corner transform");
+      }
+    }
+  }
+  sc_array_reset (&ci1.corner_transforms);
+  sc_array_reset (&ci2.corner_transforms);
+
+  SC_CHECK_ABORT (p4est_connectivity_memory_used (conn) >
+                  sizeof (p4est_transform_cache_t), "cache memory");
+  p4est_connectivity_uncache_transforms (conn);
+  SC_CHECK_ABORT (conn->transforms == NULL, "uncache transforms");
+}
+
 int
 main (int argc, char **argv)
 {
@@ -217,6 +275,7 @@ main (int argc, char **argv)
 #ifdef P4_TO_P8
         test_conn_transformation_check_face_edges (i, j, k);
 #endif /* P4_TO_P8 */
+        test_conn_transformation_check_cache (conn);
 
         p4est_connectivity_destroy (conn);
         conn = 0;
@@ -227,6 +286,22 @@ main (int argc, char **argv)
   test_conn_transformation_check_edge_corners ();
 #endif /* P4_TO_P8 */
 
+  /* compare the transform cache on connectivities with corner neighbors */
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_moebius ();
+#else
+  conn = p8est_connectivity_new_rotcubes ();
+#endif
+  test_conn_transformation_check_cache (conn);
+  p4est_connectivity_destroy (conn);
+#ifndef P4_TO_P8
+  conn = p4est_connectivity_new_brick (3, 2, 1, 1);
+#else
+  conn = p8est_connectivity_new_brick (3, 2, 2, 1, 1, 1);
+#endif
+  test_conn_transformation_check_cache (conn);
+  p4est_connectivity_destroy (conn);
+
   /* exit */
   sc_finalize ();
   mpiret = sc_MPI_Finalize ();
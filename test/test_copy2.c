@@ -0,0 +1,202 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#endif
+
+#ifndef P4_TO_P8
+static const int    start_level = 3;
+#else
+static const int    start_level = 2;
+#endif
+
+/* the user data is a function of the quadrant */
+static long
+data_value (p4est_topidx_t which_tree, p4est_quadrant_t * q)
+{
+  return (long) which_tree + 7 * (long) q->x + 11 * (long) q->y +
+#ifdef P4_TO_P8
+    13 * (long) q->z +
+#endif
+    (long) q->level;
+}
+
+static void
+init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+         p4est_quadrant_t * quadrant)
+{
+  *(long *) quadrant->p.user_data = data_value (which_tree, quadrant);
+}
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  return (int) quadrant->level < start_level + 2 &&
+    (which_tree + p4est_quadrant_child_id (quadrant)) % 3 == 0;
+}
+
+static int
+refine_tree_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * quadrant)
+{
+  return which_tree == 0 && p4est_quadrant_child_id (quadrant) == 1 &&
+    (int) quadrant->level < start_level + 3;
+}
+
+static int
+coarsen_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            p4est_quadrant_t * q[])
+{
+  return which_tree % 2 == 1 && (q[0]->x / P4EST_QUADRANT_LEN (q[0]->level))
+    % 4 == 0;
+}
+
+/* verify the user data of all local quadrants */
+static void
+check_data (p4est_t * p4est, const char *what)
+{
+  size_t              zz;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      SC_CHECK_ABORT (*(long *) q->p.user_data == data_value (jt, q), what);
+    }
+  }
+}
+
+/* count the local trees that share storage with other forests */
+static int
+count_shared (p4est_t * p4est)
+{
+  int                 count = 0;
+  p4est_topidx_t      jt;
+
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    count += p4est_cow_is_shared (p4est, jt);
+  }
+  return count;
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 num_local;
+  unsigned            crc;
+  sc_MPI_Comm         mpicomm;
+  p4est_t            *p4est, *snap, *ref, *chain;
+  p4est_connectivity_t *connectivity;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+#ifndef P4_TO_P8
+  connectivity = p4est_connectivity_new_moebius ();
+#else
+  connectivity = p8est_connectivity_new_rotcubes ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, start_level, 1,
+                         sizeof (long), init_fn, NULL);
+  p4est_refine (p4est, 1, refine_fn, init_fn);
+  p4est_partition (p4est, 0, NULL);
+  num_local = (int) (p4est->last_local_tree - p4est->first_local_tree + 1);
+
+  /* the snapshot shares all local trees and their data */
+  ref = p4est_copy (p4est, 1);
+  snap = p4est_copy_cow (p4est, 0);
+  crc = p4est_checksum (p4est);
+  SC_CHECK_ABORT (p4est_is_equal (snap, p4est, 1), "Copy equal");
+  SC_CHECK_ABORT (count_shared (snap) == num_local, "Copy shared");
+  SC_CHECK_ABORT (count_shared (p4est) == num_local, "Input shared");
+  check_data (snap, "Copy data");
+
+  /* a copy of the copy joins the storage */
+  chain = p4est_copy_cow (snap, 0);
+  SC_CHECK_ABORT (p4est_is_equal (chain, ref, 1), "Chain equal");
+
+  /* modifying a single tree leaves the others shared */
+  p4est_refine (p4est, 1, refine_tree_fn, init_fn);
+  SC_CHECK_ABORT (count_shared (p4est) ==
+                  num_local - (p4est->first_local_tree == 0 ? 1 : 0),
+                  "Refine one tree");
+  check_data (p4est, "Refine one tree data");
+  SC_CHECK_ABORT (p4est_is_equal (snap, ref, 1), "Snapshot after refine");
+
+  /* adapt the input all over */
+  p4est_refine (p4est, 0, refine_fn, init_fn);
+  p4est_coarsen (p4est, 0, coarsen_fn, init_fn);
+  p4est_balance (p4est, P4EST_CONNECT_FULL, init_fn);
+  p4est_partition (p4est, 0, NULL);
+  check_data (p4est, "Adapt data");
+  SC_CHECK_ABORT (p4est_is_equal (snap, ref, 1), "Snapshot after adapt");
+  check_data (snap, "Snapshot data");
+
+  /* the snapshot survives the input and modifies its own trees */
+  p4est_destroy (p4est);
+  p4est_coarsen (snap, 1, coarsen_fn, init_fn);
+  p4est_coarsen (ref, 1, coarsen_fn, init_fn);
+  SC_CHECK_ABORT (p4est_is_equal (snap, ref, 1), "Coarsen snapshot");
+  check_data (snap, "Coarsen snapshot data");
+  check_data (chain, "Chain data");
+  SC_CHECK_ABORT (crc == p4est_checksum (chain), "Chain checksum");
+
+  /* private storage on request and after changing the data size */
+  p4est_unshare (chain);
+  SC_CHECK_ABORT (count_shared (chain) == 0, "Unshare");
+  check_data (chain, "Unshare data");
+  p4est_destroy (chain);
+  chain = p4est_copy_cow (snap, 0);
+  p4est_reset_data (chain, sizeof (long) + 1, init_fn, NULL);
+  SC_CHECK_ABORT (count_shared (chain) == 0, "Reset data");
+  check_data (chain, "Reset data values");
+  check_data (snap, "Snapshot data after reset");
+
+  p4est_destroy (chain);
+  p4est_destroy (snap);
+  p4est_destroy (ref);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
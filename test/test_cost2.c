@@ -0,0 +1,194 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_bits.h>
+#include <p4est_cost.h>
+#else
+#include <p8est_bits.h>
+#include <p8est_cost.h>
+#endif
+
+#ifndef P4_TO_P8
+static const int    start_level = 4;
+#else
+static const int    start_level = 2;
+#endif
+
+static const double smoothing = .5;
+
+static void
+init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+         p4est_quadrant_t * quadrant)
+{
+  *(double *) quadrant->p.user_data = 0.;
+}
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  return which_tree == 0 && p4est_quadrant_child_id (quadrant) == 0;
+}
+
+/* measure a skewed cost and track its moving average in the user data */
+static void
+measure_step (p4est_cost_t * cost, int step)
+{
+  p4est_t            *p4est = cost->p4est;
+  size_t              zz;
+  double              value, *expected;
+  p4est_locidx_t      lq;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      lq = tree->quadrants_offset + (p4est_locidx_t) zz;
+      value = (1 + step % 2) * (jt == 0 ? 16. : 1.);
+      p4est_cost_add_quadrant (cost, lq, value);
+      if (jt % 2) {
+        value += 2.;
+      }
+      expected = (double *) q->p.user_data;
+      *expected = step == 0 ? value : *expected + smoothing * (value -
+                                                               *expected);
+    }
+    if (jt % 2) {
+      p4est_cost_add_tree (cost, jt, 2. * tree->quadrants.elem_count);
+    }
+  }
+  p4est_cost_step (cost);
+}
+
+/* the estimates must have followed their quadrants */
+static void
+check_estimate (p4est_cost_t * cost)
+{
+  p4est_t            *p4est = cost->p4est;
+  size_t              zz;
+  double              estimate, expected;
+  p4est_locidx_t      lq;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+
+  SC_CHECK_ABORT (cost->estimate->elem_count ==
+                  (size_t) p4est->local_num_quadrants, "Estimate count");
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      lq = tree->quadrants_offset + (p4est_locidx_t) zz;
+      estimate = *(double *) sc_array_index (cost->estimate, (size_t) lq);
+      expected = *(double *) q->p.user_data;
+      SC_CHECK_ABORT (fabs (estimate - expected) <= 1e-12 * expected,
+                      "Estimate value");
+    }
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 step;
+  int                 dummy;
+  double              before, after;
+  p4est_gloidx_t      shipped;
+  sc_MPI_Comm         mpicomm;
+  p4est_t            *p4est;
+  p4est_connectivity_t *connectivity;
+  p4est_cost_t       *cost;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+  /* create connectivity and forest structures */
+#ifdef P4_TO_P8
+  connectivity = p8est_connectivity_new_rotcubes ();
+#else
+  connectivity = p4est_connectivity_new_star ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, start_level, 1,
+                         sizeof (double), init_fn, &dummy);
+  cost = p4est_cost_new (p4est, smoothing);
+
+  /* nothing is known before the first step */
+  shipped = p4est_cost_partition (cost, 0, 0., &before);
+  SC_CHECK_ABORT (shipped == 0 && before == -1., "Partition without step");
+
+  for (step = 0; step < 3; ++step) {
+    measure_step (cost, step);
+    check_estimate (cost);
+  }
+
+  /* tree 0 is 16 times as expensive as the others */
+  before = p4est_cost_imbalance (cost);
+  SC_CHECK_ABORT (before >= 1., "Imbalance range");
+  SC_CHECK_ABORT (p4est->mpisize > 1 || before == 1., "Imbalance serial");
+  shipped = p4est_cost_partition (cost, 0, .05, &after);
+  SC_CHECK_ABORT (after == before, "Imbalance prediction");
+  SC_CHECK_ABORT (p4est->user_pointer == &dummy, "User pointer");
+  check_estimate (cost);
+  after = p4est_cost_imbalance (cost);
+  P4EST_GLOBAL_INFOF ("Imbalance before %g after %g shipped %lld\n",
+                      before, after, (long long) shipped);
+  SC_CHECK_ABORT (after <= before, "Imbalance improvement");
+  SC_CHECK_ABORT (shipped > 0 || before <= 1.05, "Imbalance shipping");
+
+  /* a large threshold tolerates the current partition */
+  shipped = p4est_cost_partition (cost, 1, 1e9, NULL);
+  SC_CHECK_ABORT (shipped == 0, "Partition threshold");
+
+  /* the measurements continue after partitioning */
+  measure_step (cost, step++);
+  check_estimate (cost);
+
+  /* adapting the forest restarts the estimate */
+  p4est_refine (p4est, 0, refine_fn, init_fn);
+  SC_CHECK_ABORT (p4est_cost_imbalance (cost) == -1., "Imbalance reset");
+  measure_step (cost, 0);
+  check_estimate (cost);
+  shipped = p4est_cost_partition (cost, 1, 0., NULL);
+  SC_CHECK_ABORT (p4est->user_pointer == &dummy, "User pointer");
+  check_estimate (cost);
+
+  p4est_cost_destroy (cost);
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
@@ -0,0 +1,251 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_fields.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_fields.h>
+#endif
+
+#ifndef P4_TO_P8
+static const int    start_level = 3;
+static const int    max_level = 7;
+#else
+static const int    start_level = 2;
+static const int    max_level = 5;
+#endif
+
+/* field 0 holds the volume of a quadrant, field 1 the quadrant it had */
+static double
+volume (const p4est_quadrant_t * q)
+{
+  return ldexp (1., -P4EST_DIM * (int) q->level);
+}
+
+/* conserve the volume, keep the default behavior for the quadrant */
+static void
+replace_volume (p4est_fields_t * fields, p4est_topidx_t which_tree,
+                p4est_locidx_t num_outgoing, p4est_locidx_t first_outgoing,
+                const p4est_quadrant_t * outgoing,
+                p4est_locidx_t num_incoming, p4est_locidx_t first_incoming,
+                const p4est_quadrant_t * incoming)
+{
+  p4est_locidx_t      li;
+  double              sum;
+  const double       *old_volume;
+  double             *new_volume;
+  const p4est_quadrant_t *old_quad;
+  p4est_quadrant_t   *new_quad;
+
+  old_volume = (double *) sc_array_index (&fields->old_data[0],
+                                          (size_t) first_outgoing);
+  new_volume = (double *) sc_array_index (&fields->data[0],
+                                          (size_t) first_incoming);
+  old_quad = (p4est_quadrant_t *) sc_array_index (&fields->old_data[1],
+                                                  (size_t) first_outgoing);
+  new_quad = (p4est_quadrant_t *) sc_array_index (&fields->data[1],
+                                                  (size_t) first_incoming);
+  SC_CHECK_ABORT (num_outgoing == 1 || num_incoming == 1, "Replace counts");
+  sum = 0.;
+  for (li = 0; li < num_outgoing; ++li) {
+    sum += old_volume[li];
+  }
+  for (li = 0; li < num_outgoing; ++li) {
+    SC_CHECK_ABORT (old_volume[li] == volume (outgoing + li), "Outgoing");
+  }
+  for (li = 0; li < num_incoming; ++li) {
+    new_volume[li] = num_incoming == 1 ? sum : volume (incoming + li);
+    new_quad[li] = *old_quad;
+    sum -= new_volume[li];
+  }
+  SC_CHECK_ABORT (sum == 0., "Replace volume");
+  ++*(int *) fields->user_pointer;
+}
+
+static void
+init_fields (p4est_fields_t * fields)
+{
+  p4est_t            *p4est = fields->p4est;
+  size_t              zz;
+  p4est_locidx_t      lq;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *tag;
+
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      lq = tree->quadrants_offset + (p4est_locidx_t) zz;
+      *(double *) p4est_fields_index (fields, 0, lq) = volume (q);
+      tag = (p4est_quadrant_t *) p4est_fields_index (fields, 1, lq);
+      *tag = *q;
+      tag->p.which_tree = jt;
+    }
+  }
+}
+
+static void
+check_fields (p4est_fields_t * fields, int check_volume, const char *what)
+{
+  p4est_t            *p4est = fields->p4est;
+  size_t              zz;
+  p4est_locidx_t      lq;
+  p4est_topidx_t      jt;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q, *tag;
+
+  SC_CHECK_ABORT (fields->data[0].elem_count ==
+                  (size_t) p4est->local_num_quadrants, what);
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      lq = tree->quadrants_offset + (p4est_locidx_t) zz;
+      SC_CHECK_ABORT (!check_volume ||
+                      *(double *) p4est_fields_index (fields, 0, lq) ==
+                      volume (q), what);
+      tag = (p4est_quadrant_t *) p4est_fields_index (fields, 1, lq);
+      SC_CHECK_ABORT (tag->p.which_tree == jt, what);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (tag, q) ||
+                      p4est_quadrant_is_ancestor (tag, q) ||
+                      p4est_quadrant_is_ancestor (q, tag), what);
+    }
+  }
+}
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  return (int) quadrant->level < max_level &&
+    (which_tree + p4est_quadrant_child_id (quadrant)) % 3 == 0;
+}
+
+static int
+coarsen_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+            p4est_quadrant_t * quadrants[])
+{
+  return (int) quadrants[0]->level > start_level &&
+    (which_tree + quadrants[0]->x / P4EST_QUADRANT_LEN (max_level)) % 2 == 0;
+}
+
+static int
+weight_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  return 1 + (int) quadrant->level;
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 num_replaced;
+  size_t              field_sizes[2];
+  long                revision;
+  sc_MPI_Comm         mpicomm;
+  p4est_t            *p4est;
+  p4est_connectivity_t *connectivity;
+  p4est_fields_t     *fields;
+  int8_t             *flags;
+  p4est_locidx_t      lq;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+#ifndef P4_TO_P8
+  connectivity = p4est_connectivity_new_moebius ();
+#else
+  connectivity = p8est_connectivity_new_rotcubes ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, start_level, 1,
+                         0, NULL, NULL);
+
+  field_sizes[0] = sizeof (double);
+  field_sizes[1] = sizeof (p4est_quadrant_t);
+  num_replaced = 0;
+  fields = p4est_fields_new (p4est, 2, field_sizes, replace_volume,
+                             &num_replaced);
+  SC_CHECK_ABORT (p4est->fields == fields, "Fields attached");
+  init_fields (fields);
+  check_fields (fields, 1, "Init");
+
+  /* an unchanged forest keeps its data */
+  revision = p4est_revision (p4est);
+  p4est_refine (p4est, 0, refine_fn, NULL);
+  p4est_coarsen (p4est, 0, coarsen_fn, NULL);
+  check_fields (fields, 1, "Refine");
+  p4est_refine (p4est, 1, refine_fn, NULL);
+  check_fields (fields, 1, "Refine recursive");
+  SC_CHECK_ABORT (p4est_revision (p4est) > revision, "Revision");
+  p4est_coarsen (p4est, 1, coarsen_fn, NULL);
+  check_fields (fields, 1, "Coarsen recursive");
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  check_fields (fields, 1, "Balance");
+  p4est_partition (p4est, 0, weight_fn);
+  check_fields (fields, 1, "Partition");
+  SC_CHECK_ABORT (num_replaced > 0, "Replace called");
+
+  /* adapt with balance nests the modifications */
+  flags = P4EST_ALLOC (int8_t, p4est->local_num_quadrants);
+  for (lq = 0; lq < p4est->local_num_quadrants; ++lq) {
+    flags[lq] = (int8_t) (lq % 5 == 0 ? 1 : lq % 5 == 1 ? -1 : 0);
+  }
+  p4est_adapt (p4est, flags, max_level, 1, P4EST_CONNECT_FACE, NULL, NULL);
+  P4EST_FREE (flags);
+  check_fields (fields, 1, "Adapt");
+  p4est_partition (p4est, 1, NULL);
+  check_fields (fields, 1, "Partition uniform");
+  p4est_fields_destroy (fields);
+  SC_CHECK_ABORT (p4est->fields == NULL, "Fields detached");
+
+  /* by default, the data is inherited */
+  fields = p4est_fields_new (p4est, 2, field_sizes, NULL, NULL);
+  init_fields (fields);
+  p4est_refine (p4est, 1, refine_fn, NULL);
+  check_fields (fields, 0, "Default refine");
+  p4est_coarsen (p4est, 1, coarsen_fn, NULL);
+  check_fields (fields, 0, "Default coarsen");
+  p4est_partition (p4est, 0, weight_fn);
+  check_fields (fields, 0, "Default partition");
+  p4est_fields_destroy (fields);
+
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
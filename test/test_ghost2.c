@@ -374,6 +374,88 @@ test_exchange_D (p4est_t * p4est, p4est_ghost_t * ghost)
   P4EST_FREE (ghost_struct_data);
 }
 
+static void
+test_exchange_E (p4est_t * p4est, p4est_ghost_t * ghost)
+{
+  int                 p, round;
+  size_t              zz;
+  p4est_topidx_t      nt;
+  p4est_locidx_t      gexcl, gincl, gl;
+  p4est_gloidx_t      gnum;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *q;
+  void              **mirror_data;
+  test_exchange_t    *mirror_struct_data;
+  test_exchange_t    *ghost_struct_data, *e;
+  p4est_ghost_exchange_plan_t *plan;
+
+  /* Test E: reuse one exchange plan, first with custom data, then with
+   * the p4est user_data */
+
+  p4est_reset_data (p4est, sizeof (test_exchange_t), NULL, NULL);
+  mirror_struct_data =
+    P4EST_ALLOC (test_exchange_t, ghost->mirrors.elem_count);
+  mirror_data = P4EST_ALLOC (void *, ghost->mirrors.elem_count);
+  ghost_struct_data = P4EST_ALLOC (test_exchange_t, ghost->ghosts.elem_count);
+  plan = p4est_ghost_exchange_plan_new (p4est, ghost,
+                                        sizeof (test_exchange_t),
+                                        ghost_struct_data);
+
+  for (round = 0; round < 2; ++round) {
+    if (round == 0) {
+      for (zz = 0; zz < ghost->mirrors.elem_count; ++zz) {
+        q = p4est_quadrant_array_index (&ghost->mirrors, zz);
+        gnum = p4est->global_first_quadrant[p4est->mpirank] +
+          (p4est_gloidx_t) q->p.piggy3.local_num;
+        mirror_data[zz] = e = mirror_struct_data + zz;
+        e->gi = gnum;
+        e->ll = (long) gnum;
+        e->magic = TEST_EXCHANGE_MAGIC;
+      }
+      p4est_ghost_exchange_plan_execute (plan, mirror_data);
+    }
+    else {
+      gnum = p4est->global_first_quadrant[p4est->mpirank];
+      for (nt = p4est->first_local_tree; nt <= p4est->last_local_tree; ++nt) {
+        tree = p4est_tree_array_index (p4est->trees, nt);
+        for (zz = 0; zz < tree->quadrants.elem_count; ++gnum, ++zz) {
+          q = p4est_quadrant_array_index (&tree->quadrants, zz);
+          e = (test_exchange_t *) q->p.user_data;
+          e->gi = gnum;
+          e->ll = (long) gnum + round;
+          e->magic = TEST_EXCHANGE_MAGIC;
+        }
+      }
+      p4est_ghost_exchange_plan_begin (plan, NULL);
+      p4est_ghost_exchange_plan_end (plan);
+    }
+
+    gexcl = 0;
+    for (p = 0; p < p4est->mpisize; ++p) {
+      gincl = ghost->proc_offsets[p + 1];
+      gnum = p4est->global_first_quadrant[p];
+      for (gl = gexcl; gl < gincl; ++gl) {
+        q = p4est_quadrant_array_index (&ghost->ghosts, gl);
+        e = ghost_struct_data + gl;
+        SC_CHECK_ABORT (gnum + (p4est_gloidx_t) q->p.piggy3.local_num ==
+                        e->gi, "Ghost exchange mismatch E1");
+        SC_CHECK_ABORT (gnum + (p4est_gloidx_t) q->p.piggy3.local_num +
+                        round == (p4est_gloidx_t) e->ll,
+                        "Ghost exchange mismatch E2");
+        SC_CHECK_ABORT (e->magic == TEST_EXCHANGE_MAGIC,
+                        "Ghost exchange mismatch E3");
+      }
+      gexcl = gincl;
+    }
+    P4EST_ASSERT (gexcl == (p4est_locidx_t) ghost->ghosts.elem_count);
+  }
+
+  p4est_ghost_exchange_plan_destroy (plan);
+  P4EST_FREE (mirror_data);
+  P4EST_FREE (mirror_struct_data);
+  P4EST_FREE (ghost_struct_data);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -421,6 +503,7 @@ main (int argc, char **argv)
   test_exchange_B (p4est, ghost);
   test_exchange_C (p4est, ghost);
   test_exchange_D (p4est, ghost);
+  test_exchange_E (p4est, ghost);
 
   for (i = 0; i < num_cycles; i++) {
     /* expand and test that the ghost layer can still exchange data properly
@@ -430,6 +513,7 @@ main (int argc, char **argv)
     test_exchange_B (p4est, ghost);
     test_exchange_C (p4est, ghost);
     test_exchange_D (p4est, ghost);
+    test_exchange_E (p4est, ghost);
   }
 
   p4est_ghost_destroy (ghost);
@@ -444,6 +528,7 @@ main (int argc, char **argv)
   test_exchange_B (p4est, ghost);
   test_exchange_C (p4est, ghost);
   test_exchange_D (p4est, ghost);
+  test_exchange_E (p4est, ghost);
 
   for (i = 0; i < num_cycles; i++) {
     /* expand and test that the ghost layer can still exchange data properly
@@ -454,6 +539,7 @@ main (int argc, char **argv)
     test_exchange_B (p4est, ghost);
     test_exchange_C (p4est, ghost);
     test_exchange_D (p4est, ghost);
+    test_exchange_E (p4est, ghost);
     test_exchange_end (exc);
   }
 
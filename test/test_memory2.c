@@ -0,0 +1,124 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#include <p4est_ghost.h>
+#include <p4est_lnodes.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#include <p8est_ghost.h>
+#include <p8est_lnodes.h>
+#endif
+
+static int
+refine_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+           p4est_quadrant_t * quadrant)
+{
+  return (int) quadrant->level < 5 &&
+    (which_tree + p4est_quadrant_child_id (quadrant)) % 3 == 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 i;
+  sc_MPI_Comm         mpicomm;
+  p4est_t            *p4est;
+  p4est_inspect_t    *inspect;
+  p4est_ghost_t      *ghost;
+  p4est_lnodes_t     *lnodes;
+  p4est_connectivity_t *connectivity;
+  sc_statinfo_t       stats[2 * P4EST_MEMORY_NUM_PHASES];
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+#ifndef P4_TO_P8
+  connectivity = p4est_connectivity_new_moebius ();
+#else
+  connectivity = p8est_connectivity_new_rotcubes ();
+#endif
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, 1, 1, 0, NULL, NULL);
+  inspect = p4est->inspect = P4EST_ALLOC_ZERO (p4est_inspect_t, 1);
+  p4est_refine (p4est, 1, refine_fn, NULL);
+  p4est_partition (p4est, 0, NULL);
+
+  /* balance records its working storage and the resulting forest */
+  p4est_balance (p4est, P4EST_CONNECT_FULL, NULL);
+  SC_CHECK_ABORT (inspect->memory_current[P4EST_MEMORY_BALANCE] ==
+                  p4est_memory_used (p4est), "Balance current");
+  SC_CHECK_ABORT (p4est->local_num_quadrants == 0 ||
+                  inspect->memory_peak[P4EST_MEMORY_BALANCE] >
+                  inspect->memory_current[P4EST_MEMORY_BALANCE],
+                  "Balance peak");
+
+  /* ghost and lnodes record the size of their result */
+  ghost = p4est_ghost_new (p4est, P4EST_CONNECT_FULL);
+  SC_CHECK_ABORT (inspect->memory_current[P4EST_MEMORY_GHOST] ==
+                  p4est_ghost_memory_used (ghost), "Ghost current");
+  lnodes = p4est_lnodes_new (p4est, ghost, 2);
+  SC_CHECK_ABORT (inspect->memory_current[P4EST_MEMORY_LNODES] ==
+                  p4est_lnodes_memory_used (lnodes), "Lnodes current");
+  SC_CHECK_ABORT (inspect->memory_peak[P4EST_MEMORY_LNODES] >
+                  inspect->memory_current[P4EST_MEMORY_LNODES],
+                  "Lnodes peak");
+
+  /* the reduction includes the forest and connectivity */
+  p4est_memory_stats (p4est, stats);
+  SC_CHECK_ABORT (inspect->memory_current[P4EST_MEMORY_FOREST] ==
+                  p4est_memory_used (p4est), "Forest current");
+  for (i = 0; i < P4EST_MEMORY_NUM_PHASES; ++i) {
+    SC_CHECK_ABORT (inspect->memory_peak[i] >= inspect->memory_current[i],
+                    "Peak below current");
+    SC_CHECK_ABORT (stats[i].min <= stats[i].max &&
+                    stats[i].max <= stats[P4EST_MEMORY_NUM_PHASES + i].max,
+                    "Memory statistics");
+  }
+  sc_stats_print (p4est_package_id, SC_LP_STATISTICS,
+                  2 * P4EST_MEMORY_NUM_PHASES, stats, 1, 0);
+
+  p4est_lnodes_destroy (lnodes);
+  p4est_ghost_destroy (ghost);
+  P4EST_FREE (inspect);
+  p4est->inspect = NULL;
+  p4est_destroy (p4est);
+  p4est_connectivity_destroy (connectivity);
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}
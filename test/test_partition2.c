@@ -96,6 +96,28 @@ weight_once (p4est_t * p4est, p4est_topidx_t which_tree,
   return 0;
 }
 
+static int
+weight_tree (p4est_t * p4est, p4est_topidx_t which_tree,
+             p4est_quadrant_t * quadrant)
+{
+  return which_tree == 0 ? 4 : 1;
+}
+
+static void
+weights_one (p4est_t * p4est, p4est_topidx_t which_tree,
+             p4est_quadrant_t * quadrant, int *weights)
+{
+  weights[0] = 1;
+}
+
+static void
+weights_hot (p4est_t * p4est, p4est_topidx_t which_tree,
+             p4est_quadrant_t * quadrant, int *weights)
+{
+  weights[0] = 1;
+  weights[1] = (which_tree == 0 && quadrant->level >= 5) ? 10 : 0;
+}
+
 static int
 traverse_fn (p4est_t * p4est, p4est_topidx_t which_tree,
              p4est_quadrant_t * quadrant, int pfirst, int plast, void *point)
@@ -405,6 +427,251 @@ test_partition_circle (sc_MPI_Comm mpicomm,
   p4est_destroy (p4est);
 }
 
+/* partition with hysteresis at the compute node boundaries */
+static void
+test_partition_nodes (p4est_t * p4est, unsigned crc)
+{
+  int                 i;
+  p4est_gloidx_t      shipped;
+  p4est_t            *copy;
+
+  copy = p4est_copy (p4est, 1);
+  copy->inspect = P4EST_ALLOC_ZERO (p4est_inspect_t, 1);
+  copy->inspect->use_partition_node_hysteresis = 1;
+
+  /* without tolerance the result is the uniform partition */
+  (void) p4est_partition_ext (copy, 0, NULL);
+  SC_CHECK_ABORT (crc == p4est_checksum (copy), "Node partition checksum");
+  for (i = 0; i <= copy->mpisize; ++i) {
+    SC_CHECK_ABORT (copy->global_first_quadrant[i] ==
+                    p4est_partition_cut_gloidx (copy->global_num_quadrants,
+                                                i, copy->mpisize),
+                    "Node partition uniform");
+  }
+  SC_CHECK_ABORT (copy->inspect->partition_node_imbalance >= 1. &&
+                  copy->inspect->partition_rank_imbalance >= 1.,
+                  "Node partition imbalance");
+
+  /* keeping the node boundaries, the partition is stable */
+  copy->inspect->partition_node_hysteresis = 1.;
+  (void) p4est_partition_ext (copy, 0, weight_one);
+  SC_CHECK_ABORT (crc == p4est_checksum (copy), "Node partition weighted");
+  shipped = p4est_partition_ext (copy, 0, weight_one);
+  SC_CHECK_ABORT (shipped == 0, "Node partition stable");
+
+  P4EST_FREE (copy->inspect);
+  copy->inspect = NULL;
+  p4est_destroy (copy);
+}
+
+/* partition with several weights per quadrant */
+static void
+test_partition_multi (p4est_t * p4est, unsigned crc)
+{
+  double              imbalance[2], even;
+  p4est_t            *copy;
+
+  copy = p4est_copy (p4est, 1);
+  even = (double) copy->global_num_quadrants / copy->mpisize;
+
+  /* a single constraint of unit weights */
+  (void) p4est_partition_multi (copy, 0, 1, weights_one, 0., imbalance);
+  SC_CHECK_ABORT (crc == p4est_checksum (copy), "Multi partition checksum");
+  SC_CHECK_ABORT (imbalance[0] >= 1. && imbalance[0] <= (even + 1.) / even,
+                  "Multi partition imbalance");
+
+  /* a uniform and a localized constraint */
+  (void) p4est_partition_multi (copy, 1, 2, weights_hot, .1, imbalance);
+  SC_CHECK_ABORT (crc == p4est_checksum (copy), "Multi partition hot spot");
+  SC_CHECK_ABORT (imbalance[0] >= 1. && imbalance[1] >= 1.,
+                  "Multi partition hot spot imbalance");
+
+  p4est_destroy (copy);
+}
+
+/* partition with the messages in transit while using the old forest */
+static void
+test_partition_split (p4est_t * p4est, unsigned crc)
+{
+  p4est_gloidx_t      shipped, shipped_ref;
+  p4est_t            *copy, *ref;
+  p4est_partition_context_t *pc;
+
+  copy = p4est_copy (p4est, 1);
+  ref = p4est_copy (p4est, 1);
+  shipped_ref = p4est_partition_ext (ref, 1, weight_tree);
+
+  /* the forest is intact until the partition is completed */
+  pc = p4est_partition_begin (copy, 1, weight_tree);
+  SC_CHECK_ABORT (p4est_is_equal (copy, p4est, 1), "Split partition begin");
+  shipped = p4est_partition_end (pc);
+  SC_CHECK_ABORT (shipped == shipped_ref, "Split partition shipped");
+  SC_CHECK_ABORT (p4est_is_equal (copy, ref, 1), "Split partition result");
+  SC_CHECK_ABORT (crc == p4est_checksum (copy), "Split partition checksum");
+
+  /* repeating the partition does not change it */
+  pc = p4est_partition_begin (copy, 1, weight_tree);
+  shipped = p4est_partition_end (pc);
+  SC_CHECK_ABORT (shipped == 0, "Split partition stable");
+
+  p4est_destroy (ref);
+  p4est_destroy (copy);
+}
+
+/* the number of payload integers of a quadrant and their values */
+static int
+payload_count (p4est_topidx_t which_tree, p4est_quadrant_t * quad)
+{
+  return (int) ((quad->x / P4EST_QUADRANT_LEN (quad->level) + which_tree)
+                % 4);
+}
+
+static int
+payload_value (p4est_topidx_t which_tree, p4est_quadrant_t * quad, int k)
+{
+  return (int) (quad->x + quad->y + which_tree) + k;
+}
+
+/* loop through the local quadrants and create or verify their payload */
+static void
+test_payload_quadrants (p4est_t * p4est, int *sizes, const char *data,
+                        sc_array_t * values, const void **payloads)
+{
+  int                 k, count, value;
+  size_t              zz;
+  p4est_topidx_t      t;
+  p4est_locidx_t      lq;
+  p4est_tree_t       *tree;
+  p4est_quadrant_t   *quad;
+
+  for (t = p4est->first_local_tree; t <= p4est->last_local_tree; ++t) {
+    tree = p4est_tree_array_index (p4est->trees, t);
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz) {
+      quad = p4est_quadrant_array_index (&tree->quadrants, zz);
+      lq = tree->quadrants_offset + (p4est_locidx_t) zz;
+      count = payload_count (t, quad);
+      if (payloads != NULL) {
+        /* create the payload in a separate place for every quadrant */
+        sizes[lq] = count * (int) sizeof (int);
+        payloads[lq] = count > 0 ? sc_array_index (values, 3 * lq) : NULL;
+        for (k = 0; k < count; ++k) {
+          ((int *) payloads[lq])[k] = payload_value (t, quad, k);
+        }
+      }
+      else {
+        SC_CHECK_ABORT (sizes[lq] == count * (int) sizeof (int),
+                        "Payload size");
+        for (k = 0; k < count; ++k) {
+          memcpy (&value, data, sizeof (int));
+          SC_CHECK_ABORT (value == payload_value (t, quad, k),
+                          "Payload value");
+          data += sizeof (int);
+        }
+      }
+    }
+  }
+}
+
+/* partition with a variable-size payload per quadrant */
+static void
+test_partition_payload (p4est_t * p4est, unsigned crc)
+{
+  int                *sizes;
+  const void        **payloads;
+  p4est_gloidx_t      shipped, shipped_ref;
+  p4est_t            *copy, *ref;
+  sc_array_t         *values, *dest_sizes, *dest_data;
+
+  copy = p4est_copy (p4est, 1);
+  ref = p4est_copy (p4est, 1);
+  shipped_ref = p4est_partition_ext (ref, 0, weight_tree);
+
+  /* the payloads are not contiguous in memory */
+  sizes = P4EST_ALLOC (int, copy->local_num_quadrants);
+  payloads = P4EST_ALLOC (const void *, copy->local_num_quadrants);
+  values = sc_array_new_count (sizeof (int), 3 * copy->local_num_quadrants);
+  test_payload_quadrants (copy, sizes, NULL, values, payloads);
+
+  dest_sizes = sc_array_new (sizeof (int));
+  dest_data = sc_array_new (1);
+  shipped = p4est_partition_payload (copy, 0, weight_tree, sizes, payloads,
+                                     dest_sizes, dest_data);
+  SC_CHECK_ABORT (shipped == shipped_ref, "Payload partition shipped");
+  SC_CHECK_ABORT (p4est_is_equal (copy, ref, 1), "Payload partition result");
+  SC_CHECK_ABORT (crc == p4est_checksum (copy), "Payload partition checksum");
+  SC_CHECK_ABORT (dest_sizes->elem_count ==
+                  (size_t) copy->local_num_quadrants, "Payload count");
+  test_payload_quadrants (copy, (int *) dest_sizes->array,
+                          dest_data->array, NULL, NULL);
+
+  sc_array_destroy (values);
+  sc_array_destroy (dest_sizes);
+  sc_array_destroy (dest_data);
+  P4EST_FREE (sizes);
+  P4EST_FREE (payloads);
+  p4est_destroy (ref);
+  p4est_destroy (copy);
+}
+
+/* compare the partition arrays of two forests */
+static int
+test_partition_arrays_equal (p4est_t * p4est, p4est_t * ref)
+{
+  const int           num_procs = p4est->mpisize;
+
+  return p4est->global_num_quadrants == ref->global_num_quadrants &&
+    !memcmp (p4est->global_first_quadrant, ref->global_first_quadrant,
+             (num_procs + 1) * sizeof (p4est_gloidx_t)) &&
+    !memcmp (p4est->global_first_position, ref->global_first_position,
+             (num_procs + 1) * sizeof (p4est_quadrant_t));
+}
+
+/* partition with the partition arrays stored once per node */
+static void
+test_partition_shared (p4est_t * p4est, unsigned crc)
+{
+  int                 shared;
+  p4est_t            *copy, *ref, *copy2;
+
+  copy = p4est_copy (p4est, 1);
+  ref = p4est_copy (p4est, 1);
+  shared = p4est_comm_partition_share (copy);
+  SC_CHECK_ABORT (shared == (copy->partition_shared != NULL),
+                  "Shared partition flag");
+  SC_CHECK_ABORT (test_partition_arrays_equal (copy, ref),
+                  "Shared partition arrays");
+
+  /* the copy of a shared forest is shared as well */
+  copy2 = p4est_copy (copy, 0);
+  SC_CHECK_ABORT (shared == (copy2->partition_shared != NULL),
+                  "Shared partition copy");
+  p4est_destroy (copy2);
+
+  /* the shared arrays follow refinement and partitioning */
+  (void) p4est_partition_ext (copy, 0, weight_tree);
+  (void) p4est_partition_ext (ref, 0, weight_tree);
+  SC_CHECK_ABORT (p4est_is_equal (copy, ref, 1), "Shared partition result");
+  SC_CHECK_ABORT (test_partition_arrays_equal (copy, ref),
+                  "Shared partition arrays after partition");
+  SC_CHECK_ABORT (crc == p4est_checksum (copy), "Shared partition checksum");
+  p4est_refine (copy, 0, refine_fn, NULL);
+  p4est_refine (ref, 0, refine_fn, NULL);
+  (void) p4est_partition_ext (copy, 1, NULL);
+  (void) p4est_partition_ext (ref, 1, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (copy, ref, 1), "Shared refine result");
+  SC_CHECK_ABORT (test_partition_arrays_equal (copy, ref),
+                  "Shared partition arrays after refine");
+
+  /* private arrays are restored on request */
+  p4est_comm_partition_unshare (copy);
+  SC_CHECK_ABORT (copy->partition_shared == NULL, "Unshared partition");
+  SC_CHECK_ABORT (test_partition_arrays_equal (copy, ref),
+                  "Unshared partition arrays");
+
+  p4est_destroy (ref);
+  p4est_destroy (copy);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -507,6 +774,21 @@ main (int argc, char **argv)
   SC_CHECK_ABORT (crc == p4est_checksum (p4est),
                   "bad checksum after uniformly weighted partition");
 
+  /* do a partition by compute nodes */
+  test_partition_nodes (p4est, crc);
+
+  /* do a partition with several constraints */
+  test_partition_multi (p4est, crc);
+
+  /* do a partition in split begin/end phases */
+  test_partition_split (p4est, crc);
+
+  /* do a partition with variable-size payload */
+  test_partition_payload (p4est, crc);
+
+  /* do a partition with node-shared partition arrays */
+  test_partition_shared (p4est, crc);
+
   /* copy the p4est */
   copy = p4est_copy (p4est, 1);
   SC_CHECK_ABORT (crc == p4est_checksum (copy), "bad checksum after copy");
@@ -118,6 +118,158 @@ check_linear_id (const p4est_quadrant_t * q1, const p4est_quadrant_t * q2)
   }
 }
 
+/* the bitwise linear id as it used to be computed */
+static              uint64_t
+linear_id_bitwise (const p4est_quadrant_t * quadrant, int level)
+{
+  int                 i;
+  uint64_t            id;
+  uint64_t            x, y;
+#ifdef P4_TO_P8
+  uint64_t            z;
+#endif
+
+  x = quadrant->x >> (P4EST_MAXLEVEL - level);
+  y = quadrant->y >> (P4EST_MAXLEVEL - level);
+#ifdef P4_TO_P8
+  z = quadrant->z >> (P4EST_MAXLEVEL - level);
+#endif
+
+  id = 0;
+  for (i = 0; i < level + 2; ++i) {
+    id |= ((x & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i));
+    id |= ((y & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i + 1));
+#ifdef P4_TO_P8
+    id |= ((z & ((uint64_t) 1 << i)) << ((P4EST_DIM - 1) * i + 2));
+#endif
+  }
+  return id;
+}
+
+/* compare the array functions with their single quadrant versions */
+static void
+check_batch (sc_array_t * quadrants)
+{
+  const size_t        count = quadrants->elem_count;
+  int                 level, sign;
+  int                *results;
+  size_t              zz, zp;
+  uint64_t           *ids;
+  p4est_quadrant_t    s;
+  p4est_quadrant_t   *q, *r, *extended, *decoded;
+
+  ids = P4EST_ALLOC (uint64_t, count);
+  results = P4EST_ALLOC (int, count);
+  extended = P4EST_ALLOC (p4est_quadrant_t, count);
+  decoded = P4EST_ALLOC (p4est_quadrant_t, count);
+
+  /* shift the quadrants outside of the root to obtain negative numbers */
+  for (zz = 0; zz < count; ++zz) {
+    q = p4est_quadrant_array_index (quadrants, zz);
+    extended[zz] = *q;
+    extended[zz].x -= P4EST_ROOT_LEN;
+#ifdef P4_TO_P8
+    extended[zz].z -= P4EST_ROOT_LEN;
+#endif
+  }
+
+  for (level = 0; level <= P4EST_OLD_QMAXLEVEL; ++level) {
+    p4est_quadrant_linear_id_batch ((p4est_quadrant_t *) quadrants->array,
+                                    count, level, ids);
+    for (zz = 0; zz < count; ++zz) {
+      q = p4est_quadrant_array_index (quadrants, zz);
+      SC_CHECK_ABORT (ids[zz] == p4est_quadrant_linear_id (q, level),
+                      "linear_id_batch");
+      SC_CHECK_ABORT (ids[zz] == linear_id_bitwise (q, level),
+                      "linear_id bitwise");
+    }
+    p4est_quadrant_set_morton_batch (decoded, count, level, ids);
+    for (zz = 0; zz < count; ++zz) {
+      p4est_quadrant_set_morton (&s, level, ids[zz]);
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (&s, decoded + zz) &&
+                      s.level == decoded[zz].level, "set_morton_batch");
+      SC_CHECK_ABORT (p4est_quadrant_linear_id (&s, level) == ids[zz],
+                      "set_morton_batch inverse");
+    }
+
+    p4est_quadrant_linear_id_batch (extended, count, level, ids);
+    for (zz = 0; zz < count; ++zz) {
+      SC_CHECK_ABORT (ids[zz] == linear_id_bitwise (extended + zz, level),
+                      "linear_id_batch extended");
+    }
+  }
+
+  /* compare against a few pivots inside and outside of the root */
+  for (zp = 0; zp < count; zp += SC_MAX (count / 7, 1)) {
+    r = p4est_quadrant_array_index (quadrants, zp);
+    p4est_quadrant_compare_batch ((p4est_quadrant_t *) quadrants->array,
+                                  count, r, results);
+    for (zz = 0; zz < count; ++zz) {
+      q = p4est_quadrant_array_index (quadrants, zz);
+      sign = p4est_quadrant_compare (q, r);
+      sign = (sign > 0) - (sign < 0);
+      SC_CHECK_ABORT (results[zz] == sign, "compare_batch");
+    }
+    p4est_quadrant_compare_batch (extended, count, r, results);
+    for (zz = 0; zz < count; ++zz) {
+      sign = p4est_quadrant_compare (extended + zz, r);
+      sign = (sign > 0) - (sign < 0);
+      SC_CHECK_ABORT (results[zz] == sign, "compare_batch extended");
+    }
+  }
+
+  P4EST_FREE (ids);
+  P4EST_FREE (results);
+  P4EST_FREE (extended);
+  P4EST_FREE (decoded);
+}
+
+static void
+check_sort (sc_array_t * quadrants)
+{
+  const size_t        count = quadrants->elem_count;
+  int                 piggy;
+  size_t              zz, zs;
+  sc_array_t         *a, *b;
+  p4est_quadrant_t   *q, *r;
+
+  a = sc_array_new_count (sizeof (p4est_quadrant_t), 2 * count);
+  b = sc_array_new_count (sizeof (p4est_quadrant_t), 2 * count);
+  for (piggy = 0; piggy < 2; ++piggy) {
+    /* scramble the quadrants and their extended copies into a few trees */
+    for (zz = 0; zz < 2 * count; ++zz) {
+      zs = (zz * 7919) % (2 * count);
+      q = p4est_quadrant_array_index (quadrants, zs % count);
+      r = p4est_quadrant_array_index (a, zz);
+      *r = *q;
+      if (zs >= count) {
+        r->x -= P4EST_ROOT_LEN;
+#ifdef P4_TO_P8
+        r->z -= P4EST_ROOT_LEN;
+#endif
+      }
+      r->p.which_tree = (p4est_topidx_t) (zs % 3);
+    }
+    sc_array_copy (b, a);
+    if (piggy) {
+      p4est_quadrant_array_sort_piggy (a);
+      sc_array_sort (b, p4est_quadrant_compare_piggy);
+    }
+    else {
+      p4est_quadrant_array_sort (a);
+      sc_array_sort (b, p4est_quadrant_compare);
+    }
+    for (zz = 0; zz < 2 * count; ++zz) {
+      q = p4est_quadrant_array_index (a, zz);
+      r = p4est_quadrant_array_index (b, zz);
+      SC_CHECK_ABORT (piggy ? !p4est_quadrant_compare_piggy (q, r) :
+                      !p4est_quadrant_compare (q, r), "array_sort");
+    }
+  }
+  sc_array_destroy (a);
+  sc_array_destroy (b);
+}
+
 static void
 check_successor_predecessor (const p4est_quadrant_t * q)
 {
@@ -194,6 +346,8 @@ main (int argc, char **argv)
   t2 = p4est_tree_array_index (p4est2->trees, 0);
   SC_CHECK_ABORT (p4est_tree_is_sorted (t1), "is_sorted");
   SC_CHECK_ABORT (p4est_tree_is_sorted (t2), "is_sorted");
+  check_batch (&t2->quadrants);
+  check_sort (&t2->quadrants);
 
   /* run a bunch of cross-tests */
   p = NULL;
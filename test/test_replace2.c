@@ -89,6 +89,52 @@ coarsen_fn (p4est_t * p4est, p4est_topidx_t which_tree,
   return q[0]->y < P4EST_ROOT_LEN / 2;
 }
 
+static void
+refine_batch_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                 p4est_locidx_t first_local, size_t num_quadrants,
+                 p4est_quadrant_t * quadrants, int8_t * flags)
+{
+  size_t              zz;
+  p4est_tree_t       *tree;
+
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  SC_CHECK_ABORT (first_local >= tree->quadrants_offset &&
+                  quadrants == p4est_quadrant_array_index
+                  (&tree->quadrants,
+                   (size_t) (first_local - tree->quadrants_offset)),
+                  "Refine batch index");
+
+  for (zz = 0; zz < num_quadrants; ++zz) {
+    flags[zz] = (int8_t) refine_fn (p4est, which_tree, &quadrants[zz]);
+  }
+}
+
+static int
+coarsen_all_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                p4est_quadrant_t * q[])
+{
+  int                 i;
+
+  for (i = 0; i < P4EST_CHILDREN; ++i) {
+    if (q[i]->y >= P4EST_ROOT_LEN / 2) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void
+coarsen_batch_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+                  p4est_locidx_t first_local, size_t num_quadrants,
+                  p4est_quadrant_t * quadrants, int8_t * flags)
+{
+  size_t              zz;
+
+  for (zz = 0; zz < num_quadrants; ++zz) {
+    flags[zz] = (int8_t) (quadrants[zz].y < P4EST_ROOT_LEN / 2);
+  }
+}
+
 static void
 replace_fn (p4est_t * p4est, p4est_topidx_t which_tree,
             int num_outgoing, p4est_quadrant_t * outgoing[],
@@ -116,6 +162,67 @@ replace_fn (p4est_t * p4est, p4est_topidx_t which_tree,
                   "_replace_t incoming and outgoing don't align");
 }
 
+/* an adaptation run on the reference forest and the forest under test */
+typedef void        (*adapt_op_t) (p4est_t * p4est, int under_test,
+                                   int level);
+
+static void
+refine_op (p4est_t * p4est, int under_test, int level)
+{
+  p4est_refine_ext (p4est, 1, level, refine_fn, NULL, replace_fn);
+}
+
+static void
+refine_batch_op (p4est_t * p4est, int under_test, int level)
+{
+  if (under_test) {
+    p4est_refine_batch (p4est, level, refine_batch_fn, NULL, replace_fn);
+  }
+  else {
+    p4est_refine_ext (p4est, 0, level, refine_fn, NULL, replace_fn);
+  }
+}
+
+static void
+coarsen_batch_op (p4est_t * p4est, int under_test, int level)
+{
+  if (under_test) {
+    p4est_coarsen_batch (p4est, coarsen_batch_fn, NULL, replace_fn);
+  }
+  else {
+    p4est_coarsen_ext (p4est, 0, 0, coarsen_all_fn, NULL, replace_fn);
+  }
+}
+
+static void
+balance_op (p4est_t * p4est, int under_test, int level)
+{
+  p4est_balance_ext (p4est, P4EST_CONNECT_FULL, NULL, replace_fn);
+}
+
+/* adapt a forest and a copy of it with the given threads and compare */
+static void
+compare_adapt (p4est_t * p4est, adapt_op_t op, int level,
+               int refine_threads, int balance_threads, const char *what)
+{
+  p4est_t            *copy;
+
+  copy = p4est_copy (p4est, 1);
+  copy->inspect = P4EST_ALLOC_ZERO (p4est_inspect_t, 1);
+  copy->inspect->refine_threads = refine_threads;
+  copy->inspect->balance_threads = balance_threads;
+
+  op (p4est, 0, level);
+  op (copy, 1, level);
+  SC_CHECK_ABORTF (p4est_is_equal (p4est, copy, 0), "%s", what);
+  SC_CHECK_ABORTF (p4est_checksum (p4est) == p4est_checksum (copy),
+                   "%s checksum", what);
+
+  P4EST_FREE (copy->inspect);
+  copy->inspect = NULL;
+  p4est_destroy (copy);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -147,6 +254,22 @@ main (int argc, char **argv)
   p4est_coarsen_ext (p4est, 1, 0, coarsen_fn, NULL, replace_fn);
   p4est_balance_ext (p4est, P4EST_CONNECT_FULL, NULL, replace_fn);
 
+  p4est_destroy (p4est);
+
+  /* compare threaded and batch adaptation on a uniform forest large
+   * enough to be split within the trees */
+  p4est = p4est_new_ext (mpicomm, connectivity, 0, refine_level, 1,
+                         sizeof (int), NULL, NULL);
+  compare_adapt (p4est, refine_op, refine_level + 2, 3, 0,
+                 "Threaded refine");
+  compare_adapt (p4est, refine_batch_op, -1, 0, 0, "Refine batch");
+  compare_adapt (p4est, coarsen_batch_op, -1, 0, 0, "Coarsen batch");
+  compare_adapt (p4est, refine_batch_op, -1, 3, 0, "Threaded refine batch");
+  compare_adapt (p4est, coarsen_batch_op, -1, 3, 0,
+                 "Threaded coarsen batch");
+  compare_adapt (p4est, refine_op, refine_level + 2, 3, 0,
+                 "Threaded refine");
+  compare_adapt (p4est, balance_op, -1, 0, 3, "Threaded balance");
   p4est_destroy (p4est);
   p4est_connectivity_destroy (connectivity);
   sc_finalize ();
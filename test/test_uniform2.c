@@ -0,0 +1,202 @@
+/*
+  This file is part of p4est.
+  p4est is a C library to manage a collection (a forest) of multiple
+  connected adaptive quadtrees or octrees in parallel.
+
+  Copyright (C) 2010 The University of Texas System
+  Additional copyright (C) 2011 individual authors
+  Written by Carsten Burstedde, Lucas C. Wilcox, and Tobin Isaac
+
+  p4est is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  p4est is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with p4est; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#ifndef P4_TO_P8
+#include <p4est_algorithms.h>
+#include <p4est_bits.h>
+#include <p4est_extended.h>
+#else
+#include <p8est_algorithms.h>
+#include <p8est_bits.h>
+#include <p8est_extended.h>
+#endif
+
+#ifndef P4_TO_P8
+static const int    max_level = 6;
+#else
+static const int    max_level = 4;
+#endif
+
+/* the user data is a function of the quadrant */
+static long
+data_value (p4est_topidx_t which_tree, p4est_quadrant_t * q)
+{
+  return (long) which_tree + 7 * (long) q->x + 11 * (long) q->y +
+#ifdef P4_TO_P8
+    13 * (long) q->z +
+#endif
+    (long) q->level;
+}
+
+static void
+init_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+         p4est_quadrant_t * quadrant)
+{
+  *(long *) quadrant->p.user_data = data_value (which_tree, quadrant);
+}
+
+/* the user pointer counts the visits of every local quadrant */
+static void
+init_batch_fn (p4est_t * p4est, p4est_topidx_t which_tree,
+               p4est_locidx_t first_local, size_t num_quadrants,
+               p4est_quadrant_t * quadrants)
+{
+  size_t              zz;
+  char               *visits = (char *) p4est->user_pointer;
+  p4est_tree_t       *tree;
+
+  tree = p4est_tree_array_index (p4est->trees, which_tree);
+  SC_CHECK_ABORT (first_local - tree->quadrants_offset ==
+                  (p4est_locidx_t) (quadrants - p4est_quadrant_array_index
+                                    (&tree->quadrants, 0)), "Batch offset");
+  for (zz = 0; zz < num_quadrants; ++zz) {
+    ++visits[first_local + (p4est_locidx_t) zz];
+    init_fn (p4est, which_tree, quadrants + zz);
+  }
+}
+
+/* compare every quadrant with its construction from the Morton index */
+static void
+check_uniform (p4est_t * p4est, int level, int with_data)
+{
+  const p4est_gloidx_t per_tree =
+    (p4est_gloidx_t) 1 << (P4EST_DIM * level);
+  p4est_topidx_t      jt;
+  p4est_locidx_t      lq;
+  p4est_gloidx_t      gq;
+  p4est_quadrant_t    expected;
+  p4est_quadrant_t   *q;
+  p4est_tree_t       *tree;
+  size_t              zz;
+
+  SC_CHECK_ABORT (p4est->global_num_quadrants ==
+                  p4est->connectivity->num_trees * per_tree,
+                  "Uniform global count");
+  P4EST_QUADRANT_INIT (&expected);
+  lq = 0;
+  for (jt = p4est->first_local_tree; jt <= p4est->last_local_tree; ++jt) {
+    tree = p4est_tree_array_index (p4est->trees, jt);
+    SC_CHECK_ABORT (tree->quadrants_offset == lq, "Uniform offset");
+    SC_CHECK_ABORT (tree->maxlevel == (int8_t) level, "Uniform maxlevel");
+    for (zz = 0; zz < tree->quadrants.elem_count; ++zz, ++lq) {
+      q = p4est_quadrant_array_index (&tree->quadrants, zz);
+      gq = p4est->global_first_quadrant[p4est->mpirank] + lq;
+      SC_CHECK_ABORT (gq / per_tree == (p4est_gloidx_t) jt, "Uniform tree");
+      p4est_quadrant_set_morton (&expected, level,
+                                 (uint64_t) (gq % per_tree));
+      SC_CHECK_ABORT (p4est_quadrant_is_equal (q, &expected),
+                      "Uniform quadrant");
+      SC_CHECK_ABORT (!with_data || *(long *) q->p.user_data ==
+                      data_value (jt, &expected), "Uniform data");
+    }
+  }
+  SC_CHECK_ABORT (lq == p4est->local_num_quadrants, "Uniform local count");
+}
+
+static void
+test_uniform (sc_MPI_Comm mpicomm, p4est_connectivity_t * connectivity,
+              int level)
+{
+  p4est_locidx_t      lq;
+  p4est_t            *ref, *p4est;
+  char               *visits;
+
+  ref = p4est_new_ext (mpicomm, connectivity, 0, level, 1,
+                       sizeof (long), init_fn, NULL);
+  check_uniform (ref, level, 1);
+
+  /* serial, with a callback per quadrant */
+  p4est = p4est_new_uniform (mpicomm, connectivity, level, 0,
+                             sizeof (long), init_fn, NULL, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, ref, 1), "Uniform serial");
+  SC_CHECK_ABORT (p4est_checksum (p4est) == p4est_checksum (ref),
+                  "Uniform checksum");
+  check_uniform (p4est, level, 1);
+  p4est_destroy (p4est);
+
+  /* threaded, with a batch callback */
+  visits = P4EST_ALLOC_ZERO (char, ref->local_num_quadrants);
+  p4est = p4est_new_uniform (mpicomm, connectivity, level, 4,
+                             sizeof (long), NULL, init_batch_fn, visits);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, ref, 1), "Uniform batch");
+  check_uniform (p4est, level, 1);
+  for (lq = 0; lq < p4est->local_num_quadrants; ++lq) {
+    SC_CHECK_ABORT (visits[lq] == 1, "Batch visits");
+  }
+  P4EST_FREE (visits);
+  p4est_destroy (p4est);
+
+  /* without user data */
+  p4est = p4est_new_uniform (mpicomm, connectivity, level, 2,
+                             0, NULL, NULL, NULL);
+  SC_CHECK_ABORT (p4est_is_equal (p4est, ref, 0), "Uniform no data");
+  check_uniform (p4est, level, 0);
+  p4est_destroy (p4est);
+
+  p4est_destroy (ref);
+}
+
+int
+main (int argc, char **argv)
+{
+  int                 mpiret;
+  int                 level;
+  sc_MPI_Comm         mpicomm;
+  p4est_connectivity_t *connectivity;
+
+  mpiret = sc_MPI_Init (&argc, &argv);
+  SC_CHECK_MPI (mpiret);
+  mpicomm = sc_MPI_COMM_WORLD;
+
+  sc_init (mpicomm, 1, 1, NULL, SC_LP_DEFAULT);
+  p4est_init (NULL, SC_LP_DEFAULT);
+
+#ifndef P4_TO_P8
+  connectivity = p4est_connectivity_new_moebius ();
+#else
+  connectivity = p8est_connectivity_new_rotcubes ();
+#endif
+  for (level = 0; level <= max_level; ++level) {
+    test_uniform (mpicomm, connectivity, level);
+  }
+  p4est_connectivity_destroy (connectivity);
+
+  /* a single tree leaves processes empty at level 0 */
+#ifndef P4_TO_P8
+  connectivity = p4est_connectivity_new_unitsquare ();
+#else
+  connectivity = p8est_connectivity_new_unitcube ();
+#endif
+  for (level = 0; level <= max_level; level += 3) {
+    test_uniform (mpicomm, connectivity, level);
+  }
+  p4est_connectivity_destroy (connectivity);
+
+  sc_finalize ();
+
+  mpiret = sc_MPI_Finalize ();
+  SC_CHECK_MPI (mpiret);
+
+  return 0;
+}